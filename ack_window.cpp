@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG SOCKETS
+
+#include "sysdeps.h"
+
+#include "ack_window.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include <android-base/logging.h>
+
+#include "adb.h"
+#include "adb_trace.h"
+
+using namespace std::chrono_literals;
+
+// The minimum RTT estimate is forgotten after this long, so that we notice when a link gets slower.
+static constexpr auto kMinRttExpiry = 10s;
+
+// Never adapt more often than this, even on links with a tiny round trip time (e.g. USB).
+static constexpr auto kMinAdaptInterval = 10ms;
+
+static std::atomic<size_t> g_total_window_bytes = 0;
+static std::atomic<size_t> g_window_count = 0;
+
+// Reserves up to |bytes| from the global budget, returning how much was actually reserved.
+static size_t ReserveWindowBytes(size_t bytes) {
+    size_t total = g_total_window_bytes.load();
+    while (true) {
+        size_t available = total < DELAYED_ACK_BUDGET_BYTES ? DELAYED_ACK_BUDGET_BYTES - total : 0;
+        size_t reserved = std::min(bytes, available);
+        if (g_total_window_bytes.compare_exchange_weak(total, total + reserved)) {
+            return reserved;
+        }
+    }
+}
+
+static void ReleaseWindowBytes(size_t bytes) {
+    g_total_window_bytes -= bytes;
+}
+
+AckWindow::AckWindow() {
+    // The peer needs a non-zero window to get started at all, so the minimum is always granted,
+    // even if the budget is exhausted.
+    window_ = MIN_DELAYED_ACK_BYTES + ReserveWindowBytes(INITIAL_DELAYED_ACK_BYTES -
+                                                         MIN_DELAYED_ACK_BYTES);
+    g_total_window_bytes += MIN_DELAYED_ACK_BYTES;
+    ++g_window_count;
+
+    credit_ = window_;
+    Clock::time_point now = Clock::now();
+    drain_start_ = now;
+    last_adapt_ = now;
+}
+
+AckWindow::~AckWindow() {
+    ReleaseWindowBytes(window_);
+    --g_window_count;
+}
+
+size_t AckWindow::TotalWindowBytes() {
+    return g_total_window_bytes;
+}
+
+size_t AckWindow::WindowCount() {
+    return g_window_count;
+}
+
+AckWindow::Clock::duration AckWindow::AdaptInterval() const {
+    if (min_rtt_ && *min_rtt_ > kMinAdaptInterval) {
+        return *min_rtt_;
+    }
+    return kMinAdaptInterval;
+}
+
+void AckWindow::OnReceived(size_t bytes, Clock::time_point now) {
+    credit_ -= bytes;
+    if (credit_ <= 0) {
+        window_limited_ = true;
+    }
+
+    if (unblock_time_) {
+        auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(now - *unblock_time_);
+        if (!min_rtt_ || rtt < *min_rtt_ || now - min_rtt_time_ > kMinRttExpiry) {
+            min_rtt_ = rtt;
+            min_rtt_time_ = now;
+        }
+        unblock_time_.reset();
+    }
+}
+
+uint32_t AckWindow::OnFlushed(size_t bytes_flushed, size_t queued_bytes, Clock::time_point now) {
+    drained_bytes_ += bytes_flushed;
+    auto elapsed = now - drain_start_;
+    if (elapsed >= AdaptInterval()) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        uint64_t sample =
+                static_cast<uint64_t>(drained_bytes_) * 1'000'000 / std::max<int64_t>(us, 1);
+        drain_rate_ = drain_rate_ == 0 ? sample : (3 * drain_rate_ + sample) / 4;
+        drained_bytes_ = 0;
+        drain_start_ = now;
+    }
+
+    size_t old_window = window_;
+    Adapt(queued_bytes, now);
+
+    // Resize the window by acking more or less than what we flushed. A shrink larger than what we
+    // just flushed is carried over to the next acks.
+    int64_t ack = static_cast<int64_t>(bytes_flushed) + pending_delta_ +
+                  (static_cast<int64_t>(window_) - static_cast<int64_t>(old_window));
+    if (ack < 0) {
+        pending_delta_ = ack;
+        ack = 0;
+    } else {
+        pending_delta_ = 0;
+    }
+
+    // If the peer was stalled waiting for this ack, time how long it takes for data to show up.
+    if (credit_ <= 0 && ack > 0 && !unblock_time_) {
+        unblock_time_ = now;
+    }
+
+    credit_ += ack;
+    return static_cast<uint32_t>(ack);
+}
+
+void AckWindow::Adapt(size_t queued_bytes, Clock::time_point now) {
+    if (now - last_adapt_ < AdaptInterval()) {
+        return;
+    }
+    last_adapt_ = now;
+
+    size_t target = window_;
+    if (queued_bytes > window_ / 2) {
+        // The local end can't keep up with the link, so a bigger window only buffers more data
+        // here. Shrink towards what's needed to keep the local end busy, at most halving at once.
+        target = window_ / 2;
+        if (min_rtt_ && drain_rate_ != 0) {
+            uint64_t bdp = drain_rate_ * min_rtt_->count() / 1'000'000;
+            target = std::max<size_t>(target, std::min<uint64_t>(window_, 2 * bdp));
+        }
+        target = std::max(target, MIN_DELAYED_ACK_BYTES);
+    } else if (window_limited_) {
+        // The peer ran out of window while we were keeping up: grow.
+        target = std::min(window_ * 2, MAX_DELAYED_ACK_BYTES);
+    }
+    window_limited_ = false;
+
+    if (target > window_) {
+        window_ += ReserveWindowBytes(target - window_);
+    } else if (target < window_) {
+        ReleaseWindowBytes(window_ - target);
+        window_ = target;
+    }
+}
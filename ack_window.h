@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <optional>
+
+#include <android-base/macros.h>
+
+// The receive window that a socket grants its peer when delayed acks are in use.
+//
+// Instead of always granting INITIAL_DELAYED_ACK_BYTES and acking exactly what was flushed, the
+// window starts out small and adapts to what the socket actually needs:
+//   - while the peer keeps running out of window and we keep up with the incoming data, the window
+//     doubles (at most once per round trip), up to MAX_DELAYED_ACK_BYTES.
+//   - when data starts piling up locally (the local end drains slower than the link delivers),
+//     the window shrinks towards twice the bandwidth-delay product, estimated from the drain rate
+//     and the minimum round trip observed between an ack and the data it unblocked.
+// Growth is bounded by a budget shared by every window in the process.
+//
+// The window is purely a receiver-side policy: resizing it is done by acking more or less than
+// what was flushed, so the peer doesn't need to know about any of this.
+class AckWindow {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    AckWindow();
+    ~AckWindow();
+
+    // The total number of bytes the peer may have outstanding.
+    size_t window() const { return window_; }
+
+    std::optional<std::chrono::microseconds> min_rtt() const { return min_rtt_; }
+    uint64_t drain_rate() const { return drain_rate_; }
+
+    // Called when a payload from the peer arrives.
+    void OnReceived(size_t bytes, Clock::time_point now);
+
+    // Called after writing |bytes_flushed| bytes to the local end, with |queued_bytes| still
+    // waiting to be written. Returns the number of bytes to acknowledge.
+    uint32_t OnFlushed(size_t bytes_flushed, size_t queued_bytes, Clock::time_point now);
+
+    // Process-wide metrics.
+    static size_t TotalWindowBytes();
+    static size_t WindowCount();
+
+  private:
+    void Adapt(size_t queued_bytes, Clock::time_point now);
+    Clock::duration AdaptInterval() const;
+
+    size_t window_;
+
+    // How many more bytes the peer is allowed to send, as far as we know.
+    int64_t credit_;
+
+    // Window shrinkage that didn't fit into the last ack, to be taken out of the next ones.
+    int64_t pending_delta_ = 0;
+
+    // Set when the peer ran (nearly) out of credit since the last adaptation.
+    bool window_limited_ = false;
+
+    // When we sent an ack that unblocked a stalled peer, waiting for the data to come back.
+    std::optional<Clock::time_point> unblock_time_;
+    std::optional<std::chrono::microseconds> min_rtt_;
+    Clock::time_point min_rtt_time_;
+
+    // Bytes per second that the local end is draining, smoothed.
+    uint64_t drain_rate_ = 0;
+    size_t drained_bytes_ = 0;
+    Clock::time_point drain_start_;
+
+    Clock::time_point last_adapt_;
+
+    DISALLOW_COPY_AND_ASSIGN(AckWindow);
+};
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ack_window.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "adb.h"
+
+using namespace std::chrono_literals;
+
+TEST(AckWindow, initial) {
+    size_t total = AckWindow::TotalWindowBytes();
+    size_t count = AckWindow::WindowCount();
+    {
+        AckWindow window;
+        ASSERT_EQ(INITIAL_DELAYED_ACK_BYTES, window.window());
+        ASSERT_EQ(total + INITIAL_DELAYED_ACK_BYTES, AckWindow::TotalWindowBytes());
+        ASSERT_EQ(count + 1, AckWindow::WindowCount());
+    }
+    ASSERT_EQ(total, AckWindow::TotalWindowBytes());
+    ASSERT_EQ(count, AckWindow::WindowCount());
+}
+
+TEST(AckWindow, steady_state_acks_what_was_flushed) {
+    AckWindow window;
+    auto now = AckWindow::Clock::now();
+
+    // The peer never comes close to running out of window, and we keep up.
+    for (int i = 0; i < 100; ++i) {
+        now += 1ms;
+        window.OnReceived(4096, now);
+        ASSERT_EQ(4096U, window.OnFlushed(4096, 0, now));
+    }
+    ASSERT_EQ(INITIAL_DELAYED_ACK_BYTES, window.window());
+}
+
+TEST(AckWindow, grows_when_window_limited) {
+    AckWindow window;
+    auto now = AckWindow::Clock::now();
+
+    size_t previous = window.window();
+    for (int i = 0; i < 10; ++i) {
+        // The peer sends everything it's allowed to, and we drain it all immediately.
+        size_t bytes = window.window();
+        now += 20ms;
+        window.OnReceived(bytes, now);
+        uint32_t ack = window.OnFlushed(bytes, 0, now);
+        ASSERT_GE(ack, bytes);
+        ASSERT_EQ(ack - bytes, window.window() - previous);
+        ASSERT_LE(window.window(), MAX_DELAYED_ACK_BYTES);
+        previous = window.window();
+    }
+    ASSERT_EQ(MAX_DELAYED_ACK_BYTES, window.window());
+    ASSERT_TRUE(window.min_rtt().has_value());
+}
+
+TEST(AckWindow, shrinks_when_local_end_is_slow) {
+    AckWindow window;
+    auto now = AckWindow::Clock::now();
+
+    // The peer fills the window, but we only manage to flush a little bit at a time.
+    size_t queued = window.window();
+    window.OnReceived(queued, now);
+
+    int64_t acked = 0;
+    for (int i = 0; i < 20; ++i) {
+        now += 20ms;
+        size_t flushed = 16 * 1024;
+        queued -= flushed;
+        acked += window.OnFlushed(flushed, queued, now);
+        ASSERT_GE(window.window(), MIN_DELAYED_ACK_BYTES);
+    }
+
+    ASSERT_EQ(MIN_DELAYED_ACK_BYTES, window.window());
+    // We acked less than we flushed, to take the window back from the peer.
+    ASSERT_LT(acked, 20 * 16 * 1024);
+}
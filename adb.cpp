@@ -21,6 +21,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -35,6 +36,7 @@
 #include <condition_variable>
 #include <functional>
 #include <mutex>
+#include <random>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -59,6 +61,7 @@
 #include "adb_mdns.h"
 #include "adb_unique_fd.h"
 #include "adb_utils.h"
+#include "buffer_budget.h"
 #include "socket_spec.h"
 #include "sysdeps/chrono.h"
 #include "transport.h"
@@ -412,6 +415,7 @@ static void handle_new_connection(atransport* t, apacket* p) {
     parse_banner(banner, t);
 
 #if ADB_HOST
+    adb_auth_key_accepted(t);
     handle_online(t);
 #else
     ADB_LOG(Connection) << "received CNXN: version=" << p->msg.arg0 << ", maxdata = " << p->msg.arg1
@@ -535,13 +539,14 @@ void handle_packet(apacket *p, atransport *t)
 
         s->peer = create_remote_socket(p->msg.arg0, t);
         s->peer->peer = s;
+        t->SetSocketPriority(s->id, GetServiceWritePriority(address));
 
         if (t->SupportsDelayedAck()) {
             VLOG(PACKETS) << "delayed ack available: send buffer = " << send_bytes;
             s->available_send_bytes = send_bytes;
 
-            // TODO: Make this adjustable at connection time?
-            send_ready(s->id, s->peer->id, t, INITIAL_DELAYED_ACK_BYTES);
+            s->ack_window.emplace();
+            send_ready(s->id, s->peer->id, t, s->ack_window->window());
         } else {
             VLOG(PACKETS) << "delayed ack unavailable";
             send_ready(s->id, s->peer->id, t, 0);
@@ -1253,6 +1258,17 @@ void adb_set_reject_kill_server(bool value) {
     g_reject_kill_server = value;
 }
 
+// Identifies this server process to clients, so they can tell whether what they cached about a
+// server (e.g. transport ids and device features) still applies.
+static const std::string& server_instance_id() {
+    static const std::string* id = [] {
+        std::random_device rd;
+        uint64_t value = (static_cast<uint64_t>(rd()) << 32) | rd();
+        return new std::string(android::base::StringPrintf("%016" PRIx64, value));
+    }();
+    return *id;
+}
+
 static bool handle_mdns_request(std::string_view service, int reply_fd) {
     if (!android::base::ConsumePrefix(&service, "mdns:")) {
         return false;
@@ -1296,6 +1312,7 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
 
         std::string serial_storage;
         bool legacy = true;
+        uint64_t features_generation = 0;
 
         // New transport selection protocol:
         // This is essentially identical to the previous version, except it returns the selected
@@ -1317,10 +1334,17 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
             // you're connecting to.
         } else {
             if (android::base::ConsumePrefix(&service, "transport-id:")) {
-                if (!ParseUint(&transport_id, service)) {
+                // transport-id:<id>[:<features generation>], see host:features-generation.
+                std::string_view id = service.substr(0, service.find(':'));
+                if (!ParseUint(&transport_id, id)) {
                     SendFail(reply_fd, "invalid transport id");
                     return HostRequestResult::Handled;
                 }
+                if (id.size() < service.size() &&
+                    !ParseUint(&features_generation, service.substr(id.size() + 1))) {
+                    SendFail(reply_fd, "invalid features generation");
+                    return HostRequestResult::Handled;
+                }
             } else if (service == "transport-usb") {
                 type = kTransportUsb;
             } else if (service == "transport-local") {
@@ -1335,6 +1359,12 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
 
         std::string error;
         atransport* t = acquire_one_transport(type, serial, transport_id, nullptr, &error);
+        if (t != nullptr && features_generation != 0 &&
+            t->features_generation() != features_generation) {
+            // The client cached features from before the device reconnected.
+            SendFail(reply_fd, "device reconnected");
+            return HostRequestResult::Handled;
+        }
         if (t != nullptr) {
             s->transport = t;
             SendOkay(reply_fd);
@@ -1375,6 +1405,19 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
         status.set_burst_mode(burst_mode_enabled());
         status.set_trace_level(get_trace_setting());
         status.set_mdns_enabled(mdns::is_enabled());
+        status.set_delayed_ack_window_bytes(AckWindow::TotalWindowBytes());
+        status.set_delayed_ack_windows(AckWindow::WindowCount());
+        BufferBudget& budget = BufferBudget::Global();
+        status.set_socket_buffer_bytes(budget.used());
+        status.set_socket_buffer_limit(budget.limit());
+        status.set_socket_buffer_peak_bytes(budget.peak());
+        status.set_socket_buffer_exhausted_count(budget.exhausted_count());
+        ReconnectStats reconnects = reconnect_stats();
+        status.set_reconnects_pending(reconnects.pending);
+        status.set_reconnects_succeeded(reconnects.succeeded);
+        status.set_reconnects_abandoned(reconnects.abandoned);
+        status.set_reconnect_mean_recovery_ms(reconnects.mean_recovery_time.count());
+        status.set_reconnect_max_recovery_ms(reconnects.max_recovery_time.count());
 
         std::string server_status_string;
         status.SerializeToString(&server_status_string);
@@ -1426,6 +1469,22 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
         return HostRequestResult::Handled;
     }
 
+    // Like features, but prefixed with "<generation>:", for clients that cache the features and
+    // pin later connections to them with transport-id:<id>:<generation>.
+    if (service == "features-generation") {
+        std::string error;
+        atransport* t =
+                s->transport ? s->transport
+                             : acquire_one_transport(type, serial, transport_id, nullptr, &error);
+        if (t != nullptr) {
+            SendOkay(reply_fd, std::to_string(t->features_generation()) + ":" +
+                                       FeatureSetToString(t->features()));
+        } else {
+            SendFail(reply_fd, error);
+        }
+        return HostRequestResult::Handled;
+    }
+
     if (service == "host-features") {
         FeatureSet features = supported_features();
         // Abuse features to report libusb status.
@@ -1475,6 +1534,30 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
         return HostRequestResult::Handled;
     }
 
+    // Pipeline preamble, sent by clients that don't want to wait for a reply to each of their
+    // requests: pipeline:<client version>:<server instance id the client expects, if any>.
+    // On success, we reply with our instance id and carry on with the next request on the same
+    // connection. On failure, the connection is closed, along with any requests that follow.
+    if (android::base::ConsumePrefix(&service, "pipeline:")) {
+        std::vector<std::string> args = android::base::Split(std::string(service), ":");
+        unsigned int version;
+        if (args.size() != 2 || sscanf(args[0].c_str(), "%04x", &version) != 1) {
+            SendFail(reply_fd, "invalid pipeline request");
+            return HostRequestResult::Handled;
+        }
+        if (version != ADB_SERVER_VERSION) {
+            SendFail(reply_fd, android::base::StringPrintf("version mismatch (server is %04x)",
+                                                           ADB_SERVER_VERSION));
+            return HostRequestResult::Handled;
+        }
+        if (!args[1].empty() && args[1] != server_instance_id()) {
+            SendFail(reply_fd, "stale server instance");
+            return HostRequestResult::Handled;
+        }
+        SendOkay(reply_fd, server_instance_id());
+        return HostRequestResult::Pipelined;
+    }
+
     // Returns our value for ADB_SERVER_VERSION.
     if (service == "version") {
         SendOkay(reply_fd, android::base::StringPrintf("%04x", ADB_SERVER_VERSION));
@@ -1618,6 +1701,7 @@ HostRequestResult handle_host_request(std::string_view service, TransportType ty
 static auto& init_mutex = *new std::mutex();
 static auto& init_cv = *new std::condition_variable();
 static bool device_scan_complete = false;
+static bool tcp_restore_complete = true;
 static bool transports_ready = false;
 
 void update_transport_status() {
@@ -1632,7 +1716,7 @@ void update_transport_status() {
     {
         std::lock_guard<std::mutex> lock(init_mutex);
         transports_ready = result;
-        ready = transports_ready && device_scan_complete;
+        ready = transports_ready && device_scan_complete && tcp_restore_complete;
     }
 
     if (ready) {
@@ -1653,9 +1737,25 @@ void adb_notify_device_scan_complete() {
     update_transport_status();
 }
 
+void adb_notify_tcp_restore_started() {
+    std::lock_guard<std::mutex> lock(init_mutex);
+    tcp_restore_complete = false;
+}
+
+void adb_notify_tcp_restore_complete() {
+    {
+        std::lock_guard<std::mutex> lock(init_mutex);
+        tcp_restore_complete = true;
+    }
+
+    update_transport_status();
+}
+
 void adb_wait_for_device_initialization() {
     std::unique_lock<std::mutex> lock(init_mutex);
-    init_cv.wait_for(lock, 3s, []() { return device_scan_complete && transports_ready; });
+    init_cv.wait_for(lock, 3s, []() {
+        return device_scan_complete && tcp_restore_complete && transports_ready;
+    });
 }
 
 #endif  // ADB_HOST
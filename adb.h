@@ -34,8 +34,18 @@ constexpr size_t MAX_PAYLOAD_V1 = 4 * 1024;
 constexpr size_t MAX_PAYLOAD = 1024 * 1024;
 
 // When delayed acks are supported, the initial number of unacknowledged bytes we're willing to
-// receive on a socket before the other side should block.
-constexpr size_t INITIAL_DELAYED_ACK_BYTES = 32 * 1024 * 1024;
+// receive on a socket before the other side should block. The window then adapts between the
+// minimum and maximum below (see AckWindow).
+constexpr size_t INITIAL_DELAYED_ACK_BYTES = 2 * 1024 * 1024;
+constexpr size_t MIN_DELAYED_ACK_BYTES = MAX_PAYLOAD;
+constexpr size_t MAX_DELAYED_ACK_BYTES = 32 * 1024 * 1024;
+
+// The total window that all of the sockets in the process may grant together.
+#if ADB_HOST
+constexpr size_t DELAYED_ACK_BUDGET_BYTES = 512 * 1024 * 1024;
+#else
+constexpr size_t DELAYED_ACK_BUDGET_BYTES = 128 * 1024 * 1024;
+#endif
 
 constexpr size_t LINUX_MAX_SOCKET_SIZE = 4194304;
 
@@ -159,8 +169,8 @@ unique_fd daemon_service_to_fd(std::string_view name, atransport* transport);
 #endif
 
 #if ADB_HOST
-asocket* host_service_to_socket(std::string_view name, std::string_view serial,
-                                TransportId transport_id);
+asocket* host_service_to_socket(std::string_view name, TransportType type,
+                                std::string_view serial, TransportId transport_id);
 #endif
 
 #if !ADB_HOST
@@ -220,6 +230,8 @@ extern const char* adb_device_banner;
 enum class HostRequestResult {
     Handled,
     SwitchedTransport,
+    // The request was a pipeline preamble: keep reading requests from the same connection.
+    Pipelined,
     Unhandled,
 };
 
@@ -245,10 +257,16 @@ void parse_banner(const std::string&, atransport* t);
 // We've found all of the transports we potentially care about.
 void adb_notify_device_scan_complete();
 
+// The devices a previous server was connected to over TCP are being connected to again (see
+// restore_tcp_connections()), or that's done.
+void adb_notify_tcp_restore_started();
+void adb_notify_tcp_restore_complete();
+
 // One or more transports have changed status, check to see if we're ready.
 void update_transport_status();
 
-// Wait until device scan has completed and every transport is ready, or a timeout elapses.
+// Wait until device scan has completed, previous TCP connections have been restored, and every
+// transport is ready, or a timeout elapses.
 void adb_wait_for_device_initialization();
 
 // When ssh-forwarding to a remote adb server, kill-server is almost never what you actually want,
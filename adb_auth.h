@@ -21,8 +21,12 @@
 
 #include <deque>
 #include <memory>
+#include <string>
+#include <string_view>
 
+#include <adb/tls/session_ticket_keys.h>
 #include <openssl/rsa.h>
+#include <openssl/ssl.h>
 
 /* AUTH packets first argument */
 /* Request */
@@ -39,13 +43,27 @@ int adb_auth_keygen(const char* filename);
 int adb_auth_pubkey(const char* filename);
 std::string adb_auth_get_userkey();
 bssl::UniquePtr<EVP_PKEY> adb_auth_get_user_privkey();
-std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys();
+std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys(const std::string& serial);
 
 void send_auth_response(const char* token, size_t token_size, atransport* t);
 
+// Called when a device comes online, to remember which key it accepted.
+void adb_auth_key_accepted(atransport* t);
+
 int adb_tls_set_certificate(SSL* ssl);
 void adb_auth_tls_handshake(atransport* t);
 
+// TLS sessions to resume when reconnecting to a device, kept in memory by device. Sessions are
+// single use, so taking one removes it until the server issues a new ticket.
+bssl::UniquePtr<SSL_SESSION> adb_tls_take_session(const std::string& serial);
+void adb_tls_save_session(const std::string& serial, bssl::UniquePtr<SSL_SESSION> session);
+
+// The session kept for |serial|, as serialized by SSL_SESSION_to_bytes(), without taking it, or an
+// empty string. Used to hand sessions over to the next server.
+std::string adb_tls_export_session(const std::string& serial);
+// Keeps a session serialized by adb_tls_export_session() for |serial|.
+void adb_tls_import_session(const std::string& serial, std::string_view data);
+
 #else // !ADB_HOST
 
 extern bool auth_required;
@@ -65,6 +83,7 @@ void send_auth_request(atransport *t);
 void adbd_auth_tls_handshake(atransport* t);
 int adbd_tls_verify_cert(X509_STORE_CTX* ctx, std::string* auth_key);
 bssl::UniquePtr<STACK_OF(X509_NAME)> adbd_tls_client_ca_list();
+std::shared_ptr<adb::tls::SessionTicketKeys> adbd_tls_session_ticket_keys();
 
 #endif // ADB_HOST
 
@@ -129,6 +129,39 @@ bool WriteFdExactly(borrowed_fd fd, const void* buf, size_t len) {
     return true;
 }
 
+bool WritevFdExactly(borrowed_fd fd, adb_iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t r = adb_writev(fd, iov, iovcnt);
+        if (r == -1) {
+            D("writevx: fd=%d error %d: %s", fd.get(), errno, strerror(errno));
+            if (errno == EAGAIN) {
+                std::this_thread::yield();
+                continue;
+            } else if (errno == EPIPE) {
+                D("writevx: fd=%d disconnected", fd.get());
+                errno = 0;
+                return false;
+            } else {
+                return false;
+            }
+        }
+
+        // Skip over the iovecs that were written out completely (including empty ones), and
+        // adjust the one that was only partially written.
+        size_t written = r;
+        while (iovcnt > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (written > 0) {
+            iov->iov_base = reinterpret_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
 bool WriteFdExactly(borrowed_fd fd, const char* str) {
     return WriteFdExactly(fd, str, strlen(str));
 }
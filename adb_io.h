@@ -23,6 +23,7 @@
 #include <string_view>
 
 #include "adb_unique_fd.h"
+#include "sysdeps/uio.h"
 
 // Sends the protocol "OKAY" message.
 bool SendOkay(borrowed_fd fd);
@@ -73,6 +74,12 @@ bool WriteFdExactly(borrowed_fd fd, const void* buf, size_t len);
 bool WriteFdExactly(borrowed_fd fd, const char* s);
 bool WriteFdExactly(borrowed_fd fd, const std::string& s);
 
+// Writes out everything described by the |iovcnt| iovecs in |iov|, using as few writev calls as
+// possible. |iov| is modified to keep track of progress after short writes.
+//
+// Returns false under the same conditions as WriteFdExactly.
+bool WritevFdExactly(borrowed_fd fd, adb_iovec* iov, int iovcnt);
+
 // Same as above, but formats the string to send.
 bool WriteFdFmt(borrowed_fd fd, const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3)));
 #endif /* ADB_IO_H */
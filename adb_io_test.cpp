@@ -21,11 +21,14 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 
@@ -102,6 +105,60 @@ POSIX_TEST(io, WriteFdExactly_whole) {
   EXPECT_STREQ(expected, s.c_str());
 }
 
+POSIX_TEST(io, WritevFdExactly_whole) {
+  char foo[] = "Foo";
+  char empty[] = "";
+  char bar[] = "bar";
+  TemporaryFile tf;
+  ASSERT_NE(-1, tf.fd);
+
+  adb_iovec iov[] = {
+    {.iov_base = foo, .iov_len = 3},
+    {.iov_base = empty, .iov_len = 0},
+    {.iov_base = bar, .iov_len = 3},
+  };
+  ASSERT_TRUE(WritevFdExactly(tf.fd, iov, 3)) << strerror(errno);
+  ASSERT_EQ(0, lseek(tf.fd, 0, SEEK_SET));
+
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFdToString(tf.fd, &s));
+  EXPECT_EQ("Foobar", s);
+}
+
+POSIX_TEST(io, WritevFdExactly_short_writes) {
+  // A small socket buffer forces writev to return early, exercising the iovec bookkeeping.
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  unique_fd reader(fds[0]);
+  unique_fd writer(fds[1]);
+  int buffer_size = 4096;
+  ASSERT_EQ(0, setsockopt(writer.get(), SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)));
+
+  std::vector<std::string> chunks;
+  std::string expected;
+  for (size_t i = 0; i < 64; ++i) {
+    chunks.emplace_back(i * 97, static_cast<char>('a' + i % 26));
+    expected += chunks.back();
+  }
+
+  std::vector<adb_iovec> iovs;
+  for (auto& chunk : chunks) {
+    iovs.push_back({.iov_base = chunk.data(), .iov_len = chunk.size()});
+  }
+
+  bool result = false;
+  std::thread thread([&writer, &iovs, &result]() {
+    result = WritevFdExactly(writer.get(), iovs.data(), iovs.size());
+    writer.reset();
+  });
+
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFdToString(reader.get(), &s));
+  thread.join();
+  ASSERT_TRUE(result);
+  EXPECT_EQ(expected, s);
+}
+
 POSIX_TEST(io, WriteFdExactly_partial) {
   const char buf[] = "Foobar";
   TemporaryFile tf;
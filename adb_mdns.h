@@ -68,6 +68,11 @@ void mdns_cleanup();
 std::string mdns_check();
 std::string mdns_list_discovered_services();
 
+struct asocket;
+// Creates the socket for the host:mdns:track service, which streams the services that are
+// discovered, change, or go away.
+asocket* create_mdns_tracker();
+
 struct MdnsInfo {
     std::string service_name;
     std::string service_type;
@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <functional>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "adb.h"
 
@@ -25,6 +27,17 @@
 
 void adb_wifi_pair_device(const std::string& host, const std::string& password,
                           std::string& response);
+
+struct PairingTarget {
+    std::string host;
+    std::string password;
+};
+
+// Pairs with all of |targets|, several at a time. |on_result| is called with the index of each
+// target and its response as in adb_wifi_pair_device(), one call at a time, in no particular order.
+void adb_wifi_pair_devices(const std::vector<PairingTarget>& targets,
+                           std::function<void(size_t, const std::string&)> on_result);
+
 bool adb_wifi_is_known_host(const std::string& host);
 
 #else  // !ADB_HOST
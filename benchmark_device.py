@@ -67,6 +67,32 @@ def analyze(name, speeds):
     msg = "%s: %d runs: median %.2f MiB/s, mean %.2f MiB/s, stddev: %.2f MiB/s"
     print(msg % (name, len(speeds), median, mean, stddev))
 
+def analyze_latency(name, latencies):
+    median = statistics.median(latencies)
+    mean = statistics.mean(latencies)
+    stddev = statistics.stdev(latencies)
+    msg = "%s: %d runs: median %.2f ms, mean %.2f ms, stddev: %.2f ms"
+    print(msg % (name, len(latencies), median, mean, stddev))
+
+def benchmark_shell_latency(device=None, runs=100):
+    if device == None:
+        device = adb.get_device()
+
+    cmd = device.adb_cmd + ["shell", "true"]
+    for pipeline in ["0", "1"]:
+        env = dict(os.environ, ADB_PIPELINE=pipeline)
+        # Warm up the server connection and the features cache.
+        subprocess.check_call(cmd, env=env)
+
+        latencies = list()
+        for _ in range(0, runs):
+            begin = time.time()
+            subprocess.check_call(cmd, env=env)
+            end = time.time()
+            latencies.append((end - begin) * 1000)
+
+        analyze_latency("shell true (ADB_PIPELINE=%s) " % pipeline, latencies)
+
 def benchmark_sink(device=None, size_mb=transfer_size_mib):
     if device == None:
         device = adb.get_device()
@@ -163,6 +189,7 @@ def main():
     benchmark_push(device)
     benchmark_pull(device)
     benchmark_device_dd(device)
+    benchmark_shell_latency(device)
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG SOCKETS
+
+#include "sysdeps.h"
+
+#include "buffer_budget.h"
+
+#include <stdlib.h>
+
+#include <utility>
+
+#include <android-base/logging.h>
+#include <android-base/no_destructor.h>
+#include <android-base/parseint.h>
+
+#include "adb_trace.h"
+#include "fdevent/fdevent.h"
+
+#if ADB_HOST
+static constexpr size_t kDefaultBufferLimit = 256 * 1024 * 1024;
+#else
+static constexpr size_t kDefaultBufferLimit = 64 * 1024 * 1024;
+#endif
+
+static size_t GetBufferLimit() {
+    const char* env = getenv("ADB_SOCKET_BUFFER_LIMIT");
+    if (env == nullptr) {
+        return kDefaultBufferLimit;
+    }
+
+    size_t limit;
+    if (!android::base::ParseByteCount(env, &limit) || limit == 0) {
+        LOG(WARNING) << "ignoring invalid ADB_SOCKET_BUFFER_LIMIT: '" << env << "'";
+        return kDefaultBufferLimit;
+    }
+    return limit;
+}
+
+BufferBudget::BufferBudget(size_t limit) : limit_(limit) {}
+
+BufferBudget& BufferBudget::Global() {
+    static android::base::NoDestructor<BufferBudget> budget(GetBufferLimit());
+    return *budget;
+}
+
+void BufferBudget::Charge(size_t bytes) {
+    size_t used = used_.fetch_add(bytes) + bytes;
+    size_t peak = peak_.load(std::memory_order_relaxed);
+    while (used > peak && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+        continue;
+    }
+}
+
+void BufferBudget::Release(size_t bytes) {
+    size_t used = used_.fetch_sub(bytes) - bytes;
+    if (used < low_watermark() && throttling_.exchange(false)) {
+        VLOG(SOCKETS) << "socket buffer budget freed up (" << used << " bytes used), resuming";
+        fdevent_run_on_looper([this]() {
+            std::function<void()> callback;
+            {
+                std::lock_guard<std::mutex> lock(callback_mutex_);
+                callback = resume_callback_;
+            }
+            if (callback) {
+                callback();
+            }
+        });
+    }
+}
+
+bool BufferBudget::Exhausted() {
+    if (used_ < limit_) {
+        return false;
+    }
+
+    // Announce that we're throttling before checking again, so that a concurrent Release either
+    // sees the flag and schedules the resume callback, or we see what it released.
+    if (!throttling_.exchange(true)) {
+        ++exhausted_count_;
+        VLOG(SOCKETS) << "socket buffer budget exhausted (" << used_ << " bytes used, limit "
+                      << limit_ << ")";
+    }
+    return used_ >= limit_;
+}
+
+void BufferBudget::SetResumeCallback(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    resume_callback_ = std::move(callback);
+}
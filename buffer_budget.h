@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+#include <android-base/macros.h>
+#include <android-base/thread_annotations.h>
+
+// Process-wide accounting of the socket data we're holding on to: payloads waiting in a local
+// socket's packet_queue to be written to its fd, and payloads waiting in a connection's write
+// queue to go out over the transport.
+//
+// Once the total goes over the limit, sockets apply backpressure (they stop reading from their
+// fds, and withhold acks for data they haven't managed to flush), until it drops back under the
+// low watermark. Charge and Release can be called from any thread; the resume callback is always
+// run on the fdevent thread.
+class BufferBudget {
+  public:
+    explicit BufferBudget(size_t limit);
+
+    // The budget shared by every socket and connection in the process. The limit can be set with
+    // $ADB_SOCKET_BUFFER_LIMIT (e.g. "512M").
+    static BufferBudget& Global();
+
+    void Charge(size_t bytes);
+    void Release(size_t bytes);
+
+    // Whether sockets should apply backpressure. If this returns true, the resume callback will
+    // be run once the budget frees up again.
+    bool Exhausted();
+
+    // Sets the function to call (on the fdevent thread) once an exhausted budget frees up.
+    void SetResumeCallback(std::function<void()> callback);
+
+    size_t limit() const { return limit_; }
+    size_t low_watermark() const { return limit_ / 4 * 3; }
+    size_t used() const { return used_; }
+    size_t peak() const { return peak_; }
+    uint64_t exhausted_count() const { return exhausted_count_; }
+
+  private:
+    const size_t limit_;
+    std::atomic<size_t> used_ = 0;
+    std::atomic<size_t> peak_ = 0;
+    std::atomic<uint64_t> exhausted_count_ = 0;
+
+    // Set when someone was told to back off, cleared when the resume callback is scheduled.
+    std::atomic<bool> throttling_ = false;
+
+    std::mutex callback_mutex_;
+    std::function<void()> resume_callback_ GUARDED_BY(callback_mutex_);
+
+    DISALLOW_COPY_AND_ASSIGN(BufferBudget);
+};
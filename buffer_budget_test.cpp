@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer_budget.h"
+
+#include <gtest/gtest.h>
+
+#include "fdevent/fdevent_test.h"
+
+class BufferBudgetTest : public FdeventTest {};
+
+TEST_F(BufferBudgetTest, accounting) {
+    BufferBudget budget(1000);
+    ASSERT_EQ(0U, budget.used());
+    ASSERT_EQ(750U, budget.low_watermark());
+
+    budget.Charge(400);
+    budget.Charge(500);
+    ASSERT_EQ(900U, budget.used());
+    ASSERT_EQ(900U, budget.peak());
+    ASSERT_FALSE(budget.Exhausted());
+
+    budget.Release(800);
+    budget.Charge(100);
+    ASSERT_EQ(200U, budget.used());
+    ASSERT_EQ(900U, budget.peak());
+
+    budget.Release(200);
+    ASSERT_EQ(0U, budget.used());
+    ASSERT_EQ(0U, budget.exhausted_count());
+}
+
+TEST_F(BufferBudgetTest, resume_after_exhausted) {
+    PrepareThread();
+
+    BufferBudget budget(1000);
+    int resumed = 0;
+    budget.SetResumeCallback([&resumed]() { ++resumed; });
+
+    budget.Charge(1000);
+    ASSERT_TRUE(budget.Exhausted());
+    ASSERT_TRUE(budget.Exhausted());
+    ASSERT_EQ(1U, budget.exhausted_count());
+
+    // Dropping below the limit isn't enough, it has to go under the low watermark.
+    budget.Release(100);
+    ASSERT_FALSE(budget.Exhausted());
+    WaitForFdeventLoop();
+    ASSERT_EQ(0, resumed);
+
+    budget.Release(200);
+    WaitForFdeventLoop();
+    ASSERT_EQ(1, resumed);
+
+    // Nobody was told to back off since, so there's nothing to resume.
+    budget.Charge(100);
+    budget.Release(100);
+    WaitForFdeventLoop();
+    ASSERT_EQ(1, resumed);
+
+    budget.Charge(300);
+    ASSERT_TRUE(budget.Exhausted());
+    ASSERT_EQ(2U, budget.exhausted_count());
+    budget.Release(1000);
+    WaitForFdeventLoop();
+    ASSERT_EQ(2, resumed);
+
+    TerminateThread();
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG AUTH
+
+#include "sysdeps.h"
+
+#include "client/accepted_key_cache.h"
+
+#include <algorithm>
+#include <utility>
+
+// The file has a line per entry:
+//   <serial> TAB <fingerprint>
+AcceptedKeyCache::AcceptedKeyCache(std::string path)
+    : store_(std::move(path), "accepted key cache", 2) {}
+
+void AcceptedKeyCache::Load() {
+    entries_ = store_.Load<Entry>([](LineStore::Record& fields) -> std::optional<Entry> {
+        if (fields[0].empty() || fields[1].empty()) {
+            return std::nullopt;
+        }
+        return Entry{std::move(fields[0]), std::move(fields[1])};
+    });
+}
+
+bool AcceptedKeyCache::Save() const {
+    return store_.Save(entries_, [](const Entry& entry) {
+        return LineStore::Record{entry.serial, entry.fingerprint};
+    });
+}
+
+std::optional<std::string> AcceptedKeyCache::Find(const std::string& serial) const {
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+                           [&serial](const Entry& entry) { return entry.serial == serial; });
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    return it->fingerprint;
+}
+
+bool AcceptedKeyCache::Update(const std::string& serial, const std::string& fingerprint) {
+    if (serial.empty() || !LineStore::IsStorable(serial) || fingerprint.empty() ||
+        !LineStore::IsStorable(fingerprint)) {
+        return false;
+    }
+
+    if (Find(serial) == fingerprint) {
+        return false;
+    }
+    LineStore::Upsert(&entries_, Entry{serial, fingerprint}, kMaxEntries,
+                      [](const Entry& a, const Entry& b) { return a.serial == b.serial; });
+    return true;
+}
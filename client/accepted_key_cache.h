@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "client/line_store.h"
+
+// An on-disk record of which of our keys each device accepted last, so that the server can offer
+// that key first when the device reconnects (after a reboot, `adb root`, and so on) instead of
+// paying a signature and a round trip for every key that the device doesn't know.
+//
+// Entries map a device serial to the hex SHA-256 fingerprint of the key's DER
+// SubjectPublicKeyInfo. They're only a hint: if the device rejects the key, the server goes on
+// to try the others as usual. See LineStore for the file format.
+class AcceptedKeyCache {
+  public:
+    struct Entry {
+        std::string serial;
+        std::string fingerprint;
+    };
+
+    static constexpr size_t kMaxEntries = 256;
+
+    explicit AcceptedKeyCache(std::string path);
+
+    // Reads the cache file. A missing or unparseable file results in an empty cache.
+    void Load();
+
+    // Writes the cache file. Returns false on failure.
+    bool Save() const;
+
+    std::optional<std::string> Find(const std::string& serial) const;
+
+    // Records that |serial| accepted the key with |fingerprint|. Returns false if that was
+    // already known, so callers can skip saving.
+    bool Update(const std::string& serial, const std::string& fingerprint);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+  private:
+    LineStore store_;
+
+    // Least recently updated first.
+    std::vector<Entry> entries_;
+};
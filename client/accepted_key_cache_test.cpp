@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/accepted_key_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <android-base/file.h>
+
+TEST(AcceptedKeyCache, round_trip) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/accepted_keys";
+
+    AcceptedKeyCache cache(path);
+    cache.Load();
+    ASSERT_FALSE(cache.Find("abc").has_value());
+
+    ASSERT_TRUE(cache.Update("abc", "0011"));
+    ASSERT_TRUE(cache.Update("192.168.1.2:5555", "2233"));
+    ASSERT_TRUE(cache.Save());
+
+    AcceptedKeyCache loaded(path);
+    loaded.Load();
+    ASSERT_EQ("0011", loaded.Find("abc"));
+    ASSERT_EQ("2233", loaded.Find("192.168.1.2:5555"));
+    ASSERT_FALSE(loaded.Find("def").has_value());
+}
+
+TEST(AcceptedKeyCache, update) {
+    TemporaryDir td;
+    AcceptedKeyCache cache(std::string(td.path) + "/accepted_keys");
+
+    // Updates that don't change anything report it, so that callers can skip saving.
+    ASSERT_TRUE(cache.Update("abc", "0011"));
+    ASSERT_FALSE(cache.Update("abc", "0011"));
+    ASSERT_TRUE(cache.Update("abc", "2233"));
+    ASSERT_EQ(1U, cache.entries().size());
+    ASSERT_EQ("2233", cache.Find("abc"));
+
+    // Serials and fingerprints that can't be stored are ignored.
+    ASSERT_FALSE(cache.Update("a\tb", "0011"));
+    ASSERT_FALSE(cache.Update("def", ""));
+    ASSERT_FALSE(cache.Find("a\tb").has_value());
+    ASSERT_FALSE(cache.Find("def").has_value());
+}
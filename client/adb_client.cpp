@@ -29,6 +29,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <optional>
@@ -45,6 +47,7 @@
 
 #include "adb_io.h"
 #include "adb_utils.h"
+#include "client/features_cache.h"
 #include "socket_spec.h"
 #include "sysdeps/chrono.h"
 
@@ -78,16 +81,19 @@ void adb_set_one_device(const char* one_device) {
     __adb_client_one_device = one_device;
 }
 
-static std::optional<TransportId> switch_socket_transport(int fd, std::string* error) {
-    TransportId result;
-    bool read_transport = true;
+// Returns the request that switches a server connection to the selected transport, or an empty
+// string if no switch is needed. Sets |read_transport| if the server replies to it with the id of
+// the transport it picked, and |result| to the id otherwise.
+static std::string switch_transport_request(bool* read_transport, TransportId* result) {
+    *read_transport = true;
+    *result = 0;
 
     std::string service;
     if (__adb_transport_id) {
-        read_transport = false;
+        *read_transport = false;
         service += "host:transport-id:";
         service += std::to_string(__adb_transport_id);
-        result = __adb_transport_id;
+        *result = __adb_transport_id;
     } else if (__adb_serial) {
         service += "host:tport:serial:";
         service += __adb_serial;
@@ -105,19 +111,18 @@ static std::optional<TransportId> switch_socket_transport(int fd, std::string* e
               break;
           case kTransportHost:
             // no switch necessary
-            return 0;
+            *read_transport = false;
+            return "";
         }
         service += "host:tport:";
         service += transport_type;
     }
+    return service;
+}
 
-    if (!SendProtocolString(fd, service)) {
-        *error = perror_str("write failure during connection");
-        return std::nullopt;
-    }
-
-    LOG(DEBUG) << "Switch transport in progress: " << service;
-
+static std::optional<TransportId> read_switch_transport_reply(int fd, bool read_transport,
+                                                              TransportId result,
+                                                              std::string* error) {
     if (!adb_status(fd, error)) {
         D("Switch transport failed: %s", error->c_str());
         return std::nullopt;
@@ -134,6 +139,23 @@ static std::optional<TransportId> switch_socket_transport(int fd, std::string* e
     return result;
 }
 
+static std::optional<TransportId> switch_socket_transport(int fd, std::string* error) {
+    bool read_transport;
+    TransportId result;
+    std::string service = switch_transport_request(&read_transport, &result);
+    if (service.empty()) {
+        return result;
+    }
+
+    if (!SendProtocolString(fd, service)) {
+        *error = perror_str("write failure during connection");
+        return std::nullopt;
+    }
+
+    LOG(DEBUG) << "Switch transport in progress: " << service;
+    return read_switch_transport_reply(fd, read_transport, result, error);
+}
+
 bool adb_status(borrowed_fd fd, std::string* error) {
     char buf[5];
     if (!ReadFdExactly(fd, buf, 4)) {
@@ -195,6 +217,190 @@ static int _adb_connect(std::string_view service, TransportId* transport, std::s
     return fd.release();
 }
 
+// Whether to pipeline requests to the server (see host:pipeline) and cache device features.
+// Cleared once we find out that the server doesn't support it.
+static bool pipelining_enabled_by_env() {
+    const char* env = getenv("ADB_PIPELINE");
+    return env == nullptr || strcmp(env, "0") != 0;
+}
+static std::atomic<bool> g_pipelining(pipelining_enabled_by_env());
+
+// A transport, as of one particular connection of its device (see host:features-generation).
+struct PinnedTransport {
+    TransportId id;
+    uint64_t generation;
+};
+
+// What we learned from pipelined requests.
+struct PipelineState {
+    std::mutex mutex;
+
+    // The instance id of the server we're talking to.
+    std::string server_instance GUARDED_BY(mutex);
+
+    // Once we've decided on a device's features, further connections are pinned to the transport
+    // they belong to, so that we can't end up talking to a different device (or a different
+    // incarnation of the same device) with the wrong features.
+    std::optional<PinnedTransport> pinned_transport GUARDED_BY(mutex);
+    FeatureSet pinned_features GUARDED_BY(mutex);
+};
+
+static PipelineState& pipeline_state() {
+    static android::base::NoDestructor<PipelineState> state;
+    return *state;
+}
+
+// Returns the key for the selected transport in the features cache. We only cache features for
+// specific devices: "any device" can mean a different one next time.
+static std::optional<std::string> transport_selector() {
+    if (__adb_transport_id) {
+        return "id:" + std::to_string(__adb_transport_id);
+    } else if (__adb_serial) {
+        return std::string("serial:") + __adb_serial;
+    }
+    return std::nullopt;
+}
+
+static std::optional<std::string> features_cache_path() {
+    int port;
+    std::string error;
+    if (!is_local_socket_spec(__adb_server_socket_spec) ||
+        !parse_tcp_socket_spec(__adb_server_socket_spec, nullptr, &port, nullptr, &error)) {
+        return std::nullopt;
+    }
+    return adb_get_android_dir_path() + OS_PATH_SEPARATOR + "adb." + std::to_string(port) +
+           ".features";
+}
+
+static std::string ProtocolString(std::string_view s) {
+    return android::base::StringPrintf("%04zx", s.size()).append(s);
+}
+
+// Connects to |service| with a single round trip to the server: a pipeline preamble (which stands
+// in for host:version), the transport switch, and the service request are sent in one write. If
+// |pinned_transport| is set, the connection is switched to that transport (as long as the device
+// hasn't reconnected since), and the preamble checks that the server is the |instance_id| it came
+// from.
+//
+// Returns the fd, or -1 with |error| set if the transport selection or the service failed.
+// Returns std::nullopt if the caller should fall back to unpipelined requests, in which case the
+// service wasn't started.
+static std::optional<int> _adb_connect_pipelined(std::string_view service, TransportId* transport,
+                                                 std::string* error, bool force_switch,
+                                                 std::optional<PinnedTransport> pinned_transport,
+                                                 const std::string& instance_id) {
+    if (service.empty() || service.size() > MAX_PAYLOAD - 4) {
+        return std::nullopt;
+    }
+
+    std::string reason;
+    unique_fd fd;
+    if (!socket_spec_connect(&fd, __adb_server_socket_spec, nullptr, nullptr, &reason)) {
+        // Leave starting the server to the unpipelined path.
+        return std::nullopt;
+    }
+
+    std::string requests = ProtocolString(android::base::StringPrintf(
+            "host:pipeline:%04x:%s", ADB_SERVER_VERSION, instance_id.c_str()));
+
+    bool switch_transport = !service.starts_with("host") || force_switch;
+    std::string switch_request;
+    bool read_transport = false;
+    TransportId transport_id = 0;
+    if (switch_transport) {
+        if (pinned_transport) {
+            switch_request = android::base::StringPrintf("host:transport-id:%" PRIu64 ":%" PRIu64,
+                                                         pinned_transport->id,
+                                                         pinned_transport->generation);
+            transport_id = pinned_transport->id;
+        } else {
+            switch_request = switch_transport_request(&read_transport, &transport_id);
+        }
+        if (!switch_request.empty()) {
+            requests += ProtocolString(switch_request);
+        }
+    }
+    requests += ProtocolString(service);
+
+    LOG(DEBUG) << "_adb_connect_pipelined: " << switch_request << " " << service;
+    if (!WriteFdExactly(fd.get(), requests)) {
+        return std::nullopt;
+    }
+
+    std::string server_instance;
+    if (!adb_status(fd.get(), error) || !ReadProtocolString(fd.get(), &server_instance, error)) {
+        D("pipeline preamble failed: %s", error->c_str());
+        // Servers that predate pipelining don't know about it, and the unpipelined path knows
+        // how to deal with servers of a different version, so stick to it from now on.
+        if (error->starts_with("unknown host service") || error->starts_with("version mismatch")) {
+            g_pipelining = false;
+        }
+        return std::nullopt;
+    }
+    {
+        PipelineState& state = pipeline_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.server_instance = server_instance;
+    }
+
+    if (switch_transport) {
+        if (!switch_request.empty()) {
+            std::optional<TransportId> result =
+                    read_switch_transport_reply(fd.get(), read_transport, transport_id, error);
+            if (!result) {
+                // If the transport we pinned went away, the caller has to start over.
+                return pinned_transport ? std::nullopt : std::optional<int>(-1);
+            }
+            transport_id = *result;
+        }
+        if (transport) {
+            *transport = transport_id;
+        }
+    }
+
+    if (!adb_status(fd.get(), error)) {
+        return -1;
+    }
+
+    D("_adb_connect_pipelined: return fd %d", fd.get());
+    return fd.release();
+}
+
+// Called when the transport we pinned is gone (or the server was restarted). Checks that the
+// device we'll now be talking to has the features we've been assuming.
+static bool revalidate_pinned_features(std::string* error) {
+    FeatureSet pinned_features;
+    {
+        PipelineState& state = pipeline_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.pinned_transport.reset();
+        pinned_features = state.pinned_features;
+    }
+
+    std::optional<std::string> selector = transport_selector();
+    std::optional<std::string> path = features_cache_path();
+    if (selector && path) {
+        FeaturesCache cache(*path);
+        cache.Load();
+        cache.Remove(*selector);
+        cache.Save();
+    }
+
+    std::string result;
+    if (!adb_query(format_host_command("features"), &result, error)) {
+        return false;
+    }
+
+    FeatureSet features = StringToFeatureSet(result);
+    std::sort(features.begin(), features.end());
+    std::sort(pinned_features.begin(), pinned_features.end());
+    if (features != pinned_features) {
+        *error = "device features changed while connecting (did it reconnect?), try again";
+        return false;
+    }
+    return true;
+}
+
 bool adb_kill_server() {
     D("adb_kill_server");
     std::string reason;
@@ -357,6 +563,29 @@ int adb_connect(TransportId* transport, std::string_view service, std::string* e
                 bool force_switch_device) {
     LOG(DEBUG) << "adb_connect: service: " << service;
 
+    if (g_pipelining && service != "host:start-server") {
+        std::optional<PinnedTransport> pinned_transport;
+        std::string instance_id;
+        {
+            PipelineState& state = pipeline_state();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            pinned_transport = state.pinned_transport;
+            if (pinned_transport) {
+                instance_id = state.server_instance;
+            }
+        }
+
+        std::optional<int> fd = _adb_connect_pipelined(service, transport, error,
+                                                       force_switch_device, pinned_transport,
+                                                       instance_id);
+        if (fd) {
+            return *fd;
+        }
+        if (pinned_transport && !revalidate_pinned_features(error)) {
+            return -1;
+        }
+    }
+
     // Query the adb server's version.
     if (!adb_check_server_version(error)) {
         return -1;
@@ -429,10 +658,90 @@ std::string format_host_command(const char* command) {
     return android::base::StringPrintf("%s:%s", prefix, command);
 }
 
+static void pin_transport(const std::string& instance_id, PinnedTransport transport,
+                          const FeatureSet& features) {
+    PipelineState& state = pipeline_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.server_instance = instance_id;
+    state.pinned_transport = transport;
+    state.pinned_features = features;
+}
+
+// Gets the selected device's features from the cache if we can, or from the server (and then
+// caches them) otherwise.
+static std::optional<FeatureSet> get_feature_set_pipelined(std::string* error) {
+    std::optional<std::string> selector = transport_selector();
+    std::optional<std::string> path = features_cache_path();
+    std::optional<FeaturesCache> cache;
+    if (selector && path) {
+        cache.emplace(*path);
+        cache->Load();
+        if (std::optional<FeaturesCache::Entry> entry = cache->Find(*selector)) {
+            D("using cached features for %s (transport %" PRIu64 ", generation %" PRIu64 ")",
+              selector->c_str(), entry->transport_id, entry->generation);
+            pin_transport(cache->instance_id(), {entry->transport_id, entry->generation},
+                          entry->features);
+            return entry->features;
+        }
+    }
+
+    TransportId transport_id = 0;
+    unique_fd fd(adb_connect(&transport_id, "host:features-generation", error, true));
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    std::string result;
+    if (!ReadProtocolString(fd.get(), &result, error)) {
+        return std::nullopt;
+    }
+    ReadOrderlyShutdown(fd.get());
+
+    // <generation>:<features>
+    uint64_t generation;
+    std::string_view features_string = result;
+    if (!ParseUint(&generation, features_string, &features_string) ||
+        !android::base::ConsumePrefix(&features_string, ":")) {
+        *error = "invalid features-generation reply: " + result;
+        return std::nullopt;
+    }
+    FeatureSet features = StringToFeatureSet(std::string(features_string));
+
+    std::string instance_id;
+    {
+        PipelineState& state = pipeline_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        instance_id = state.server_instance;
+    }
+    // If the request didn't end up being pipelined, we don't know which server this came from.
+    if (!g_pipelining || instance_id.empty() || transport_id == 0) {
+        return features;
+    }
+
+    pin_transport(instance_id, {transport_id, generation}, features);
+    if (cache) {
+        cache->Update(instance_id, {*selector, transport_id, generation, features});
+        cache->Save();
+    }
+    return features;
+}
+
 const std::optional<FeatureSet>& adb_get_feature_set(std::string* error) {
     static std::mutex feature_mutex [[clang::no_destroy]];
     static std::optional<FeatureSet> features [[clang::no_destroy]];
     std::lock_guard<std::mutex> lock(feature_mutex);
+    if (!features && g_pipelining) {
+        std::string err;
+        features = get_feature_set_pipelined(&err);
+        // If it turned out that the server doesn't pipeline, it doesn't know about
+        // host:features-generation either, so ask it again the old way.
+        if (features || g_pipelining) {
+            if (!features && error) {
+                *error = err;
+            }
+            return features;
+        }
+    }
     if (!features) {
         std::string result;
         std::string err;
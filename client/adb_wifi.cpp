@@ -16,22 +16,25 @@
 
 #include "adb_wifi.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <thread>
 #include <type_traits>
+#include <vector>
 
 #include <adb/crypto/key.h>
 #include <adb/crypto/x509_generator.h>
-#include <android-base/file.h>
 #include <android-base/parsenetaddress.h>
 #include "client/pairing/pairing_client.h"
 
 #include "adb_auth.h"
-#include "adb_known_hosts.pb.h"
 #include "adb_mdns.h"
 #include "adb_utils.h"
 #include "client/adb_client.h"
+#include "client/known_hosts.h"
 #include "sysdeps.h"
 
 using adbwifi::pairing::PairingClient;
@@ -63,119 +66,47 @@ static std::vector<uint8_t> stringToUint8(const std::string& str) {
     return std::vector<uint8_t>(p8, p8 + str.length());
 }
 
-// Tries to replace the |old_file| with |new_file|.
-// On success, then |old_file| has been removed and replaced with the
-// contents of |new_file|, |new_file| will be removed, and only |old_file| will
-// remain.
-// On failure, both files will be unchanged.
-// |new_file| must exist, but |old_file| does not need to exist.
-bool SafeReplaceFile(std::string_view old_file, std::string_view new_file) {
-    std::string to_be_deleted(old_file);
-    to_be_deleted += ".tbd";
-
-    bool old_renamed = true;
-    if (adb_rename(old_file.data(), to_be_deleted.c_str()) != 0) {
-        // Don't exit here. This is not necessarily an error, because |old_file|
-        // may not exist.
-        PLOG(INFO) << "Failed to rename " << old_file;
-        old_renamed = false;
-    }
-
-    if (adb_rename(new_file.data(), old_file.data()) != 0) {
-        PLOG(ERROR) << "Unable to rename file (" << new_file << " => " << old_file << ")";
-        if (old_renamed) {
-            // Rename the .tbd file back to it's original name
-            adb_rename(to_be_deleted.c_str(), old_file.data());
-        }
-        return false;
-    }
-
-    adb_unlink(to_be_deleted.c_str());
-    return true;
-}
-
-static std::string get_user_known_hosts_path() {
-    return adb_get_android_dir_path() + OS_PATH_SEPARATOR + "adb_known_hosts.pb";
-}
-
-bool load_known_hosts_from_file(const std::string& path, adb::proto::AdbKnownHosts& known_hosts) {
-    // Check for file existence.
-    struct stat buf;
-    if (stat(path.c_str(), &buf) == -1) {
-        LOG(INFO) << "Known hosts file [" << path << "] does not exist...";
-        return false;
-    }
-
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        PLOG(ERROR) << "Unable to open [" << path << "].";
-        return false;
-    }
-
-    if (!known_hosts.ParseFromIstream(&file)) {
-        PLOG(ERROR) << "Failed to parse [" << path << "]. Deleting it as it may be corrupted.";
-        adb_unlink(path.c_str());
-        return false;
-    }
-
-    return true;
+bool adb_wifi_is_known_host(const std::string& host) {
+    return KnownHosts::Global().Contains(host);
 }
 
-static bool write_known_host_to_file(std::string& known_host) {
-    std::string path = get_user_known_hosts_path();
-    if (path.empty()) {
-        PLOG(ERROR) << "Error getting user known hosts filename";
-        return false;
-    }
+struct PairingCredentials {
+    std::vector<uint8_t> certificate;
+    std::vector<uint8_t> priv_key;
+    // Our public key, sent to the device on pairing success.
+    PeerInfo system_info;
+};
 
-    adb::proto::AdbKnownHosts known_hosts;
-    load_known_hosts_from_file(path, known_hosts);
-    auto* host_info = known_hosts.add_host_infos();
-    host_info->set_guid(known_host);
+// Generating a certificate is expensive, and the user key doesn't change while the server runs, so
+// all pairings share one.
+static const PairingCredentials* get_pairing_credentials() {
+    static auto& mutex = *new std::mutex();
+    static std::unique_ptr<PairingCredentials> credentials;
 
-    std::unique_ptr<TemporaryFile> temp_file(new TemporaryFile(adb_get_android_dir_path()));
-    if (temp_file->fd == -1) {
-        PLOG(ERROR) << "Failed to open [" << temp_file->path << "] for writing";
-        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (credentials) {
+        return credentials.get();
     }
 
-    if (!known_hosts.SerializeToFileDescriptor(temp_file->fd)) {
-        LOG(ERROR) << "Unable to write out adb_knowns_hosts";
-        return false;
-    }
-    temp_file->DoNotRemove();
-    std::string temp_file_name(temp_file->path);
-    temp_file.reset();
-
-    // Replace the existing adb_known_hosts with the new one
-    if (!SafeReplaceFile(path, temp_file_name.c_str())) {
-        LOG(ERROR) << "Failed to replace old adb_known_hosts";
-        adb_unlink(temp_file_name.c_str());
-        return false;
+    auto priv_key = adb_auth_get_user_privkey();
+    auto x509_cert = GenerateX509Certificate(priv_key.get());
+    if (!x509_cert) {
+        LOG(ERROR) << "Unable to create X509 certificate for pairing";
+        return nullptr;
     }
-    chmod(path.c_str(), S_IRUSR | S_IWUSR | S_IRGRP);
-
-    return true;
-}
 
-bool adb_wifi_is_known_host(const std::string& host) {
-    std::string path = get_user_known_hosts_path();
-    if (path.empty()) {
-        PLOG(ERROR) << "Error getting user known hosts filename";
-        return false;
-    }
+    auto result = std::make_unique<PairingCredentials>();
+    result->certificate = stringToUint8(X509ToPEMString(x509_cert.get()));
+    result->priv_key = stringToUint8(Key::ToPEMString(priv_key.get()));
 
-    adb::proto::AdbKnownHosts known_hosts;
-    if (!load_known_hosts_from_file(path, known_hosts)) {
-        return false;
-    }
+    result->system_info = {};
+    result->system_info.type = ADB_RSA_PUB_KEY;
+    std::string public_key = adb_auth_get_userkey();
+    CHECK_LE(public_key.size(), sizeof(result->system_info.data) - 1);  // -1 for null byte
+    memcpy(result->system_info.data, public_key.data(), public_key.size());
 
-    for (const auto& host_info : known_hosts.host_infos()) {
-        if (host == host_info.guid()) {
-            return true;
-        }
-    }
-    return false;
+    credentials = std::move(result);
+    return credentials.get();
 }
 
 void adb_wifi_pair_device(const std::string& host, const std::string& password,
@@ -197,28 +128,15 @@ void adb_wifi_pair_device(const std::string& host, const std::string& password,
         }
     }
 
-    auto priv_key = adb_auth_get_user_privkey();
-    auto x509_cert = GenerateX509Certificate(priv_key.get());
-    if (!x509_cert) {
-        LOG(ERROR) << "Unable to create X509 certificate for pairing";
+    const PairingCredentials* credentials = get_pairing_credentials();
+    if (credentials == nullptr) {
+        response = "Failed: unable to create X509 certificate for pairing.";
         return;
     }
-    auto cert_str = X509ToPEMString(x509_cert.get());
-    auto priv_str = Key::ToPEMString(priv_key.get());
-
-    // Send our public key on pairing success
-    PeerInfo system_info = {};
-    system_info.type = ADB_RSA_PUB_KEY;
-    std::string public_key = adb_auth_get_userkey();
-    CHECK_LE(public_key.size(), sizeof(system_info.data) - 1);  // -1 for null byte
-
-    memcpy(system_info.data, public_key.data(), public_key.size());
 
     auto pswd8 = stringToUint8(password);
-    auto cert8 = stringToUint8(cert_str);
-    auto priv8 = stringToUint8(priv_str);
-
-    auto client = PairingClient::Create(pswd8, system_info, cert8, priv8);
+    auto client = PairingClient::Create(pswd8, credentials->system_info, credentials->certificate,
+                                        credentials->priv_key);
     if (client == nullptr) {
         response = "Failed: unable to create pairing client.";
         return;
@@ -250,7 +168,33 @@ void adb_wifi_pair_device(const std::string& host, const std::string& password,
     response = "Successfully paired to " + host + " [guid=" + device_guid + "]";
 
     // Write to adb_known_hosts
-    write_known_host_to_file(device_guid);
+    KnownHosts::Global().Add(device_guid);
     // Try to auto-connect.
     adb_secure_connect_by_service_name(device_guid);
 }
+
+void adb_wifi_pair_devices(const std::vector<PairingTarget>& targets,
+                           std::function<void(size_t, const std::string&)> on_result) {
+    // Pairing mostly waits on the network and on the devices, so pair with several at a time.
+    static constexpr size_t kMaxConcurrentPairings = 16;
+
+    std::mutex result_mutex;
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(kMaxConcurrentPairings, targets.size()); ++i) {
+        workers.emplace_back([&]() {
+            for (size_t j = next++; j < targets.size(); j = next++) {
+                std::string response;
+                adb_wifi_pair_device(targets[j].host, targets[j].password, response);
+                if (response.empty()) {
+                    response = "Failed: unable to pair.";
+                }
+                std::lock_guard<std::mutex> lock(result_mutex);
+                on_result(j, response);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG AUTH
+
+#include "sysdeps.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <adb/crypto/key.h>
+#include <adb/crypto/rsa_2048_key.h>
+#include <adb/crypto/x509_generator.h>
+#include <adb/pairing/pairing_server.h>
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "adb_known_hosts.pb.h"
+#include "client/known_hosts.h"
+#include "client/pairing/pairing_client.h"
+
+using adbwifi::pairing::PairingClient;
+
+enum class Store {
+    // What the host used to do: read the whole file for every lookup and every addition, and
+    // write it back for every addition.
+    File,
+    Indexed,
+};
+
+static std::string Guid(size_t i) {
+    return android::base::StringPrintf("adb-%08zx-AbCdEf", i);
+}
+
+static void FillKnownHosts(const std::string& path, size_t count) {
+    KnownHosts known_hosts(path);
+    for (size_t i = 0; i < count; ++i) {
+        known_hosts.Add(Guid(i));
+    }
+}
+
+static adb::proto::AdbKnownHosts ReadKnownHosts(const std::string& path) {
+    adb::proto::AdbKnownHosts known_hosts;
+    std::string content;
+    android::base::ReadFileToString(path, &content);
+    known_hosts.ParseFromString(content);
+    return known_hosts;
+}
+
+template <Store store>
+static void BM_KnownHostsContains(benchmark::State& state) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+    size_t count = state.range(0);
+    FillKnownHosts(path, count);
+    KnownHosts known_hosts(path);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        std::string guid = Guid((i++ * 7919) % count);
+        bool found = false;
+        if (store == Store::File) {
+            adb::proto::AdbKnownHosts hosts = ReadKnownHosts(path);
+            for (const auto& host_info : hosts.host_infos()) {
+                if (host_info.guid() == guid) {
+                    found = true;
+                }
+            }
+        } else {
+            found = known_hosts.Contains(guid);
+        }
+        CHECK(found);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_KnownHostsContains, Store::File)->Arg(10)->Arg(100)->Arg(1000);
+BENCHMARK_TEMPLATE(BM_KnownHostsContains, Store::Indexed)->Arg(10)->Arg(100)->Arg(1000);
+
+// Adds hosts from several threads at once, as when pairing with a rack of devices.
+template <Store store>
+static void BM_KnownHostsAdd(benchmark::State& state) {
+    static constexpr size_t kThreads = 16;
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+    size_t existing = state.range(0);
+    FillKnownHosts(path, existing);
+    KnownHosts known_hosts(path);
+    std::mutex file_mutex;
+
+    std::atomic<size_t> next = existing;
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < kThreads; ++i) {
+            threads.emplace_back([&]() {
+                std::string guid = Guid(next++);
+                if (store == Store::File) {
+                    // The old code had no lock, and could lose additions.
+                    std::lock_guard<std::mutex> lock(file_mutex);
+                    adb::proto::AdbKnownHosts hosts = ReadKnownHosts(path);
+                    hosts.add_host_infos()->set_guid(guid);
+                    CHECK(android::base::WriteStringToFile(hosts.SerializeAsString(),
+                                                           path + ".tmp"));
+                    CHECK_EQ(0, adb_rename((path + ".tmp").c_str(), path.c_str()));
+                } else {
+                    CHECK(known_hosts.Add(guid));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kThreads);
+}
+BENCHMARK_TEMPLATE(BM_KnownHostsAdd, Store::File)->Arg(10)->Arg(1000)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_KnownHostsAdd, Store::Indexed)->Arg(10)->Arg(1000)->UseRealTime();
+
+struct ServerDeleter {
+    void operator()(PairingServerCtx* p) { pairing_server_destroy(p); }
+};
+using ServerPtr = std::unique_ptr<PairingServerCtx, ServerDeleter>;
+
+struct PairingCounter {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t done = 0;
+    size_t failed = 0;
+
+    static void OnResult(const PeerInfo* peer_info, void* opaque) {
+        auto* counter = reinterpret_cast<PairingCounter*>(opaque);
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        ++counter->done;
+        if (!peer_info) ++counter->failed;
+        counter->cv.notify_all();
+    }
+};
+
+// Pairs with range(0) devices over loopback, range(1) at a time, like `adb pair --batch`. Each
+// device has its own pairing server, as on a rack of phones.
+static void BM_PairDevices(benchmark::State& state) {
+    size_t devices = state.range(0);
+    size_t concurrency = state.range(1);
+    static const std::vector<uint8_t> kPassword = {'1', '2', '3', '4', '5', '6'};
+
+    auto key = adb::crypto::CreateRSA2048Key();
+    CHECK(key);
+    auto x509 = adb::crypto::GenerateX509Certificate(key->GetEvpPkey());
+    CHECK(x509);
+    std::string cert = adb::crypto::X509ToPEMString(x509.get());
+    std::string priv = adb::crypto::Key::ToPEMString(key->GetEvpPkey());
+    PairingClient::Data cert8(cert.begin(), cert.end());
+    PairingClient::Data priv8(priv.begin(), priv.end());
+    PeerInfo client_info = {};
+    client_info.type = ADB_RSA_PUB_KEY;
+    strcpy(reinterpret_cast<char*>(client_info.data), "host key");
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        PairingCounter server_counter;
+        std::vector<ServerPtr> servers;
+        std::vector<uint16_t> ports;
+        for (size_t i = 0; i < devices; ++i) {
+            PeerInfo device_info = {};
+            device_info.type = ADB_DEVICE_GUID;
+            strcpy(reinterpret_cast<char*>(device_info.data), Guid(i).c_str());
+            servers.emplace_back(pairing_server_new_no_cert(kPassword.data(), kPassword.size(),
+                                                            &device_info, 0));
+            ports.push_back(pairing_server_start(servers.back().get(), PairingCounter::OnResult,
+                                                 &server_counter));
+            CHECK_NE(0, ports.back());
+        }
+        state.ResumeTiming();
+
+        std::atomic<size_t> next = 0;
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < concurrency; ++i) {
+            workers.emplace_back([&]() {
+                for (size_t j = next++; j < devices; j = next++) {
+                    PairingCounter counter;
+                    auto client = PairingClient::Create(kPassword, client_info, cert8, priv8);
+                    std::unique_lock<std::mutex> lock(counter.mutex);
+                    CHECK(client->Start(android::base::StringPrintf("127.0.0.1:%d", ports[j]),
+                                        PairingCounter::OnResult, &counter));
+                    counter.cv.wait(lock, [&]() { return counter.done == 1; });
+                    CHECK_EQ(0U, counter.failed);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        state.PauseTiming();
+        {
+            std::unique_lock<std::mutex> lock(server_counter.mutex);
+            server_counter.cv.wait(lock, [&]() { return server_counter.done == devices; });
+        }
+        servers.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * devices);
+}
+BENCHMARK(BM_PairDevices)
+        ->Args({16, 1})
+        ->Args({16, 16})
+        ->Args({64, 1})
+        ->Args({64, 16})
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
@@ -22,10 +22,12 @@
 #include <sys/inotify.h>
 #endif
 
+#include <list>
 #include <map>
 #include <mutex>
 #include <set>
 #include <string>
+#include <utility>
 
 #include <adb/crypto/rsa_2048_key.h>
 #include <adb/crypto/x509_generator.h>
@@ -47,6 +49,7 @@
 #include "adb_auth.h"
 #include "adb_io.h"
 #include "adb_utils.h"
+#include "client/accepted_key_cache.h"
 #include "sysdeps.h"
 #include "transport.h"
 
@@ -55,6 +58,17 @@ static std::map<std::string, std::shared_ptr<RSA>>& g_keys =
     *new std::map<std::string, std::shared_ptr<RSA>>;
 static std::map<int, std::string>& g_monitored_paths = *new std::map<int, std::string>;
 
+// Set up by adb_auth_init, guarded by g_keys_mutex.
+static AcceptedKeyCache* g_accepted_keys = nullptr;
+static std::string g_user_key_fingerprint;
+
+// TLS sessions to resume, most recently saved last. Sessions are single use, so they're removed
+// when taken.
+static constexpr size_t kMaxTlsSessions = 64;
+static std::mutex& g_tls_sessions_mutex = *new std::mutex;
+static auto& g_tls_sessions =
+        *new std::list<std::pair<std::string, bssl::UniquePtr<SSL_SESSION>>>();
+
 using namespace adb::crypto;
 using namespace adb::tls;
 
@@ -135,7 +149,7 @@ static std::shared_ptr<RSA> read_key_file(const std::string& file) {
     return std::shared_ptr<RSA>(key, RSA_free);
 }
 
-static bool load_key(const std::string& file) {
+static bool load_key(const std::string& file, std::string* out_fingerprint = nullptr) {
     std::shared_ptr<RSA> key = read_key_file(file);
     if (!key) {
         return false;
@@ -143,6 +157,9 @@ static bool load_key(const std::string& file) {
 
     std::lock_guard<std::mutex> lock(g_keys_mutex);
     std::string fingerprint = hash_key(key.get());
+    if (out_fingerprint) {
+        *out_fingerprint = fingerprint;
+    }
     bool already_loaded = g_keys.contains(fingerprint);
     if (!already_loaded) {
         g_keys[fingerprint] = std::move(key);
@@ -222,7 +239,17 @@ static bool load_userkey() {
         }
     }
 
-    return load_key(path);
+    std::string fingerprint;
+    if (!load_key(path, &fingerprint)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_keys_mutex);
+    g_user_key_fingerprint = std::move(fingerprint);
+    return true;
+}
+
+static std::string get_accepted_keys_path() {
+    return adb_get_android_dir_path() + OS_PATH_SEPARATOR + "adb_accepted_keys";
 }
 
 static std::set<std::string> get_vendor_keys() {
@@ -238,13 +265,25 @@ static std::set<std::string> get_vendor_keys() {
     return result;
 }
 
-std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys() {
+std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys(const std::string& serial) {
     std::deque<std::shared_ptr<RSA>> result;
 
-    // Copy all the currently known keys.
     std::lock_guard<std::mutex> lock(g_keys_mutex);
-    for (const auto& it : g_keys) {
-        result.push_back(it.second);
+    std::optional<std::string> accepted;
+    if (g_accepted_keys) {
+        if (auto fingerprint = g_accepted_keys->Find(serial)) {
+            accepted = SHA256HexStringToBits(*fingerprint);
+        }
+    }
+
+    // Copy all the currently known keys, starting with the one the device accepted last time.
+    for (const auto& [fingerprint, key] : g_keys) {
+        if (fingerprint == accepted) {
+            VLOG(AUTH) << "trying the key " << serial << " accepted last first";
+            result.push_front(key);
+        } else {
+            result.push_back(key);
+        }
     }
 
     // Add a sentinel to the list. Our caller uses this to mean "out of private keys,
@@ -413,6 +452,12 @@ static void adb_auth_inotify_init(const std::set<std::string>& paths) {
 void adb_auth_init() {
     VLOG(AUTH) << "adb_auth_init...";
 
+    {
+        std::lock_guard<std::mutex> lock(g_keys_mutex);
+        g_accepted_keys = new AcceptedKeyCache(get_accepted_keys_path());
+        g_accepted_keys->Load();
+    }
+
     if (!load_userkey()) {
         LOG(ERROR) << "Failed to load (or generate) user key";
         return;
@@ -480,6 +525,26 @@ void send_auth_response(const char* token, size_t token_size, atransport* t) {
     send_packet(p, t);
 }
 
+void adb_auth_key_accepted(atransport* t) {
+    // With TLS, the device tells us which keys it knows up front.
+    if (t->use_tls || t->serial.empty() || !t->KeysFetched()) {
+        return;
+    }
+
+    // If we ran out of private keys, we sent the user's public key, and the user accepted it.
+    std::shared_ptr<RSA> key = t->Key();
+    std::lock_guard<std::mutex> lock(g_keys_mutex);
+    std::string fingerprint = key ? hash_key(key.get()) : g_user_key_fingerprint;
+    if (!g_accepted_keys || fingerprint.empty()) {
+        return;
+    }
+
+    if (g_accepted_keys->Update(t->serial, SHA256BitsToHexString(fingerprint))) {
+        VLOG(AUTH) << t->serial << " accepted key " << SHA256BitsToHexString(fingerprint);
+        g_accepted_keys->Save();
+    }
+}
+
 void adb_auth_tls_handshake(atransport* t) {
     std::thread([t]() {
         std::shared_ptr<RSA> key = t->Key();
@@ -554,3 +619,65 @@ int adb_tls_set_certificate(SSL* ssl) {
     // not require auth, even though it has a list of keys.
     return 1;
 }
+
+// A device found over mDNS can come back on a different address and port, but it keeps its
+// instance name ("adb-<guid>-<random>"), so key sessions on that instead of the full serial.
+static std::string tls_session_key(const std::string& serial) {
+    if (android::base::StartsWith(serial, "adb-")) {
+        return serial.substr(0, serial.find('.'));
+    }
+    return serial;
+}
+
+bssl::UniquePtr<SSL_SESSION> adb_tls_take_session(const std::string& serial) {
+    std::string key = tls_session_key(serial);
+    std::lock_guard<std::mutex> lock(g_tls_sessions_mutex);
+    for (auto it = g_tls_sessions.begin(); it != g_tls_sessions.end(); ++it) {
+        if (it->first == key) {
+            bssl::UniquePtr<SSL_SESSION> session = std::move(it->second);
+            g_tls_sessions.erase(it);
+            return session;
+        }
+    }
+    return nullptr;
+}
+
+void adb_tls_save_session(const std::string& serial, bssl::UniquePtr<SSL_SESSION> session) {
+    std::string key = tls_session_key(serial);
+    VLOG(AUTH) << "saving TLS session for " << key;
+    std::lock_guard<std::mutex> lock(g_tls_sessions_mutex);
+    std::erase_if(g_tls_sessions, [&key](const auto& entry) { return entry.first == key; });
+    if (g_tls_sessions.size() >= kMaxTlsSessions) {
+        g_tls_sessions.pop_front();
+    }
+    g_tls_sessions.emplace_back(std::move(key), std::move(session));
+}
+
+std::string adb_tls_export_session(const std::string& serial) {
+    std::string key = tls_session_key(serial);
+    std::lock_guard<std::mutex> lock(g_tls_sessions_mutex);
+    for (const auto& [session_key, session] : g_tls_sessions) {
+        if (session_key != key) continue;
+
+        uint8_t* data;
+        size_t size;
+        if (!SSL_SESSION_to_bytes(session.get(), &data, &size)) {
+            return "";
+        }
+        std::string result(reinterpret_cast<char*>(data), size);
+        OPENSSL_free(data);
+        return result;
+    }
+    return "";
+}
+
+void adb_tls_import_session(const std::string& serial, std::string_view data) {
+    bssl::UniquePtr<SSL_CTX> ctx(SSL_CTX_new(TLS_method()));
+    bssl::UniquePtr<SSL_SESSION> session(SSL_SESSION_from_bytes(
+            reinterpret_cast<const uint8_t*>(data.data()), data.size(), ctx.get()));
+    if (!session) {
+        VLOG(AUTH) << "ignoring unparseable TLS session for " << serial;
+        return;
+    }
+    adb_tls_save_session(serial, std::move(session));
+}
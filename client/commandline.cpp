@@ -32,6 +32,9 @@
 #include <sys/types.h>
 #include <iostream>
 
+#include <atomic>
+#include <fstream>
+#include <map>
 #include <memory>
 #include <string>
 #include <thread>
@@ -63,11 +66,15 @@
 #include "adb_utils.h"
 #include "app_processes.pb.h"
 #include "bugreport.h"
+#include "client/device_broadcast.h"
 #include "client/file_sync_client.h"
 #include "commandline.h"
+#include "exec_batch_protocol.h"
 #include "fastdeploy.h"
+#include "framebuffer_stream.h"
 #include "incremental_server.h"
 #include "services.h"
+#include "shell_compression.h"
 #include "shell_protocol.h"
 #include "socket_spec.h"
 #include "sysdeps/chrono.h"
@@ -102,6 +109,11 @@ static void help() {
         " will only connect to one USB device, specified by a serial number or USB device"
         " address.\n"
         " --exit-on-write-error    exit if stdout is closed\n"
+        " --devices all|SELECTOR,...\n"
+        "                          run the command on every matching device in parallel, with\n"
+        "                          each output line prefixed by the serial; a selector is a\n"
+        "                          serial, model:MODEL, product:PRODUCT or device:DEVICE\n"
+        " --jobs N                 run on at most N devices at a time with --devices [default=8]\n"
         "\n"
         "general commands:\n"
         " devices [-l]             list connected devices (-l for long output)\n"
@@ -114,6 +126,9 @@ static void help() {
         "     disconnect from given TCP/IP device [default port=5555], or all\n"
         " pair HOST[:PORT] [PAIRING CODE]\n"
         "     pair with a device for secure TCP/IP communication\n"
+        " pair --batch [FILE]\n"
+        "     pair with every device listed in FILE (or stdin), one\n"
+        "     'HOST[:PORT] PAIRING_CODE' per line, several at a time\n"
         " forward --list           list all forward socket connections\n"
         " forward [--no-rebind] LOCAL REMOTE\n"
         "     forward socket connection using:\n"
@@ -139,6 +154,7 @@ static void help() {
         " reverse --remove-all     remove all reverse socket connections from device\n"
         " mdns check               check if mdns discovery is available\n"
         " mdns services            list all discovered services\n"
+        " mdns track               print discovered services as they come and go\n"
         "\n"
         "file transfer:\n"
         " push [--sync] [-z ALGORITHM] [-Z] LOCAL... REMOTE\n"
@@ -170,6 +186,10 @@ static void help() {
         "     -T: disable pty allocation\n"
         "     -t: allocate a pty if on a tty (-tt: force pty allocation)\n"
         "     -x: disable remote exit codes and stdout/stderr separation\n"
+        " exec-batch [-j JOBS] [FILE]\n"
+        "     run each line of FILE (default stdin) as a shell command, over one connection;\n"
+        "     output is printed in order, exit status is that of the first failing command\n"
+        "     -j: maximum number of commands to run at once on the device (default 4)\n"
         " emu COMMAND              run emulator console command\n"
         "\n"
         "app installation (see also `adb shell cmd package help`):\n"
@@ -207,8 +227,17 @@ static void help() {
         "     write bugreport to given PATH [default=bugreport.zip];\n"
         "     if PATH is a directory, the bug report is saved in that directory.\n"
         "     devices that don't support zipped bug reports output to stdout.\n"
+        " framebuffer-stream [-c lz4|zstd|none] [-n FRAMES] [-i INTERVAL_MS] [DIR]\n"
+        "     stream screen captures, sending only what changed between frames; each frame\n"
+        "     is written in the framebuffer: format to DIR/frame-NNNNN.raw (default stdout)\n"
+        "     -c: compression (default lz4)\n"
+        "     -n: stop after FRAMES frames (default: until interrupted)\n"
+        "     -i: capture at most once every INTERVAL_MS milliseconds (default 0)\n"
         " jdwp                     list pids of processes hosting a JDWP transport\n"
         " logcat                   show device log (logcat --help for more)\n"
+        " logcat --shared [-T COUNT] [--pid=PID] [FILTERSPEC...]\n"
+        "     show device log through a logcat shared with other adb clients,\n"
+        "     filtered on the host; -T starts with the COUNT most recent lines\n"
         "\n"
         "security:\n"
         " disable-verity           disable dm-verity checking on userdebug builds\n"
@@ -258,6 +287,11 @@ static void help() {
         " $ANDROID_LOG_TAGS        tags to be used by logcat (see logcat --help)\n"
         " $ADB_LOCAL_TRANSPORT_MAX_PORT max emulator scan port (default 5585, 16 emus)\n"
         " $ADB_MDNS_AUTO_CONNECT   comma-separated list of mdns services to allow auto-connect (default adb-tls-connect)\n"
+        " $ADB_PIPELINE            if 0, don't pipeline requests to the server or cache device\n"
+        "                          features\n"
+        " $ADB_SHELL_COMPRESSION   compress shell output (any/none/lz4/zstd, default none)\n"
+        " $ADB_SOCKET_BUFFER_LIMIT max socket data the server buffers before applying\n"
+        "                          backpressure (default 256M)\n"
         "\n"
         "Online documentation: https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/docs/user/adb.1.md\n"
         "\n"
@@ -302,6 +336,7 @@ int read_and_dump_protocol(borrowed_fd fd, StandardStreamsCallbackInterface* cal
       LOG(ERROR) << "failed to allocate memory for ShellProtocol object";
       return 1;
     }
+    ShellOutputDecompressor stdout_decompressor, stderr_decompressor;
     while (protocol->Read()) {
       if (protocol->id() == ShellProtocol::kIdStdout) {
         if (!callback->OnStdout(protocol->data(), protocol->data_length())) {
@@ -313,6 +348,25 @@ int read_and_dump_protocol(borrowed_fd fd, StandardStreamsCallbackInterface* cal
           exit_code = SIGPIPE + 128;
           break;
         }
+      } else if (protocol->id() == ShellProtocol::kIdStdoutCompressed ||
+                 protocol->id() == ShellProtocol::kIdStderrCompressed) {
+        bool is_stdout = protocol->id() == ShellProtocol::kIdStdoutCompressed;
+        bool callback_failed = false;
+        auto output = [&](const char* data, size_t length) {
+          callback_failed = is_stdout ? !callback->OnStdout(data, length)
+                                      : !callback->OnStderr(data, length);
+          return !callback_failed;
+        };
+        ShellOutputDecompressor& decompressor = is_stdout ? stdout_decompressor
+                                                          : stderr_decompressor;
+        if (!decompressor.Decode(protocol->data(), protocol->data_length(), output)) {
+          if (callback_failed) {
+            exit_code = SIGPIPE + 128;
+          } else {
+            LOG(ERROR) << "failed to decompress shell output";
+          }
+          break;
+        }
       } else if (protocol->id() == ShellProtocol::kIdExit) {
         // data() returns a char* which doesn't have defined signedness.
         // Cast to uint8_t to prevent 255 from being sign extended to INT_MIN,
@@ -515,6 +569,7 @@ static void stdin_read_thread_loop(void* x) {
     char* buffer_ptr = raw_buffer;
     size_t buffer_size = sizeof(raw_buffer);
     if (args->protocol != nullptr) {
+        args->protocol->Reserve(MAX_PAYLOAD);
         buffer_ptr = args->protocol->data();
         buffer_size = args->protocol->data_capacity();
     }
@@ -591,6 +646,34 @@ static void stdin_read_thread_loop(void* x) {
     }
 }
 
+static CompressionType parse_compression_type(const std::string& str, bool allow_numbers);
+
+// Returns the shell service argument asking for the output compression picked by
+// $ADB_SHELL_COMPRESSION, or nullptr if the output shouldn't (or can't) be compressed.
+static const char* ShellCompressionArg() {
+    const char* adb_shell_compression = getenv("ADB_SHELL_COMPRESSION");
+    if (!adb_shell_compression) {
+        return nullptr;
+    }
+
+    CompressionType compression = parse_compression_type(adb_shell_compression, true);
+    if (compression == CompressionType::None) {
+        return nullptr;
+    }
+
+    // Brotli is too slow to keep up with interactive output, so it isn't offered.
+    auto&& features = adb_get_feature_set_or_die();
+    if ((compression == CompressionType::Any || compression == CompressionType::Zstd) &&
+        CanUseFeature(*features, kFeatureShell2Zstd)) {
+        return kShellServiceArgZstd;
+    }
+    if ((compression == CompressionType::Any || compression == CompressionType::LZ4) &&
+        CanUseFeature(*features, kFeatureShell2LZ4)) {
+        return kShellServiceArgLZ4;
+    }
+    return nullptr;
+}
+
 // Returns a shell service string with the indicated arguments and command.
 static std::string ShellServiceString(bool use_shell_protocol,
                                       const std::string& type_arg,
@@ -603,6 +686,10 @@ static std::string ShellServiceString(bool use_shell_protocol,
         if (terminal_type != nullptr) {
             args.push_back(std::string("TERM=") + terminal_type);
         }
+
+        if (const char* compression_arg = ShellCompressionArg()) {
+            args.push_back(compression_arg);
+        }
     }
     if (!type_arg.empty()) {
         args.push_back(type_arg);
@@ -827,6 +914,162 @@ static int adb_shell_noinput(int argc, const char** argv) {
     return adb_shell(argc, argv);
 }
 
+// Output of a command run by exec-batch, held back until the commands before it have finished.
+struct ExecBatchResult {
+    std::string out;
+    std::string err;
+    std::optional<int> exit_code;
+};
+
+// State shared with the thread sending exec-batch commands. It's reference counted because if
+// the device goes away, the thread may be stuck reading stdin and is left behind.
+struct ExecBatchInput {
+    unique_fd fd;
+    std::ifstream file;
+    std::istream* stream = &std::cin;
+    std::atomic<uint32_t> sent = 0;
+    std::atomic<bool> failed = false;
+    // Set once the sender is done reading input.
+    std::atomic<bool> done = false;
+};
+
+static void exec_batch_send_commands(std::shared_ptr<ExecBatchInput> input) {
+    auto protocol = std::make_unique<ShellProtocol>(input->fd);
+    std::string line;
+    for (size_t line_number = 1; std::getline(*input->stream, line); ++line_number) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        if (line.size() > kExecBatchMaxData) {
+            fprintf(stderr, "adb: exec-batch: command on line %zu is too long\n", line_number);
+            input->failed = true;
+            break;
+        }
+        if (!ExecBatchWrite(protocol.get(), ShellProtocol::kIdStdin, input->sent, line.data(),
+                            line.size())) {
+            input->failed = true;
+            break;
+        }
+        ++input->sent;
+    }
+
+    // Past this point, the thread can't block on anything but the connection.
+    input->done = true;
+    protocol->Write(ShellProtocol::kIdCloseStdin, 0);
+}
+
+// Runs the commands in a file (or stdin), one per line, over a single connection. Each command's
+// output is printed once all the commands before it have finished, so it comes out as if they had
+// run one after the other. Returns the first non-zero exit code.
+static int adb_exec_batch(int argc, const char** argv) {
+    auto&& features = adb_get_feature_set_or_die();
+    if (!CanUseFeature(*features, kFeatureExecBatch)) {
+        error_exit("exec-batch is not supported by the device");
+    }
+
+    auto input = std::make_shared<ExecBatchInput>();
+    std::string service = "exec-batch:";
+    const char* input_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-j")) {
+            unsigned jobs;
+            if (i + 1 == argc || !android::base::ParseUint(argv[i + 1], &jobs) || jobs == 0) {
+                error_exit("exec-batch: -j requires a positive number");
+            }
+            service += std::to_string(jobs);
+            ++i;
+        } else if (!input_path) {
+            input_path = argv[i];
+        } else {
+            error_exit("usage: adb exec-batch [-j JOBS] [FILE]");
+        }
+    }
+    if (input_path && strcmp(input_path, "-") != 0) {
+        input->file.open(input_path);
+        if (!input->file) {
+            error_exit("exec-batch: failed to open '%s': %s", input_path, strerror(errno));
+        }
+        input->stream = &input->file;
+    }
+
+    std::string error;
+    input->fd.reset(adb_connect(service, &error));
+    if (input->fd < 0) {
+        fprintf(stderr, "error: %s\n", error.c_str());
+        return 1;
+    }
+
+    // Commands are sent from another thread, so that their output can be read while more are
+    // still coming in on stdin.
+    std::thread sender(exec_batch_send_commands, input);
+
+    std::map<uint32_t, ExecBatchResult> results;
+    uint32_t next = 0;
+    int exit_code = 0;
+    auto protocol = std::make_unique<ShellProtocol>(input->fd);
+    while (protocol->Read()) {
+        uint32_t id;
+        std::string_view data;
+        if (!ExecBatchParse(*protocol, &id, &data) || id < next) {
+            continue;
+        }
+
+        // The oldest unfinished command's output doesn't need to be held back.
+        ExecBatchResult& result = results[id];
+        if (protocol->id() == ShellProtocol::kIdStdout) {
+            if (id == next) {
+                fwrite(data.data(), 1, data.size(), stdout);
+            } else {
+                result.out.append(data);
+            }
+        } else if (protocol->id() == ShellProtocol::kIdStderr) {
+            if (id == next) {
+                fwrite(data.data(), 1, data.size(), stderr);
+            } else {
+                result.err.append(data);
+            }
+        } else if (protocol->id() == ShellProtocol::kIdExit && data.size() == 1) {
+            result.exit_code = static_cast<uint8_t>(data[0]);
+        }
+
+        for (auto it = results.find(next); it != results.end() && it->second.exit_code;
+             it = results.find(next)) {
+            if (exit_code == 0) exit_code = *it->second.exit_code;
+            results.erase(it);
+
+            // What was held back for the new oldest command can go out now.
+            it = results.find(++next);
+            if (it != results.end()) {
+                fwrite(it->second.out.data(), 1, it->second.out.size(), stdout);
+                fwrite(it->second.err.data(), 1, it->second.err.size(), stderr);
+                it->second.out.clear();
+                it->second.err.clear();
+            }
+        }
+        fflush(stdout);
+    }
+
+    // The device only closes the stream early if the connection was lost, in which case the
+    // sender might still be waiting for input.
+    adb_shutdown(input->fd);
+    bool lost = !input->done || next < input->sent;
+    if (input->done) {
+        sender.join();
+    } else {
+        sender.detach();
+    }
+
+    if (lost) {
+        fprintf(stderr, "adb: exec-batch: connection lost\n");
+        // OpenSSH returns 255 on unexpected disconnection.
+        return 255;
+    }
+    if (input->failed && exit_code == 0) {
+        return 1;
+    }
+    return exit_code;
+}
+
 static int adb_sideload_legacy(const char* filename, int in_fd, int size) {
     std::string error;
     unique_fd out_fd(adb_connect(android::base::StringPrintf("sideload:%d", size), &error));
@@ -1148,7 +1391,136 @@ int send_shell_command(const std::string& command, bool disable_shell_protocol,
     return read_and_dump(fd.get(), use_shell_protocol, callback);
 }
 
+// Receives a framebuffer-stream: and writes out each frame as the framebuffer: service would have
+// sent it, either to separate files in a directory or one after the other to stdout.
+static int adb_framebuffer_stream(int argc, const char** argv) {
+    auto&& features = adb_get_feature_set_or_die();
+    if (!CanUseFeature(*features, kFeatureFramebufferStream)) {
+        error_exit("framebuffer-stream is not supported by the device");
+    }
+
+    FramebufferStreamOptions options;
+    const char* output_dir = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            std::string_view name = argv[++i];
+            if (name == "lz4") {
+                options.compression = CompressionType::LZ4;
+            } else if (name == "zstd") {
+                options.compression = CompressionType::Zstd;
+            } else if (name == "none") {
+                options.compression = CompressionType::None;
+            } else {
+                error_exit("framebuffer-stream: unknown compression '%s'", argv[i]);
+            }
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            if (!android::base::ParseUint(argv[++i], &options.frames) || options.frames == 0) {
+                error_exit("framebuffer-stream: -n requires a positive number");
+            }
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            unsigned interval;
+            if (!android::base::ParseUint(argv[++i], &interval)) {
+                error_exit("framebuffer-stream: -i requires a number of milliseconds");
+            }
+            options.interval = std::chrono::milliseconds(interval);
+        } else if (!output_dir && argv[i][0] != '-') {
+            output_dir = argv[i];
+        } else {
+            error_exit("usage: adb framebuffer-stream [-c lz4|zstd|none] [-n FRAMES] "
+                       "[-i INTERVAL_MS] [DIR]");
+        }
+    }
+
+    std::string error;
+    unique_fd fd(adb_connect("framebuffer-stream:" + options.ToString(), &error));
+    if (fd < 0) {
+        fprintf(stderr, "error: %s\n", error.c_str());
+        return 1;
+    }
+
+    FramebufferDecoder decoder;
+    if (!decoder.ReadHeader(fd, &error)) {
+        fprintf(stderr, "adb: framebuffer-stream: %s\n", error.c_str());
+        return 1;
+    }
+
+    size_t frames = 0;
+    uint64_t wire_bytes = sizeof(FramebufferStreamHeader);
+    uint64_t image_bytes = 0;
+    while (decoder.ReadFrame(fd, &error)) {
+        const FramebufferFrame& frame = decoder.frame();
+        wire_bytes += sizeof(FramebufferFrameHeader) + decoder.last_header().payload_size;
+        image_bytes += frame.pixels.size();
+
+        fbinfo info;
+        if (!FillFbinfo(frame.format, frame.width, frame.height, frame.color_space, &info)) {
+            fprintf(stderr, "adb: framebuffer-stream: unsupported pixel format %u\n",
+                    frame.format);
+            return 1;
+        }
+
+        unique_fd output_fd;
+        borrowed_fd out = STDOUT_FILENO;
+        if (output_dir) {
+            std::string path =
+                    android::base::StringPrintf("%s/frame-%05zu.raw", output_dir, frames);
+            output_fd.reset(adb_creat(path.c_str(), 0644));
+            if (output_fd < 0) {
+                fprintf(stderr, "adb: framebuffer-stream: failed to create '%s': %s\n",
+                        path.c_str(), strerror(errno));
+                return 1;
+            }
+            out = output_fd;
+        }
+        if (!WriteFdExactly(out, &info, sizeof(info)) ||
+            !WriteFdExactly(out, frame.pixels.data(), frame.pixels.size())) {
+            fprintf(stderr, "adb: framebuffer-stream: write failed: %s\n", strerror(errno));
+            return 1;
+        }
+        ++frames;
+    }
+    if (!error.empty()) {
+        fprintf(stderr, "adb: framebuffer-stream: %s\n", error.c_str());
+        return 1;
+    }
+
+    fprintf(stderr, "%zu frames, %" PRIu64 " bytes received for %" PRIu64 " bytes of images\n",
+            frames, wire_bytes, image_bytes);
+    return 0;
+}
+
+// Reads the device log through the server's shared logcat stream, see client/logcat_fanout.h.
+static int logcat_shared(int argc, const char** argv) {
+    // Like the device's logcat, start with $ANDROID_LOG_TAGS, and let the command line override it.
+    std::vector<std::string> args;
+    if (const char* log_tags = getenv("ANDROID_LOG_TAGS")) {
+        for (const std::string& tag : android::base::Split(log_tags, " ")) {
+            if (!tag.empty()) args.push_back(tag);
+        }
+    }
+    for (int i = 0; i < argc; ++i) {
+        if (!*argv[i] || strchr(argv[i], ' ')) {
+            error_exit("invalid logcat --shared argument '%s'", argv[i]);
+        }
+        args.push_back(argv[i]);
+    }
+
+    std::string error;
+    std::string service = "logcat-shared:" + android::base::Join(args, ' ');
+    unique_fd fd(adb_connect(format_host_command(service.c_str()), &error));
+    if (fd < 0 || !adb_status(fd.get(), &error)) {
+        fprintf(stderr, "error: %s\n", error.c_str());
+        return 1;
+    }
+
+    return read_and_dump(fd.get());
+}
+
 static int logcat(int argc, const char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "--shared")) {
+        return logcat_shared(argc - 2, argv + 2);
+    }
+
     char* log_tags = getenv("ANDROID_LOG_TAGS");
     std::string quoted = escape_arg(log_tags == nullptr ? "" : log_tags);
 
@@ -1434,6 +1806,51 @@ class TrackAppStreamsCallback : public DefaultStandardStreamsCallback {
     DISALLOW_COPY_AND_ASSIGN(TrackAppStreamsCallback);
 };
 
+// Prints out human readable form of the protobuf messages for "track-app-delta" service. Unlike
+// "track-app", a message can be spread across several reads.
+class TrackAppDeltaStreamsCallback : public DefaultStandardStreamsCallback {
+  public:
+    TrackAppDeltaStreamsCallback() : DefaultStandardStreamsCallback(nullptr, nullptr) {}
+
+    bool OnStdout(const char* buffer, size_t length) override {
+        buffer_.append(buffer, length);
+
+        // Each message is its length in 8 hex digits followed by a binary protobuf.
+        static constexpr size_t kHeaderLength = 8;
+        size_t offset = 0;
+        while (buffer_.size() - offset >= kHeaderLength) {
+            std::string header = buffer_.substr(offset, kHeaderLength);
+            char* end;
+            size_t message_length = strtoul(header.c_str(), &end, 16);
+            if (*end != '\0') {
+                fprintf(stderr, "adb: invalid track-app-delta message length '%s'\n",
+                        header.c_str());
+                return false;
+            }
+            if (buffer_.size() - offset - kHeaderLength < message_length) {
+                break;
+            }
+
+            adb::proto::AppProcessesDelta delta;
+            delta.ParseFromString(buffer_.substr(offset + kHeaderLength, message_length));
+            offset += kHeaderLength + message_length;
+
+            std::string string_proto;
+            google::protobuf::TextFormat::PrintToString(delta, &string_proto);
+            string_proto += "\n";
+            if (!OnStream(nullptr, stdout, string_proto.data(), string_proto.length(), false)) {
+                return false;
+            }
+        }
+        buffer_.erase(0, offset);
+        return true;
+    }
+
+  private:
+    std::string buffer_;
+    DISALLOW_COPY_AND_ASSIGN(TrackAppDeltaStreamsCallback);
+};
+
 static int adb_connect_command_bidirectional(const std::string& command) {
     std::string error;
     unique_fd fd(adb_connect(command, &error));
@@ -1507,6 +1924,72 @@ static int adb_query_command(const std::string& command) {
     return 0;
 }
 
+// Sends the devices to pair with to the server all at once, so that it can pair with several at a
+// time, and prints each result as it comes in.
+static int adb_pair_batch(const char* input_path) {
+    std::ifstream file;
+    std::istream* stream = &std::cin;
+    if (input_path && strcmp(input_path, "-") != 0) {
+        file.open(input_path);
+        if (!file) {
+            error_exit("pair: failed to open '%s': %s", input_path, strerror(errno));
+        }
+        stream = &file;
+    }
+
+    std::vector<std::string> targets;
+    std::string line;
+    for (size_t line_number = 1; std::getline(*stream, line); ++line_number) {
+        std::vector<std::string> fields = android::base::Tokenize(line, " \t\r");
+        if (fields.empty() || fields[0].starts_with("#")) continue;
+        if (fields.size() != 2) {
+            error_exit("pair: expected 'HOST[:PORT] PAIRING_CODE' on line %zu", line_number);
+        }
+        // The same format as host:pair.
+        targets.push_back(fields[1] + ":" + fields[0]);
+    }
+    if (targets.empty()) {
+        error_exit("pair: no devices to pair with");
+    }
+
+    std::string error;
+    unique_fd fd(adb_connect("host:pair-batch", &error));
+    if (fd < 0) {
+        error_exit("%s", error.c_str());
+    }
+    for (const std::string& target : targets) {
+        if (!SendProtocolString(fd, target)) {
+            error_exit("pair: failed to send devices to the server");
+        }
+    }
+    if (!SendProtocolString(fd, "")) {
+        error_exit("pair: failed to send devices to the server");
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        std::string result;
+        if (!ReadProtocolString(fd, &result, &error)) {
+            error_exit("pair: %s", error.c_str());
+        }
+        // <host> TAB <response>
+        std::string_view host(result);
+        std::string_view response;
+        if (size_t tab = host.find('\t'); tab != std::string_view::npos) {
+            response = host.substr(tab + 1);
+            host = host.substr(0, tab);
+        }
+        if (response.starts_with("Successful")) {
+            printf("%.*s\n", static_cast<int>(response.size()), response.data());
+        } else {
+            fprintf(stderr, "error: %.*s: %.*s\n", static_cast<int>(host.size()), host.data(),
+                    static_cast<int>(response.size()), response.data());
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
 // Disallow stdin, stdout, and stderr.
 static bool _is_valid_ack_reply_fd(const int ack_reply_fd) {
 #ifdef _WIN32
@@ -1552,6 +2035,63 @@ bool forward_dest_is_featured(const std::string& dest, std::string* error) {
     return true;
 }
 
+static int adb_run_command(int argc, const char** argv, const char* serial);
+
+// Runs a command on every device matching |selector_spec|, see client/device_broadcast.h.
+static int adb_broadcast(const char* selector_spec, size_t jobs, int argc, const char** argv) {
+#if defined(_WIN32)
+    error_exit("--devices isn't supported on Windows");
+#else
+    // Commands that are about the server rather than a device.
+    static constexpr const char* kServerCommands[] = {
+            "connect",   "devices",     "disconnect",    "help",    "keygen", "kill-server",
+            "mdns",      "pair",        "server-status", "start-server", "version",
+    };
+    for (const char* command : kServerCommands) {
+        if (!strcmp(argv[0], command)) {
+            error_exit("%s can't be used with --devices", argv[0]);
+        }
+    }
+
+    DeviceSelector selector;
+    std::string error;
+    if (!selector.Parse(selector_spec, &error)) {
+        error_exit("invalid --devices: %s", error.c_str());
+    }
+
+    std::string device_list;
+    if (!adb_query("host:devices-l", &device_list, &error)) {
+        error_exit("failed to list devices: %s", error.c_str());
+    }
+
+    std::vector<BroadcastTarget> targets;
+    for (BroadcastTarget& target : ParseDeviceList(device_list)) {
+        if (selector.Matches(target)) {
+            targets.push_back(std::move(target));
+        }
+    }
+
+    bool missing = false;
+    for (const std::string& serial : selector.serials()) {
+        auto it = std::find_if(targets.begin(), targets.end(),
+                               [&serial](const auto& target) { return target.serial == serial; });
+        if (it == targets.end()) {
+            fprintf(stderr, "adb: device '%s' not found or not online\n", serial.c_str());
+            missing = true;
+        }
+    }
+    if (targets.empty()) {
+        error_exit("no devices match '%s'", selector_spec);
+    }
+
+    int result = RunOnDevices(targets, jobs, [argc, argv](const BroadcastTarget& target) {
+        adb_set_transport(kTransportAny, nullptr, target.transport_id);
+        return adb_run_command(argc, argv, nullptr);
+    });
+    return result != 0 ? result : missing;
+#endif
+}
+
 int adb_commandline(int argc, const char** argv) {
     bool no_daemon = false;
     bool is_daemon = false;
@@ -1569,6 +2109,8 @@ int adb_commandline(int argc, const char** argv) {
     const char* server_port_str = nullptr;
     const char* server_socket_str = nullptr;
     const char* one_device_str = nullptr;
+    const char* broadcast_devices = nullptr;
+    size_t broadcast_jobs = 8;
 
     // We need to check for -d and -e before we look at $ANDROID_SERIAL.
     const char* serial = nullptr;
@@ -1649,6 +2191,18 @@ int adb_commandline(int argc, const char** argv) {
             server_socket_str = argv[1];
             --argc;
             ++argv;
+        } else if (!strcmp(argv[0], "--devices")) {
+            if (argc < 2) error_exit("--devices requires an argument");
+            broadcast_devices = argv[1];
+            --argc;
+            ++argv;
+        } else if (!strcmp(argv[0], "--jobs")) {
+            if (argc < 2 || !android::base::ParseUint(argv[1], &broadcast_jobs) ||
+                broadcast_jobs == 0) {
+                error_exit("--jobs requires a positive number");
+            }
+            --argc;
+            ++argv;
         } else if (strcmp(argv[0], "--exit-on-write-error") == 0) {
             DEFAULT_STANDARD_STREAMS_CALLBACK.ReturnErrors(true);
         } else {
@@ -1707,8 +2261,12 @@ int adb_commandline(int argc, const char** argv) {
     adb_set_one_device(one_device_str);
     adb_set_socket_spec(server_socket_str);
 
+    if (broadcast_devices && (transport_type != kTransportAny || serial || transport_id)) {
+        error_exit("--devices can't be combined with -s, -t, -d or -e");
+    }
+
     // If none of -d, -e, or -s were specified, try $ANDROID_SERIAL.
-    if (transport_type == kTransportAny && serial == nullptr) {
+    if (transport_type == kTransportAny && serial == nullptr && !broadcast_devices) {
         serial = getenv("ANDROID_SERIAL");
     }
 
@@ -1754,6 +2312,13 @@ int adb_commandline(int argc, const char** argv) {
         ++argv;
     }
 
+    if (broadcast_devices) {
+        return adb_broadcast(broadcast_devices, broadcast_jobs, argc, argv);
+    }
+    return adb_run_command(argc, argv, serial);
+}
+
+static int adb_run_command(int argc, const char** argv, const char* serial) {
     /* adb_connect() commands */
     if (!strcmp(argv[0], "devices")) {
         const char *listopt;
@@ -1795,6 +2360,10 @@ int adb_commandline(int argc, const char** argv) {
     } else if (!strcmp(argv[0], "abb")) {
         return adb_abb(argc, argv);
     } else if (!strcmp(argv[0], "pair")) {
+        if (argc >= 2 && !strcmp(argv[1], "--batch")) {
+            if (argc > 3) error_exit("usage: adb pair --batch [FILE]");
+            return adb_pair_batch(argc == 3 ? argv[2] : nullptr);
+        }
         if (argc < 2 || argc > 3) error_exit("usage: adb pair HOST[:PORT] [PAIRING CODE]");
 
         std::string password;
@@ -1815,6 +2384,10 @@ int adb_commandline(int argc, const char** argv) {
         return adb_send_emulator_command(argc, argv, serial);
     } else if (!strcmp(argv[0], "shell")) {
         return adb_shell(argc, argv);
+    } else if (!strcmp(argv[0], "exec-batch")) {
+        return adb_exec_batch(argc, argv);
+    } else if (!strcmp(argv[0], "framebuffer-stream")) {
+        return adb_framebuffer_stream(argc, argv);
     } else if (!strcmp(argv[0], "exec-in") || !strcmp(argv[0], "exec-out")) {
         int exec_in = !strcmp(argv[0], "exec-in");
 
@@ -1983,6 +2556,9 @@ int adb_commandline(int argc, const char** argv) {
             if (argc != 1) error_exit("mdns %s doesn't take any arguments", argv[0]);
             query += "services";
             printf("List of discovered mdns services\n");
+        } else if (!strcmp(argv[0], "track")) {
+            if (argc != 1) error_exit("mdns %s doesn't take any arguments", argv[0]);
+            return adb_connect_command("host:mdns:track");
         } else {
             error_exit("unknown mdns command [%s]", argv[0]);
         }
@@ -2135,9 +2711,15 @@ int adb_commandline(int argc, const char** argv) {
                 return adb_connect_command("track-app");
             } else if (!strcmp(argv[1], "--proto-text")) {
                 return adb_connect_command("track-app", nullptr, &callback);
+            } else if (!strcmp(argv[1], "--delta")) {
+                if (!CanUseFeature(*features, kFeatureTrackAppDelta)) {
+                    error_exit("track-app --delta is not supported by the device");
+                }
+                TrackAppDeltaStreamsCallback delta_callback;
+                return adb_connect_command("track-app-delta", nullptr, &delta_callback);
             }
         } else {
-            error_exit("usage: adb track-app [--proto-binary][--proto-text]");
+            error_exit("usage: adb track-app [--proto-binary][--proto-text][--delta]");
         }
     } else if (!strcmp(argv[0], "track-devices")) {
         const char* listopt;
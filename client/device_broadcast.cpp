@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG ADB
+
+#include "sysdeps.h"
+
+#include "client/device_broadcast.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#endif
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include "adb_io.h"
+#include "adb_trace.h"
+#include "adb_unique_fd.h"
+
+std::vector<BroadcastTarget> ParseDeviceList(std::string_view output) {
+    std::vector<BroadcastTarget> result;
+    for (const std::string& line : android::base::Split(std::string(output), "\n")) {
+        std::vector<std::string> fields = android::base::Tokenize(line, " \t");
+        if (fields.size() < 2) continue;
+
+        BroadcastTarget target;
+        target.serial = fields[0];
+        target.state = fields[1];
+        for (size_t i = 2; i < fields.size(); ++i) {
+            std::string_view field = fields[i];
+            if (android::base::ConsumePrefix(&field, "product:")) {
+                target.product = field;
+            } else if (android::base::ConsumePrefix(&field, "model:")) {
+                target.model = field;
+            } else if (android::base::ConsumePrefix(&field, "device:")) {
+                target.device = field;
+            } else if (android::base::ConsumePrefix(&field, "transport_id:")) {
+                android::base::ParseUint(std::string(field), &target.transport_id);
+            }
+        }
+
+        // Without a transport id, there's no way to talk to this device in particular.
+        if (target.transport_id == 0) continue;
+        result.push_back(std::move(target));
+    }
+    return result;
+}
+
+bool DeviceSelector::Parse(std::string_view spec, std::string* error) {
+    if (spec.empty()) {
+        *error = "empty device selector";
+        return false;
+    }
+
+    for (const std::string& term : android::base::Split(std::string(spec), ",")) {
+        std::string_view value = term;
+        if (term.empty()) {
+            *error = "empty term in device selector '" + std::string(spec) + "'";
+            return false;
+        } else if (term == "all") {
+            all_ = true;
+        } else if (android::base::ConsumePrefix(&value, "product:")) {
+            products_.emplace_back(value);
+        } else if (android::base::ConsumePrefix(&value, "model:")) {
+            models_.emplace_back(value);
+        } else if (android::base::ConsumePrefix(&value, "device:")) {
+            devices_.emplace_back(value);
+        } else {
+            serials_.push_back(term);
+        }
+    }
+    return true;
+}
+
+static bool Contains(const std::vector<std::string>& values, const std::string& value) {
+    return !value.empty() && std::find(values.begin(), values.end(), value) != values.end();
+}
+
+bool DeviceSelector::Matches(const BroadcastTarget& target) const {
+    if (target.state != "device") return false;
+    return all_ || Contains(serials_, target.serial) || Contains(products_, target.product) ||
+           Contains(models_, target.model) || Contains(devices_, target.device);
+}
+
+std::string LinePrefixer::Add(std::string_view data) {
+    std::string result;
+    while (!data.empty()) {
+        size_t newline = data.find('\n');
+        if (newline == std::string_view::npos) {
+            partial_.append(data);
+            break;
+        }
+        result += prefix_;
+        result += partial_;
+        result.append(data.substr(0, newline + 1));
+        partial_.clear();
+        data.remove_prefix(newline + 1);
+    }
+    return result;
+}
+
+std::string LinePrefixer::Finish() {
+    if (partial_.empty()) return "";
+    std::string result = prefix_ + partial_ + "\n";
+    partial_.clear();
+    return result;
+}
+
+#if !defined(_WIN32)
+
+namespace {
+
+// One of the output streams of a child.
+struct ChildStream {
+    ChildStream(unique_fd fd, int output_fd, std::string prefix)
+        : fd(std::move(fd)), output_fd(output_fd), prefixer(std::move(prefix)) {}
+
+    unique_fd fd;
+    int output_fd;
+    LinePrefixer prefixer;
+};
+
+struct Child {
+    size_t index;
+    pid_t pid;
+    std::vector<std::unique_ptr<ChildStream>> streams;
+};
+
+}  // namespace
+
+static bool StartChild(const BroadcastTarget& target, size_t index,
+                       const std::function<int(const BroadcastTarget&)>& run, Child* child) {
+    unique_fd stdout_read, stdout_write, stderr_read, stderr_write;
+    if (!android::base::Pipe(&stdout_read, &stdout_write) ||
+        !android::base::Pipe(&stderr_read, &stderr_write)) {
+        PLOG(ERROR) << "failed to create pipes for " << target.serial;
+        return false;
+    }
+
+    // Anything we've buffered would be written out by the child too.
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        PLOG(ERROR) << "failed to fork for " << target.serial;
+        return false;
+    }
+
+    if (pid == 0) {
+        int devnull = adb_open("/dev/null", O_RDONLY);
+        dup2(devnull, STDIN_FILENO);
+        dup2(stdout_write.get(), STDOUT_FILENO);
+        dup2(stderr_write.get(), STDERR_FILENO);
+        int status = run(target);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status);
+    }
+
+    std::string prefix = "[" + target.serial + "] ";
+    child->index = index;
+    child->pid = pid;
+    child->streams.push_back(
+            std::make_unique<ChildStream>(std::move(stdout_read), STDOUT_FILENO, prefix));
+    child->streams.push_back(
+            std::make_unique<ChildStream>(std::move(stderr_read), STDERR_FILENO, prefix));
+    return true;
+}
+
+// Copies what's available from |stream|. Returns false once the child has closed it.
+static bool PumpStream(ChildStream* stream) {
+    char buf[64 * 1024];
+    ssize_t rc = adb_read(stream->fd, buf, sizeof(buf));
+    std::string output;
+    if (rc > 0) {
+        output = stream->prefixer.Add(std::string_view(buf, rc));
+    } else {
+        output = stream->prefixer.Finish();
+    }
+    if (!output.empty()) {
+        WriteFdExactly(stream->output_fd, output.data(), output.size());
+    }
+    return rc > 0;
+}
+
+static int WaitForChild(const Child& child) {
+    int status;
+    if (TEMP_FAILURE_RETRY(waitpid(child.pid, &status, 0)) != child.pid) {
+        PLOG(ERROR) << "waitpid failed";
+        return 1;
+    }
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+int RunOnDevices(const std::vector<BroadcastTarget>& targets, size_t jobs,
+                 const std::function<int(const BroadcastTarget&)>& run) {
+    jobs = std::max<size_t>(jobs, 1);
+    std::vector<int> statuses(targets.size(), 0);
+    std::vector<Child> running;
+    size_t next = 0;
+
+    while (next < targets.size() || !running.empty()) {
+        while (next < targets.size() && running.size() < jobs) {
+            Child child;
+            if (!StartChild(targets[next], next, run, &child)) {
+                statuses[next] = 1;
+            } else {
+                running.push_back(std::move(child));
+            }
+            ++next;
+        }
+        if (running.empty()) continue;
+
+        std::vector<adb_pollfd> pfds;
+        std::vector<ChildStream*> polled;
+        for (Child& child : running) {
+            for (auto& stream : child.streams) {
+                pfds.push_back({.fd = stream->fd.get(), .events = POLLIN});
+                polled.push_back(stream.get());
+            }
+        }
+        if (adb_poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            PLOG(FATAL) << "poll failed";
+        }
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (pfds[i].revents != 0 && !PumpStream(polled[i])) {
+                polled[i]->fd.reset();
+            }
+        }
+
+        // Reap the children that closed both of their streams.
+        for (auto it = running.begin(); it != running.end();) {
+            bool done = std::all_of(it->streams.begin(), it->streams.end(),
+                                    [](const auto& stream) { return stream->fd == -1; });
+            if (!done) {
+                ++it;
+                continue;
+            }
+            statuses[it->index] = WaitForChild(*it);
+            it = running.erase(it);
+        }
+    }
+
+    int result = 0;
+    std::vector<std::string> failed;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (statuses[i] == 0) continue;
+        if (result == 0) result = statuses[i];
+        failed.push_back(targets[i].serial);
+    }
+    if (!failed.empty()) {
+        fprintf(stderr, "adb: failed on %zu of %zu devices: %s\n", failed.size(), targets.size(),
+                android::base::Join(failed, ", ").c_str());
+    }
+    return result;
+}
+
+#endif  // !defined(_WIN32)
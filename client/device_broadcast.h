@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "adb.h"
+
+// Running one command on many devices at once (`adb --devices SELECTOR COMMAND...`).
+//
+// The client lists the devices once, then runs the command for each selected device in a child
+// forked from itself, pinned to that device's transport id, a bounded number at a time. The
+// children inherit what the parent already learned about the server, and don't pay for exec or
+// process startup.
+// Each line of their output is prefixed with the device's serial.
+
+// A device, as listed by host:devices-l.
+struct BroadcastTarget {
+    std::string serial;
+    std::string state;
+    std::string product;
+    std::string model;
+    std::string device;
+    TransportId transport_id = 0;
+};
+
+// Parses the output of host:devices-l. Lines that can't be parsed are skipped.
+std::vector<BroadcastTarget> ParseDeviceList(std::string_view output);
+
+// Which devices to run a command on: "all", or a comma-separated list of serials and
+// model:MODEL, product:PRODUCT or device:DEVICE matches. Only devices that are online (in the
+// "device" state) are ever selected.
+class DeviceSelector {
+  public:
+    // Returns false and sets |error| if |spec| is invalid.
+    bool Parse(std::string_view spec, std::string* error);
+
+    bool Matches(const BroadcastTarget& target) const;
+
+    // The serials that were listed explicitly, so that missing devices can be reported.
+    const std::vector<std::string>& serials() const { return serials_; }
+
+  private:
+    bool all_ = false;
+    std::vector<std::string> serials_;
+    std::vector<std::string> products_;
+    std::vector<std::string> models_;
+    std::vector<std::string> devices_;
+};
+
+// Splits a stream of output into lines, and prefixes each one.
+class LinePrefixer {
+  public:
+    explicit LinePrefixer(std::string prefix) : prefix_(std::move(prefix)) {}
+
+    // Returns the prefixed lines completed by |data|.
+    std::string Add(std::string_view data);
+
+    // Returns what's left of the last line, prefixed and newline-terminated.
+    std::string Finish();
+
+  private:
+    std::string prefix_;
+    std::string partial_;
+};
+
+#if !defined(_WIN32)
+// Calls |run| for each of |targets| in a forked child, with at most |jobs| running at once,
+// copying the children's stdout and stderr to ours with each line prefixed with "[SERIAL] ". The
+// children's stdin is /dev/null. |run|'s return value is the child's exit status.
+//
+// Returns 0 if every child succeeded, and otherwise the exit status of the first target (in
+// |targets| order) that failed, after reporting which ones did on stderr.
+int RunOnDevices(const std::vector<BroadcastTarget>& targets, size_t jobs,
+                 const std::function<int(const BroadcastTarget&)>& run);
+#endif
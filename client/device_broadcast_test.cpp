@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/device_broadcast.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+TEST(DeviceBroadcast, parse_device_list) {
+    std::string output =
+            "emulator-5554          device product:sdk_gphone64 model:sdk_gphone64_x86_64 "
+            "device:emu64x transport_id:1\n"
+            "0123456789ABCDEF       unauthorized usb:1-1 transport_id:7\n"
+            "garbage\n"
+            "no-id                  device product:x\n"
+            "192.168.1.2:5555       device product:oriole model:Pixel_6 device:oriole "
+            "transport_id:12\n";
+    std::vector<BroadcastTarget> targets = ParseDeviceList(output);
+    ASSERT_EQ(3U, targets.size());
+
+    EXPECT_EQ("emulator-5554", targets[0].serial);
+    EXPECT_EQ("device", targets[0].state);
+    EXPECT_EQ("sdk_gphone64", targets[0].product);
+    EXPECT_EQ("sdk_gphone64_x86_64", targets[0].model);
+    EXPECT_EQ("emu64x", targets[0].device);
+    EXPECT_EQ(1U, targets[0].transport_id);
+
+    EXPECT_EQ("unauthorized", targets[1].state);
+    EXPECT_EQ(7U, targets[1].transport_id);
+
+    EXPECT_EQ("192.168.1.2:5555", targets[2].serial);
+    EXPECT_EQ("Pixel_6", targets[2].model);
+    EXPECT_EQ(12U, targets[2].transport_id);
+}
+
+TEST(DeviceBroadcast, selector) {
+    BroadcastTarget pixel = {"A", "device", "oriole", "Pixel_6", "oriole", 1};
+    BroadcastTarget emulator = {"emulator-5554", "device", "sdk", "sdk_x86_64", "emu64x", 2};
+    BroadcastTarget offline = {"B", "offline", "oriole", "Pixel_6", "oriole", 3};
+
+    std::string error;
+    DeviceSelector all;
+    ASSERT_TRUE(all.Parse("all", &error));
+    EXPECT_TRUE(all.Matches(pixel));
+    EXPECT_TRUE(all.Matches(emulator));
+    EXPECT_FALSE(all.Matches(offline));
+
+    DeviceSelector by_model;
+    ASSERT_TRUE(by_model.Parse("model:Pixel_6", &error));
+    EXPECT_TRUE(by_model.Matches(pixel));
+    EXPECT_FALSE(by_model.Matches(emulator));
+    EXPECT_FALSE(by_model.Matches(offline));
+
+    DeviceSelector list;
+    ASSERT_TRUE(list.Parse("emulator-5554,product:nope,B", &error));
+    EXPECT_FALSE(list.Matches(pixel));
+    EXPECT_TRUE(list.Matches(emulator));
+    EXPECT_EQ((std::vector<std::string>{"emulator-5554", "B"}), list.serials());
+
+    DeviceSelector invalid;
+    EXPECT_FALSE(invalid.Parse("", &error));
+    EXPECT_FALSE(invalid.Parse("A,,B", &error));
+}
+
+TEST(DeviceBroadcast, line_prefixer) {
+    LinePrefixer prefixer("[x] ");
+    EXPECT_EQ("", prefixer.Add("hel"));
+    EXPECT_EQ("[x] hello\n[x] world\n", prefixer.Add("lo\nworld\nagai"));
+    EXPECT_EQ("[x] agai\n", prefixer.Add("\n"));
+    EXPECT_EQ("", prefixer.Finish());
+    EXPECT_EQ("", prefixer.Add("tail"));
+    EXPECT_EQ("[x] tail\n", prefixer.Finish());
+}
+
+#if !defined(_WIN32)
+TEST(DeviceBroadcast, run_on_devices) {
+    std::vector<BroadcastTarget> targets;
+    for (int i = 0; i < 5; ++i) {
+        targets.push_back({"dev" + std::to_string(i), "device", "", "", "", TransportId(i + 1)});
+    }
+
+    testing::internal::CaptureStdout();
+    testing::internal::CaptureStderr();
+    int result = RunOnDevices(targets, 2, [](const BroadcastTarget& target) {
+        printf("hello from %s\nno newline", target.serial.c_str());
+        fprintf(stderr, "transport %llu\n", static_cast<unsigned long long>(target.transport_id));
+        return target.transport_id == 3 || target.transport_id == 5 ? 40 + target.transport_id : 0;
+    });
+    std::string out = testing::internal::GetCapturedStdout();
+    std::string err = testing::internal::GetCapturedStderr();
+
+    EXPECT_EQ(43, result);
+    for (int i = 0; i < 5; ++i) {
+        std::string serial = "dev" + std::to_string(i);
+        EXPECT_NE(std::string::npos, out.find("[" + serial + "] hello from " + serial + "\n"));
+        EXPECT_NE(std::string::npos, out.find("[" + serial + "] no newline\n"));
+        EXPECT_NE(std::string::npos,
+                  err.find("[" + serial + "] transport " + std::to_string(i + 1) + "\n"));
+    }
+    EXPECT_NE(std::string::npos, err.find("failed on 2 of 5 devices: dev2, dev4"));
+}
+#endif
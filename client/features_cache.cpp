@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG ADB
+
+#include "sysdeps.h"
+
+#include "client/features_cache.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <android-base/parseint.h>
+
+// The file is a line with the server instance id, followed by a line per entry:
+//   <selector> TAB <transport id> TAB <features generation> TAB <comma-separated features>
+FeaturesCache::FeaturesCache(std::string path)
+    : store_(std::move(path), "features cache", 4, /*has_header=*/true) {}
+
+void FeaturesCache::Load() {
+    entries_ = store_.Load<Entry>(
+            [](LineStore::Record& fields) -> std::optional<Entry> {
+                Entry entry;
+                if (fields[0].empty() ||
+                    !android::base::ParseUint(fields[1], &entry.transport_id) ||
+                    !android::base::ParseUint(fields[2], &entry.generation)) {
+                    return std::nullopt;
+                }
+                entry.selector = std::move(fields[0]);
+                entry.features = StringToFeatureSet(fields[3]);
+                return entry;
+            },
+            &instance_id_);
+}
+
+bool FeaturesCache::Save() const {
+    return store_.Save(
+            entries_,
+            [](const Entry& entry) {
+                return LineStore::Record{entry.selector, std::to_string(entry.transport_id),
+                                         std::to_string(entry.generation),
+                                         FeatureSetToString(entry.features)};
+            },
+            instance_id_);
+}
+
+std::optional<FeaturesCache::Entry> FeaturesCache::Find(const std::string& selector) const {
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+                           [&selector](const Entry& entry) { return entry.selector == selector; });
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    return *it;
+}
+
+void FeaturesCache::Update(const std::string& instance_id, Entry entry) {
+    if (entry.selector.empty() || !LineStore::IsStorable(entry.selector)) {
+        return;
+    }
+
+    if (instance_id != instance_id_) {
+        instance_id_ = instance_id;
+        entries_.clear();
+    }
+
+    LineStore::Upsert(&entries_, std::move(entry), kMaxEntries,
+                      [](const Entry& a, const Entry& b) { return a.selector == b.selector; });
+}
+
+void FeaturesCache::Remove(const std::string& selector) {
+    std::erase_if(entries_, [&selector](const Entry& entry) { return entry.selector == selector; });
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "adb.h"
+#include "client/line_store.h"
+#include "transport.h"
+
+// An on-disk cache of device features, so that short-lived adb processes don't have to ask the
+// server for them before every command.
+//
+// Entries are keyed by the transport selection the client was invoked with (see -s and -t), and
+// are only valid for the server instance that reported them, and for the transport id and
+// features generation they were reported for: the server never reuses a transport id, and a
+// device's features can't change without it reconnecting, which changes the generation (even when
+// a TCP device reconnects to the same transport). Clients must pin the connection to the cached
+// transport id and generation, and treat a failure to switch to it as a cache miss.
+//
+// See LineStore for the file format. Concurrent adb processes can read and update it without
+// coordinating; if two of them race, one of the updates is lost.
+class FeaturesCache {
+  public:
+    struct Entry {
+        std::string selector;
+        TransportId transport_id;
+        uint64_t generation;
+        FeatureSet features;
+    };
+
+    static constexpr size_t kMaxEntries = 64;
+
+    explicit FeaturesCache(std::string path);
+
+    // Reads the cache file. A missing or unparseable file results in an empty cache.
+    void Load();
+
+    // Writes the cache file. Returns false on failure.
+    bool Save() const;
+
+    // The server instance the entries are valid for.
+    const std::string& instance_id() const { return instance_id_; }
+
+    std::optional<Entry> Find(const std::string& selector) const;
+
+    // Adds or replaces the entry for |selector|. Entries for other server instances are dropped.
+    void Update(const std::string& instance_id, Entry entry);
+
+    // Drops the entry for |selector|, e.g. after its transport went away.
+    void Remove(const std::string& selector);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+  private:
+    LineStore store_;
+    std::string instance_id_;
+
+    // Least recently updated first.
+    std::vector<Entry> entries_;
+};
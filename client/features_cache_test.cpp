@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/features_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <android-base/file.h>
+
+TEST(FeaturesCache, round_trip) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/features";
+
+    FeaturesCache cache(path);
+    cache.Load();
+    ASSERT_TRUE(cache.instance_id().empty());
+    ASSERT_FALSE(cache.Find("serial:abc").has_value());
+
+    cache.Update("1234", {"serial:abc", 7, 3, {"shell_v2", "cmd"}});
+    cache.Update("1234", {"id:9", 9, 4, {}});
+    ASSERT_TRUE(cache.Save());
+
+    FeaturesCache loaded(path);
+    loaded.Load();
+    ASSERT_EQ("1234", loaded.instance_id());
+    auto entry = loaded.Find("serial:abc");
+    ASSERT_TRUE(entry.has_value());
+    ASSERT_EQ(7U, entry->transport_id);
+    ASSERT_EQ(3U, entry->generation);
+    ASSERT_EQ((FeatureSet{"shell_v2", "cmd"}), entry->features);
+    entry = loaded.Find("id:9");
+    ASSERT_TRUE(entry.has_value());
+    ASSERT_TRUE(entry->features.empty());
+}
+
+TEST(FeaturesCache, new_instance_drops_entries) {
+    TemporaryDir td;
+    FeaturesCache cache(std::string(td.path) + "/features");
+
+    cache.Update("1234", {"serial:abc", 7, 1, {"shell_v2"}});
+    cache.Update("5678", {"serial:def", 1, 2, {"cmd"}});
+    ASSERT_EQ("5678", cache.instance_id());
+    ASSERT_FALSE(cache.Find("serial:abc").has_value());
+    ASSERT_TRUE(cache.Find("serial:def").has_value());
+}
+
+TEST(FeaturesCache, reconnect_replaces_entry) {
+    TemporaryDir td;
+    FeaturesCache cache(std::string(td.path) + "/features");
+
+    // A TCP device that reconnects keeps its transport id, but gets a new generation.
+    cache.Update("1234", {"serial:abc", 7, 1, {"shell_v2"}});
+    cache.Update("1234", {"serial:abc", 7, 5, {"shell_v2", "cmd"}});
+    ASSERT_TRUE(cache.Save());
+
+    FeaturesCache loaded(std::string(td.path) + "/features");
+    loaded.Load();
+    ASSERT_EQ(1U, loaded.entries().size());
+    auto entry = loaded.Find("serial:abc");
+    ASSERT_TRUE(entry.has_value());
+    ASSERT_EQ(7U, entry->transport_id);
+    ASSERT_EQ(5U, entry->generation);
+    ASSERT_EQ((FeatureSet{"shell_v2", "cmd"}), entry->features);
+}
+
+TEST(FeaturesCache, update_and_remove) {
+    TemporaryDir td;
+    FeaturesCache cache(std::string(td.path) + "/features");
+
+    cache.Update("1234", {"serial:abc", 7, 1, {"shell_v2"}});
+    cache.Update("1234", {"serial:def", 8, 2, {"cmd"}});
+    cache.Remove("serial:abc");
+    ASSERT_FALSE(cache.Find("serial:abc").has_value());
+    ASSERT_TRUE(cache.Find("serial:def").has_value());
+
+    // Selectors that can't be stored are ignored.
+    cache.Update("1234", {"serial:a\tb", 1, 1, {}});
+    ASSERT_FALSE(cache.Find("serial:a\tb").has_value());
+}
+
+TEST(FeaturesCache, invalid_numbers) {
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFile("1234\nserial:abc\t7\tnot a number\tcmd\n",
+                                                 tf.path));
+
+    FeaturesCache cache(tf.path);
+    cache.Load();
+    ASSERT_TRUE(cache.instance_id().empty());
+    ASSERT_TRUE(cache.entries().empty());
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG AUTH
+
+#include "sysdeps.h"
+
+#include "client/known_hosts.h"
+
+#include <sys/stat.h>
+
+#include <memory>
+#include <utility>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+#include "adb_io.h"
+#include "adb_trace.h"
+#include "adb_utils.h"
+
+// Tries to replace the |old_file| with |new_file|.
+// On success, then |old_file| has been removed and replaced with the
+// contents of |new_file|, |new_file| will be removed, and only |old_file| will
+// remain.
+// On failure, both files will be unchanged.
+// |new_file| must exist, but |old_file| does not need to exist.
+static bool SafeReplaceFile(std::string_view old_file, std::string_view new_file) {
+    std::string to_be_deleted(old_file);
+    to_be_deleted += ".tbd";
+
+    bool old_renamed = true;
+    if (adb_rename(old_file.data(), to_be_deleted.c_str()) != 0) {
+        // Don't exit here. This is not necessarily an error, because |old_file|
+        // may not exist.
+        PLOG(INFO) << "Failed to rename " << old_file;
+        old_renamed = false;
+    }
+
+    if (adb_rename(new_file.data(), old_file.data()) != 0) {
+        PLOG(ERROR) << "Unable to rename file (" << new_file << " => " << old_file << ")";
+        if (old_renamed) {
+            // Rename the .tbd file back to it's original name
+            adb_rename(to_be_deleted.c_str(), old_file.data());
+        }
+        return false;
+    }
+
+    adb_unlink(to_be_deleted.c_str());
+    return true;
+}
+
+static bool load_known_hosts_from_file(const std::string& path,
+                                       adb::proto::AdbKnownHosts& known_hosts) {
+    // Check for file existence.
+    struct stat buf;
+    if (stat(path.c_str(), &buf) == -1) {
+        LOG(INFO) << "Known hosts file [" << path << "] does not exist...";
+        return false;
+    }
+
+    std::string content;
+    if (!android::base::ReadFileToString(path, &content)) {
+        PLOG(ERROR) << "Unable to open [" << path << "].";
+        return false;
+    }
+
+    if (!known_hosts.ParseFromString(content)) {
+        PLOG(ERROR) << "Failed to parse [" << path << "]. Deleting it as it may be corrupted.";
+        adb_unlink(path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+KnownHosts::KnownHosts(std::string path) : path_(std::move(path)) {}
+
+KnownHosts& KnownHosts::Global() {
+    static auto& known_hosts = *new KnownHosts(adb_get_android_dir_path() + OS_PATH_SEPARATOR +
+                                               "adb_known_hosts.pb");
+    return known_hosts;
+}
+
+std::optional<KnownHosts::FileStamp> KnownHosts::Stat() const {
+    struct stat st;
+    if (stat(path_.c_str(), &st) == -1) {
+        return std::nullopt;
+    }
+    return FileStamp{st.st_mtime, st.st_size, st.st_ino};
+}
+
+void KnownHosts::ReloadIfChanged() {
+    std::optional<FileStamp> stamp = Stat();
+    if (loaded_ && stamp == stamp_) {
+        return;
+    }
+    loaded_ = true;
+    stamp_ = stamp;
+
+    adb::proto::AdbKnownHosts known_hosts;
+    load_known_hosts_from_file(path_, known_hosts);
+
+    if (written_generation_ == generation_) {
+        // Nothing is waiting to be written, so the file is the truth, e.g. after it was deleted to
+        // forget every device.
+        known_hosts_.Clear();
+        guids_.clear();
+    }
+    for (const auto& host_info : known_hosts.host_infos()) {
+        if (guids_.insert(host_info.guid()).second) {
+            *known_hosts_.add_host_infos() = host_info;
+        }
+    }
+    VLOG(AUTH) << "loaded " << guids_.size() << " known hosts from " << path_;
+}
+
+bool KnownHosts::Contains(const std::string& guid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Check the file even if |guid| is in memory, so that deleting it (or another server replacing
+    // it) revokes the devices it no longer lists. That's one stat when nothing changed.
+    ReloadIfChanged();
+    return guids_.contains(guid);
+}
+
+size_t KnownHosts::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReloadIfChanged();
+    return guids_.size();
+}
+
+bool KnownHosts::Write(const std::string& data) const {
+    auto temp_file = std::make_unique<TemporaryFile>(android::base::Dirname(path_));
+    if (temp_file->fd == -1) {
+        PLOG(ERROR) << "Failed to open [" << temp_file->path << "] for writing";
+        return false;
+    }
+
+    if (!WriteFdExactly(temp_file->fd, data)) {
+        LOG(ERROR) << "Unable to write out adb_knowns_hosts";
+        return false;
+    }
+    temp_file->DoNotRemove();
+    std::string temp_file_name(temp_file->path);
+    temp_file.reset();
+
+    // Replace the existing adb_known_hosts with the new one
+    if (!SafeReplaceFile(path_, temp_file_name.c_str())) {
+        LOG(ERROR) << "Failed to replace old adb_known_hosts";
+        adb_unlink(temp_file_name.c_str());
+        return false;
+    }
+    chmod(path_.c_str(), S_IRUSR | S_IWUSR | S_IRGRP);
+    return true;
+}
+
+bool KnownHosts::Add(const std::string& guid) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Pick up what the servers on other ports added, so that writing doesn't drop it.
+    ReloadIfChanged();
+    if (guids_.insert(guid).second) {
+        known_hosts_.add_host_infos()->set_guid(guid);
+        ++generation_;
+    }
+
+    // If |guid| was already there, it may still be waiting to be written.
+    uint64_t wanted = generation_;
+    while (written_generation_ < wanted) {
+        if (writing_) {
+            // What was added meanwhile isn't part of the write in progress. Once it's done, one
+            // of the waiters writes all of it at once.
+            cv_.wait(lock);
+            continue;
+        }
+
+        writing_ = true;
+        uint64_t generation = generation_;
+        std::string data = known_hosts_.SerializeAsString();
+        lock.unlock();
+        bool written = Write(data);
+        lock.lock();
+        writing_ = false;
+        cv_.notify_all();
+        if (!written) {
+            return false;
+        }
+        written_generation_ = generation;
+        stamp_ = Stat();
+    }
+    return true;
+}
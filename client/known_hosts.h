@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+#include <android-base/macros.h>
+#include <android-base/thread_annotations.h>
+
+#include "adb_known_hosts.pb.h"
+
+// The GUIDs of the devices that this host paired with, kept in memory with an index, and written
+// to adb_known_hosts.pb as they are added.
+//
+// Additions that arrive while the file is being written, e.g. when pairing with many devices at
+// once, are written together by the next write. The file is shared with the servers on other
+// ports, or may be deleted to forget every device, so every lookup reads it again if it changed
+// since.
+class KnownHosts {
+  public:
+    explicit KnownHosts(std::string path);
+
+    static KnownHosts& Global();
+
+    bool Contains(const std::string& guid);
+
+    // Adds |guid|, and returns once it has been written to the file. Returns false if the write
+    // failed.
+    bool Add(const std::string& guid);
+
+    size_t size();
+
+  private:
+    // What identifies the version of the file that was read or written last.
+    struct FileStamp {
+        time_t mtime;
+        off_t size;
+        ino_t ino;
+
+        bool operator==(const FileStamp&) const = default;
+    };
+
+    std::optional<FileStamp> Stat() const;
+    void ReloadIfChanged() REQUIRES(mutex_);
+    bool Write(const std::string& data) const;
+
+    const std::string path_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    adb::proto::AdbKnownHosts known_hosts_ GUARDED_BY(mutex_);
+    std::unordered_set<std::string> guids_ GUARDED_BY(mutex_);
+    bool loaded_ GUARDED_BY(mutex_) = false;
+    std::optional<FileStamp> stamp_ GUARDED_BY(mutex_);
+
+    // Bumped by every addition. Everything up to |written_generation_| is in the file.
+    uint64_t generation_ GUARDED_BY(mutex_) = 0;
+    uint64_t written_generation_ GUARDED_BY(mutex_) = 0;
+    bool writing_ GUARDED_BY(mutex_) = false;
+
+    DISALLOW_COPY_AND_ASSIGN(KnownHosts);
+};
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/known_hosts.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+
+TEST(KnownHosts, round_trip) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+
+    KnownHosts known_hosts(path);
+    ASSERT_FALSE(known_hosts.Contains("adb-1234"));
+    ASSERT_TRUE(known_hosts.Add("adb-1234"));
+    ASSERT_TRUE(known_hosts.Add("adb-5678"));
+    ASSERT_TRUE(known_hosts.Add("adb-1234"));
+    ASSERT_EQ(2U, known_hosts.size());
+
+    KnownHosts loaded(path);
+    ASSERT_TRUE(loaded.Contains("adb-1234"));
+    ASSERT_TRUE(loaded.Contains("adb-5678"));
+    ASSERT_FALSE(loaded.Contains("adb-9abc"));
+    ASSERT_EQ(2U, loaded.size());
+}
+
+TEST(KnownHosts, concurrent_adds) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+
+    KnownHosts known_hosts(path);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 32; ++i) {
+        threads.emplace_back([&known_hosts, i]() {
+            ASSERT_TRUE(known_hosts.Add("adb-" + std::to_string(i)));
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    KnownHosts loaded(path);
+    ASSERT_EQ(32U, loaded.size());
+    for (size_t i = 0; i < 32; ++i) {
+        ASSERT_TRUE(loaded.Contains("adb-" + std::to_string(i)));
+    }
+}
+
+TEST(KnownHosts, shared_file) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+
+    // Two servers on different ports.
+    KnownHosts first(path);
+    KnownHosts second(path);
+    ASSERT_TRUE(first.Add("adb-1234"));
+    ASSERT_TRUE(second.Contains("adb-1234"));
+    ASSERT_TRUE(second.Add("adb-5678"));
+    ASSERT_TRUE(first.Contains("adb-5678"));
+
+    // Neither loses what the other added.
+    ASSERT_TRUE(first.Add("adb-9abc"));
+    KnownHosts loaded(path);
+    ASSERT_EQ(3U, loaded.size());
+}
+
+TEST(KnownHosts, deleted_file) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+
+    KnownHosts known_hosts(path);
+    ASSERT_TRUE(known_hosts.Add("adb-1234"));
+    ASSERT_TRUE(known_hosts.Contains("adb-1234"));
+
+    // Deleting the file forgets the devices, even the ones already in memory.
+    ASSERT_TRUE(android::base::RemoveFileIfExists(path));
+    ASSERT_FALSE(known_hosts.Contains("adb-1234"));
+    ASSERT_EQ(0U, known_hosts.size());
+}
+
+TEST(KnownHosts, corrupt_file) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/adb_known_hosts.pb";
+    ASSERT_TRUE(android::base::WriteStringToFile("\xff\xff\xff\xff", path));
+
+    KnownHosts known_hosts(path);
+    ASSERT_FALSE(known_hosts.Contains("adb-1234"));
+    ASSERT_TRUE(known_hosts.Add("adb-1234"));
+
+    KnownHosts loaded(path);
+    ASSERT_TRUE(loaded.Contains("adb-1234"));
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG ADB
+
+#include "sysdeps.h"
+
+#include "client/line_store.h"
+
+#include <fcntl.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "adb_io.h"
+#include "adb_trace.h"
+#include "adb_unique_fd.h"
+
+LineStore::LineStore(std::string path, std::string name, size_t field_count, bool has_header)
+    : path_(std::move(path)),
+      name_(std::move(name)),
+      field_count_(field_count),
+      has_header_(has_header) {}
+
+bool LineStore::ReadRecords(std::string* header, std::vector<Record>* records) const {
+    if (header) header->clear();
+
+    std::string content;
+    if (!android::base::ReadFileToString(path_, &content)) {
+        return false;
+    }
+
+    std::vector<std::string> lines = android::base::Split(content, "\n");
+    size_t first = 0;
+    if (has_header_) {
+        if (lines[0].empty()) {
+            return false;
+        }
+        if (header) *header = lines[0];
+        first = 1;
+    }
+
+    for (size_t i = first; i < lines.size(); ++i) {
+        if (lines[i].empty()) continue;
+
+        Record fields = android::base::Split(lines[i], "\t");
+        if (fields.size() != field_count_) {
+            ReportCorrupt();
+            if (header) header->clear();
+            records->clear();
+            return false;
+        }
+        records->push_back(std::move(fields));
+    }
+    VLOG(ADB) << "loaded " << records->size() << " " << name_ << " entries from " << path_;
+    return true;
+}
+
+bool LineStore::WriteRecords(const std::string& header, const std::vector<Record>& records) const {
+    std::string content;
+    if (has_header_) {
+        content += header + "\n";
+    }
+    for (const Record& record : records) {
+        CHECK_EQ(field_count_, record.size());
+        content += android::base::Join(record, '\t') + "\n";
+    }
+
+    // Write to a temporary file and rename it over the old one, so that readers never see a
+    // partially written file.
+    std::string temp_path =
+            android::base::StringPrintf("%s.%d.tmp", path_.c_str(), static_cast<int>(getpid()));
+    unique_fd fd(adb_open_mode(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd < 0 || !WriteFdExactly(fd, content)) {
+        PLOG(DEBUG) << "failed to write " << name_ << " to " << temp_path;
+        adb_unlink(temp_path.c_str());
+        return false;
+    }
+    fd.reset();
+    if (adb_rename(temp_path.c_str(), path_.c_str()) != 0) {
+        PLOG(DEBUG) << "failed to rename " << name_ << " to " << path_;
+        adb_unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void LineStore::ReportCorrupt() const {
+    LOG(WARNING) << "ignoring corrupt " << name_ << " " << path_;
+}
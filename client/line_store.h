@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The on-disk format shared by the small caches that adb keeps next to its keys (device
+// features, accepted keys, `adb connect` history, ...).
+//
+// A file is an optional header line, followed by a line per entry with a fixed number of
+// tab-separated fields. Files are replaced atomically, so several adb processes can share one
+// without coordinating, and are only readable by their owner, since some of them hold key
+// material. A file that can't be parsed is treated as missing: these are all caches that get
+// rebuilt as adb goes.
+class LineStore {
+  public:
+    using Record = std::vector<std::string>;
+
+    // |name| is only used in log messages.
+    LineStore(std::string path, std::string name, size_t field_count, bool has_header = false);
+
+    const std::string& path() const { return path_; }
+
+    // Reads the file, turning each record into an entry with |parse|, which returns std::nullopt
+    // for records that don't make sense. If the file is missing or corrupt (no header, a record
+    // with the wrong number of fields, or one that |parse| rejects), the result is empty, and so
+    // is |*header|.
+    template <typename Entry, typename Parse>
+    std::vector<Entry> Load(Parse parse, std::string* header = nullptr) const {
+        std::vector<Entry> entries;
+        std::vector<Record> records;
+        if (!ReadRecords(header, &records)) {
+            return entries;
+        }
+        for (Record& record : records) {
+            std::optional<Entry> entry = parse(record);
+            if (!entry) {
+                ReportCorrupt();
+                if (header) header->clear();
+                return {};
+            }
+            entries.push_back(std::move(*entry));
+        }
+        return entries;
+    }
+
+    // Replaces the file with |header| (if the file has one) and a record per entry, as returned
+    // by |format|. Returns false on failure.
+    template <typename Entry, typename Format>
+    bool Save(const std::vector<Entry>& entries, Format format,
+              const std::string& header = "") const {
+        std::vector<Record> records;
+        records.reserve(entries.size());
+        for (const Entry& entry : entries) {
+            records.push_back(format(entry));
+        }
+        return WriteRecords(header, records);
+    }
+
+    // Whether |field| can be stored without being mistaken for a field or record separator.
+    static bool IsStorable(std::string_view field) {
+        return field.find_first_of("\t\n") == std::string_view::npos;
+    }
+
+    // Adds |entry| to |entries|, which are ordered least recently updated first, replacing any
+    // entry that |same| matches it with, and evicting the least recently updated entry if there
+    // would be more than |max_entries|.
+    template <typename Entry, typename Same>
+    static void Upsert(std::vector<Entry>* entries, Entry entry, size_t max_entries, Same same) {
+        std::erase_if(*entries, [&](const Entry& e) { return same(e, entry); });
+        if (entries->size() >= max_entries) {
+            entries->erase(entries->begin(), entries->end() - (max_entries - 1));
+        }
+        entries->push_back(std::move(entry));
+    }
+
+  private:
+    bool ReadRecords(std::string* header, std::vector<Record>* records) const;
+    bool WriteRecords(const std::string& header, const std::vector<Record>& records) const;
+    void ReportCorrupt() const;
+
+    std::string path_;
+    std::string name_;
+    size_t field_count_;
+    bool has_header_;
+};
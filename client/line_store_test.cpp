@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "client/line_store.h"
+
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+
+namespace {
+
+struct Entry {
+    std::string key;
+    std::string value;
+};
+
+std::optional<Entry> ParseEntry(LineStore::Record& fields) {
+    if (fields[0].empty()) {
+        return std::nullopt;
+    }
+    return Entry{fields[0], fields[1]};
+}
+
+LineStore::Record FormatEntry(const Entry& entry) {
+    return {entry.key, entry.value};
+}
+
+}  // namespace
+
+TEST(LineStore, round_trip) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/store";
+
+    LineStore store(path, "test store", 2, /*has_header=*/true);
+    std::string header = "stale";
+    ASSERT_TRUE(store.Load<Entry>(ParseEntry, &header).empty());
+    ASSERT_TRUE(header.empty());
+
+    std::vector<Entry> entries = {{"a", "1"}, {"b", ""}};
+    ASSERT_TRUE(store.Save(entries, FormatEntry, "header"));
+
+#if !defined(_WIN32)
+    // Some stores hold key material.
+    struct stat st;
+    ASSERT_EQ(0, stat(path.c_str(), &st));
+    ASSERT_EQ(0600, st.st_mode & 0777);
+#endif
+
+    std::vector<Entry> loaded = store.Load<Entry>(ParseEntry, &header);
+    ASSERT_EQ("header", header);
+    ASSERT_EQ(2U, loaded.size());
+    ASSERT_EQ("a", loaded[0].key);
+    ASSERT_EQ("1", loaded[0].value);
+    ASSERT_EQ("b", loaded[1].key);
+    ASSERT_EQ("", loaded[1].value);
+
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &content));
+    ASSERT_EQ("header\na\t1\nb\t\n", content);
+}
+
+TEST(LineStore, corrupt_file) {
+    TemporaryFile tf;
+    LineStore store(tf.path, "test store", 2, /*has_header=*/true);
+    std::string header;
+
+    // A record with the wrong number of fields.
+    ASSERT_TRUE(android::base::WriteStringToFile("header\na\t1\nb\n", tf.path));
+    ASSERT_TRUE(store.Load<Entry>(ParseEntry, &header).empty());
+    ASSERT_TRUE(header.empty());
+
+    // A record that the parser rejects.
+    ASSERT_TRUE(android::base::WriteStringToFile("header\na\t1\n\t2\n", tf.path));
+    ASSERT_TRUE(store.Load<Entry>(ParseEntry, &header).empty());
+    ASSERT_TRUE(header.empty());
+
+    // No header.
+    ASSERT_TRUE(android::base::WriteStringToFile("\na\t1\n", tf.path));
+    ASSERT_TRUE(store.Load<Entry>(ParseEntry, &header).empty());
+
+    // Files without a header line don't mistake the first record for one.
+    LineStore headerless(tf.path, "test store", 2);
+    ASSERT_TRUE(android::base::WriteStringToFile("a\t1\n", tf.path));
+    ASSERT_EQ(1U, headerless.Load<Entry>(ParseEntry).size());
+}
+
+TEST(LineStore, upsert_and_evict) {
+    auto same_key = [](const Entry& a, const Entry& b) { return a.key == b.key; };
+    std::vector<Entry> entries;
+    LineStore::Upsert(&entries, Entry{"a", "1"}, 3, same_key);
+    LineStore::Upsert(&entries, Entry{"b", "1"}, 3, same_key);
+    LineStore::Upsert(&entries, Entry{"a", "2"}, 3, same_key);
+    ASSERT_EQ(2U, entries.size());
+    ASSERT_EQ("b", entries[0].key);
+    ASSERT_EQ("a", entries[1].key);
+    ASSERT_EQ("2", entries[1].value);
+
+    // The least recently updated entry goes first.
+    LineStore::Upsert(&entries, Entry{"c", "1"}, 3, same_key);
+    LineStore::Upsert(&entries, Entry{"d", "1"}, 3, same_key);
+    ASSERT_EQ(3U, entries.size());
+    ASSERT_EQ("a", entries[0].key);
+    ASSERT_EQ("d", entries[2].key);
+}
+
+TEST(LineStore, is_storable) {
+    ASSERT_TRUE(LineStore::IsStorable(""));
+    ASSERT_TRUE(LineStore::IsStorable("192.168.1.2:5555"));
+    ASSERT_FALSE(LineStore::IsStorable("a\tb"));
+    ASSERT_FALSE(LineStore::IsStorable("a\nb"));
+}
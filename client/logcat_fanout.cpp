@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sysdeps.h"
+
+#include "client/logcat_fanout.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/thread_annotations.h>
+
+#include "adb_io.h"
+#include "adb_trace.h"
+#include "adb_unique_fd.h"
+#include "services.h"
+#include "transport.h"
+
+using namespace std::chrono_literals;
+
+// The device side of the stream. Like a plain `adb logcat`, this starts with whatever is already
+// in the device's buffers, so the first client doesn't miss anything.
+static constexpr char kDeviceService[] = "exec:logcat -v threadtime";
+
+// Limits on the history kept for late joiners, and on the backlog of a client that isn't keeping
+// up. Lines that don't fit into a client's backlog are dropped, oldest first.
+static constexpr size_t kHistoryBytes = 2 * 1024 * 1024;
+static constexpr size_t kBacklogBytes = 1024 * 1024;
+
+// Longer lines are passed on in pieces.
+static constexpr size_t kMaxLineLength = 64 * 1024;
+
+static size_t EntryBytes(const LogcatEntry& entry) {
+    return sizeof(entry) + entry.text.size();
+}
+
+static std::optional<LogcatPriority> ParsePriority(char c) {
+    switch (c) {
+        case 'V':
+            return LogcatPriority::Verbose;
+        case 'D':
+            return LogcatPriority::Debug;
+        case 'I':
+            return LogcatPriority::Info;
+        case 'W':
+            return LogcatPriority::Warn;
+        case 'E':
+            return LogcatPriority::Error;
+        case 'F':
+        case 'A':
+            return LogcatPriority::Fatal;
+        case 'S':
+            return LogcatPriority::Silent;
+        default:
+            return std::nullopt;
+    }
+}
+
+// Splits the next space-separated field off the front of |s|.
+static std::string_view NextField(std::string_view* s) {
+    size_t start = s->find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        *s = {};
+        return {};
+    }
+    s->remove_prefix(start);
+    size_t end = std::min(s->find(' '), s->size());
+    std::string_view field = s->substr(0, end);
+    s->remove_prefix(end);
+    return field;
+}
+
+// A threadtime line looks like:
+//   10-17 12:34:56.789  1234  5678 I ActivityManager: Start proc ...
+LogcatEntry LogcatEntry::Parse(std::string text) {
+    LogcatEntry entry;
+    std::string_view rest = text;
+    NextField(&rest);  // Date.
+    NextField(&rest);  // Time.
+    std::string_view pid = NextField(&rest);
+    NextField(&rest);  // Tid.
+    std::string_view priority = NextField(&rest);
+
+    int parsed_pid;
+    size_t tag_end = rest.find(": ");
+    if (priority.size() == 1 && ParsePriority(priority[0]) && tag_end != std::string_view::npos &&
+        android::base::ParseInt(std::string(pid), &parsed_pid, 0)) {
+        std::string_view tag = rest.substr(0, tag_end);
+        tag.remove_prefix(std::min(tag.find_first_not_of(' '), tag.size()));
+        tag.remove_suffix(tag.size() - std::min(tag.find_last_not_of(' ') + 1, tag.size()));
+
+        entry.priority = *ParsePriority(priority[0]);
+        entry.tag = tag;
+        entry.pid = parsed_pid;
+    }
+    entry.text = std::move(text);
+    return entry;
+}
+
+bool LogcatFilter::Parse(const std::vector<std::string>& args, std::string* error) {
+    for (const std::string& arg : args) {
+        std::string_view value = arg;
+        if (android::base::ConsumePrefix(&value, "--pid=")) {
+            int pid;
+            if (!android::base::ParseInt(std::string(value), &pid, 0)) {
+                *error = "invalid pid: " + arg;
+                return false;
+            }
+            pid_ = pid;
+            continue;
+        }
+
+        // TAG[:PRIORITY], where a missing priority means all of them.
+        std::string tag = arg;
+        LogcatPriority priority = LogcatPriority::Verbose;
+        size_t colon = arg.rfind(':');
+        if (colon != std::string::npos) {
+            tag = arg.substr(0, colon);
+            std::optional<LogcatPriority> parsed;
+            if (arg.size() == colon + 2) {
+                parsed = ParsePriority(arg[colon + 1]);
+            }
+            if (!parsed) {
+                *error = "invalid filterspec: " + arg;
+                return false;
+            }
+            priority = *parsed;
+        }
+        if (tag.empty() || android::base::StartsWith(tag, "-")) {
+            *error = "invalid filterspec: " + arg;
+            return false;
+        }
+
+        if (tag == "*") {
+            default_priority_ = priority;
+        } else {
+            tags_[tag] = priority;
+        }
+    }
+    return true;
+}
+
+bool LogcatFilter::Matches(const LogcatEntry& entry) const {
+    // Like logcat, always show lines that aren't messages, such as the buffer markers.
+    if (entry.priority == LogcatPriority::Unknown) {
+        return true;
+    }
+    if (pid_ && entry.pid != *pid_) {
+        return false;
+    }
+
+    auto it = tags_.find(entry.tag);
+    LogcatPriority min_priority = it == tags_.end() ? default_priority_ : it->second;
+    return min_priority != LogcatPriority::Silent && entry.priority >= min_priority;
+}
+
+void LogcatRing::Push(std::shared_ptr<const LogcatEntry> entry) {
+    bytes_ += EntryBytes(*entry);
+    entries_.push_back(std::move(entry));
+    while (bytes_ > max_bytes_) {
+        bytes_ -= EntryBytes(*entries_.front());
+        entries_.pop_front();
+    }
+}
+
+std::vector<std::shared_ptr<const LogcatEntry>> LogcatRing::Tail(size_t count,
+                                                                 const LogcatFilter& filter) const {
+    std::vector<std::shared_ptr<const LogcatEntry>> result;
+    for (auto it = entries_.rbegin(); it != entries_.rend() && result.size() < count; ++it) {
+        if (filter.Matches(**it)) {
+            result.push_back(*it);
+        }
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+namespace {
+
+struct Subscriber {
+    LogcatFilter filter;
+
+    // Guarded by the hub's mutex.
+    std::deque<std::shared_ptr<const LogcatEntry>> backlog;
+    size_t backlog_bytes = 0;
+    size_t dropped = 0;
+    bool closed = false;
+    std::condition_variable cv;
+
+    void Queue(std::shared_ptr<const LogcatEntry> entry) {
+        backlog_bytes += EntryBytes(*entry);
+        backlog.push_back(std::move(entry));
+        while (backlog_bytes > kBacklogBytes) {
+            backlog_bytes -= EntryBytes(*backlog.front());
+            backlog.pop_front();
+            ++dropped;
+        }
+    }
+};
+
+class LogcatHub;
+
+auto& hubs_mutex = *new std::mutex();
+auto& hubs GUARDED_BY(hubs_mutex) =
+        *new std::unordered_map<TransportId, std::shared_ptr<LogcatHub>>();
+
+// The device-side log stream of a transport, and the clients reading it.
+class LogcatHub {
+  public:
+    LogcatHub(TransportId transport_id, unique_fd fd)
+        : transport_id_(transport_id), fd_(std::move(fd)) {}
+
+    // Adds |subscriber| to the hub for |t|, with up to |history| recent lines already queued,
+    // and starts the device-side stream if there isn't one yet. Must be called on the fdevent
+    // thread.
+    static std::shared_ptr<LogcatHub> Subscribe(atransport* t, Subscriber* subscriber,
+                                                size_t history, std::string* error)
+            EXCLUDES(hubs_mutex) {
+        std::lock_guard<std::mutex> hubs_lock(hubs_mutex);
+        std::shared_ptr<LogcatHub>& hub = hubs[t->id];
+        if (!hub) {
+            int fds[2];
+            if (adb_socketpair(fds) != 0) {
+                *error = android::base::StringPrintf("failed to create socketpair: %s",
+                                                     strerror(errno));
+                hubs.erase(t->id);
+                return nullptr;
+            }
+            asocket* s = create_local_socket(unique_fd(fds[1]));
+            s->transport = t;
+            connect_to_remote(s, kDeviceService);
+
+            VLOG(ADB) << "starting shared logcat for transport " << t->id;
+            hub = std::make_shared<LogcatHub>(t->id, unique_fd(fds[0]));
+            std::thread([hub]() {
+                adb_thread_setname("logcat hub");
+                hub->ReadLoop();
+            }).detach();
+        }
+
+        // Hubs are removed from |hubs| as soon as they stop, so this one is still running.
+        std::lock_guard<std::mutex> lock(hub->mutex_);
+        for (auto& entry : hub->history_.Tail(history, subscriber->filter)) {
+            subscriber->Queue(std::move(entry));
+        }
+        hub->subscribers_.push_back(subscriber);
+        return hub;
+    }
+
+    void Unsubscribe(Subscriber* subscriber) EXCLUDES(hubs_mutex, mutex_) {
+        std::lock_guard<std::mutex> hubs_lock(hubs_mutex);
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::erase(subscribers_, subscriber);
+        if (subscribers_.empty() && !stopped_) {
+            // Closing our end makes the server close the device-side stream, and ends ReadLoop().
+            VLOG(ADB) << "stopping shared logcat for transport " << transport_id_;
+            StopLocked();
+            adb_shutdown(fd_.get());
+        }
+    }
+
+    // Waits a while for lines for |subscriber|, and moves them to |entries|. Returns false once
+    // the stream has ended and everything has been handed out.
+    bool Wait(Subscriber* subscriber, std::vector<std::shared_ptr<const LogcatEntry>>* entries,
+              size_t* dropped) EXCLUDES(mutex_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        subscriber->cv.wait_for(lock, 1s, [subscriber]() {
+            return !subscriber->backlog.empty() || subscriber->dropped || subscriber->closed;
+        });
+        entries->assign(std::make_move_iterator(subscriber->backlog.begin()),
+                        std::make_move_iterator(subscriber->backlog.end()));
+        subscriber->backlog.clear();
+        subscriber->backlog_bytes = 0;
+        *dropped = std::exchange(subscriber->dropped, 0);
+        return !subscriber->closed || !entries->empty() || *dropped;
+    }
+
+  private:
+    void ReadLoop() EXCLUDES(hubs_mutex, mutex_) {
+        std::string pending;
+        std::vector<std::shared_ptr<const LogcatEntry>> lines;
+        char buf[16 * 1024];
+        while (true) {
+            int rc = adb_read(fd_, buf, sizeof(buf));
+            if (rc <= 0) {
+                break;
+            }
+            pending.append(buf, rc);
+
+            size_t start = 0;
+            while (true) {
+                size_t end = pending.find('\n', start);
+                if (end == std::string::npos) {
+                    if (pending.size() - start < kMaxLineLength) break;
+                    end = start + kMaxLineLength - 1;
+                }
+                lines.push_back(std::make_shared<const LogcatEntry>(
+                        LogcatEntry::Parse(pending.substr(start, end + 1 - start))));
+                start = end + 1;
+            }
+            pending.erase(0, start);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& line : lines) {
+                for (Subscriber* subscriber : subscribers_) {
+                    if (subscriber->filter.Matches(*line)) {
+                        subscriber->Queue(line);
+                        subscriber->cv.notify_one();
+                    }
+                }
+                history_.Push(std::move(line));
+            }
+            lines.clear();
+        }
+
+        VLOG(ADB) << "shared logcat for transport " << transport_id_ << " ended";
+        std::lock_guard<std::mutex> hubs_lock(hubs_mutex);
+        std::lock_guard<std::mutex> lock(mutex_);
+        StopLocked();
+    }
+
+    void StopLocked() REQUIRES(hubs_mutex, mutex_) {
+        if (!stopped_) {
+            stopped_ = true;
+            auto it = hubs.find(transport_id_);
+            if (it != hubs.end() && it->second.get() == this) {
+                hubs.erase(it);
+            }
+        }
+        for (Subscriber* subscriber : subscribers_) {
+            subscriber->closed = true;
+            subscriber->cv.notify_one();
+        }
+    }
+
+    const TransportId transport_id_;
+    unique_fd fd_;
+
+    std::mutex mutex_;
+    LogcatRing history_ GUARDED_BY(mutex_){kHistoryBytes};
+    std::vector<Subscriber*> subscribers_ GUARDED_BY(mutex_);
+    bool stopped_ GUARDED_BY(mutex_) = false;
+
+    DISALLOW_COPY_AND_ASSIGN(LogcatHub);
+};
+
+void logcat_subscriber_service(unique_fd fd, std::shared_ptr<LogcatHub> hub,
+                               std::shared_ptr<Subscriber> subscriber, std::string error) {
+    if (!hub) {
+        SendFail(fd, error);
+        return;
+    }
+    SendOkay(fd);
+
+    std::vector<std::shared_ptr<const LogcatEntry>> entries;
+    size_t dropped;
+    std::string output;
+    while (hub->Wait(subscriber.get(), &entries, &dropped)) {
+        output.clear();
+        if (dropped) {
+            output += android::base::StringPrintf(
+                    "--------- adb: dropped %zu lines while this client fell behind\n", dropped);
+        }
+        for (const auto& entry : entries) {
+            output += entry->text;
+        }
+
+        if (!output.empty()) {
+            if (!WriteFdExactly(fd, output.data(), output.size())) {
+                break;
+            }
+        } else {
+            // Clients never send anything, so a readable socket means the client has gone away.
+            adb_pollfd pfd = {.fd = fd.get(), .events = POLLIN};
+            if (adb_poll(&pfd, 1, 0) != 0) {
+                break;
+            }
+        }
+    }
+    hub->Unsubscribe(subscriber.get());
+}
+
+}  // namespace
+
+asocket* create_logcat_subscriber(std::string_view args, TransportType type,
+                                  std::string_view serial, TransportId transport_id) {
+    auto subscriber = std::make_shared<Subscriber>();
+    std::vector<std::string> filter_args;
+    size_t history = SIZE_MAX;
+    std::string error;
+    std::vector<std::string> split = android::base::Split(std::string(args), " ");
+    for (size_t i = 0; i < split.size() && error.empty(); ++i) {
+        if (split[i].empty()) {
+            continue;
+        } else if (split[i] == "-T") {
+            if (i + 1 == split.size() || !android::base::ParseUint(split[i + 1], &history)) {
+                error = "-T requires a line count";
+            }
+            ++i;
+        } else {
+            filter_args.push_back(split[i]);
+        }
+    }
+
+    std::shared_ptr<LogcatHub> hub;
+    if (error.empty() && subscriber->filter.Parse(filter_args, &error)) {
+        std::string serial_str(serial);
+        atransport* t =
+                acquire_one_transport(type, serial_str.empty() ? nullptr : serial_str.c_str(),
+                                      transport_id, nullptr, &error);
+        if (t) {
+            hub = LogcatHub::Subscribe(t, subscriber.get(), history, &error);
+        }
+    }
+
+    unique_fd fd = create_service_thread(
+            "logcat", std::bind(logcat_subscriber_service, std::placeholders::_1, hub, subscriber,
+                                std::move(error)));
+    if (fd < 0) {
+        if (hub) {
+            hub->Unsubscribe(subscriber.get());
+        }
+        return nullptr;
+    }
+    return create_local_socket(std::move(fd));
+}
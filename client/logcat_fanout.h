@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "adb.h"
+#include "socket.h"
+
+// Shared device logs: the adb server keeps a single logcat running per device,
+// and fans its output out to any number of local clients (see `adb logcat
+// --shared`). Each client gets its own filter, applied on the host, and can
+// ask for recent history that the server keeps in a bounded ring buffer.
+//
+// The device-side stream is started by the first client and stopped when the
+// last one goes away.
+
+// Log priorities, with the same values as android_LogPriority.
+enum class LogcatPriority : uint8_t {
+    Unknown = 0,
+    Verbose = 2,
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Fatal,
+    Silent,
+};
+
+// A line of `logcat -v threadtime` output.
+struct LogcatEntry {
+    // The whole line, including the trailing newline.
+    std::string text;
+
+    // Unknown for lines that aren't log messages, such as "--------- beginning of main".
+    LogcatPriority priority = LogcatPriority::Unknown;
+    std::string tag;
+    int pid = -1;
+
+    static LogcatEntry Parse(std::string text);
+};
+
+// A client's choice of log messages, using logcat's syntax: TAG[:PRIORITY]
+// filterspecs with "*" for the default, and --pid=PID.
+class LogcatFilter {
+  public:
+    // Returns false and sets |error| on invalid arguments.
+    bool Parse(const std::vector<std::string>& args, std::string* error);
+
+    bool Matches(const LogcatEntry& entry) const;
+
+  private:
+    std::unordered_map<std::string, LogcatPriority> tags_;
+    LogcatPriority default_priority_ = LogcatPriority::Verbose;
+    std::optional<int> pid_;
+};
+
+// The most recent log lines, up to a total size.
+class LogcatRing {
+  public:
+    explicit LogcatRing(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    void Push(std::shared_ptr<const LogcatEntry> entry);
+
+    // Returns the last |count| entries that match |filter|, oldest first.
+    std::vector<std::shared_ptr<const LogcatEntry>> Tail(size_t count,
+                                                         const LogcatFilter& filter) const;
+
+    size_t size() const { return entries_.size(); }
+    size_t bytes() const { return bytes_; }
+
+  private:
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    std::deque<std::shared_ptr<const LogcatEntry>> entries_;
+};
+
+// Creates the socket for a logcat-shared:<args> host service. |args| are
+// space-separated LogcatFilter arguments, plus -T COUNT to start with (at
+// most) the COUNT most recent lines instead of all the buffered ones.
+asocket* create_logcat_subscriber(std::string_view args, TransportType type,
+                                  std::string_view serial, TransportId transport_id);
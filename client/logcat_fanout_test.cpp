@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "client/logcat_fanout.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+static std::shared_ptr<const LogcatEntry> Entry(const std::string& text) {
+    return std::make_shared<const LogcatEntry>(LogcatEntry::Parse(text));
+}
+
+TEST(LogcatFanout, parse) {
+    LogcatEntry entry = LogcatEntry::Parse(
+            "10-17 12:34:56.789  1234  5678 I ActivityManager: Start proc 42: a:b\n");
+    ASSERT_EQ(LogcatPriority::Info, entry.priority);
+    ASSERT_EQ("ActivityManager", entry.tag);
+    ASSERT_EQ(1234, entry.pid);
+    ASSERT_EQ("10-17 12:34:56.789  1234  5678 I ActivityManager: Start proc 42: a:b\n",
+              entry.text);
+
+    // Short tags are padded.
+    entry = LogcatEntry::Parse("10-17 12:34:56.789   1     1 W init    : hello\n");
+    ASSERT_EQ(LogcatPriority::Warn, entry.priority);
+    ASSERT_EQ("init", entry.tag);
+    ASSERT_EQ(1, entry.pid);
+
+    entry = LogcatEntry::Parse("--------- beginning of main\n");
+    ASSERT_EQ(LogcatPriority::Unknown, entry.priority);
+    entry = LogcatEntry::Parse("\n");
+    ASSERT_EQ(LogcatPriority::Unknown, entry.priority);
+}
+
+TEST(LogcatFanout, filter) {
+    auto verbose = Entry("10-17 12:34:56.789  100  100 V Foo: x\n");
+    auto info = Entry("10-17 12:34:56.789  100  100 I Foo: x\n");
+    auto error = Entry("10-17 12:34:56.789  200  200 E Bar: x\n");
+    auto marker = Entry("--------- beginning of main\n");
+
+    std::string message;
+    LogcatFilter all;
+    ASSERT_TRUE(all.Parse({}, &message));
+    ASSERT_TRUE(all.Matches(*verbose));
+    ASSERT_TRUE(all.Matches(*error));
+
+    LogcatFilter foo;
+    ASSERT_TRUE(foo.Parse({"Foo:I", "*:S"}, &message));
+    ASSERT_FALSE(foo.Matches(*verbose));
+    ASSERT_TRUE(foo.Matches(*info));
+    ASSERT_FALSE(foo.Matches(*error));
+    ASSERT_TRUE(foo.Matches(*marker));
+
+    LogcatFilter pid;
+    ASSERT_TRUE(pid.Parse({"--pid=200", "*:W"}, &message));
+    ASSERT_FALSE(pid.Matches(*info));
+    ASSERT_TRUE(pid.Matches(*error));
+
+    LogcatFilter bad;
+    ASSERT_FALSE(bad.Parse({"Foo:X"}, &message));
+    ASSERT_FALSE(bad.Parse({"-d"}, &message));
+    ASSERT_FALSE(bad.Parse({"--pid=abc"}, &message));
+}
+
+TEST(LogcatFanout, ring) {
+    std::string line = "10-17 12:34:56.789  100  100 I Foo: ";
+    size_t entry_size = sizeof(LogcatEntry) + line.size() + 2;
+
+    // Room for three entries.
+    LogcatRing ring(entry_size * 3);
+    for (int i = 0; i < 5; ++i) {
+        ring.Push(Entry(line + std::to_string(i) + "\n"));
+    }
+    ASSERT_EQ(3U, ring.size());
+    ASSERT_EQ(entry_size * 3, ring.bytes());
+
+    LogcatFilter all;
+    std::vector<std::shared_ptr<const LogcatEntry>> tail = ring.Tail(2, all);
+    ASSERT_EQ(2U, tail.size());
+    ASSERT_EQ(line + "3\n", tail[0]->text);
+    ASSERT_EQ(line + "4\n", tail[1]->text);
+    ASSERT_EQ(3U, ring.Tail(SIZE_MAX, all).size());
+
+    LogcatFilter none;
+    std::string error;
+    ASSERT_TRUE(none.Parse({"*:S"}, &error));
+    ASSERT_TRUE(ring.Tail(SIZE_MAX, none).empty());
+}
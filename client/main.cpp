@@ -42,6 +42,7 @@
 #include "client/usb.h"
 #include "client/usb_libusb_hotplug.h"
 #include "commandline.h"
+#include "socket_spec.h"
 #include "sysdeps/chrono.h"
 #include "transport.h"
 
@@ -69,10 +70,12 @@ static void setup_daemon_logging() {
 void adb_server_cleanup() {
     // Upon exit, we want to clean up in the following order:
     //   1. close_smartsockets, so that we don't get any new clients
-    //   2. kick_all_transports, to avoid writing only part of a packet to a transport.
-    //   3. usb_cleanup, to tear down the USB stack.
-    //   4. mdns_cleanup, to tear down mdns stack.
+    //   2. stop_saving_tcp_connections, to remember the devices before disconnecting them.
+    //   3. kick_all_transports, to avoid writing only part of a packet to a transport.
+    //   4. usb_cleanup, to tear down the USB stack.
+    //   5. mdns_cleanup, to tear down mdns stack.
     close_smartsockets();
+    stop_saving_tcp_connections();
     kick_all_transports();
     usb_cleanup();
     mdns_cleanup();
@@ -172,6 +175,12 @@ int adb_server_main(int is_daemon, const std::string& socket_spec, const char* o
 
     adb_auth_init();
 
+    // Servers listening on different ports are independent, and keep their own devices.
+    if (int port = get_host_socket_spec_port(socket_spec, &error); port >= 0) {
+        restore_tcp_connections(adb_get_android_dir_path() + OS_PATH_SEPARATOR + "adb." +
+                                std::to_string(port) + ".connections");
+    }
+
     if (is_daemon) {
 #if !defined(_WIN32)
         // Start a new session for the daemon. Do this here instead of after the fork so
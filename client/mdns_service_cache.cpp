@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG MDNS
+
+#include "sysdeps.h"
+
+#include "client/mdns_service_cache.h"
+
+#include <android-base/logging.h>
+
+#include "adb_trace.h"
+
+MdnsServiceCache& MdnsServiceCache::Global() {
+    static auto& cache = *new MdnsServiceCache();
+    return cache;
+}
+
+MdnsInfo MdnsServiceCache::ToInfo(const Key& key, const Entry& entry) {
+    return MdnsInfo(key.second, key.first, entry.addr, entry.port);
+}
+
+MdnsServiceCache::Clock::time_point MdnsServiceCache::ExpiryTime(Clock::time_point now,
+                                                                 Clock::duration ttl) {
+    if (ttl == kNoExpiry || now > Clock::time_point::max() - ttl) {
+        return Clock::time_point::max();
+    }
+    return now + ttl;
+}
+
+void MdnsServiceCache::UpdateLocked(const MdnsInfo& info, Clock::time_point expiry,
+                                    std::vector<Delta>* deltas) {
+    auto it = entries_.find(KeyView(info.service_type, info.service_name));
+    if (it == entries_.end()) {
+        entries_.emplace(Key(info.service_type, info.service_name),
+                         Entry{info.addr, info.port, expiry, generation_});
+        deltas->push_back({Change::Added, info});
+        return;
+    }
+
+    Entry& entry = it->second;
+    entry.expiry = expiry;
+    entry.generation = generation_;
+    if (entry.addr != info.addr || entry.port != info.port) {
+        entry.addr = info.addr;
+        entry.port = info.port;
+        deltas->push_back({Change::Updated, info});
+    }
+}
+
+void MdnsServiceCache::NotifyLocked(const std::vector<Delta>& deltas) {
+    if (deltas.empty()) return;
+    for (const auto& [id, listener] : listeners_) {
+        listener(deltas);
+    }
+}
+
+void MdnsServiceCache::Update(const MdnsInfo& info, Clock::time_point now, Clock::duration ttl) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Delta> deltas;
+    UpdateLocked(info, ExpiryTime(now, ttl), &deltas);
+    NotifyLocked(deltas);
+}
+
+void MdnsServiceCache::Replace(std::string_view service_type, const std::vector<MdnsInfo>& infos,
+                               Clock::time_point now, Clock::duration ttl) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Delta> deltas;
+    Clock::time_point expiry = ExpiryTime(now, ttl);
+
+    // Everything of |service_type| that isn't in |infos| goes away: refresh what is, which stamps
+    // it with the new generation, then drop whatever still has an older one.
+    ++generation_;
+    for (const MdnsInfo& info : infos) {
+        if (info.service_type != service_type) {
+            LOG(WARNING) << "ignoring " << info.service_name << "." << info.service_type
+                         << " when replacing services of type " << service_type;
+            continue;
+        }
+        UpdateLocked(info, expiry, &deltas);
+    }
+
+    for (auto it = entries_.lower_bound(KeyView(service_type, ""));
+         it != entries_.end() && it->first.first == service_type;) {
+        if (it->second.generation != generation_) {
+            deltas.push_back({Change::Removed, ToInfo(it->first, it->second)});
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    NotifyLocked(deltas);
+}
+
+void MdnsServiceCache::Remove(std::string_view service_type, std::string_view instance_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(KeyView(service_type, instance_name));
+    if (it == entries_.end()) return;
+
+    std::vector<Delta> deltas = {{Change::Removed, ToInfo(it->first, it->second)}};
+    entries_.erase(it);
+    NotifyLocked(deltas);
+}
+
+void MdnsServiceCache::Expire(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Delta> deltas;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.expiry < now) {
+            D("%s.%s expired", it->first.second.c_str(), it->first.first.c_str());
+            deltas.push_back({Change::Removed, ToInfo(it->first, it->second)});
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    NotifyLocked(deltas);
+}
+
+std::optional<MdnsInfo> MdnsServiceCache::Find(std::string_view service_type,
+                                               std::string_view instance_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(KeyView(service_type, instance_name));
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    return ToInfo(it->first, it->second);
+}
+
+std::vector<MdnsInfo> MdnsServiceCache::List() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<MdnsInfo> result;
+    result.reserve(entries_.size());
+    for (const auto& [key, entry] : entries_) {
+        result.push_back(ToInfo(key, entry));
+    }
+    return result;
+}
+
+size_t MdnsServiceCache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t MdnsServiceCache::AddListener(Listener listener) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Delta> deltas;
+    deltas.reserve(entries_.size());
+    for (const auto& [key, entry] : entries_) {
+        deltas.push_back({Change::Added, ToInfo(key, entry)});
+    }
+    listener(deltas);
+
+    size_t id = next_listener_id_++;
+    listeners_.emplace(id, std::move(listener));
+    return id;
+}
+
+void MdnsServiceCache::RemoveListener(size_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    listeners_.erase(id);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <android-base/macros.h>
+#include <android-base/thread_annotations.h>
+
+#include "adb_mdns.h"
+
+// The services found by mDNS discovery, indexed by service type and instance name, so that
+// looking one up or listing them doesn't have to walk everything the discovery backend knows
+// about.
+//
+// Entries expire if the backend doesn't report them again within their TTL. Listeners are told
+// about every service that is added, changes address or port, or goes away.
+//
+// In MdnsInfo, |service_name| is the instance name, and |service_type| the service type (e.g.
+// "_adb-tls-connect._tcp").
+class MdnsServiceCache {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // A TTL for services that only go away when the backend says so.
+    static constexpr Clock::duration kNoExpiry = Clock::duration::max();
+
+    enum class Change {
+        Added,
+        Updated,
+        Removed,
+    };
+
+    struct Delta {
+        Change change;
+        MdnsInfo info;
+    };
+
+    // Called with the cache locked, so it must not call back into the cache.
+    using Listener = std::function<void(const std::vector<Delta>&)>;
+
+    MdnsServiceCache() = default;
+
+    static MdnsServiceCache& Global();
+
+    // Adds or refreshes |info|, which then expires |ttl| after |now|.
+    void Update(const MdnsInfo& info, Clock::time_point now, Clock::duration ttl);
+
+    // Replaces the services of |service_type| with |infos|, e.g. with everything the backend
+    // currently knows about.
+    void Replace(std::string_view service_type, const std::vector<MdnsInfo>& infos,
+                 Clock::time_point now, Clock::duration ttl);
+
+    void Remove(std::string_view service_type, std::string_view instance_name);
+
+    // Drops the services whose TTL ran out before |now|.
+    void Expire(Clock::time_point now);
+
+    std::optional<MdnsInfo> Find(std::string_view service_type, std::string_view instance_name);
+
+    // All services, ordered by service type and then by instance name.
+    std::vector<MdnsInfo> List();
+
+    size_t size();
+
+    // Registers |listener|, and immediately calls it with every known service as Added, even if
+    // there are none.
+    size_t AddListener(Listener listener);
+    void RemoveListener(size_t id);
+
+  private:
+    struct Entry {
+        std::string addr;
+        uint16_t port;
+        Clock::time_point expiry;
+        // The last Replace() that saw this entry.
+        uint64_t generation;
+    };
+
+    // (service type, instance name)
+    using Key = std::pair<std::string, std::string>;
+    using KeyView = std::pair<std::string_view, std::string_view>;
+
+    // Allows looking entries up without copying the names.
+    struct KeyLess {
+        using is_transparent = void;
+
+        static KeyView View(const Key& key) { return {key.first, key.second}; }
+        static KeyView View(const KeyView& key) { return key; }
+
+        template <typename A, typename B>
+        bool operator()(const A& a, const B& b) const {
+            return View(a) < View(b);
+        }
+    };
+
+    static MdnsInfo ToInfo(const Key& key, const Entry& entry);
+    static Clock::time_point ExpiryTime(Clock::time_point now, Clock::duration ttl);
+
+    // Adds or refreshes |info|, and records the change in |deltas| if there was one.
+    void UpdateLocked(const MdnsInfo& info, Clock::time_point expiry, std::vector<Delta>* deltas)
+            REQUIRES(mutex_);
+    void NotifyLocked(const std::vector<Delta>& deltas) REQUIRES(mutex_);
+
+    std::mutex mutex_;
+    std::map<Key, Entry, KeyLess> entries_ GUARDED_BY(mutex_);
+    std::map<size_t, Listener> listeners_ GUARDED_BY(mutex_);
+    size_t next_listener_id_ GUARDED_BY(mutex_) = 0;
+    uint64_t generation_ GUARDED_BY(mutex_) = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(MdnsServiceCache);
+};
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG MDNS
+
+#include "sysdeps.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "adb_trace.h"
+#include "client/mdns_service_cache.h"
+
+using namespace std::chrono_literals;
+
+enum class Lookup {
+    // What the host used to do: go through everything discovery knows about for every lookup.
+    Walk,
+    Cache,
+};
+
+static constexpr const char* kConnect = "_adb-tls-connect._tcp";
+
+// What a lab subnet full of devices announces: one connect service per device.
+static std::vector<MdnsInfo> Announcements(size_t count) {
+    std::vector<MdnsInfo> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        result.emplace_back(android::base::StringPrintf("adb-%08zx-AbCdEf", i), kConnect,
+                            android::base::StringPrintf("10.%zu.%zu.%zu", (i >> 16) & 0xff,
+                                                        (i >> 8) & 0xff, i & 0xff),
+                            5555);
+    }
+    return result;
+}
+
+template <Lookup lookup>
+static void BM_MdnsLookup(benchmark::State& state) {
+    size_t count = state.range(0);
+    std::vector<MdnsInfo> services = Announcements(count);
+    MdnsServiceCache cache;
+    cache.Replace(kConnect, services, MdnsServiceCache::Clock::now(), 120s);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        // Look the devices up in a different order than they were announced in.
+        const std::string& name = services[(i++ * 7919) % count].service_name;
+        std::optional<MdnsInfo> info;
+        if (lookup == Lookup::Walk) {
+            // The watchers hand out a snapshot of their services.
+            std::vector<std::reference_wrapper<const MdnsInfo>> snapshot(services.begin(),
+                                                                         services.end());
+            for (const MdnsInfo& s : snapshot) {
+                if (s.service_name == name) {
+                    info.emplace(s);
+                }
+            }
+        } else {
+            info = cache.Find(kConnect, name);
+        }
+        benchmark::DoNotOptimize(info);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_MdnsLookup, Lookup::Walk)->Arg(100)->Arg(1000)->Arg(10000);
+BENCHMARK_TEMPLATE(BM_MdnsLookup, Lookup::Cache)->Arg(100)->Arg(1000)->Arg(10000);
+
+// A responder announcing all of its records, the first time around (everything is new and
+// reported to `adb mdns track`) and again later (nothing changed, nothing to report).
+static void BM_MdnsAnnounce(benchmark::State& state) {
+    std::vector<MdnsInfo> services = Announcements(state.range(0));
+    bool repeat = state.range(1);
+    size_t deltas = 0;
+    MdnsServiceCache cache;
+    cache.AddListener([&](const std::vector<MdnsServiceCache::Delta>& d) { deltas += d.size(); });
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto now = MdnsServiceCache::Clock::now();
+        cache.Replace(kConnect, repeat ? services : std::vector<MdnsInfo>(), now, 120s);
+        state.ResumeTiming();
+
+        for (const MdnsInfo& info : services) {
+            cache.Update(info, now, 120s);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * services.size());
+    benchmark::DoNotOptimize(deltas);
+}
+BENCHMARK(BM_MdnsAnnounce)->ArgsProduct({{100, 1000, 10000}, {0, 1}});
+
+// The periodic resynchronization with the discovery backend.
+static void BM_MdnsResync(benchmark::State& state) {
+    std::vector<MdnsInfo> services = Announcements(state.range(0));
+    MdnsServiceCache cache;
+    cache.Replace(kConnect, services, MdnsServiceCache::Clock::now(), 120s);
+    for (auto _ : state) {
+        cache.Replace(kConnect, services, MdnsServiceCache::Clock::now(), 120s);
+    }
+    state.SetItemsProcessed(state.iterations() * services.size());
+}
+BENCHMARK(BM_MdnsResync)->Arg(100)->Arg(1000)->Arg(10000);
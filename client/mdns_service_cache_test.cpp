@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/mdns_service_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using Change = MdnsServiceCache::Change;
+using Delta = MdnsServiceCache::Delta;
+
+static constexpr const char* kConnect = "_adb-tls-connect._tcp";
+static constexpr const char* kPairing = "_adb-tls-pairing._tcp";
+
+static std::string Describe(const std::vector<Delta>& deltas) {
+    std::string result;
+    for (const auto& delta : deltas) {
+        switch (delta.change) {
+            case Change::Added:
+                result += "+";
+                break;
+            case Change::Updated:
+                result += "~";
+                break;
+            case Change::Removed:
+                result += "-";
+                break;
+        }
+        result += delta.info.service_name + " " + delta.info.addr + ":" +
+                  std::to_string(delta.info.port) + "\n";
+    }
+    return result;
+}
+
+TEST(MdnsServiceCache, find) {
+    MdnsServiceCache cache;
+    auto now = MdnsServiceCache::Clock::now();
+    cache.Update(MdnsInfo("adb-1", kConnect, "192.168.1.1", 5555), now, 120s);
+    cache.Update(MdnsInfo("adb-1", kPairing, "192.168.1.1", 37000), now, 120s);
+    ASSERT_EQ(2U, cache.size());
+
+    auto info = cache.Find(kConnect, "adb-1");
+    ASSERT_TRUE(info.has_value());
+    ASSERT_EQ("adb-1", info->service_name);
+    ASSERT_EQ(kConnect, info->service_type);
+    ASSERT_EQ("192.168.1.1", info->addr);
+    ASSERT_EQ(5555, info->port);
+
+    info = cache.Find(kPairing, "adb-1");
+    ASSERT_TRUE(info.has_value());
+    ASSERT_EQ(37000, info->port);
+
+    ASSERT_FALSE(cache.Find(kConnect, "adb-2").has_value());
+    ASSERT_FALSE(cache.Find("_adb._tcp", "adb-1").has_value());
+
+    // Updating an entry replaces it.
+    cache.Update(MdnsInfo("adb-1", kConnect, "192.168.1.2", 5556), now, 120s);
+    ASSERT_EQ(2U, cache.size());
+    info = cache.Find(kConnect, "adb-1");
+    ASSERT_EQ("192.168.1.2", info->addr);
+    ASSERT_EQ(5556, info->port);
+
+    cache.Remove(kConnect, "adb-1");
+    ASSERT_FALSE(cache.Find(kConnect, "adb-1").has_value());
+    ASSERT_EQ(1U, cache.size());
+}
+
+TEST(MdnsServiceCache, list) {
+    MdnsServiceCache cache;
+    auto now = MdnsServiceCache::Clock::now();
+    cache.Update(MdnsInfo("b", kPairing, "10.0.0.2", 2), now, 120s);
+    cache.Update(MdnsInfo("b", kConnect, "10.0.0.2", 1), now, 120s);
+    cache.Update(MdnsInfo("a", kConnect, "10.0.0.1", 1), now, 120s);
+
+    auto list = cache.List();
+    ASSERT_EQ(3U, list.size());
+    ASSERT_EQ("a", list[0].service_name);
+    ASSERT_EQ(kConnect, list[0].service_type);
+    ASSERT_EQ("b", list[1].service_name);
+    ASSERT_EQ(kConnect, list[1].service_type);
+    ASSERT_EQ("b", list[2].service_name);
+    ASSERT_EQ(kPairing, list[2].service_type);
+}
+
+TEST(MdnsServiceCache, expire) {
+    MdnsServiceCache cache;
+    auto now = MdnsServiceCache::Clock::now();
+    cache.Update(MdnsInfo("short", kConnect, "10.0.0.1", 1), now, 10s);
+    cache.Update(MdnsInfo("long", kConnect, "10.0.0.2", 1), now, 60s);
+    cache.Update(MdnsInfo("forever", kConnect, "10.0.0.3", 1), now, MdnsServiceCache::kNoExpiry);
+
+    cache.Expire(now + 5s);
+    ASSERT_EQ(3U, cache.size());
+
+    cache.Expire(now + 30s);
+    ASSERT_FALSE(cache.Find(kConnect, "short").has_value());
+    ASSERT_EQ(2U, cache.size());
+
+    // Reporting a service again pushes its expiry back.
+    cache.Update(MdnsInfo("long", kConnect, "10.0.0.2", 1), now + 30s, 60s);
+    cache.Expire(now + 80s);
+    ASSERT_TRUE(cache.Find(kConnect, "long").has_value());
+
+    cache.Expire(now + 100s);
+    ASSERT_FALSE(cache.Find(kConnect, "long").has_value());
+    ASSERT_TRUE(cache.Find(kConnect, "forever").has_value());
+}
+
+TEST(MdnsServiceCache, replace) {
+    MdnsServiceCache cache;
+    auto now = MdnsServiceCache::Clock::now();
+    cache.Update(MdnsInfo("a", kConnect, "10.0.0.1", 1), now, 120s);
+    cache.Update(MdnsInfo("b", kConnect, "10.0.0.2", 1), now, 120s);
+    cache.Update(MdnsInfo("a", kPairing, "10.0.0.1", 2), now, 120s);
+
+    std::vector<Delta> deltas;
+    cache.AddListener([&](const std::vector<Delta>& d) { deltas = d; });
+
+    cache.Replace(kConnect,
+                  {MdnsInfo("a", kConnect, "10.0.0.1", 1), MdnsInfo("c", kConnect, "10.0.0.3", 1)},
+                  now + 60s, 120s);
+    ASSERT_EQ("+c 10.0.0.3:1\n-b 10.0.0.2:1\n", Describe(deltas));
+
+    // Other service types are left alone.
+    ASSERT_TRUE(cache.Find(kPairing, "a").has_value());
+    ASSERT_EQ(3U, cache.size());
+
+    // The services that were still there were refreshed.
+    cache.Expire(now + 150s);
+    ASSERT_TRUE(cache.Find(kConnect, "a").has_value());
+    ASSERT_FALSE(cache.Find(kPairing, "a").has_value());
+
+    // The second of two identical replacements changes nothing.
+    deltas.clear();
+    cache.Replace(kConnect, {MdnsInfo("a", kConnect, "10.0.0.1", 1)}, now + 150s,
+                  MdnsServiceCache::kNoExpiry);
+    cache.Replace(kConnect, {MdnsInfo("a", kConnect, "10.0.0.1", 1)}, now + 150s,
+                  MdnsServiceCache::kNoExpiry);
+    ASSERT_EQ("-c 10.0.0.3:1\n", Describe(deltas));
+    ASSERT_EQ(1U, cache.size());
+}
+
+TEST(MdnsServiceCache, listener) {
+    MdnsServiceCache cache;
+    auto now = MdnsServiceCache::Clock::now();
+    cache.Update(MdnsInfo("a", kConnect, "10.0.0.1", 1), now, 120s);
+
+    std::string events;
+    size_t id = cache.AddListener([&](const std::vector<Delta>& d) { events += Describe(d); });
+    ASSERT_EQ("+a 10.0.0.1:1\n", events);
+
+    // Refreshing a service without changing it isn't news.
+    events.clear();
+    cache.Update(MdnsInfo("a", kConnect, "10.0.0.1", 1), now + 10s, 120s);
+    ASSERT_EQ("", events);
+
+    cache.Update(MdnsInfo("a", kConnect, "10.0.0.9", 1), now + 10s, 120s);
+    cache.Update(MdnsInfo("b", kConnect, "10.0.0.2", 1), now + 10s, 120s);
+    cache.Remove(kConnect, "a");
+    cache.Remove(kConnect, "a");
+    cache.Expire(now + 200s);
+    ASSERT_EQ("~a 10.0.0.9:1\n+b 10.0.0.2:1\n-a 10.0.0.9:1\n-b 10.0.0.2:1\n", events);
+
+    cache.RemoveListener(id);
+    events.clear();
+    cache.Update(MdnsInfo("c", kConnect, "10.0.0.3", 1), now, 120s);
+    ASSERT_EQ("", events);
+
+    // New listeners are told about what's there, or that there's nothing, right away.
+    MdnsServiceCache empty;
+    bool called = false;
+    empty.AddListener([&](const std::vector<Delta>& d) {
+        ASSERT_TRUE(d.empty());
+        called = true;
+    });
+    ASSERT_TRUE(called);
+}
@@ -37,6 +37,7 @@
 #include "adb_trace.h"
 #include "adb_utils.h"
 #include "adb_wifi.h"
+#include "client/mdns_service_cache.h"
 #include "client/mdns_utils.h"
 #include "fdevent/fdevent.h"
 #include "sysdeps.h"
@@ -213,6 +214,20 @@ class ResolvedService : public AsyncServiceRef {
 
         auto ip_addr = s->ip_address();
         auto port = s->port();
+
+        // mDNSResponder tells us when a service goes away, so it doesn't need to expire from the
+        // cache.
+        MdnsServiceCache::Global().Update(
+                MdnsInfo(service_name, kADBDNSServices[*service_index], ip_addr, port),
+                MdnsServiceCache::Clock::now(), MdnsServiceCache::kNoExpiry);
+
+        // A device that is back on the network may be waiting to be reconnected, either by its
+        // mDNS name or by its address.
+        reconnect_transport_now(
+                android::base::StringPrintf("%s.%s", service_name.c_str(), reg_type.c_str()));
+        reconnect_transport_now(android::base::StringPrintf(
+                s->sa_family_ == AF_INET6 ? "[%s]:%hu" : "%s:%hu", ip_addr.c_str(), port));
+
         if (adb_DNSServiceShouldAutoConnect(reg_type, service_name)) {
             std::string response;
             D("Attempting to connect service_name=[%s], regtype=[%s] ip_addr=(%s:%hu)",
@@ -536,6 +551,9 @@ void DNSSD_API on_service_browsed(DNSServiceRef sdref, DNSServiceFlags flags,
         D("%s: Discover lost service_name=[%s] regtype=[%s] domain=[%s]", __func__, service_name,
           regtype, domain);
         ResolvedService::RemoveDNSService(regtype, service_name);
+        if (auto index = adb_DNSServiceIndexByName(regtype)) {
+            MdnsServiceCache::Global().Remove(kADBDNSServices[*index], service_name);
+        }
     }
 }
 
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG TRANSPORT
+
+#include "sysdeps.h"
+
+#include "client/port_prober.h"
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <android-base/logging.h>
+
+#include "adb_trace.h"
+#include "adb_utils.h"
+#include "fdevent/fdevent.h"
+#include "sysdeps/network.h"
+
+LoopbackPortProber::LoopbackPortProber(std::vector<int> ports, ResultCallback on_result,
+                                       DoneCallback on_done, Options options)
+    : pending_(ports.begin(), ports.end()),
+      options_(std::move(options)),
+      on_result_(std::move(on_result)),
+      on_done_(std::move(on_done)) {}
+
+void LoopbackPortProber::Start(std::vector<int> ports, ResultCallback on_result,
+                               DoneCallback on_done, Options options) {
+    fdevent_check_looper();
+    options.max_in_flight = std::max<size_t>(1, options.max_in_flight);
+    if (!options.connect) {
+        options.connect = network_loopback_client_nonblocking;
+    }
+    auto* prober = new LoopbackPortProber(std::move(ports), std::move(on_result),
+                                          std::move(on_done), std::move(options));
+    prober->StartMore();
+}
+
+bool LoopbackPortProber::Connect(Probe* probe) {
+    std::string error;
+    int fd = options_.connect(probe->ipv6, probe->port, &error);
+    if (fd == -1) {
+        VLOG(TRANSPORT) << "probing port " << probe->port << (probe->ipv6 ? " (IPv6)" : "")
+                        << " failed: " << error;
+        return false;
+    }
+
+    probe->fde = fdevent_create(fd, &LoopbackPortProber::OnEvent, probe);
+    fdevent_set(probe->fde, FDE_WRITE);
+    fdevent_set_timeout(probe->fde, options_.timeout);
+    return true;
+}
+
+void LoopbackPortProber::StartMore() {
+    while (in_flight_ < options_.max_in_flight && !pending_.empty()) {
+        int port = pending_.front();
+        pending_.pop_front();
+        if (!Wanted(port)) {
+            continue;
+        }
+
+        auto* probe = new Probe{this, port, false, nullptr};
+        bool connecting = Connect(probe);
+        if (!connecting) {
+            probe->ipv6 = true;
+            connecting = Connect(probe);
+        }
+        if (connecting) {
+            ++in_flight_;
+        } else {
+            on_result_(probe->port, unique_fd());
+            delete probe;
+        }
+    }
+
+    if (in_flight_ == 0 && pending_.empty()) {
+        DoneCallback on_done = std::move(on_done_);
+        delete this;
+        on_done();
+    }
+}
+
+void LoopbackPortProber::Finish(Probe* probe, unique_fd fd) {
+    --in_flight_;
+    // Whatever made the port unwanted while the connect was in progress takes precedence.
+    if (Wanted(probe->port)) {
+        on_result_(probe->port, std::move(fd));
+    }
+    delete probe;
+    StartMore();
+}
+
+void LoopbackPortProber::OnEvent(fdevent* fde, unsigned events, void* arg) {
+    auto* probe = static_cast<Probe*>(arg);
+    LoopbackPortProber* prober = probe->prober;
+
+    int error = ETIMEDOUT;
+    if (!(events & FDE_TIMEOUT)) {
+        socklen_t len = sizeof(error);
+        if (getsockopt(fde->fd.get(), SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+            error = errno;
+        }
+    }
+
+    if (error == 0) {
+        unique_fd fd = fdevent_release(fde);
+        set_file_block_mode(fd, true);
+        prober->Finish(probe, std::move(fd));
+        return;
+    }
+
+    fdevent_destroy(fde);
+    probe->fde = nullptr;
+    VLOG(TRANSPORT) << "probing port " << probe->port << (probe->ipv6 ? " (IPv6)" : "")
+                    << " failed: " << strerror(error);
+    if (!probe->ipv6) {
+        probe->ipv6 = true;
+        if (prober->Connect(probe)) {
+            return;
+        }
+    }
+    prober->Finish(probe, unique_fd());
+}
+
+#endif  // !defined(_WIN32)
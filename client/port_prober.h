@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/macros.h>
+
+#include "adb_unique_fd.h"
+
+#if !defined(_WIN32)
+
+struct fdevent;
+
+// Connects to many TCP ports on loopback at once, with nonblocking connects driven by the fdevent
+// loop, rather than waiting for each connect in turn. Like network_loopback_client(), each port is
+// tried on IPv4 first, and then on IPv6.
+//
+// Everything happens on the fdevent looper, including the callbacks.
+class LoopbackPortProber {
+  public:
+    // Called with each port, and the connected socket (in blocking mode) or -1 if nothing accepted
+    // the connection in time.
+    using ResultCallback = std::function<void(int port, unique_fd fd)>;
+    // Called once every port has had its result.
+    using DoneCallback = std::function<void()>;
+
+    static constexpr size_t kDefaultMaxInFlight = 64;
+    static constexpr std::chrono::milliseconds kDefaultTimeout = std::chrono::seconds(1);
+
+    struct Options {
+        // How many connects may be in progress at a time.
+        size_t max_in_flight = kDefaultMaxInFlight;
+        // How long each connect is given before it's given up on.
+        std::chrono::milliseconds timeout = kDefaultTimeout;
+        // Whether a port still needs probing, e.g. because nothing else connected to what listens
+        // on it meanwhile. Asked before connecting, and again once the connect finished. Ports it
+        // returns false for get no result, and their connection, if any, is closed. If unset,
+        // every port is wanted.
+        std::function<bool(int port)> wanted;
+        // Starts a nonblocking connect, see network_loopback_client_nonblocking(). Only replaced
+        // by tests.
+        std::function<int(bool ipv6, int port, std::string* error)> connect;
+    };
+
+    // Probes |ports|. Must be called on the looper.
+    static void Start(std::vector<int> ports, ResultCallback on_result, DoneCallback on_done,
+                      Options options);
+    static void Start(std::vector<int> ports, ResultCallback on_result, DoneCallback on_done) {
+        Start(std::move(ports), std::move(on_result), std::move(on_done), Options());
+    }
+
+  private:
+    struct Probe {
+        LoopbackPortProber* prober;
+        int port;
+        bool ipv6;
+        fdevent* fde;
+    };
+
+    LoopbackPortProber(std::vector<int> ports, ResultCallback on_result, DoneCallback on_done,
+                       Options options);
+
+    // Starts connects until |options_.max_in_flight| are in progress, and deletes this once
+    // everything is done.
+    void StartMore();
+    // Returns false if connecting failed right away.
+    bool Connect(Probe* probe);
+    void Finish(Probe* probe, unique_fd fd);
+    bool Wanted(int port) const { return !options_.wanted || options_.wanted(port); }
+
+    static void OnEvent(fdevent* fde, unsigned events, void* arg);
+
+    std::deque<int> pending_;
+    size_t in_flight_ = 0;
+    const Options options_;
+    ResultCallback on_result_;
+    DoneCallback on_done_;
+
+    DISALLOW_COPY_AND_ASSIGN(LoopbackPortProber);
+};
+
+#endif  // !defined(_WIN32)
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/port_prober.h"
+
+#include <gtest/gtest.h>
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "adb_io.h"
+#include "fdevent/fdevent.h"
+#include "fdevent/fdevent_test.h"
+#include "sysdeps.h"
+#include "sysdeps/network.h"
+
+using namespace std::chrono_literals;
+
+class LoopbackPortProberTest : public FdeventTest {
+  protected:
+    // Listens on a free port, like an emulator would on its adb port.
+    int StartEmulator() {
+        std::string error;
+        unique_fd fd(network_loopback_server(0, SOCK_STREAM, &error, true));
+        EXPECT_NE(-1, fd.get()) << error;
+        int port = adb_socket_get_local_port(fd);
+        emulators_.push_back(std::move(fd));
+        return port;
+    }
+
+    // Returns a port that nothing listens on.
+    int FreePort() {
+        std::string error;
+        unique_fd fd(network_loopback_server(0, SOCK_STREAM, &error, true));
+        EXPECT_NE(-1, fd.get()) << error;
+        return adb_socket_get_local_port(fd);
+    }
+
+    // Probes |ports| and returns which ones accepted the connection.
+    std::map<int, bool> Probe(std::vector<int> ports,
+                              LoopbackPortProber::Options options = LoopbackPortProber::Options()) {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::map<int, bool> results;
+        bool done = false;
+
+        // Keep track of the connects in progress.
+        options.connect = [this](bool ipv6, int port, std::string* error) {
+            std::lock_guard<std::mutex> lock(connect_mutex_);
+            if (!connecting_.contains(port)) {
+                ++connect_count_[port];
+            }
+            connecting_.insert(port);
+            peak_connecting_ = std::max(peak_connecting_, connecting_.size());
+            if (on_connect_) on_connect_(port);
+            return network_loopback_client_nonblocking(ipv6, port, error);
+        };
+
+        fdevent_run_on_looper([&]() {
+            LoopbackPortProber::Start(
+                    ports,
+                    [&](int port, unique_fd fd) {
+                        {
+                            std::lock_guard<std::mutex> lock(connect_mutex_);
+                            connecting_.erase(port);
+                        }
+                        std::lock_guard<std::mutex> lock(mutex);
+                        EXPECT_FALSE(results.contains(port));
+                        results[port] = fd != -1;
+                        if (fd != -1) {
+                            // The socket is usable with blocking writes.
+                            EXPECT_TRUE(WriteFdExactly(fd, "ping"));
+                        }
+                    },
+                    [&]() {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        done = true;
+                        cv.notify_one();
+                    },
+                    std::move(options));
+        });
+
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cv.wait_for(lock, 10s, [&]() { return done; }));
+        return results;
+    }
+
+    std::mutex connect_mutex_;
+    std::set<int> connecting_;
+    size_t peak_connecting_ = 0;
+    std::map<int, size_t> connect_count_;
+    std::function<void(int port)> on_connect_;
+
+    std::vector<unique_fd> emulators_;
+};
+
+TEST_F(LoopbackPortProberTest, finds_listening_ports) {
+    PrepareThread();
+
+    std::vector<int> ports;
+    std::map<int, bool> expected;
+    for (size_t i = 0; i < 8; ++i) {
+        int port = StartEmulator();
+        ports.push_back(port);
+        expected[port] = true;
+
+        port = FreePort();
+        ports.push_back(port);
+        expected[port] = false;
+    }
+
+    ASSERT_EQ(expected, Probe(ports));
+    ASSERT_EQ(0U, fdevent_installed_count());
+    TerminateThread();
+}
+
+TEST_F(LoopbackPortProberTest, limits_connects_in_flight) {
+    PrepareThread();
+
+    std::vector<int> ports;
+    std::map<int, bool> expected;
+    for (size_t i = 0; i < 8; ++i) {
+        int port = StartEmulator();
+        ports.push_back(port);
+        expected[port] = true;
+
+        port = FreePort();
+        ports.push_back(port);
+        expected[port] = false;
+    }
+
+    for (size_t max_in_flight : {1, 3, 64}) {
+        peak_connecting_ = 0;
+        LoopbackPortProber::Options options;
+        options.max_in_flight = max_in_flight;
+        ASSERT_EQ(expected, Probe(ports, options));
+        ASSERT_LE(peak_connecting_, max_in_flight);
+        // Connects to free ports may fail right away, but the ones to the emulators stay in
+        // flight until the looper gets to them.
+        ASSERT_GE(peak_connecting_, std::min<size_t>(max_in_flight, 8));
+        ASSERT_TRUE(connecting_.empty());
+    }
+    ASSERT_EQ(0U, fdevent_installed_count());
+    TerminateThread();
+}
+
+TEST_F(LoopbackPortProberTest, unwanted_ports) {
+    PrepareThread();
+
+    int registered_before = StartEmulator();
+    int registered_during = StartEmulator();
+    int other = StartEmulator();
+
+    // One emulator registered itself before probing started, another one while it was being
+    // connected to: neither gets a result, and the connection to the second one is dropped.
+    std::set<int> registered = {registered_before};
+    on_connect_ = [&](int port) {
+        if (port == registered_during) registered.insert(port);
+    };
+    LoopbackPortProber::Options options;
+    options.wanted = [&registered](int port) { return !registered.contains(port); };
+
+    std::map<int, bool> expected = {{other, true}};
+    ASSERT_EQ(expected, Probe({registered_before, registered_during, other}, options));
+    ASSERT_FALSE(connect_count_.contains(registered_before));
+    ASSERT_EQ(1U, connect_count_[registered_during]);
+    ASSERT_EQ(0U, fdevent_installed_count());
+    TerminateThread();
+}
+
+TEST_F(LoopbackPortProberTest, no_ports) {
+    PrepareThread();
+    ASSERT_TRUE(Probe({}).empty());
+    TerminateThread();
+}
+
+#endif  // !defined(_WIN32)
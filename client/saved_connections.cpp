@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG ADB
+
+#include "sysdeps.h"
+
+#include "client/saved_connections.h"
+
+#include <utility>
+
+#include <openssl/base64.h>
+
+// The file has a line per entry:
+//   <address> TAB <serial> TAB <base64 TLS session, or nothing>
+static std::string EncodeSession(const std::string& session) {
+    size_t encoded_size;
+    if (session.empty() || !EVP_EncodedLength(&encoded_size, session.size())) {
+        return "";
+    }
+    std::string result(encoded_size, '\0');
+    size_t actual = EVP_EncodeBlock(reinterpret_cast<uint8_t*>(result.data()),
+                                    reinterpret_cast<const uint8_t*>(session.data()),
+                                    session.size());
+    result.resize(actual);
+    return result;
+}
+
+static bool DecodeSession(const std::string& encoded, std::string* session) {
+    if (encoded.empty()) {
+        session->clear();
+        return true;
+    }
+    size_t decoded_size;
+    if (!EVP_DecodedLength(&decoded_size, encoded.size())) {
+        return false;
+    }
+    session->resize(decoded_size);
+    if (!EVP_DecodeBase64(reinterpret_cast<uint8_t*>(session->data()), &decoded_size,
+                          decoded_size, reinterpret_cast<const uint8_t*>(encoded.data()),
+                          encoded.size())) {
+        return false;
+    }
+    session->resize(decoded_size);
+    return true;
+}
+
+SavedConnections::SavedConnections(std::string path)
+    : store_(std::move(path), "saved connections", 3) {}
+
+void SavedConnections::Load() {
+    std::vector<Entry> entries =
+            store_.Load<Entry>([](LineStore::Record& fields) -> std::optional<Entry> {
+                Entry entry;
+                if (fields[0].empty() || fields[1].empty() ||
+                    !DecodeSession(fields[2], &entry.tls_session)) {
+                    return std::nullopt;
+                }
+                entry.address = std::move(fields[0]);
+                entry.serial = std::move(fields[1]);
+                return entry;
+            });
+
+    entries_.clear();
+    for (Entry& entry : entries) {
+        Add(std::move(entry));
+    }
+}
+
+bool SavedConnections::Save() const {
+    return store_.Save(entries_, [](const Entry& entry) {
+        return LineStore::Record{entry.address, entry.serial, EncodeSession(entry.tls_session)};
+    });
+}
+
+void SavedConnections::Add(Entry entry) {
+    if (entry.address.empty() || entry.serial.empty() || !LineStore::IsStorable(entry.address) ||
+        !LineStore::IsStorable(entry.serial)) {
+        return;
+    }
+
+    LineStore::Upsert(&entries_, std::move(entry), kMaxEntries,
+                      [](const Entry& a, const Entry& b) { return a.address == b.address; });
+}
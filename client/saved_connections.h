@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "client/line_store.h"
+
+// The devices that the server was connected to with `adb connect`, so that the next server can
+// connect to them again when it starts, e.g. after `adb kill-server`, or when a client of another
+// version replaced it.
+//
+// The file can hold TLS sessions, which are as sensitive as the keys in the same directory, which
+// is why LineStore files are only readable by their owner.
+class SavedConnections {
+  public:
+    struct Entry {
+        // What `adb connect` was given.
+        std::string address;
+        // The serial of the transport it led to.
+        std::string serial;
+        // A TLS session to resume, as serialized by SSL_SESSION_to_bytes(), or empty.
+        std::string tls_session;
+    };
+
+    static constexpr size_t kMaxEntries = 1024;
+
+    explicit SavedConnections(std::string path);
+
+    // Reads the file. A missing or unparseable file results in no entries.
+    void Load();
+
+    // Replaces the file. Returns false on failure.
+    bool Save() const;
+
+    // Adds or replaces the entry for |entry.address|.
+    void Add(Entry entry);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+  private:
+    LineStore store_;
+    std::vector<Entry> entries_;
+};
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client/saved_connections.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <android-base/file.h>
+
+TEST(SavedConnections, round_trip) {
+    TemporaryDir td;
+    std::string path = std::string(td.path) + "/connections";
+
+    SavedConnections saved(path);
+    saved.Load();
+    ASSERT_TRUE(saved.entries().empty());
+
+    std::string session("\0\x01session\n\t\xff", 13);
+    saved.Add({"192.168.1.2:5555", "192.168.1.2:5555", session});
+    saved.Add({"vsock:3:5555", "vsock:3:5555", ""});
+    ASSERT_TRUE(saved.Save());
+
+    SavedConnections loaded(path);
+    loaded.Load();
+    ASSERT_EQ(2U, loaded.entries().size());
+    ASSERT_EQ("192.168.1.2:5555", loaded.entries()[0].address);
+    ASSERT_EQ("192.168.1.2:5555", loaded.entries()[0].serial);
+    ASSERT_EQ(session, loaded.entries()[0].tls_session);
+    ASSERT_EQ("vsock:3:5555", loaded.entries()[1].address);
+    ASSERT_TRUE(loaded.entries()[1].tls_session.empty());
+}
+
+TEST(SavedConnections, replace) {
+    TemporaryDir td;
+    SavedConnections saved(std::string(td.path) + "/connections");
+
+    saved.Add({"host:5555", "serial1", ""});
+    saved.Add({"host:5555", "serial2", ""});
+    ASSERT_EQ(1U, saved.entries().size());
+    ASSERT_EQ("serial2", saved.entries()[0].serial);
+
+    // Addresses and serials that can't be stored are ignored.
+    saved.Add({"a\tb", "serial", ""});
+    saved.Add({"address", "a\nb", ""});
+    saved.Add({"", "serial", ""});
+    ASSERT_EQ(1U, saved.entries().size());
+}
+
+TEST(SavedConnections, invalid_session) {
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFile("host:5555\tserial\tnot base64!\n", tf.path));
+
+    SavedConnections saved(tf.path);
+    saved.Load();
+    ASSERT_TRUE(saved.entries().empty());
+}
@@ -20,3 +20,16 @@
 
 // Start scanning for emulator on localhost interface
 void init_emulator_scanner(const std::string& addr);
+
+// Connects to the devices in the saved connections file at |path| (see SavedConnections) again,
+// several at a time, and from then on keeps the file up to date with the devices connected to with
+// `adb connect`. If $ADB_RESTORE_CONNECTIONS is "0", neither happens, and the file is left as it
+// is.
+void restore_tcp_connections(const std::string& path);
+
+// Updates the saved connections file, if the devices connected to with `adb connect` changed.
+void save_tcp_connections();
+
+// Saves the devices connected to with `adb connect` one last time, with their TLS sessions, before
+// the server exits and disconnects them.
+void stop_saving_tcp_connections();
@@ -25,12 +25,17 @@
 #include <string.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <android-base/parsenetaddress.h>
@@ -39,9 +44,14 @@
 #include <cutils/sockets.h>
 
 #include "adb.h"
+#include "adb_auth.h"
 #include "adb_io.h"
 #include "adb_unique_fd.h"
 #include "adb_utils.h"
+#include "client/mdns_utils.h"
+#include "client/port_prober.h"
+#include "client/saved_connections.h"
+#include "fdevent/fdevent.h"
 #include "socket_spec.h"
 #include "sysdeps/chrono.h"
 
@@ -72,6 +82,187 @@ static std::mutex& emulator_transports_lock = *new std::mutex();
 static std::unordered_map<int, atransport*> emulator_transports
         [[clang::no_destroy]] GUARDED_BY(emulator_transports_lock);
 
+// The devices connected to with `adb connect`, and the file that they are saved to.
+static std::mutex& saved_connections_lock = *new std::mutex();
+static std::string& saved_connections_path GUARDED_BY(saved_connections_lock) = *new std::string();
+// Serial to the address that connect_device() was given for it.
+static auto& connected_addresses GUARDED_BY(saved_connections_lock) =
+        *new std::map<std::string, std::string>();
+// What was last written to the file, as (address, serial) pairs.
+static auto& saved_addresses GUARDED_BY(saved_connections_lock) =
+        *new std::vector<std::pair<std::string, std::string>>();
+// Don't overwrite the file with a partial list while the saved devices are being connected to, or
+// with an empty one while the server is shutting down.
+static bool restoring_connections GUARDED_BY(saved_connections_lock) = false;
+static bool saving_stopped GUARDED_BY(saved_connections_lock) = false;
+
+static void record_connected_address(const std::string& serial, const std::string& address) {
+    // Devices found with mDNS are connected to again when they're discovered again, with whatever
+    // address they have by then.
+    auto instance = mdns::mdns_parse_instance_name(serial);
+    if (instance && !instance->service_name.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(saved_connections_lock);
+    connected_addresses[serial] = address;
+}
+
+// Returns the (address, serial) pairs of the devices connected to with `adb connect`, or nullopt if
+// nothing should be saved. Must not be called with saved_connections_lock held, because
+// iterate_transports takes the transport lock, which is held while calling update_transports().
+static std::optional<std::vector<std::pair<std::string, std::string>>> current_connections() {
+    std::map<std::string, std::string> addresses;
+    {
+        std::lock_guard<std::mutex> lock(saved_connections_lock);
+        if (saved_connections_path.empty() || restoring_connections || saving_stopped) {
+            return std::nullopt;
+        }
+        addresses = connected_addresses;
+    }
+
+    std::vector<std::pair<std::string, std::string>> result;
+    iterate_transports([&addresses, &result](const atransport* t) {
+        if (t->IsTcpDevice()) {
+            auto it = addresses.find(t->serial);
+            if (it != addresses.end()) {
+                result.emplace_back(it->second, it->first);
+            }
+        }
+        return true;
+    });
+    return result;
+}
+
+void save_tcp_connections() {
+    auto current = current_connections();
+    if (!current) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(saved_connections_lock);
+    if (restoring_connections || saving_stopped || *current == saved_addresses) {
+        return;
+    }
+
+    // Sessions are only written on the way out: they change with every connection, and the ones
+    // the server has at shutdown are the freshest.
+    SavedConnections saved(saved_connections_path);
+    for (const auto& [address, serial] : *current) {
+        saved.Add({address, serial, ""});
+    }
+    if (saved.Save()) {
+        saved_addresses = std::move(*current);
+    }
+}
+
+void stop_saving_tcp_connections() {
+    auto current = current_connections();
+    if (!current) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(saved_connections_lock);
+    saving_stopped = true;
+
+    SavedConnections saved(saved_connections_path);
+    for (const auto& [address, serial] : *current) {
+        saved.Add({address, serial, adb_tls_export_session(serial)});
+    }
+    saved.Save();
+}
+
+void restore_tcp_connections(const std::string& path) {
+    // The number of devices that are connected to at the same time. Most of the time is spent
+    // waiting for the network and for the devices to respond, rather than working.
+    static constexpr size_t kMaxConcurrentRestores = 16;
+
+    SavedConnections saved(path);
+    saved.Load();
+
+    std::vector<std::string> addresses;
+    {
+        std::lock_guard<std::mutex> lock(saved_connections_lock);
+        saved_connections_path = path;
+
+        // Keep the file as it is until something changes, whether or not the devices are
+        // connected to again.
+        saved_addresses.clear();
+        for (const auto& entry : saved.entries()) {
+            saved_addresses.emplace_back(entry.address, entry.serial);
+        }
+
+        // If the saved devices aren't connected to, leave the file alone too: saving would
+        // replace it with whatever this server happens to connect to, and the next server that
+        // does restore would lose the rest.
+        const char* restore = getenv("ADB_RESTORE_CONNECTIONS");
+        if (restore && strcmp(restore, "0") == 0) {
+            saving_stopped = true;
+            return;
+        }
+
+        for (const auto& entry : saved.entries()) {
+            if (!entry.tls_session.empty()) {
+                adb_tls_import_session(entry.serial, entry.tls_session);
+            }
+            addresses.push_back(entry.address);
+        }
+        if (addresses.empty()) {
+            return;
+        }
+        restoring_connections = true;
+    }
+
+    adb_notify_tcp_restore_started();
+    std::thread([addresses = std::move(addresses)]() {
+        adb_thread_setname("restore connections");
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> connected = 0;
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < std::min(kMaxConcurrentRestores, addresses.size()); ++i) {
+            workers.emplace_back([&addresses, &next, &connected]() {
+                for (size_t j = next++; j < addresses.size(); j = next++) {
+                    std::string response;
+                    connect_device(addresses[j], &response);
+                    D("restoring connection to '%s': %s", addresses[j].c_str(), response.c_str());
+                    if (response.starts_with("connected to")) {
+                        ++connected;
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        LOG(INFO) << "reconnected to " << connected << " of " << addresses.size()
+                  << " saved devices in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count()
+                  << "ms";
+
+        {
+            std::lock_guard<std::mutex> lock(saved_connections_lock);
+            restoring_connections = false;
+        }
+        save_tcp_connections();
+        adb_notify_tcp_restore_complete();
+    }).detach();
+}
+
+static bool register_emulator(unique_fd fd, int console_port, int adb_port) {
+    D("client: connected on remote on fd %d", fd.get());
+    close_on_exec(fd.get());
+    disable_tcp_nagle(fd.get());
+    std::string serial = getEmulatorSerialString(console_port);
+    return register_socket_transport(
+            std::move(fd), std::move(serial), adb_port, true,
+            [](atransport*) { return ReconnectResult::Abort; }, false);
+}
+
 bool connect_emulator(int port) {
     std::string dummy;
     return connect_emulator_arbitrary_ports(port - 1, port, &dummy) == 0;
@@ -128,6 +319,7 @@ void connect_device(const std::string& address, std::string* response) {
             *response = android::base::StringPrintf("failed to connect to %s", serial.c_str());
         }
     } else {
+        record_connected_address(serial, address);
         *response = android::base::StringPrintf("connected to %s", serial.c_str());
     }
 }
@@ -149,26 +341,78 @@ int connect_emulator_arbitrary_ports(int console_port, int adb_port, std::string
         fd.reset(network_loopback_client(adb_port, SOCK_STREAM, error));
     }
 
-    if (fd >= 0) {
-        D("client: connected on remote on fd %d", fd.get());
-        close_on_exec(fd.get());
-        disable_tcp_nagle(fd.get());
-        std::string serial = getEmulatorSerialString(console_port);
-        if (register_socket_transport(
-                    std::move(fd), std::move(serial), adb_port, true,
-                    [](atransport*) { return ReconnectResult::Abort; }, false)) {
-            return 0;
-        }
+    if (fd >= 0 && register_emulator(std::move(fd), console_port, adb_port)) {
+        return 0;
     }
     return -1;
 }
 
+// Connects to the emulators listening on |adb_ports| (their console ports being one less), and
+// returns the ports that didn't accept the connection. An emulator that is already registered, e.g.
+// because it told the server that it started with host:emulator, counts as connected.
+static std::vector<int> ConnectEmulators(const std::vector<int>& adb_ports) {
+    std::vector<int> failed;
+#if !defined(_WIN32)
+    // With ADBHOST set, emulators are looked for on that host before loopback, which needs a
+    // resolver, so it isn't done concurrently.
+    if (!getenv("ADBHOST")) {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        LoopbackPortProber::Options options;
+        // Self-registration may beat us to an emulator, even while the connect is in progress,
+        // in which case the connection isn't needed.
+        options.wanted = [](int adb_port) {
+            return find_emulator_transport_by_adb_port(adb_port) == nullptr &&
+                   find_emulator_transport_by_console_port(adb_port - 1) == nullptr;
+        };
+        fdevent_run_on_looper([&]() {
+            LoopbackPortProber::Start(
+                    adb_ports,
+                    [&failed](int adb_port, unique_fd fd) {
+                        if (fd == -1 || !register_emulator(std::move(fd), adb_port - 1, adb_port)) {
+                            failed.push_back(adb_port);
+                        }
+                    },
+                    [&]() {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        done = true;
+                        cv.notify_one();
+                    },
+                    std::move(options));
+        });
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&done]() { return done; });
+        return failed;
+    }
+#endif
+
+    for (int port : adb_ports) {
+        // Note, uses port and port-1.
+        if (!connect_emulator(port) && find_emulator_transport_by_adb_port(port) == nullptr) {
+            failed.push_back(port);
+        }
+    }
+    return failed;
+}
+
 static void PollAllLocalPortsForEmulator() {
     // Try to connect to any number of running emulator instances.
+    std::vector<int> ports;
     for (int port = DEFAULT_ADB_LOCAL_TRANSPORT_PORT; port <= adb_local_transport_max_port;
          port += 2) {
-        connect_emulator(port);  // Note, uses port and port-1, so '=max_port' is OK.
+        ports.push_back(port);  // Note, uses port and port-1, so '=max_port' is OK.
     }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t failed = ConnectEmulators(ports).size();
+    VLOG(TRANSPORT) << "found " << ports.size() - failed << " emulators on " << ports.size()
+                    << " ports in "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count()
+                    << "ms";
 }
 
 // Retry the disconnected local port for 60 times, and sleep 1 second between two retries.
@@ -204,11 +448,17 @@ static void client_socket_thread(std::string_view) {
         std::this_thread::sleep_for(LOCAL_PORT_RETRY_INTERVAL);
 
         // Try connecting retry ports.
-        std::vector<RetryPort> next_ports;
-        for (auto& port : ports) {
+        std::vector<int> adb_ports;
+        for (const auto& port : ports) {
             VLOG(TRANSPORT) << "retry port " << port.port << ", last retry_count "
                             << port.retry_count;
-            if (connect_emulator(port.port)) {
+            adb_ports.push_back(port.port);
+        }
+        std::vector<int> failed = ConnectEmulators(adb_ports);
+
+        std::vector<RetryPort> next_ports;
+        for (auto& port : ports) {
+            if (std::find(failed.begin(), failed.end(), port.port) == failed.end()) {
                 VLOG(TRANSPORT) << "retry port " << port.port << " successfully";
                 continue;
             }
@@ -301,6 +551,7 @@ int init_socket_transport(atransport* t, unique_fd fd, int adb_port, bool is_emu
 
     // Regular tcp connection.
     auto fd_connection = std::make_unique<FdConnection>(std::move(fd));
+    fd_connection->SetTlsPeer(t->serial);
     t->SetConnection(std::make_unique<BlockingConnectionAdapter>(std::move(fd_connection)));
     return fail;
 }
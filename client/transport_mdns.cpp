@@ -24,8 +24,10 @@
 #include <arpa/inet.h>
 #endif
 
+#include <chrono>
 #include <memory>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -46,9 +48,11 @@
 #include "adb_trace.h"
 #include "adb_utils.h"
 #include "adb_wifi.h"
+#include "client/mdns_service_cache.h"
 #include "client/mdns_utils.h"
 #include "client/openscreen/platform/task_runner.h"
 #include "fdevent/fdevent.h"
+#include "socket.h"
 #include "sysdeps.h"
 
 namespace {
@@ -57,6 +61,12 @@ using namespace mdns;
 using namespace openscreen;
 using ServiceWatcher = discovery::DnsSdServiceWatcher<ServiceInfo>;
 using ServicesUpdatedState = ServiceWatcher::ServicesUpdatedState;
+using namespace std::chrono_literals;
+
+// How long a service stays in the cache without discovery reporting it again. Openscreen only
+// reports changes, so the cache is resynchronized with the watchers twice per TTL, which refreshes
+// the services that are still there.
+constexpr std::chrono::seconds kServiceTtl = 120s;
 
 struct DiscoveryState;
 DiscoveryState* g_state = nullptr;
@@ -93,6 +103,10 @@ struct DiscoveryState {
     InterfaceInfo interface_info;
 };
 
+MdnsInfo ToMdnsInfo(const ServiceInfo& si) {
+    return MdnsInfo(si.instance_name, si.service_name, si.v4_address_string(), si.port);
+}
+
 // Callback provided to service receiver for updates.
 void OnServiceReceiverResult(std::vector<std::reference_wrapper<const ServiceInfo>> infos,
                              std::reference_wrapper<const ServiceInfo> info,
@@ -102,9 +116,26 @@ void OnServiceReceiverResult(std::vector<std::reference_wrapper<const ServiceInf
                << " service_name=" << info.get().service_name << " addr=" << info.get().v4_address
                << " addrv6=" << info.get().v6_address << " total_serv=" << infos.size();
 
+    if (state == ServicesUpdatedState::EndpointDeleted) {
+        MdnsServiceCache::Global().Remove(info.get().service_name, info.get().instance_name);
+    } else {
+        MdnsServiceCache::Global().Update(ToMdnsInfo(info.get()), MdnsServiceCache::Clock::now(),
+                                          kServiceTtl);
+    }
+
     switch (state) {
         case ServicesUpdatedState::EndpointCreated:
         case ServicesUpdatedState::EndpointUpdated:
+            // A device that is back on the network may be waiting to be reconnected, either by
+            // its mDNS name or by its address.
+            reconnect_transport_now(android::base::StringPrintf(
+                    "%s.%s", info.get().instance_name.c_str(), info.get().service_name.c_str()));
+            if (info.get().v4_address) {
+                std::stringstream ss;
+                ss << info.get().v4_address << ":" << info.get().port;
+                reconnect_transport_now(ss.str());
+            }
+
             if (adb_DNSServiceShouldAutoConnect(info.get().service_name,
                                                 info.get().instance_name) &&
                 info.get().v4_address) {
@@ -160,6 +191,27 @@ std::optional<discovery::Config> GetConfigForAllInterfaces() {
     return config;
 }
 
+// Refreshes the cache with what the watchers know, and schedules the next refresh. Runs on the
+// task runner, like everything else that touches the watchers.
+void ResyncServices() {
+    auto& cache = MdnsServiceCache::Global();
+    auto now = MdnsServiceCache::Clock::now();
+    for (size_t i = 0; i < g_state->watchers.size(); ++i) {
+        const auto& watcher = g_state->watchers[i];
+        if (!watcher->is_running()) {
+            continue;
+        }
+        std::vector<MdnsInfo> infos;
+        for (const auto& s : watcher->GetServices()) {
+            infos.push_back(ToMdnsInfo(s.get()));
+        }
+        cache.Replace(kADBDNSServices[i], infos, now, kServiceTtl);
+    }
+    cache.Expire(now);
+
+    g_state->task_runner->PostTaskWithDelay([]() { ResyncServices(); }, kServiceTtl / 2);
+}
+
 void StartDiscovery() {
     CHECK(!g_state);
     g_state = new DiscoveryState();
@@ -200,23 +252,11 @@ void StartDiscovery() {
         if (g_using_bonjour) {
             VLOG(MDNS) << "Fallback to MdnsResponder client for discovery";
             g_adb_mdnsresponder_funcs = StartMdnsResponderDiscovery();
+            return;
         }
-    });
-}
 
-void ForEachService(const std::unique_ptr<ServiceWatcher>& receiver,
-                    std::string_view wanted_instance_name, adb_secure_foreach_service_callback cb) {
-    if (!receiver->is_running()) {
-        return;
-    }
-    auto services = receiver->GetServices();
-    for (const auto& s : services) {
-        if (wanted_instance_name.empty() || s.get().instance_name == wanted_instance_name) {
-            std::stringstream ss;
-            ss << s.get().v4_address;
-            cb(s.get());
-        }
-    }
+        g_state->task_runner->PostTaskWithDelay([]() { ResyncServices(); }, kServiceTtl / 2);
+    });
 }
 
 bool ConnectAdbSecureDevice(const MdnsInfo& info) {
@@ -269,11 +309,8 @@ bool adb_secure_connect_by_service_name(const std::string& instance_name) {
         return false;
     }
 
-    std::optional<MdnsInfo> info;
-    auto cb = [&](const mdns::ServiceInfo& si) {
-        info.emplace(si.instance_name, si.service_name, si.v4_address_string(), si.port);
-    };
-    ForEachService(g_state->watchers[kADBSecureConnectServiceRefIndex], instance_name, cb);
+    auto info = MdnsServiceCache::Global().Find(kADBDNSServices[kADBSecureConnectServiceRefIndex],
+                                                instance_name);
     if (info.has_value()) {
         return ConnectAdbSecureDevice(*info);
     }
@@ -302,14 +339,10 @@ std::string mdns_list_discovered_services() {
     }
 
     std::string result;
-    auto cb = [&](const mdns::ServiceInfo& si) {
-        result += android::base::StringPrintf("%s\t%s\t%s:%u\n", si.instance_name.data(),
-                                              si.service_name.data(), si.v4_address_string().data(),
-                                              si.port);
-    };
-
-    for (const auto& receiver : g_state->watchers) {
-        ForEachService(receiver, "", cb);
+    for (const MdnsInfo& info : MdnsServiceCache::Global().List()) {
+        result += android::base::StringPrintf("%s\t%s\t%s:%u\n", info.service_name.c_str(),
+                                              info.service_type.c_str(), info.addr.c_str(),
+                                              info.port);
     }
     return result;
 }
@@ -331,11 +364,7 @@ std::optional<MdnsInfo> mdns_get_connect_service_info(const std::string& name) {
         return std::nullopt;
     }
 
-    std::optional<MdnsInfo> info;
-    auto cb = [&](const ServiceInfo& si) {
-        info.emplace(si.instance_name, si.service_name, si.v4_address_string(), si.port);
-    };
-
+    auto& cache = MdnsServiceCache::Global();
     std::string reg_type;
     // Service name was provided.
     if (!mdns_instance->service_name.empty()) {
@@ -348,20 +377,18 @@ std::optional<MdnsInfo> mdns_get_connect_service_info(const std::string& name) {
         switch (*index) {
             case kADBTransportServiceRefIndex:
             case kADBSecureConnectServiceRefIndex:
-                ForEachService(g_state->watchers[*index], mdns_instance->instance_name, cb);
-                break;
+                return cache.Find(kADBDNSServices[*index], mdns_instance->instance_name);
             default:
                 D("Not a connectable service name [%s]", reg_type.data());
                 return std::nullopt;
         }
-        return info;
     }
 
     // No mdns service name provided. Just search for the instance name in all adb connect services.
     // Prefer the secured connect service over the other.
-    ForEachService(g_state->watchers[kADBSecureConnectServiceRefIndex], name, cb);
+    auto info = cache.Find(kADBDNSServices[kADBSecureConnectServiceRefIndex], name);
     if (!info.has_value()) {
-        ForEachService(g_state->watchers[kADBTransportServiceRefIndex], name, cb);
+        info = cache.Find(kADBDNSServices[kADBTransportServiceRefIndex], name);
     }
 
     return info;
@@ -384,11 +411,7 @@ std::optional<MdnsInfo> mdns_get_pairing_service_info(const std::string& name) {
         return std::nullopt;
     }
 
-    std::optional<MdnsInfo> info;
-    auto cb = [&](const ServiceInfo& si) {
-        info.emplace(si.instance_name, si.service_name, si.v4_address_string(), si.port);
-    };
-
+    auto& cache = MdnsServiceCache::Global();
     std::string reg_type;
     // Verify it's a pairing service if user explicitly inputs it.
     if (!mdns_instance->service_name.empty()) {
@@ -400,15 +423,129 @@ std::optional<MdnsInfo> mdns_get_pairing_service_info(const std::string& name) {
         }
         switch (*index) {
             case kADBSecurePairingServiceRefIndex:
-                break;
+                return cache.Find(kADBDNSServices[*index], mdns_instance->instance_name);
             default:
                 D("Not an adb pairing reg_type [%s]", reg_type.data());
                 return std::nullopt;
         }
-        return info;
     }
 
-    ForEachService(g_state->watchers[kADBSecurePairingServiceRefIndex], name, cb);
+    return cache.Find(kADBDNSServices[kADBSecurePairingServiceRefIndex], name);
+}
 
-    return info;
+namespace {
+
+// Streams the changes to the service cache to `adb mdns track` clients. Each message lists the
+// services that were added ("+"), changed address or port ("~"), or went away ("-"), one per line,
+// with the same fields as `adb mdns services`. The first messages list the services that were
+// already known.
+struct MdnsTracker {
+    asocket socket;
+    size_t id;
+    size_t listener_id;
+    // Messages, each with its length prefix, that haven't been handed to the peer yet.
+    std::string pending;
+};
+
+// Only touched on the fdevent thread, which is also where trackers are closed. The cache calls
+// listeners on the discovery thread, which hands their messages over by tracker id.
+auto& g_mdns_trackers = *new std::unordered_map<size_t, MdnsTracker*>();
+size_t g_next_mdns_tracker_id = 0;
+
+std::string FormatMdnsDeltas(const std::vector<MdnsServiceCache::Delta>& deltas) {
+    // The length prefix is four hex digits, so big batches are split over several messages.
+    constexpr size_t kMaxMessageSize = 0xffff;
+
+    std::string result;
+    std::string message;
+    auto flush = [&]() {
+        result += android::base::StringPrintf("%04zx", message.size());
+        result += message;
+        message.clear();
+    };
+
+    for (const auto& delta : deltas) {
+        char change = '+';
+        if (delta.change == MdnsServiceCache::Change::Updated) {
+            change = '~';
+        } else if (delta.change == MdnsServiceCache::Change::Removed) {
+            change = '-';
+        }
+        std::string line = android::base::StringPrintf(
+                "%c\t%s\t%s\t%s:%u\n", change, delta.info.service_name.c_str(),
+                delta.info.service_type.c_str(), delta.info.addr.c_str(), delta.info.port);
+        if (message.size() + line.size() > kMaxMessageSize) {
+            flush();
+        }
+        message += line;
+    }
+    if (!message.empty() || result.empty()) {
+        flush();
+    }
+    return result;
+}
+
+void MdnsTrackerFlush(MdnsTracker* tracker) {
+    asocket* peer = tracker->socket.peer;
+    if (!peer || tracker->pending.empty()) {
+        return;
+    }
+
+    apacket::payload_type data;
+    data.resize(tracker->pending.size());
+    memcpy(&data[0], tracker->pending.data(), tracker->pending.size());
+    tracker->pending.clear();
+
+    // This may destroy the tracker if the connection is closed.
+    peer->enqueue(peer, std::move(data));
+}
+
+void MdnsTrackerClose(asocket* socket) {
+    MdnsTracker* tracker = reinterpret_cast<MdnsTracker*>(socket);
+    asocket* peer = socket->peer;
+
+    D("mdns tracker %p removed", tracker);
+    if (peer) {
+        peer->peer = nullptr;
+        peer->close(peer);
+    }
+    MdnsServiceCache::Global().RemoveListener(tracker->listener_id);
+    g_mdns_trackers.erase(tracker->id);
+    delete tracker;
+}
+
+int MdnsTrackerEnqueue(asocket* socket, apacket::payload_type) {
+    // You can't write to a tracker.
+    MdnsTrackerClose(socket);
+    return -1;
+}
+
+void MdnsTrackerReady(asocket* socket) {
+    MdnsTrackerFlush(reinterpret_cast<MdnsTracker*>(socket));
+}
+
+}  // namespace
+
+asocket* create_mdns_tracker() {
+    fdevent_check_looper();
+    MdnsTracker* tracker = new MdnsTracker();
+    tracker->socket.enqueue = MdnsTrackerEnqueue;
+    tracker->socket.ready = MdnsTrackerReady;
+    tracker->socket.close = MdnsTrackerClose;
+    tracker->id = g_next_mdns_tracker_id++;
+    g_mdns_trackers.emplace(tracker->id, tracker);
+
+    D("mdns tracker %p created", tracker);
+    tracker->listener_id = MdnsServiceCache::Global().AddListener(
+            [id = tracker->id](const std::vector<MdnsServiceCache::Delta>& deltas) {
+                fdevent_run_on_looper([id, messages = FormatMdnsDeltas(deltas)]() {
+                    auto it = g_mdns_trackers.find(id);
+                    if (it == g_mdns_trackers.end()) {
+                        return;
+                    }
+                    it->second->pending += messages;
+                    MdnsTrackerFlush(it->second);
+                });
+            });
+    return &tracker->socket;
 }
@@ -76,6 +76,10 @@ struct Encoder {
         return true;
     }
 
+    // Makes Encode() emit everything appended so far without ending the stream, so that the
+    // other end can decode it. Encode() returns NeedInput once that's done.
+    void Flush() { flush_ = true; }
+
     virtual EncodeResult Encode(Block* output) = 0;
 
   protected:
@@ -84,6 +88,7 @@ struct Encoder {
 
     const size_t output_block_size_;
     bool finished_ = false;
+    bool flush_ = false;
     IOVector input_buffer_;
 };
 
@@ -127,6 +132,7 @@ struct NullEncoder final : public Encoder {
         output->resize(output->size() - available_out);
 
         if (input_buffer_.empty()) {
+            flush_ = false;
             return finished_ ? EncodeResult::Done : EncodeResult::NeedInput;
         }
         return EncodeResult::MoreOutput;
@@ -199,6 +205,8 @@ struct BrotliEncoder final : public Encoder {
             BrotliEncoderOperation op = BROTLI_OPERATION_PROCESS;
             if (finished_) {
                 op = BROTLI_OPERATION_FINISH;
+            } else if (flush_) {
+                op = BROTLI_OPERATION_FLUSH;
             }
 
             if (!BrotliEncoderCompressStream(encoder_.get(), op, &available_in, &next_in,
@@ -221,6 +229,17 @@ struct BrotliEncoder final : public Encoder {
                 output_bytes_left_ = output_block_size_;
                 return EncodeResult::MoreOutput;
             } else if (input_buffer_.empty()) {
+                if (flush_) {
+                    if (BrotliEncoderHasMoreOutput(encoder_.get())) {
+                        continue;
+                    }
+                    // Hand out the partially filled block.
+                    flush_ = false;
+                    output_block_.resize(output_block_size_ - output_bytes_left_);
+                    *output = std::move(output_block_);
+                    output_block_.resize(output_block_size_);
+                    output_bytes_left_ = output_block_size_;
+                }
                 return EncodeResult::NeedInput;
             }
         }
@@ -274,6 +293,10 @@ struct LZ4Decoder final : public Decoder {
                                                       : DecodeResult::MoreOutput;
         }
 
+        // A full output buffer may mean there's more to come out of what's been consumed.
+        if (!input_buffer_.empty() || available_out == output_buffer_.size()) {
+            return DecodeResult::MoreOutput;
+        }
         return DecodeResult::NeedInput;
     }
 
@@ -300,16 +323,15 @@ struct LZ4Encoder final : public Encoder {
         output_buffer_.append(std::move(header));
     }
 
-    // As an optimization, only emit a block if we have an entire output block ready, or we're done.
+    // As an optimization, only emit a block if we have an entire output block ready, or we're done
+    // or flushing.
     bool OutputReady() const {
-        return output_buffer_.size() >= output_block_size_ || lz4_finalized_;
+        return output_buffer_.size() >= output_block_size_ || lz4_finalized_ ||
+               (lz4_flushed_ && !output_buffer_.empty());
     }
 
     // TODO: Switch the output type to IOVector to remove a copy?
     EncodeResult Encode(Block* output) final {
-        size_t available_in = input_buffer_.front_size();
-        const char* next_in = input_buffer_.front_data();
-
         // LZ4 makes no guarantees about being able to recover from trying to compress with an
         // insufficiently large output buffer. LZ4F_compressBound tells us how much buffer we
         // need to compress a given number of bytes, but the smallest value seems to be bigger
@@ -319,13 +341,14 @@ struct LZ4Encoder final : public Encoder {
         constexpr size_t max_input_size = 65536;
         const size_t encode_block_size = LZ4F_compressBound(max_input_size, nullptr);
 
-        if (available_in != 0) {
+        while (!input_buffer_.empty() && output_buffer_.size() < output_block_size_) {
             if (lz4_finalized_) {
                 LOG(ERROR) << "LZ4Encoder received data after Finish?";
                 return EncodeResult::Error;
             }
 
-            available_in = std::min(available_in, max_input_size);
+            size_t available_in = std::min(input_buffer_.front_size(), max_input_size);
+            const char* next_in = input_buffer_.front_data();
 
             Block encode_block(encode_block_size);
             size_t available_out = encode_block.capacity();
@@ -347,7 +370,7 @@ struct LZ4Encoder final : public Encoder {
             output_buffer_.append(std::move(encode_block));
         }
 
-        if (finished_ && !lz4_finalized_) {
+        if (finished_ && !lz4_finalized_ && input_buffer_.empty()) {
             lz4_finalized_ = true;
 
             Block final_block(encode_block_size + 4);
@@ -360,6 +383,22 @@ struct LZ4Encoder final : public Encoder {
 
             final_block.resize(rc);
             output_buffer_.append(std::move(final_block));
+        } else if (flush_ && !finished_ && input_buffer_.empty()) {
+            flush_ = false;
+            lz4_flushed_ = true;
+
+            Block flush_block(encode_block_size);
+            size_t rc = LZ4F_flush(encoder_.get(), flush_block.data(), flush_block.size(),
+                                   nullptr);
+            if (LZ4F_isError(rc)) {
+                LOG(ERROR) << "LZ4F_flush failed: " << LZ4F_getErrorName(rc);
+                return EncodeResult::Error;
+            }
+
+            if (rc > 0) {
+                flush_block.resize(rc);
+                output_buffer_.append(std::move(flush_block));
+            }
         }
 
         if (OutputReady()) {
@@ -371,14 +410,16 @@ struct LZ4Encoder final : public Encoder {
 
         if (lz4_finalized_ && output_buffer_.empty()) {
             return EncodeResult::Done;
-        } else if (OutputReady()) {
+        } else if (OutputReady() || !input_buffer_.empty() || (flush_ && !finished_)) {
             return EncodeResult::MoreOutput;
         }
+        lz4_flushed_ = false;
         return EncodeResult::NeedInput;
     }
 
   private:
     bool lz4_finalized_ = false;
+    bool lz4_flushed_ = false;
     std::unique_ptr<LZ4F_cctx, LZ4F_errorCode_t (*)(LZ4F_cctx*)> encoder_;
     IOVector output_buffer_;
 };
@@ -425,6 +466,11 @@ struct ZstdDecoder final : public Decoder {
             return input_buffer_.empty() && zstd_done_ ? DecodeResult::Done
                                                        : DecodeResult::MoreOutput;
         }
+
+        // A full output buffer may mean there's more to come out of what's been consumed.
+        if (!input_buffer_.empty() || out.pos == out.size) {
+            return DecodeResult::MoreOutput;
+        }
         return DecodeResult::NeedInput;
     }
 
@@ -455,7 +501,12 @@ struct ZstdEncoder final : public Encoder {
         out.size = static_cast<size_t>(output->size());
         out.pos = 0;
 
-        ZSTD_EndDirective end_directive = finished_ ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_EndDirective end_directive = ZSTD_e_continue;
+        if (finished_) {
+            end_directive = ZSTD_e_end;
+        } else if (flush_) {
+            end_directive = ZSTD_e_flush;
+        }
         size_t rc = ZSTD_compressStream2(encoder_.get(), &out, &in, end_directive);
         if (ZSTD_isError(rc)) {
             LOG(ERROR) << "ZSTD_compressStream2 failed: " << ZSTD_getErrorName(rc);
@@ -473,8 +524,12 @@ struct ZstdEncoder final : public Encoder {
                     return EncodeResult::Error;
                 }
                 return EncodeResult::Done;
+            } else if (input_buffer_.empty()) {
+                // With ZSTD_e_flush, this also means everything has been flushed.
+                flush_ = false;
+                return EncodeResult::NeedInput;
             } else {
-                return input_buffer_.empty() ? EncodeResult::NeedInput : EncodeResult::MoreOutput;
+                return EncodeResult::MoreOutput;
             }
         } else {
             return EncodeResult::MoreOutput;
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "compression_utils.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <span>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "file_sync_protocol.h"
+
+// These drive the codecs the way sync does (see sync_recv_v2 and SendLargeFileCompressed): the
+// sender reads a file in chunks, Append()s each one and Finish()es at EOF, draining Encode() until
+// it needs input; the receiver Append()s each packet, Finish()es on ID_DONE and drains Decode().
+class CompressionUtilsTest : public ::testing::TestWithParam<CompressionType> {
+  protected:
+    Encoder* MakeEncoder(size_t output_block_size) {
+        switch (GetParam()) {
+            case CompressionType::None:
+                return &encoder_storage_.emplace<NullEncoder>(output_block_size);
+            case CompressionType::Brotli:
+                return &encoder_storage_.emplace<BrotliEncoder>(output_block_size);
+            case CompressionType::LZ4:
+                return &encoder_storage_.emplace<LZ4Encoder>(output_block_size);
+            case CompressionType::Zstd:
+                return &encoder_storage_.emplace<ZstdEncoder>(output_block_size);
+            case CompressionType::Any:
+                break;
+        }
+        LOG(FATAL) << "unexpected CompressionType::Any";
+        return nullptr;
+    }
+
+    Decoder* MakeDecoder(std::span<char> output_buffer) {
+        switch (GetParam()) {
+            case CompressionType::None:
+                return &decoder_storage_.emplace<NullDecoder>(output_buffer);
+            case CompressionType::Brotli:
+                return &decoder_storage_.emplace<BrotliDecoder>(output_buffer);
+            case CompressionType::LZ4:
+                return &decoder_storage_.emplace<LZ4Decoder>(output_buffer);
+            case CompressionType::Zstd:
+                return &decoder_storage_.emplace<ZstdDecoder>(output_buffer);
+            case CompressionType::Any:
+                break;
+        }
+        LOG(FATAL) << "unexpected CompressionType::Any";
+        return nullptr;
+    }
+
+    void Compress(const std::string& input, size_t chunk_size, std::vector<std::string>* packets) {
+        Encoder* encoder = MakeEncoder(SYNC_DATA_MAX);
+        size_t offset = 0;
+        bool sending = true;
+        while (sending) {
+            size_t length = std::min(chunk_size, input.size() - offset);
+            if (length == 0) {
+                encoder->Finish();
+            } else {
+                encoder->Append(Block(input.substr(offset, length)));
+                offset += length;
+            }
+
+            while (true) {
+                Block output;
+                EncodeResult result = encoder->Encode(&output);
+                ASSERT_NE(EncodeResult::Error, result);
+                if (!output.empty()) {
+                    // Each block is sent in a single ID_DATA packet.
+                    ASSERT_LE(output.size(), static_cast<size_t>(SYNC_DATA_MAX));
+                    packets->emplace_back(output.data(), output.size());
+                }
+                if (result == EncodeResult::Done) {
+                    sending = false;
+                    break;
+                } else if (result == EncodeResult::NeedInput) {
+                    break;
+                }
+            }
+        }
+    }
+
+    void Decompress(const std::vector<std::string>& packets, size_t output_size,
+                    std::string* output) {
+        std::vector<char> buffer(output_size);
+        Decoder* decoder = MakeDecoder(std::span<char>(buffer.data(), buffer.size()));
+        for (size_t i = 0; i <= packets.size(); ++i) {
+            if (i == packets.size()) {
+                ASSERT_TRUE(decoder->Finish());
+            } else {
+                decoder->Append(Block(packets[i]));
+            }
+
+            while (true) {
+                std::span<char> decoded;
+                DecodeResult result = decoder->Decode(&decoded);
+                ASSERT_NE(DecodeResult::Error, result);
+                output->append(decoded.data(), decoded.size());
+                if (result == DecodeResult::Done) {
+                    ASSERT_EQ(packets.size(), i) << "done before the last packet";
+                    return;
+                } else if (result == DecodeResult::NeedInput) {
+                    // Sync would wait for a packet that never comes.
+                    ASSERT_LT(i, packets.size()) << "needs input after Finish()";
+                    break;
+                }
+            }
+        }
+    }
+
+    void RoundTrip(const std::string& input, size_t chunk_size, size_t output_size) {
+        std::vector<std::string> packets;
+        ASSERT_NO_FATAL_FAILURE(Compress(input, chunk_size, &packets));
+        std::string output;
+        ASSERT_NO_FATAL_FAILURE(Decompress(packets, output_size, &output));
+        ASSERT_EQ(input.size(), output.size());
+        ASSERT_TRUE(input == output);
+    }
+
+    std::variant<std::monostate, NullEncoder, BrotliEncoder, LZ4Encoder, ZstdEncoder>
+            encoder_storage_;
+    std::variant<std::monostate, NullDecoder, BrotliDecoder, LZ4Decoder, ZstdDecoder>
+            decoder_storage_;
+};
+
+// Log-like text with some noise, so that it compresses, but not so well that it fits in a block.
+static std::string MakeInput(size_t size) {
+    std::mt19937 random(size);
+    std::string input;
+    while (input.size() < size) {
+        input += "line " + std::to_string(random() % 100003) + " of some log output: ";
+        for (size_t i = random() % 64; i > 0; --i) {
+            input += static_cast<char>(random());
+        }
+        input += '\n';
+    }
+    input.resize(size);
+    return input;
+}
+
+TEST_P(CompressionUtilsTest, empty) {
+    RoundTrip("", SYNC_DATA_MAX, SYNC_DATA_MAX);
+}
+
+TEST_P(CompressionUtilsTest, multi_block) {
+    RoundTrip(MakeInput(1024 * 1024 + 123), SYNC_DATA_MAX, SYNC_DATA_MAX);
+}
+
+TEST_P(CompressionUtilsTest, short_reads) {
+    RoundTrip(MakeInput(512 * 1024), 1000, SYNC_DATA_MAX);
+}
+
+TEST_P(CompressionUtilsTest, incompressible) {
+    std::mt19937 random(42);
+    std::string input(1024 * 1024, '\0');
+    std::generate(input.begin(), input.end(), [&random]() { return static_cast<char>(random()); });
+    RoundTrip(input, SYNC_DATA_MAX, SYNC_DATA_MAX);
+}
+
+// Each packet decodes into many output buffers, so they fill up with input still left.
+TEST_P(CompressionUtilsTest, output_fills_mid_stream) {
+    RoundTrip(std::string(8 * 1024 * 1024, 'a'), SYNC_DATA_MAX, SYNC_DATA_MAX);
+    RoundTrip(MakeInput(1024 * 1024), SYNC_DATA_MAX, 1000);
+}
+
+INSTANTIATE_TEST_SUITE_P(Algorithms, CompressionUtilsTest,
+                         ::testing::Values(CompressionType::None, CompressionType::Brotli,
+                                           CompressionType::LZ4, CompressionType::Zstd));
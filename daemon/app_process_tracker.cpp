@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sysdeps.h"
+
+#include "daemon/app_process_tracker.h"
+
+#include <algorithm>
+
+#include <android-base/stringprintf.h>
+
+bool is_app_process(const ProcessInfo& process) {
+    return process.debuggable || process.profileable;
+}
+
+void AppProcessDeltaTracker::Subscribe(const void* subscriber, SendFn send) {
+    subscribers_.push_back(Subscriber{.id = subscriber, .send = std::move(send)});
+}
+
+void AppProcessDeltaTracker::Ready(const void* subscriber) {
+    for (auto& s : subscribers_) {
+        if (s.id == subscriber && !s.ready) {
+            s.ready = true;
+            s.send(SnapshotMessage());
+        }
+    }
+}
+
+void AppProcessDeltaTracker::Unsubscribe(const void* subscriber) {
+    auto pred = [subscriber](const Subscriber& s) { return s.id == subscriber; };
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(), pred),
+                       subscribers_.end());
+}
+
+void AppProcessDeltaTracker::ProcessChanged(const ProcessInfo* before, const ProcessInfo* after) {
+    bool was_app = before && is_app_process(*before);
+    bool is_app = after && is_app_process(*after);
+    if (!was_app && !is_app) {
+        return;
+    }
+
+    adb::proto::AppProcessesDelta delta;
+    if (!is_app) {
+        processes_.erase(before->pid);
+        delta.add_removed_pid(before->pid);
+    } else {
+        adb::proto::ProcessEntry entry = after->toProtobuf();
+        processes_[after->pid] = entry;
+        if (was_app) {
+            *delta.add_changed() = std::move(entry);
+        } else {
+            *delta.add_added() = std::move(entry);
+        }
+    }
+    delta.set_sequence(++sequence_);
+
+    std::string msg;
+    for (auto& s : subscribers_) {
+        if (!s.ready) continue;
+        if (msg.empty()) {
+            msg = EncodeMessage(delta);
+        }
+        s.send(msg);
+    }
+}
+
+std::string AppProcessDeltaTracker::EncodeMessage(const adb::proto::AppProcessesDelta& delta) {
+    std::string body = delta.SerializeAsString();
+    return android::base::StringPrintf("%08zx", body.size()) + body;
+}
+
+std::string AppProcessDeltaTracker::SnapshotMessage() const {
+    adb::proto::AppProcessesDelta snapshot;
+    snapshot.set_sequence(sequence_);
+    snapshot.set_reset(true);
+    for (const auto& [pid, entry] : processes_) {
+        *snapshot.add_added() = entry;
+    }
+    return EncodeMessage(snapshot);
+}
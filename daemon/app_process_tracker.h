@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <adbconnection/common.h>
+
+#include "app_processes.pb.h"
+
+// Whether the process is reported by the "track-app" services.
+bool is_app_process(const ProcessInfo& process);
+
+// The state behind "track-app-delta": the list of app processes, and the subscribers that are
+// sent a snapshot of it followed by one AppProcessesDelta per change.
+//
+// A subscriber is only sent its snapshot once it's ready (i.e. once its peer is connected).
+// Changes made before then are part of that snapshot, so they aren't also sent as deltas.
+//
+// Not thread-safe: adbd only uses it from the fdevent thread.
+class AppProcessDeltaTracker {
+  public:
+    using SendFn = std::function<void(std::string_view msg)>;
+
+    void Subscribe(const void* subscriber, SendFn send);
+    void Ready(const void* subscriber);
+    void Unsubscribe(const void* subscriber);
+
+    // Records that a process was added (|before| is null), went away (|after| is null), or that
+    // its info changed, and sends the delta to every ready subscriber. Changes that don't affect
+    // the list of app processes are ignored.
+    void ProcessChanged(const ProcessInfo* before, const ProcessInfo* after);
+
+    // The sequence number of the last change.
+    int64_t sequence() const { return sequence_; }
+
+    // Frames |delta| the way track-app-delta sends it. Unlike the other trackers, the length
+    // prefix is 8 hex digits, so the list isn't limited to 64KiB.
+    static std::string EncodeMessage(const adb::proto::AppProcessesDelta& delta);
+
+  private:
+    struct Subscriber {
+        const void* id;
+        SendFn send;
+        bool ready = false;
+    };
+
+    std::string SnapshotMessage() const;
+
+    std::map<uint64_t, adb::proto::ProcessEntry> processes_;
+    std::vector<Subscriber> subscribers_;
+    int64_t sequence_ = 0;
+};
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "daemon/app_process_tracker.h"
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+ProcessInfo MakeProcess(uint64_t pid, bool debuggable = true) {
+    ProcessInfo process = {};
+    process.pid = pid;
+    process.debuggable = debuggable;
+    process.profileable = false;
+    process.architecture = "arm64";
+    process.process_name = "app" + std::to_string(pid);
+    process.uid = 10000 + pid;
+    return process;
+}
+
+// Splits the messages a subscriber received back into AppProcessesDeltas.
+std::vector<adb::proto::AppProcessesDelta> Decode(const std::string& stream) {
+    std::vector<adb::proto::AppProcessesDelta> result;
+    size_t offset = 0;
+    while (offset < stream.size()) {
+        EXPECT_LE(offset + 8, stream.size());
+        size_t len = strtoul(stream.substr(offset, 8).c_str(), nullptr, 16);
+        offset += 8;
+        EXPECT_LE(offset + len, stream.size());
+        adb::proto::AppProcessesDelta delta;
+        EXPECT_TRUE(delta.ParseFromString(stream.substr(offset, len)));
+        result.push_back(std::move(delta));
+        offset += len;
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST(AppProcessDeltaTracker, initial_snapshot) {
+    AppProcessDeltaTracker tracker;
+    ProcessInfo a = MakeProcess(100);
+    ProcessInfo b = MakeProcess(200);
+    ProcessInfo not_app = MakeProcess(300, false);
+    tracker.ProcessChanged(nullptr, &a);
+    tracker.ProcessChanged(nullptr, &b);
+    tracker.ProcessChanged(nullptr, &not_app);
+    ASSERT_EQ(2, tracker.sequence());
+
+    std::string received;
+    tracker.Subscribe(&received, [&received](std::string_view msg) { received.append(msg); });
+    ASSERT_TRUE(received.empty());
+
+    tracker.Ready(&received);
+    auto messages = Decode(received);
+    ASSERT_EQ(1U, messages.size());
+    ASSERT_TRUE(messages[0].reset());
+    ASSERT_EQ(2, messages[0].sequence());
+    ASSERT_EQ(2, messages[0].added_size());
+    ASSERT_EQ(100, messages[0].added(0).pid());
+    ASSERT_EQ("app100", messages[0].added(0).process_name());
+    ASSERT_EQ(200, messages[0].added(1).pid());
+
+    // Being told that it's ready again doesn't resend the snapshot.
+    tracker.Ready(&received);
+    ASSERT_EQ(1U, Decode(received).size());
+}
+
+TEST(AppProcessDeltaTracker, add_change_remove) {
+    AppProcessDeltaTracker tracker;
+    std::string received;
+    tracker.Subscribe(&received, [&received](std::string_view msg) { received.append(msg); });
+    tracker.Ready(&received);
+
+    ProcessInfo a = MakeProcess(100);
+    tracker.ProcessChanged(nullptr, &a);
+
+    ProcessInfo a_waiting = a;
+    a_waiting.waiting_for_debugger = true;
+    tracker.ProcessChanged(&a, &a_waiting);
+
+    tracker.ProcessChanged(&a_waiting, nullptr);
+
+    // Processes that aren't apps don't generate deltas.
+    ProcessInfo not_app = MakeProcess(300, false);
+    tracker.ProcessChanged(nullptr, &not_app);
+    tracker.ProcessChanged(&not_app, nullptr);
+
+    auto messages = Decode(received);
+    ASSERT_EQ(4U, messages.size());
+
+    ASSERT_TRUE(messages[0].reset());
+    ASSERT_EQ(0, messages[0].sequence());
+    ASSERT_EQ(0, messages[0].added_size());
+
+    ASSERT_FALSE(messages[1].reset());
+    ASSERT_EQ(1, messages[1].sequence());
+    ASSERT_EQ(1, messages[1].added_size());
+    ASSERT_EQ(100, messages[1].added(0).pid());
+
+    ASSERT_EQ(2, messages[2].sequence());
+    ASSERT_EQ(0, messages[2].added_size());
+    ASSERT_EQ(1, messages[2].changed_size());
+    ASSERT_TRUE(messages[2].changed(0).waiting_for_debugger());
+
+    ASSERT_EQ(3, messages[3].sequence());
+    ASSERT_EQ(1, messages[3].removed_pid_size());
+    ASSERT_EQ(100, messages[3].removed_pid(0));
+}
+
+TEST(AppProcessDeltaTracker, late_subscriber_gets_snapshot) {
+    AppProcessDeltaTracker tracker;
+    std::string first;
+    tracker.Subscribe(&first, [&first](std::string_view msg) { first.append(msg); });
+    tracker.Ready(&first);
+
+    ProcessInfo a = MakeProcess(100);
+    ProcessInfo b = MakeProcess(200);
+    tracker.ProcessChanged(nullptr, &a);
+    tracker.ProcessChanged(nullptr, &b);
+
+    // A subscriber that arrives mid-stream isn't sent anything until it's ready, and changes
+    // made in the meantime are part of its snapshot rather than separate deltas.
+    std::string second;
+    tracker.Subscribe(&second, [&second](std::string_view msg) { second.append(msg); });
+    tracker.ProcessChanged(&a, nullptr);
+    ASSERT_TRUE(second.empty());
+    tracker.Ready(&second);
+
+    ProcessInfo c = MakeProcess(300);
+    tracker.ProcessChanged(nullptr, &c);
+
+    auto second_messages = Decode(second);
+    ASSERT_EQ(2U, second_messages.size());
+    ASSERT_TRUE(second_messages[0].reset());
+    ASSERT_EQ(3, second_messages[0].sequence());
+    ASSERT_EQ(1, second_messages[0].added_size());
+    ASSERT_EQ(200, second_messages[0].added(0).pid());
+    ASSERT_FALSE(second_messages[1].reset());
+    ASSERT_EQ(4, second_messages[1].sequence());
+    ASSERT_EQ(300, second_messages[1].added(0).pid());
+
+    // The first subscriber saw every change as a delta.
+    auto first_messages = Decode(first);
+    ASSERT_EQ(5U, first_messages.size());
+    for (size_t i = 1; i < first_messages.size(); ++i) {
+        ASSERT_FALSE(first_messages[i].reset());
+        ASSERT_EQ(static_cast<int64_t>(i), first_messages[i].sequence());
+    }
+
+    // Unsubscribed trackers aren't sent anything.
+    tracker.Unsubscribe(&first);
+    tracker.ProcessChanged(&b, nullptr);
+    ASSERT_EQ(5U, Decode(first).size());
+    ASSERT_EQ(3U, Decode(second).size());
+}
@@ -18,7 +18,6 @@
 
 #include "sysdeps.h"
 
-#include <resolv.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -30,27 +29,22 @@
 #include <thread>
 
 #include <adb/crypto/rsa_2048_key.h>
-#include <adb/tls/adb_ca_list.h>
 #include <adbd_auth.h>
 #include <android-base/file.h>
 #include <android-base/no_destructor.h>
-#include <android-base/strings.h>
-#include <crypto_utils/android_pubkey.h>
-#include <openssl/obj_mac.h>
 #include <openssl/rsa.h>
-#include <openssl/sha.h>
 #include <openssl/ssl.h>
 
 #include "adb.h"
 #include "adb_auth.h"
 #include "adb_io.h"
 #include "adb_wifi.h"
+#include "daemon/auth_key_store.h"
 #include "fdevent/fdevent.h"
 #include "transport.h"
 #include "types.h"
 
 using namespace adb::crypto;
-using namespace adb::tls;
 using namespace std::chrono_literals;
 
 static AdbdAuthContext* auth_ctx;
@@ -63,6 +57,8 @@ static struct adisconnect adb_disconnect = {adb_disconnected, nullptr};
 static android::base::NoDestructor<std::map<uint32_t, weak_ptr<atransport>>> transports;
 static uint32_t transport_auth_id = 0;
 
+static android::base::NoDestructor<AuthKeyStore> key_store;
+
 bool auth_required = true;
 bool socket_access_allowed = true;
 
@@ -104,90 +100,45 @@ static void IteratePublicKeys(std::function<bool(std::string_view public_key)> f
             &f);
 }
 
+// Brings the key store up to date with the keys libadbd_auth currently knows about.
+static void UpdateKeyStore() {
+    std::vector<std::string> public_keys;
+    IteratePublicKeys([&](std::string_view public_key) {
+        public_keys.emplace_back(public_key);
+        return true;
+    });
+    key_store->Update(public_keys);
+}
+
 bssl::UniquePtr<STACK_OF(X509_NAME)> adbd_tls_client_ca_list() {
     if (!auth_required) {
         return nullptr;
     }
 
-    bssl::UniquePtr<STACK_OF(X509_NAME)> ca_list(sk_X509_NAME_new_null());
-
-    IteratePublicKeys([&](std::string_view public_key) {
-        // TODO: do we really have to support both ' ' and '\t'?
-        std::vector<std::string> split = android::base::Split(std::string(public_key), " \t");
-        uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
-        const std::string& pubkey = split[0];
-        if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
-            LOG(ERROR) << "Invalid base64 key " << pubkey;
-            return true;
-        }
-
-        RSA* key = nullptr;
-        if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
-            LOG(ERROR) << "Failed to parse key " << pubkey;
-            return true;
-        }
-        bssl::UniquePtr<RSA> rsa_key(key);
-
-        unsigned char* dkey = nullptr;
-        int len = i2d_RSA_PUBKEY(rsa_key.get(), &dkey);
-        if (len <= 0 || dkey == nullptr) {
-            LOG(ERROR) << "Failed to encode RSA public key";
-            return true;
-        }
-
-        uint8_t digest[SHA256_DIGEST_LENGTH];
-        // Put the encoded key in the commonName attribute of the issuer name.
-        // Note that the commonName has a max length of 64 bytes, which is less
-        // than the SHA256_DIGEST_LENGTH.
-        SHA256(dkey, len, digest);
-        OPENSSL_free(dkey);
-
-        auto digest_str = SHA256BitsToHexString(
-                std::string_view(reinterpret_cast<const char*>(&digest[0]), sizeof(digest)));
-        LOG(INFO) << "fingerprint=[" << digest_str << "]";
-        auto issuer = CreateCAIssuerFromEncodedKey(digest_str);
-        CHECK(bssl::PushToStack(ca_list.get(), std::move(issuer)));
-        return true;
-    });
+    UpdateKeyStore();
+    return key_store->CaList();
+}
 
-    return ca_list;
+std::shared_ptr<adb::tls::SessionTicketKeys> adbd_tls_session_ticket_keys() {
+    // Tickets stay valid for 8 hours, long enough to ride out a day's worth of network blips
+    // without holding on to any key for long.
+    static auto& keys = *new std::shared_ptr<adb::tls::SessionTicketKeys>(
+            std::make_shared<adb::tls::SessionTicketKeys>(1h, 8));
+    return keys;
 }
 
 bool adbd_auth_verify(const char* token, size_t token_size, const std::string& sig,
                       std::string* auth_key) {
-    bool authorized = false;
     auth_key->clear();
 
-    IteratePublicKeys([&](std::string_view public_key) {
-        // TODO: do we really have to support both ' ' and '\t'?
-        std::vector<std::string> split = android::base::Split(std::string(public_key), " \t");
-        uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
-        const std::string& pubkey = split[0];
-        if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
-            LOG(ERROR) << "Invalid base64 key " << pubkey;
-            return true;
-        }
-
-        RSA* key = nullptr;
-        if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
-            LOG(ERROR) << "Failed to parse key " << pubkey;
-            return true;
-        }
-
-        bool verified =
-                (RSA_verify(NID_sha1, reinterpret_cast<const uint8_t*>(token), token_size,
-                            reinterpret_cast<const uint8_t*>(sig.c_str()), sig.size(), key) == 1);
-        RSA_free(key);
-        if (verified) {
-            *auth_key = public_key;
-            authorized = true;
-            return false;
-        }
-
-        return true;
-    });
-
-    return authorized;
+    UpdateKeyStore();
+    std::optional<std::string> key =
+            key_store->Verify(reinterpret_cast<const uint8_t*>(token), token_size, sig);
+    if (!key) {
+        return false;
+    }
+    *auth_key = std::move(*key);
+    return true;
 }
 
 static bool adbd_auth_generate_token(void* token, size_t token_size) {
@@ -237,6 +188,7 @@ static void adbd_key_removed(const char* public_key, size_t len) {
     // The framework removed the key from its keystore. We need to disconnect all
     // devices using that key. Search by t->auth_key
     std::string_view auth_key(public_key, len);
+    key_store->Remove(auth_key);
     kick_all_transports_by_auth_key(auth_key);
 }
 
@@ -305,7 +257,6 @@ int adbd_tls_verify_cert(X509_STORE_CTX* ctx, std::string* auth_key) {
         return 1;
     }
 
-    bool authorized = false;
     X509* cert = X509_STORE_CTX_get0_cert(ctx);
     if (cert == nullptr) {
         VLOG(AUTH) << "got null x509 certificate";
@@ -317,42 +268,15 @@ int adbd_tls_verify_cert(X509_STORE_CTX* ctx, std::string* auth_key) {
         return 0;
     }
 
-    IteratePublicKeys([&](std::string_view public_key) {
-        // TODO: do we really have to support both ' ' and '\t'?
-        std::vector<std::string> split = android::base::Split(std::string(public_key), " \t");
-        uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
-        const std::string& pubkey = split[0];
-        if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
-            LOG(ERROR) << "Invalid base64 key " << pubkey;
-            return true;
-        }
-
-        RSA* key = nullptr;
-        if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
-            LOG(ERROR) << "Failed to parse key " << pubkey;
-            return true;
-        }
-
-        bool verified = false;
-        bssl::UniquePtr<EVP_PKEY> known_evp(EVP_PKEY_new());
-        EVP_PKEY_set1_RSA(known_evp.get(), key);
-        if (EVP_PKEY_cmp(known_evp.get(), evp_pkey.get())) {
-            VLOG(AUTH) << "Matched auth_key=" << public_key;
-            verified = true;
-        } else {
-            VLOG(AUTH) << "auth_key doesn't match [" << public_key << "]";
-        }
-        RSA_free(key);
-        if (verified) {
-            *auth_key = public_key;
-            authorized = true;
-            return false;
-        }
-
-        return true;
-    });
-
-    return authorized ? 1 : 0;
+    UpdateKeyStore();
+    std::optional<std::string> key = key_store->Find(evp_pkey.get());
+    if (!key) {
+        VLOG(AUTH) << "no authorized key matches the certificate";
+        return 0;
+    }
+    VLOG(AUTH) << "Matched auth_key=" << *key;
+    *auth_key = std::move(*key);
+    return 1;
 }
 
 void adbd_auth_tls_handshake(atransport* t) {
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG AUTH
+
+#include "sysdeps.h"
+
+#include "daemon/auth_key_store.h"
+
+#include <resolv.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <adb/tls/adb_ca_list.h>
+#include <android-base/logging.h>
+#include <crypto_utils/android_pubkey.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+
+#include "adb_trace.h"
+
+using adb::tls::CreateCAIssuerFromEncodedKey;
+using adb::tls::SHA256BitsToHexString;
+
+std::string AuthKeyStore::Fingerprint(EVP_PKEY* pkey) {
+    uint8_t* der = nullptr;
+    int len = i2d_PUBKEY(pkey, &der);
+    if (len <= 0 || der == nullptr) {
+        LOG(ERROR) << "Failed to encode public key";
+        return "";
+    }
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(der, len, digest);
+    OPENSSL_free(der);
+    return SHA256BitsToHexString(
+            std::string_view(reinterpret_cast<const char*>(digest), sizeof(digest)));
+}
+
+std::unique_ptr<AuthKeyStore::Key> AuthKeyStore::ParseKey(std::string_view public_key) {
+    auto key = std::make_unique<Key>();
+    key->public_key = public_key;
+
+    // The key is followed by an optional comment, separated by either a space or a tab.
+    std::string encoded(public_key.substr(0, public_key.find_first_of(" \t")));
+    uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
+    if (b64_pton(encoded.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
+        LOG(ERROR) << "Invalid base64 key " << encoded;
+        return key;
+    }
+
+    RSA* rsa = nullptr;
+    if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &rsa)) {
+        LOG(ERROR) << "Failed to parse key " << encoded;
+        return key;
+    }
+    bssl::UniquePtr<RSA> rsa_key(rsa);
+
+    bssl::UniquePtr<EVP_PKEY> pkey(EVP_PKEY_new());
+    if (!pkey || !EVP_PKEY_set1_RSA(pkey.get(), rsa_key.get())) {
+        LOG(ERROR) << "Failed to create EVP_PKEY for key " << encoded;
+        return key;
+    }
+
+    std::string fingerprint = Fingerprint(pkey.get());
+    if (fingerprint.empty()) {
+        return key;
+    }
+
+    VLOG(AUTH) << "fingerprint=[" << fingerprint << "]";
+    key->rsa = std::move(rsa_key);
+    key->pkey = std::move(pkey);
+    key->fingerprint = std::move(fingerprint);
+    return key;
+}
+
+void AuthKeyStore::Update(const std::vector<std::string>& public_keys) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t generation = ++generation_;
+    bool changed = false;
+
+    for (const std::string& public_key : public_keys) {
+        auto it = keys_.find(public_key);
+        if (it == keys_.end()) {
+            it = keys_.emplace(public_key, ParseKey(public_key)).first;
+            Key* key = it->second.get();
+            if (key->rsa) {
+                // With the same key listed twice, the first one wins.
+                by_fingerprint_.try_emplace(key->fingerprint, key);
+                verify_order_.push_back(key);
+                changed = true;
+            }
+        }
+        it->second->generation = generation;
+    }
+
+    for (auto it = keys_.begin(); it != keys_.end();) {
+        auto next = std::next(it);
+        if (it->second->generation != generation) {
+            changed |= it->second->rsa != nullptr;
+            Erase(it);
+        }
+        it = next;
+    }
+
+    if (changed) {
+        ca_list_.reset();
+    }
+}
+
+void AuthKeyStore::Remove(std::string_view public_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keys_.find(public_key);
+    if (it != keys_.end()) {
+        if (it->second->rsa) {
+            ca_list_.reset();
+        }
+        Erase(it);
+    }
+}
+
+void AuthKeyStore::Erase(std::map<std::string, std::unique_ptr<Key>, std::less<>>::iterator it) {
+    Key* key = it->second.get();
+    if (key->rsa) {
+        std::erase(verify_order_, key);
+
+        auto fp = by_fingerprint_.find(key->fingerprint);
+        if (fp != by_fingerprint_.end() && fp->second == key) {
+            by_fingerprint_.erase(fp);
+            // Fall back to another copy of the same key, if there is one.
+            auto other = std::find_if(verify_order_.begin(), verify_order_.end(),
+                                      [key](Key* k) { return k->fingerprint == key->fingerprint; });
+            if (other != verify_order_.end()) {
+                by_fingerprint_.emplace(key->fingerprint, *other);
+            }
+        }
+    }
+    keys_.erase(it);
+}
+
+std::optional<std::string> AuthKeyStore::Verify(const uint8_t* token, size_t token_size,
+                                                std::string_view sig) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = verify_order_.begin(); it != verify_order_.end(); ++it) {
+        Key* key = *it;
+        if (RSA_verify(NID_sha1, token, token_size, reinterpret_cast<const uint8_t*>(sig.data()),
+                       sig.size(), key->rsa.get()) == 1) {
+            std::rotate(verify_order_.begin(), it, std::next(it));
+            return key->public_key;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> AuthKeyStore::Find(EVP_PKEY* pkey) {
+    std::string fingerprint = Fingerprint(pkey);
+    if (fingerprint.empty()) {
+        return std::nullopt;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = by_fingerprint_.find(fingerprint);
+    if (it == by_fingerprint_.end()) {
+        VLOG(AUTH) << "no authorized key with fingerprint " << fingerprint;
+        return std::nullopt;
+    }
+
+    // The fingerprint is only an index, make sure it's really the same key.
+    Key* key = it->second;
+    if (EVP_PKEY_cmp(key->pkey.get(), pkey) != 1) {
+        LOG(WARNING) << "key with fingerprint " << fingerprint << " doesn't match";
+        return std::nullopt;
+    }
+    return key->public_key;
+}
+
+bssl::UniquePtr<STACK_OF(X509_NAME)> AuthKeyStore::CaList() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ca_list_) {
+        ca_list_.reset(sk_X509_NAME_new_null());
+        for (const auto& [fingerprint, key] : by_fingerprint_) {
+            // Put the fingerprint in the commonName attribute of the issuer name.
+            CHECK(bssl::PushToStack(ca_list_.get(), CreateCAIssuerFromEncodedKey(fingerprint)));
+        }
+        VLOG(AUTH) << "built CA list for " << sk_X509_NAME_num(ca_list_.get()) << " keys";
+    }
+
+    // The caller hands the list over to the SSL connection, so it gets its own copy.
+    bssl::UniquePtr<STACK_OF(X509_NAME)> result(sk_X509_NAME_new_null());
+    for (size_t i = 0; i < sk_X509_NAME_num(ca_list_.get()); ++i) {
+        bssl::UniquePtr<X509_NAME> name(X509_NAME_dup(sk_X509_NAME_value(ca_list_.get(), i)));
+        CHECK(bssl::PushToStack(result.get(), std::move(name)));
+    }
+    return result;
+}
+
+size_t AuthKeyStore::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return verify_order_.size();
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/macros.h>
+#include <android-base/thread_annotations.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+// The keys that are allowed to connect (one adb_keys line each), parsed once and indexed for the
+// lookups adbd does on every connection attempt.
+//
+// libadbd_auth owns the list of keys, so callers hand the current list to Update() before looking
+// anything up. Only keys that weren't in the previous list are decoded, and keys that are gone are
+// dropped along with everything derived from them. Keys are indexed by the SHA-256 fingerprint of
+// their DER SubjectPublicKeyInfo, which is how TLS clients present them, and the CA list for the
+// TLS CertificateRequest is only rebuilt when the set of keys changes.
+//
+// All methods are thread safe.
+class AuthKeyStore {
+  public:
+    AuthKeyStore() = default;
+
+    // Replaces the set of authorized keys with |public_keys|.
+    void Update(const std::vector<std::string>& public_keys);
+
+    // Forgets |public_key| until the next Update() that contains it.
+    void Remove(std::string_view public_key);
+
+    // Returns the key for which |sig| is a valid signature of |token|. Keys that were used most
+    // recently are tried first.
+    std::optional<std::string> Verify(const uint8_t* token, size_t token_size,
+                                      std::string_view sig);
+
+    // Returns the authorized key that is the same as |pkey|, e.g. a TLS client certificate's.
+    std::optional<std::string> Find(EVP_PKEY* pkey);
+
+    // The issuer names of all authorized keys, for SSL_set_client_CA_list.
+    bssl::UniquePtr<STACK_OF(X509_NAME)> CaList();
+
+    // The number of usable keys.
+    size_t size();
+
+    // The hex SHA-256 of |pkey|'s DER SubjectPublicKeyInfo, or an empty string on failure.
+    static std::string Fingerprint(EVP_PKEY* pkey);
+
+  private:
+    struct Key {
+        std::string public_key;
+        uint64_t generation = 0;
+
+        // Unset if the key couldn't be decoded.
+        bssl::UniquePtr<RSA> rsa;
+        bssl::UniquePtr<EVP_PKEY> pkey;
+        std::string fingerprint;
+    };
+
+    static std::unique_ptr<Key> ParseKey(std::string_view public_key);
+    void Erase(std::map<std::string, std::unique_ptr<Key>, std::less<>>::iterator it)
+            REQUIRES(mutex_);
+
+    std::mutex mutex_;
+    uint64_t generation_ GUARDED_BY(mutex_) = 0;
+
+    // Every key we were given, including ones that failed to decode, so they aren't retried.
+    std::map<std::string, std::unique_ptr<Key>, std::less<>> keys_ GUARDED_BY(mutex_);
+
+    // Usable keys, by fingerprint and most recently verified first.
+    std::unordered_map<std::string, Key*> by_fingerprint_ GUARDED_BY(mutex_);
+    std::vector<Key*> verify_order_ GUARDED_BY(mutex_);
+
+    bssl::UniquePtr<STACK_OF(X509_NAME)> ca_list_ GUARDED_BY(mutex_);
+
+    DISALLOW_COPY_AND_ASSIGN(AuthKeyStore);
+};
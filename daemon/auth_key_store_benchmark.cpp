@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG AUTH
+
+#include "sysdeps.h"
+
+#include <resolv.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <adb/crypto/rsa_2048_key.h>
+#include <adb/tls/adb_ca_list.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <benchmark/benchmark.h>
+#include <crypto_utils/android_pubkey.h>
+#include <openssl/bn.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+
+#include "adb_trace.h"
+#include "daemon/auth_key_store.h"
+
+using adb::crypto::CalculatePublicKey;
+using adb::crypto::CreateRSA2048Key;
+
+enum class Lookup {
+    // What adbd used to do: decode every key on every connection attempt.
+    Legacy,
+    AuthKeyStore,
+};
+
+// Keys that will never match, standing in for everyone else's keys on a shared device. Generating
+// real key pairs takes too long, so these are just random 2048-bit moduli.
+static std::string CreateOtherPublicKey() {
+    bssl::UniquePtr<BIGNUM> n(BN_new());
+    bssl::UniquePtr<BIGNUM> e(BN_new());
+    bssl::UniquePtr<RSA> rsa(RSA_new());
+    if (!BN_rand(n.get(), 2048, BN_RAND_TOP_ONE, BN_RAND_BOTTOM_ODD) ||
+        !BN_set_word(e.get(), RSA_F4) ||
+        !RSA_set0_key(rsa.get(), n.release(), e.release(), nullptr)) {
+        LOG(FATAL) << "failed to create key";
+    }
+
+    std::string public_key;
+    if (!CalculatePublicKey(&public_key, rsa.get())) {
+        LOG(FATAL) << "failed to encode key";
+    }
+    return public_key;
+}
+
+struct Fixture {
+    bssl::UniquePtr<EVP_PKEY> pkey;
+    std::vector<std::string> public_keys;
+    std::vector<uint8_t> token = std::vector<uint8_t>(SHA_DIGEST_LENGTH, 0x42);
+    std::string sig;
+};
+
+// |count| keys, the last of which is the one that connects.
+static const Fixture& GetFixture(size_t count) {
+    static auto& fixtures = *new std::map<size_t, Fixture>();
+    auto [it, inserted] = fixtures.try_emplace(count);
+    Fixture& fixture = it->second;
+    if (!inserted) {
+        return fixture;
+    }
+
+    auto key = CreateRSA2048Key();
+    CHECK(key.has_value());
+    bssl::UniquePtr<RSA> rsa(EVP_PKEY_get1_RSA(key->GetEvpPkey()));
+    fixture.pkey.reset(EVP_PKEY_new());
+    EVP_PKEY_set1_RSA(fixture.pkey.get(), rsa.get());
+
+    for (size_t i = 1; i < count; ++i) {
+        fixture.public_keys.push_back(CreateOtherPublicKey());
+    }
+    std::string public_key;
+    CHECK(CalculatePublicKey(&public_key, rsa.get()));
+    fixture.public_keys.push_back(public_key);
+
+    fixture.sig.resize(RSA_size(rsa.get()));
+    unsigned int sig_len;
+    CHECK_EQ(1, RSA_sign(NID_sha1, fixture.token.data(), fixture.token.size(),
+                         reinterpret_cast<uint8_t*>(fixture.sig.data()), &sig_len, rsa.get()));
+    fixture.sig.resize(sig_len);
+    return fixture;
+}
+
+static bssl::UniquePtr<RSA> DecodeLegacy(const std::string& public_key) {
+    std::vector<std::string> split = android::base::Split(public_key, " \t");
+    uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
+    if (b64_pton(split[0].c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
+        return nullptr;
+    }
+    RSA* key = nullptr;
+    if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
+        return nullptr;
+    }
+    return bssl::UniquePtr<RSA>(key);
+}
+
+static bool VerifyLegacy(const Fixture& fixture) {
+    for (const std::string& public_key : fixture.public_keys) {
+        bssl::UniquePtr<RSA> key = DecodeLegacy(public_key);
+        if (key && RSA_verify(NID_sha1, fixture.token.data(), fixture.token.size(),
+                              reinterpret_cast<const uint8_t*>(fixture.sig.data()),
+                              fixture.sig.size(), key.get()) == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool FindLegacy(const Fixture& fixture) {
+    for (const std::string& public_key : fixture.public_keys) {
+        bssl::UniquePtr<RSA> key = DecodeLegacy(public_key);
+        if (!key) continue;
+        bssl::UniquePtr<EVP_PKEY> known_evp(EVP_PKEY_new());
+        EVP_PKEY_set1_RSA(known_evp.get(), key.get());
+        if (EVP_PKEY_cmp(known_evp.get(), fixture.pkey.get()) == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t CaListLegacy(const Fixture& fixture) {
+    bssl::UniquePtr<STACK_OF(X509_NAME)> ca_list(sk_X509_NAME_new_null());
+    for (const std::string& public_key : fixture.public_keys) {
+        bssl::UniquePtr<RSA> key = DecodeLegacy(public_key);
+        if (!key) continue;
+        uint8_t* dkey = nullptr;
+        int len = i2d_RSA_PUBKEY(key.get(), &dkey);
+        uint8_t digest[SHA256_DIGEST_LENGTH];
+        SHA256(dkey, len, digest);
+        OPENSSL_free(dkey);
+        auto digest_str = adb::tls::SHA256BitsToHexString(
+                std::string_view(reinterpret_cast<const char*>(digest), sizeof(digest)));
+        CHECK(bssl::PushToStack(ca_list.get(), adb::tls::CreateCAIssuerFromEncodedKey(digest_str)));
+    }
+    return sk_X509_NAME_num(ca_list.get());
+}
+
+// adbd_auth_verify: the key that signed the AUTH token.
+template <Lookup kLookup>
+void BM_Auth_Verify(benchmark::State& state) {
+    const Fixture& fixture = GetFixture(state.range(0));
+    AuthKeyStore store;
+    for (auto _ : state) {
+        bool verified;
+        if (kLookup == Lookup::Legacy) {
+            verified = VerifyLegacy(fixture);
+        } else {
+            // adbd still hands the store the current list of keys every time.
+            store.Update(fixture.public_keys);
+            verified = store.Verify(fixture.token.data(), fixture.token.size(), fixture.sig)
+                               .has_value();
+        }
+        CHECK(verified);
+    }
+}
+
+// adbd_tls_verify_cert: the key in the client's certificate.
+template <Lookup kLookup>
+void BM_Auth_TlsVerifyCert(benchmark::State& state) {
+    const Fixture& fixture = GetFixture(state.range(0));
+    AuthKeyStore store;
+    for (auto _ : state) {
+        bool found;
+        if (kLookup == Lookup::Legacy) {
+            found = FindLegacy(fixture);
+        } else {
+            store.Update(fixture.public_keys);
+            found = store.Find(fixture.pkey.get()).has_value();
+        }
+        CHECK(found);
+    }
+}
+
+// adbd_tls_client_ca_list: the CA list sent to TLS clients.
+template <Lookup kLookup>
+void BM_Auth_TlsCaList(benchmark::State& state) {
+    const Fixture& fixture = GetFixture(state.range(0));
+    AuthKeyStore store;
+    for (auto _ : state) {
+        size_t count;
+        if (kLookup == Lookup::Legacy) {
+            count = CaListLegacy(fixture);
+        } else {
+            store.Update(fixture.public_keys);
+            count = sk_X509_NAME_num(store.CaList().get());
+        }
+        CHECK_EQ(count, fixture.public_keys.size());
+    }
+}
+
+#define KEY_COUNTS RangeMultiplier(4)->Range(1, 1024)
+BENCHMARK_TEMPLATE(BM_Auth_Verify, Lookup::Legacy)->KEY_COUNTS;
+BENCHMARK_TEMPLATE(BM_Auth_Verify, Lookup::AuthKeyStore)->KEY_COUNTS;
+BENCHMARK_TEMPLATE(BM_Auth_TlsVerifyCert, Lookup::Legacy)->KEY_COUNTS;
+BENCHMARK_TEMPLATE(BM_Auth_TlsVerifyCert, Lookup::AuthKeyStore)->KEY_COUNTS;
+BENCHMARK_TEMPLATE(BM_Auth_TlsCaList, Lookup::Legacy)->KEY_COUNTS;
+BENCHMARK_TEMPLATE(BM_Auth_TlsCaList, Lookup::AuthKeyStore)->KEY_COUNTS;
+
+int main(int argc, char** argv) {
+    android::base::SetMinimumLogSeverity(android::base::WARNING);
+    adb_trace_init(argv);
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "daemon/auth_key_store.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <adb/crypto/rsa_2048_key.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+
+using adb::crypto::CalculatePublicKey;
+using adb::crypto::CreateRSA2048Key;
+using adb::crypto::Key;
+
+namespace {
+
+struct TestKey {
+    Key key;
+    bssl::UniquePtr<RSA> rsa;
+    std::string public_key;
+
+    std::string Sign(const std::vector<uint8_t>& token) const {
+        std::string sig(RSA_size(rsa.get()), '\0');
+        unsigned int len;
+        EXPECT_EQ(1, RSA_sign(NID_sha1, token.data(), token.size(),
+                              reinterpret_cast<uint8_t*>(sig.data()), &len, rsa.get()));
+        sig.resize(len);
+        return sig;
+    }
+};
+
+TestKey CreateTestKey() {
+    auto key = CreateRSA2048Key();
+    EXPECT_TRUE(key.has_value());
+    bssl::UniquePtr<RSA> rsa(EVP_PKEY_get1_RSA(key->GetEvpPkey()));
+    std::string public_key;
+    EXPECT_TRUE(CalculatePublicKey(&public_key, rsa.get()));
+    return {std::move(*key), std::move(rsa), public_key};
+}
+
+}  // namespace
+
+TEST(AuthKeyStore, verify) {
+    TestKey key1 = CreateTestKey();
+    TestKey key2 = CreateTestKey();
+    std::vector<uint8_t> token(SHA_DIGEST_LENGTH, 0x42);
+
+    AuthKeyStore store;
+    store.Update({key1.public_key, key2.public_key});
+    ASSERT_EQ(2U, store.size());
+    ASSERT_EQ(key1.public_key, store.Verify(token.data(), token.size(), key1.Sign(token)));
+    ASSERT_EQ(key2.public_key, store.Verify(token.data(), token.size(), key2.Sign(token)));
+    ASSERT_EQ(key1.public_key, store.Verify(token.data(), token.size(), key1.Sign(token)));
+
+    std::string sig = key2.Sign(token);
+    token[0] ^= 1;
+    ASSERT_FALSE(store.Verify(token.data(), token.size(), sig).has_value());
+    token[0] ^= 1;
+
+    store.Remove(key2.public_key);
+    ASSERT_EQ(1U, store.size());
+    ASSERT_FALSE(store.Verify(token.data(), token.size(), sig).has_value());
+
+    store.Update({key2.public_key});
+    ASSERT_EQ(1U, store.size());
+    ASSERT_EQ(key2.public_key, store.Verify(token.data(), token.size(), sig));
+    ASSERT_FALSE(store.Verify(token.data(), token.size(), key1.Sign(token)).has_value());
+}
+
+TEST(AuthKeyStore, find) {
+    TestKey key1 = CreateTestKey();
+    TestKey key2 = CreateTestKey();
+
+    AuthKeyStore store;
+    store.Update({key1.public_key});
+    ASSERT_EQ(key1.public_key, store.Find(key1.key.GetEvpPkey()));
+    ASSERT_FALSE(store.Find(key2.key.GetEvpPkey()).has_value());
+
+    // The same key with a different comment.
+    std::string renamed = key1.public_key.substr(0, key1.public_key.find(' ')) + "\tother@host";
+    store.Update({key1.public_key, renamed, key2.public_key});
+    ASSERT_EQ(key1.public_key, store.Find(key1.key.GetEvpPkey()));
+    ASSERT_EQ(key2.public_key, store.Find(key2.key.GetEvpPkey()));
+
+    store.Update({renamed});
+    ASSERT_EQ(renamed, store.Find(key1.key.GetEvpPkey()));
+    ASSERT_FALSE(store.Find(key2.key.GetEvpPkey()).has_value());
+}
+
+TEST(AuthKeyStore, ca_list) {
+    TestKey key1 = CreateTestKey();
+    TestKey key2 = CreateTestKey();
+
+    AuthKeyStore store;
+    store.Update({key1.public_key});
+    auto ca_list = store.CaList();
+    ASSERT_EQ(1U, sk_X509_NAME_num(ca_list.get()));
+
+    store.Update({key1.public_key, key2.public_key});
+    ca_list = store.CaList();
+    ASSERT_EQ(2U, sk_X509_NAME_num(ca_list.get()));
+
+    store.Remove(key1.public_key);
+    ca_list = store.CaList();
+    ASSERT_EQ(1U, sk_X509_NAME_num(ca_list.get()));
+}
+
+TEST(AuthKeyStore, invalid_keys) {
+    TestKey key = CreateTestKey();
+
+    AuthKeyStore store;
+    store.Update({"not base64!", "QUFBQQ== too short", key.public_key});
+    ASSERT_EQ(1U, store.size());
+    ASSERT_EQ(key.public_key, store.Find(key.key.GetEvpPkey()));
+    ASSERT_EQ(1U, sk_X509_NAME_num(store.CaList().get()));
+}
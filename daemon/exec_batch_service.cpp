@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG SHELL
+
+#include "sysdeps.h"
+
+#include "daemon/exec_batch_service.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/thread_annotations.h>
+
+#include "adb_trace.h"
+#include "daemon/shell_service.h"
+#include "exec_batch_protocol.h"
+#include "shell_protocol.h"
+
+namespace {
+
+struct BatchCommand {
+    uint32_t id;
+    std::string command;
+};
+
+class ExecBatch {
+  public:
+    ExecBatch(unique_fd fd, size_t max_workers, size_t max_pending)
+        : fd_(std::move(fd)),
+          max_workers_(max_workers),
+          max_pending_(max_pending),
+          output_(fd_) {}
+
+    void Run();
+
+  private:
+    // Returns true if the client closed stdin to say that it has sent all of its commands, or
+    // false if it went away (or the stream broke) instead.
+    bool ReadCommands();
+    void WorkerLoop();
+    void RunCommand(const BatchCommand& command);
+
+    // Sends output of a command. Once the client is gone, nothing more is sent.
+    bool Send(ShellProtocol::Id id, uint32_t command_id, const char* data, size_t length);
+
+    unique_fd fd_;
+    const size_t max_workers_;
+    const size_t max_pending_;
+
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    // Signalled when a worker takes a command off |queue_|.
+    std::condition_variable space_cv_;
+    std::deque<BatchCommand> queue_ GUARDED_BY(queue_mutex_);
+    bool input_done_ GUARDED_BY(queue_mutex_) = false;
+    size_t idle_workers_ GUARDED_BY(queue_mutex_) = 0;
+    std::vector<std::thread> workers_;
+
+    // Workers interleave whole packets on |fd_|.
+    std::mutex output_mutex_;
+    ShellProtocol output_ GUARDED_BY(output_mutex_);
+    bool output_failed_ GUARDED_BY(output_mutex_) = false;
+
+    DISALLOW_COPY_AND_ASSIGN(ExecBatch);
+};
+
+void ExecBatch::Run() {
+    bool orderly = ReadCommands();
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        input_done_ = true;
+        if (!orderly) {
+            // Nobody is left to read the output of the commands that haven't started yet, so
+            // don't run them. The ones that are already running finish (or fail to write their
+            // output and get torn down) as usual.
+            D("exec-batch: dropping %zu queued commands", queue_.size());
+            queue_.clear();
+        }
+    }
+    queue_cv_.notify_all();
+
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+bool ExecBatch::ReadCommands() {
+    // Commands are only queued here, never run, so that the client can keep sending commands while
+    // they run. Once |max_pending_| of them are waiting, stop reading until a worker takes one, so
+    // that the client can't make us buffer without bound: it's held back by the socket instead.
+    auto input = std::make_unique<ShellProtocol>(fd_);
+    while (input->Read()) {
+        if (input->id() == ShellProtocol::kIdCloseStdin) {
+            return true;
+        }
+        if (input->id() != ShellProtocol::kIdStdin) {
+            continue;
+        }
+
+        uint32_t id;
+        std::string_view data;
+        if (!ExecBatchParse(*input, &id, &data)) {
+            LOG(WARNING) << "exec-batch: ignoring packet without command id";
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        space_cv_.wait(lock, [this]() REQUIRES(queue_mutex_) {
+            return queue_.size() < max_pending_;
+        });
+        queue_.push_back({id, std::string(data)});
+        if (queue_.size() > idle_workers_ && workers_.size() < max_workers_) {
+            workers_.emplace_back(&ExecBatch::WorkerLoop, this);
+        }
+        lock.unlock();
+        queue_cv_.notify_one();
+    }
+    D("exec-batch: client closed the stream");
+    return false;
+}
+
+void ExecBatch::WorkerLoop() {
+    adb_thread_setname("exec-batch");
+    while (true) {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        ++idle_workers_;
+        queue_cv_.wait(lock, [this]() REQUIRES(queue_mutex_) {
+            return !queue_.empty() || input_done_;
+        });
+        --idle_workers_;
+        if (queue_.empty()) {
+            return;
+        }
+        BatchCommand command = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        space_cv_.notify_one();
+
+        RunCommand(command);
+    }
+}
+
+void ExecBatch::RunCommand(const BatchCommand& command) {
+    D("exec-batch: running command %u: '%s'", command.id, command.command.c_str());
+
+    unique_fd fd = StartSubprocess(command.command, nullptr, SubprocessType::kRaw,
+                                   SubprocessProtocol::kShell);
+    if (fd < 0) {
+        static constexpr char kError[] = "exec-batch: failed to start command\n";
+        char exit_code = 1;
+        Send(ShellProtocol::kIdStderr, command.id, kError, sizeof(kError) - 1);
+        Send(ShellProtocol::kIdExit, command.id, &exit_code, 1);
+        return;
+    }
+
+    // The subprocess speaks the shell protocol itself, so its packets only need the command id
+    // added before they're forwarded.
+    auto protocol = std::make_unique<ShellProtocol>(fd);
+    if (!protocol->Write(ShellProtocol::kIdCloseStdin, 0)) {
+        PLOG(WARNING) << "exec-batch: failed to close stdin of command " << command.id;
+    }
+
+    // Like ssh, report 255 if the command went away without an exit code.
+    char exit_code = static_cast<char>(255);
+    while (protocol->Read()) {
+        int id = protocol->id();
+        if (id == ShellProtocol::kIdStdout || id == ShellProtocol::kIdStderr) {
+            if (!Send(static_cast<ShellProtocol::Id>(id), command.id, protocol->data(),
+                      protocol->data_length())) {
+                // Closing |fd| tears the subprocess down.
+                return;
+            }
+        } else if (id == ShellProtocol::kIdExit && protocol->data_length() == 1) {
+            exit_code = protocol->data()[0];
+            break;
+        }
+    }
+    Send(ShellProtocol::kIdExit, command.id, &exit_code, 1);
+}
+
+bool ExecBatch::Send(ShellProtocol::Id id, uint32_t command_id, const char* data,
+                     size_t length) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (output_failed_) {
+        return false;
+    }
+    if (!ExecBatchWrite(&output_, id, command_id, data, length)) {
+        D("exec-batch: client went away");
+        output_failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+void exec_batch_service(unique_fd fd, size_t max_workers, size_t max_pending) {
+    // ExecBatch holds a ShellProtocol buffer, which is too big for the stack.
+    auto batch = std::make_unique<ExecBatch>(std::move(fd), max_workers, max_pending);
+    batch->Run();
+}
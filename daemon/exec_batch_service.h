@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "adb_unique_fd.h"
+
+// Runs the commands sent over |fd| (see exec_batch_protocol.h), at most |max_workers| at a time.
+// Once |max_pending| commands are waiting for a worker, no more are read from |fd| until one of
+// them starts.
+void exec_batch_service(unique_fd fd, size_t max_workers, size_t max_pending);
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "daemon/exec_batch_service.h"
+
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+
+#include "exec_batch_protocol.h"
+#include "shell_protocol.h"
+#include "sysdeps.h"
+
+using namespace std::chrono_literals;
+
+class ExecBatchServiceTest : public ::testing::Test {
+  public:
+    static void SetUpTestCase() {
+        // This is normally done in main.cpp.
+        saved_sigpipe_handler_ = signal(SIGPIPE, SIG_IGN);
+    }
+
+    static void TearDownTestCase() { signal(SIGPIPE, saved_sigpipe_handler_); }
+
+    static sighandler_t saved_sigpipe_handler_;
+};
+
+sighandler_t ExecBatchServiceTest::saved_sigpipe_handler_ = nullptr;
+
+// Pipelines many more commands than may be pending while the only worker is stuck, and checks
+// that the service stops reading them until it's unstuck, and then runs them all.
+TEST_F(ExecBatchServiceTest, pipelined_commands_past_pending_limit) {
+    static constexpr size_t kMaxPending = 2;
+    static constexpr uint32_t kCommands = 256;
+
+    TemporaryDir td;
+    std::string fifo = std::string(td.path) + "/fifo";
+    ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+
+    int fds[2];
+    ASSERT_EQ(0, adb_socketpair(fds));
+    unique_fd client_fd(fds[0]);
+    unique_fd service_fd(fds[1]);
+    std::thread service(
+            [&service_fd]() { exec_batch_service(std::move(service_fd), 1, kMaxPending); });
+
+    // Blocks the only worker until the FIFO is written to.
+    std::string blocker = "read line < " + fifo;
+    // Padded so that the socket holds few of them.
+    std::string command = "true " + std::string(32 * 1024, 'x');
+    std::atomic<uint32_t> sent = 0;
+    std::thread sender([&]() {
+        auto protocol = std::make_unique<ShellProtocol>(client_fd);
+        if (!ExecBatchWrite(protocol.get(), ShellProtocol::kIdStdin, 0, blocker.data(),
+                            blocker.size())) {
+            return;
+        }
+        for (uint32_t id = 1; id <= kCommands; ++id) {
+            if (!ExecBatchWrite(protocol.get(), ShellProtocol::kIdStdin, id, command.data(),
+                                command.size())) {
+                return;
+            }
+            ++sent;
+        }
+        protocol->Write(ShellProtocol::kIdCloseStdin, 0);
+    });
+
+    // Wait for the sender to get stuck.
+    uint32_t last_sent;
+    do {
+        last_sent = sent;
+        std::this_thread::sleep_for(200ms);
+    } while (sent != last_sent);
+    EXPECT_LT(last_sent, kCommands);
+
+    unique_fd fifo_fd(adb_open(fifo.c_str(), O_WRONLY));
+    ASSERT_GE(fifo_fd.get(), 0);
+    ASSERT_EQ(1, adb_write(fifo_fd.get(), "\n", 1));
+    fifo_fd.reset();
+
+    // There's a single worker, so the commands finish in order.
+    auto protocol = std::make_unique<ShellProtocol>(client_fd);
+    for (uint32_t expected_id = 0; expected_id <= kCommands; ++expected_id) {
+        uint32_t id;
+        std::string_view data;
+        ASSERT_TRUE(protocol->Read());
+        ASSERT_EQ(ShellProtocol::kIdExit, protocol->id());
+        ASSERT_TRUE(ExecBatchParse(*protocol, &id, &data));
+        ASSERT_EQ(expected_id, id);
+        ASSERT_EQ(std::string_view("\0", 1), data);
+    }
+    ASSERT_FALSE(protocol->Read());
+
+    sender.join();
+    service.join();
+}
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/fb.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,161 +29,152 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <memory>
+
+#include <android-base/logging.h>
+
 #include "sysdeps.h"
 
 #include "adb.h"
 #include "adb_io.h"
 #include "adb_utils.h"
+#include "framebuffer_stream.h"
 
 /* TODO:
 ** - sync with vsync to avoid tearing
 */
-/* This version number defines the format of the fbinfo struct.
-   It must match versioning in ddms where this data is consumed. */
-#define DDMS_RAWIMAGE_VERSION 2
-struct fbinfo {
-    unsigned int version;
-    unsigned int bpp;
-    unsigned int colorSpace;
-    unsigned int size;
-    unsigned int width;
-    unsigned int height;
-    unsigned int red_offset;
-    unsigned int red_length;
-    unsigned int blue_offset;
-    unsigned int blue_length;
-    unsigned int green_offset;
-    unsigned int green_length;
-    unsigned int alpha_offset;
-    unsigned int alpha_length;
-} __attribute__((packed));
 
-void framebuffer_service(unique_fd fd) {
-    struct fbinfo fbinfo;
-    unsigned int i, bsize;
-    char buf[640];
-    int fd_screencap;
-    int w, h, f, c;
-    int fds[2];
+// screencap writes a whole frame before exiting, so give it a pipe big enough that it isn't woken
+// up for every page we take out of it. Failing to resize the pipe (e.g. because of
+// /proc/sys/fs/pipe-max-size) just makes things slower.
+static constexpr int kScreencapPipeSize = 1024 * 1024;
+
+// The largest amount of data moved by one splice or read/write.
+static constexpr size_t kCopyChunkSize = 1024 * 1024;
+
+// Starts screencap with its output going to |output|. Returns the pid, or -1 on failure.
+//
+// posix_spawn doesn't copy adbd's page tables like fork does, which is most of the cost of starting
+// a short-lived child from a process with as many threads and mappings as adbd.
+static pid_t StartScreencap(unique_fd* output) {
+    unique_fd read_end, write_end;
+    if (!Pipe(&read_end, &write_end)) return -1;
+    fcntl(read_end.get(), F_SETPIPE_SZ, kScreencapPipeSize);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, write_end.get(), STDOUT_FILENO);
+
     pid_t pid;
+    const char* command = "screencap";
+    const char* args[2] = {command, nullptr};
+    int rc = posix_spawnp(&pid, command, &actions, nullptr, const_cast<char**>(args), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        errno = rc;
+        PLOG(ERROR) << "failed to start screencap";
+        return -1;
+    }
 
-    if (pipe2(fds, O_CLOEXEC) < 0) return;
+    *output = std::move(read_end);
+    return pid;
+}
 
-    pid = fork();
-    if (pid < 0) goto done;
+// Moves |*size| bytes from |in| to |out| without copying them through userspace, counting |*size|
+// down as it goes. Returns false if the kernel can't splice between these FDs, in which case the
+// rest has to be copied.
+static bool SpliceScreencapData(borrowed_fd in, borrowed_fd out, size_t* size, bool* error) {
+    while (*size > 0) {
+        ssize_t rc = TEMP_FAILURE_RETRY(splice(in.get(), nullptr, out.get(), nullptr,
+                                               std::min(*size, kCopyChunkSize),
+                                               SPLICE_F_MOVE | SPLICE_F_MORE));
+        if (rc < 0 && errno == EINVAL) {
+            return false;
+        }
+        if (rc <= 0) {
+            *error = true;
+            return true;
+        }
+        *size -= rc;
+    }
+    return true;
+}
 
-    if (pid == 0) {
-        dup2(fds[1], STDOUT_FILENO);
-        adb_close(fds[0]);
-        adb_close(fds[1]);
-        const char* command = "screencap";
-        const char *args[2] = {command, nullptr};
-        execvp(command, (char**)args);
-        perror("exec screencap failed");
-        _exit(127);
+bool SendScreencapData(borrowed_fd screencap, borrowed_fd fd, size_t size, bool allow_splice) {
+    bool error = false;
+    if (allow_splice && SpliceScreencapData(screencap, fd, &size, &error)) {
+        return !error;
     }
 
-    adb_close(fds[1]);
-    fd_screencap = fds[0];
-
-    /* read w, h, format & color space */
-    if(!ReadFdExactly(fd_screencap, &w, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &h, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &f, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &c, 4)) goto done;
-
-    fbinfo.version = DDMS_RAWIMAGE_VERSION;
-    fbinfo.colorSpace = c;
-    /* see hardware/hardware.h */
-    switch (f) {
-        case 1: /* RGBA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
-            break;
-        case 2: /* RGBX_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
-            break;
-        case 3: /* RGB_888 */
-            fbinfo.bpp = 24;
-            fbinfo.size = w * h * 3;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
-            break;
-        case 4: /* RGB_565 */
-            fbinfo.bpp = 16;
-            fbinfo.size = w * h * 2;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 11;
-            fbinfo.red_length = 5;
-            fbinfo.green_offset = 5;
-            fbinfo.green_length = 6;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 5;
-            fbinfo.alpha_offset = 0;
-            fbinfo.alpha_length = 0;
-            break;
-        case 5: /* BGRA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 16;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
-           break;
-        default:
-            goto done;
+    auto buf = std::make_unique<char[]>(std::min(size, kCopyChunkSize));
+    while (size > 0) {
+        // Take whatever is in the pipe rather than waiting for a full buffer, so that writing to
+        // the socket overlaps with screencap producing the rest.
+        ssize_t rc = adb_read(screencap, buf.get(), std::min(size, kCopyChunkSize));
+        if (rc <= 0) {
+            return false;
+        }
+        if (!WriteFdExactly(fd, buf.get(), rc)) {
+            return false;
+        }
+        size -= rc;
     }
+    return true;
+}
+
+bool SendScreencapFrame(borrowed_fd screencap, borrowed_fd fd, bool allow_splice) {
+    // Width, height, format and color space.
+    uint32_t header[4];
+    if (!ReadFdExactly(screencap, header, sizeof(header))) return false;
 
-    /* write header */
-    if (!WriteFdExactly(fd.get(), &fbinfo, sizeof(fbinfo))) goto done;
+    fbinfo info;
+    if (!FillFbinfo(header[2], header[0], header[1], header[3], &info)) return false;
+    if (!WriteFdExactly(fd, &info, sizeof(info))) return false;
 
-    /* write data */
-    for(i = 0; i < fbinfo.size; i += bsize) {
-      bsize = sizeof(buf);
-      if (i + bsize > fbinfo.size)
-        bsize = fbinfo.size - i;
-      if(!ReadFdExactly(fd_screencap, buf, bsize)) goto done;
-      if (!WriteFdExactly(fd.get(), buf, bsize)) goto done;
+    return SendScreencapData(screencap, fd, info.size, allow_splice);
+}
+
+void framebuffer_service(unique_fd fd) {
+    unique_fd fd_screencap;
+    pid_t pid = StartScreencap(&fd_screencap);
+    if (pid < 0) return;
+
+    SendScreencapFrame(fd_screencap, fd);
+
+    fd_screencap.reset();
+    TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+}
+
+// Runs screencap once, and reads its output into |frame|.
+static bool CaptureFrame(FramebufferFrame* frame) {
+    unique_fd fd_screencap;
+    pid_t pid = StartScreencap(&fd_screencap);
+    if (pid < 0) {
+        return false;
     }
 
-done:
-    adb_close(fds[0]);
+    uint32_t header[4];
+    fbinfo info;
+    bool result = ReadFdExactly(fd_screencap, header, sizeof(header)) &&
+                  FillFbinfo(header[2], header[0], header[1], header[3], &info);
+    if (result) {
+        frame->width = header[0];
+        frame->height = header[1];
+        frame->format = header[2];
+        frame->color_space = header[3];
+        frame->pixels.resize(info.size);
+        result = ReadFdExactly(fd_screencap, frame->pixels.data(), frame->pixels.size());
+    }
+    if (!result) {
+        LOG(ERROR) << "failed to read frame from screencap";
+    }
 
+    fd_screencap.reset();
     TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+    return result;
+}
+
+void framebuffer_stream_service(unique_fd fd, FramebufferStreamOptions options) {
+    SendFramebufferStream(fd, options, CaptureFrame);
 }
@@ -16,8 +16,19 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include "adb_unique_fd.h"
+#include "framebuffer_stream.h"
 
 #if defined(__ANDROID__)
+// Copies |size| bytes of screencap output from |screencap| to |fd|, splicing them if possible and
+// |allow_splice| is set.
+bool SendScreencapData(borrowed_fd screencap, borrowed_fd fd, size_t size, bool allow_splice);
+
+// Reads a frame from |screencap| and sends it to |fd| in the framebuffer: service's format.
+bool SendScreencapFrame(borrowed_fd screencap, borrowed_fd fd, bool allow_splice = true);
+
 void framebuffer_service(unique_fd fd);
+void framebuffer_stream_service(unique_fd fd, FramebufferStreamOptions options);
 #endif
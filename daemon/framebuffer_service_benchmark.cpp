@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sysdeps.h"
+
+#include <fcntl.h>
+
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include "adb_io.h"
+#include "adb_trace.h"
+#include "daemon/framebuffer_service.h"
+
+// A 1080p RGBA_8888 frame, as screencap would write it.
+static constexpr uint32_t kWidth = 1920;
+static constexpr uint32_t kHeight = 1080;
+static constexpr uint32_t kFormatRgba8888 = 1;
+static constexpr size_t kFrameSize = kWidth * kHeight * 4;
+
+// Stands in for screencap: writes a header and a frame to a pipe as fast as the reader allows.
+static std::thread StartSyntheticScreencap(unique_fd* output) {
+    unique_fd read_end, write_end;
+    if (!android::base::Pipe(&read_end, &write_end)) {
+        PLOG(FATAL) << "failed to create pipe";
+    }
+    fcntl(read_end.get(), F_SETPIPE_SZ, 1024 * 1024);
+    *output = std::move(read_end);
+
+    return std::thread([fd = std::move(write_end)]() {
+        static const std::vector<char> frame(kFrameSize, 0x5a);
+        uint32_t header[4] = {kWidth, kHeight, kFormatRgba8888, 0};
+        WriteFdExactly(fd, header, sizeof(header));
+        WriteFdExactly(fd, frame.data(), frame.size());
+    });
+}
+
+// What framebuffer_service used to do: copy through a 640 byte buffer.
+static bool SendScreencapFrameLegacy(borrowed_fd screencap, borrowed_fd fd) {
+    uint32_t header[4];
+    fbinfo info;
+    if (!ReadFdExactly(screencap, header, sizeof(header)) ||
+        !FillFbinfo(header[2], header[0], header[1], header[3], &info) ||
+        !WriteFdExactly(fd, &info, sizeof(info))) {
+        return false;
+    }
+
+    char buf[640];
+    for (size_t i = 0; i < info.size; i += sizeof(buf)) {
+        size_t size = std::min(sizeof(buf), info.size - i);
+        if (!ReadFdExactly(screencap, buf, size) || !WriteFdExactly(fd, buf, size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum class CopyMode { Legacy, Buffered, Splice };
+
+// Sends frames from the synthetic source to a socketpair, like the framebuffer: service sends them
+// to the client, and reports the throughput.
+template <CopyMode kMode>
+void BM_Framebuffer_SendFrame(benchmark::State& state) {
+    int fds[2];
+    if (adb_socketpair(fds) != 0) {
+        PLOG(FATAL) << "failed to create socketpair";
+    }
+    unique_fd socket(fds[0]);
+    unique_fd reader(fds[1]);
+
+    std::thread drain([&reader]() {
+        std::vector<char> buf(256 * 1024);
+        while (adb_read(reader.get(), buf.data(), buf.size()) > 0) {
+            continue;
+        }
+    });
+
+    for (auto _ : state) {
+        unique_fd screencap;
+        std::thread source = StartSyntheticScreencap(&screencap);
+        bool sent = kMode == CopyMode::Legacy
+                            ? SendScreencapFrameLegacy(screencap, socket)
+                            : SendScreencapFrame(screencap, socket, kMode == CopyMode::Splice);
+        if (!sent) {
+            LOG(FATAL) << "failed to send frame";
+        }
+        source.join();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * kFrameSize));
+
+    adb_shutdown(socket.get());
+    drain.join();
+}
+
+BENCHMARK_TEMPLATE(BM_Framebuffer_SendFrame, CopyMode::Legacy)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Framebuffer_SendFrame, CopyMode::Buffered)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Framebuffer_SendFrame, CopyMode::Splice)->UseRealTime();
+
+int main(int argc, char** argv) {
+    android::base::SetMinimumLogSeverity(android::base::WARNING);
+    adb_trace_init(argv);
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -28,8 +28,11 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <list>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -37,6 +40,7 @@
 #include <android-base/cmsg.h>
 #include <android-base/file.h>
 #include <android-base/unique_fd.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <processgroup/processgroup.h>
 
 #include "adb.h"
@@ -44,6 +48,7 @@
 #include "adb_unique_fd.h"
 #include "adb_utils.h"
 #include "app_processes.pb.h"
+#include "daemon/app_process_tracker.h"
 
 using android::base::borrowed_fd;
 using android::base::unique_fd;
@@ -138,11 +143,11 @@ using android::base::unique_fd;
 enum class TrackerKind {
     kJdwp,
     kApp,
+    kAppDelta,
 };
 
 static void jdwp_process_event(int socket, unsigned events, void* _proc);
-static void jdwp_process_list_updated();
-static void app_process_list_updated();
+static void process_list_changed(const ProcessInfo* before, const ProcessInfo* after);
 
 struct JdwpProcess;
 static auto& _jdwp_list = *new std::list<std::unique_ptr<JdwpProcess>>();
@@ -213,22 +218,28 @@ static size_t jdwp_process_list(char* buffer, size_t bufferlen) {
 // Populate the list of processes for "track-app" service.
 // The list is a protobuf message in the binary format for efficiency.
 static size_t app_process_list(char* buffer, size_t bufferlen) {
-    adb::proto::AppProcesses output;  // result that's guaranteed to fit in the given buffer
-    adb::proto::AppProcesses temp;    // temporary result that may be longer than the given buffer
-    std::string serialized_message;
+    adb::proto::AppProcesses output;
+    size_t output_size = 0;
 
     for (auto& proc : _jdwp_list) {
-        if (!proc->process.debuggable && !proc->process.profileable) continue;
-        auto* entry = temp.add_process();
-        *entry = proc->process.toProtobuf();
-        temp.SerializeToString(&serialized_message);
-        if (serialized_message.size() > bufferlen) {
+        if (!is_app_process(proc->process)) continue;
+        adb::proto::ProcessEntry entry = proc->process.toProtobuf();
+
+        // Each entry adds a tag byte, its varint length and its contents to the serialized
+        // message, so we can tell whether it fits without re-serializing everything so far.
+        size_t entry_size = entry.ByteSizeLong();
+        size_t field_size =
+                1 + google::protobuf::io::CodedOutputStream::VarintSize64(entry_size) + entry_size;
+        if (output_size + field_size > bufferlen) {
             D("truncating app process list (max len = %zu)", bufferlen);
             break;
         }
-        output = temp;
+        output_size += field_size;
+        *output.add_process() = std::move(entry);
     }
-    output.SerializeToString(&serialized_message);
+
+    std::string serialized_message = output.SerializeAsString();
+    CHECK_EQ(output_size, serialized_message.size());
     memcpy(buffer, serialized_message.data(), serialized_message.length());
     return serialized_message.length();
 }
@@ -241,7 +252,11 @@ static size_t process_list(TrackerKind kind, char* buffer, size_t bufferlen) {
             return jdwp_process_list(buffer, bufferlen);
         case TrackerKind::kApp:
             return app_process_list(buffer, bufferlen);
+        case TrackerKind::kAppDelta:
+            break;
     }
+    LOG(FATAL) << "track-app-delta doesn't send full lists";
+    return 0;
 }
 
 static size_t process_list_msg(TrackerKind kind, char* buffer, size_t bufferlen) {
@@ -271,9 +286,9 @@ static void jdwp_process_event(int socket, unsigned events, void* _proc) {
         }
 
         VLOG(JDWP) << "Received JDWP Process info for pid=" << process_info->pid;
+        ProcessInfo before = proc->process;
         proc->process = std::move(*process_info);
-        jdwp_process_list_updated();
-        app_process_list_updated();
+        process_list_changed(&before, &proc->process);
     }
 
     if (events & FDE_WRITE) {
@@ -300,11 +315,9 @@ static void jdwp_process_event(int socket, unsigned events, void* _proc) {
 
 CloseProcess:
     VLOG(JDWP) << "Process " << proc->process.pid << " has disconnected";
-    bool debuggable = proc->process.debuggable;
-    bool profileable = proc->process.profileable;
+    ProcessInfo before = proc->process;
     proc->RemoveFromList();
-    if (debuggable) jdwp_process_list_updated();
-    if (debuggable || profileable) app_process_list_updated();
+    process_list_changed(&before, nullptr);
 }
 
 static bool is_process_in_freezer(const ProcessInfo& info) {
@@ -352,6 +365,16 @@ static unique_fd send_socket_to_process(JdwpProcess& proc) {
     }
 
     VLOG(JDWP) << std::format("socketpair: ({},{})", fds[0], fds[1]);
+
+    // DDM traffic (heap dumps, method traces) can be tens of megabytes. With the default buffer
+    // size, ART blocks as soon as a couple of hundred kilobytes are queued, and each round trip
+    // to the host only carries what fit in the socket while we were waiting for its ack. Let a
+    // whole max-size packet (and then some) queue up in each direction instead, like the sync
+    // service does.
+    int max_buf = LINUX_MAX_SOCKET_SIZE;
+    adb_setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &max_buf, sizeof(max_buf));
+    adb_setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &max_buf, sizeof(max_buf));
+
     proc.out_fds.emplace_back(fds[1]);
     if (proc.out_fds.size() == 1) {
         fdevent_add(proc.fde, FDE_WRITE);
@@ -457,8 +480,25 @@ struct JdwpTracker : public asocket {
 };
 
 static auto& _jdwp_trackers = *new std::vector<std::unique_ptr<JdwpTracker>>();
+static auto& _app_delta_tracker = *new AppProcessDeltaTracker();
+
+// Sends |msg| to the tracker's peer, split into as many packets as it takes.
+static void tracker_send(JdwpTracker* t, std::string_view msg) {
+    size_t max_payload = t->get_max_payload();
+    while (!msg.empty() && t->peer) {
+        size_t len = std::min(max_payload, msg.size());
+        apacket::payload_type payload(msg.begin(), msg.begin() + len);
+        t->peer->enqueue(t->peer, std::move(payload));
+        msg.remove_prefix(len);
+    }
+}
 
 static void process_list_updated(TrackerKind kind) {
+    auto pred = [kind](const auto& t) { return t->kind == kind && t->peer; };
+    if (std::none_of(_jdwp_trackers.begin(), _jdwp_trackers.end(), pred)) {
+        return;
+    }
+
     // Find out the max payload we can output.
     // We start with the max the protocol can handle (hex4).
     size_t maxPayload = UINT16_MAX;
@@ -487,6 +527,22 @@ static void app_process_list_updated() {
     process_list_updated(TrackerKind::kApp);
 }
 
+// Tells the trackers that a process was added (|before| is null), went away (|after| is null), or
+// that its info changed.
+static void process_list_changed(const ProcessInfo* before, const ProcessInfo* after) {
+    if ((before && before->debuggable) || (after && after->debuggable)) {
+        jdwp_process_list_updated();
+    }
+
+    bool was_app = before && is_app_process(*before);
+    bool is_app = after && is_app_process(*after);
+    if (!was_app && !is_app) {
+        return;
+    }
+    app_process_list_updated();
+    _app_delta_tracker.ProcessChanged(before, after);
+}
+
 static void jdwp_tracker_close(asocket* s) {
     D("LS(%d): destroying jdwp tracker service", s->id);
 
@@ -498,6 +554,7 @@ static void jdwp_tracker_close(asocket* s) {
     }
 
     remove_socket(s);
+    _app_delta_tracker.Unsubscribe(s);
 
     auto pred = [s](const auto& tracker) { return tracker.get() == s; };
     _jdwp_trackers.erase(std::remove_if(_jdwp_trackers.begin(), _jdwp_trackers.end(), pred),
@@ -508,10 +565,15 @@ static void jdwp_tracker_ready(asocket* s) {
     JdwpTracker* t = (JdwpTracker*)s;
 
     if (t->need_initial) {
+        t->need_initial = false;
+        if (t->kind == TrackerKind::kAppDelta) {
+            _app_delta_tracker.Ready(t);
+            return;
+        }
+
         apacket::payload_type data;
         data.resize(s->get_max_payload());
         data.resize(process_list_msg(t->kind, &data[0], data.size()));
-        t->need_initial = false;
         s->peer->enqueue(s->peer, std::move(data));
     }
 }
@@ -543,6 +605,11 @@ static asocket* create_process_tracker_service_socket(TrackerKind kind) {
     t->close = jdwp_tracker_close;
 
     asocket* result = t.get();
+    if (kind == TrackerKind::kAppDelta) {
+        JdwpTracker* tracker = t.get();
+        _app_delta_tracker.Subscribe(
+                tracker, [tracker](std::string_view msg) { tracker_send(tracker, msg); });
+    }
 
     _jdwp_trackers.emplace_back(std::move(t));
 
@@ -557,6 +624,10 @@ asocket* create_app_tracker_service_socket() {
     return create_process_tracker_service_socket(TrackerKind::kApp);
 }
 
+asocket* create_app_delta_tracker_service_socket() {
+    return create_process_tracker_service_socket(TrackerKind::kAppDelta);
+}
+
 int init_jdwp() {
     std::thread([]() {
         adb_thread_setname("jdwp control");
@@ -569,8 +640,7 @@ int init_jdwp() {
                     LOG(FATAL) << "failed to allocate JdwpProcess";
                 }
                 _jdwp_list.emplace_back(std::move(proc));
-                if (process.debuggable) jdwp_process_list_updated();
-                if (process.debuggable || process.profileable) app_process_list_updated();
+                process_list_changed(nullptr, &process);
             });
         });
     }).detach();
@@ -596,6 +666,10 @@ asocket* create_jdwp_tracker_service_socket() {
     return nullptr;
 }
 
+asocket* create_app_delta_tracker_service_socket() {
+    return nullptr;
+}
+
 int init_jdwp() {
     return 0;
 }
@@ -23,6 +23,7 @@ int init_jdwp();
 asocket* create_jdwp_service_socket();
 asocket* create_jdwp_tracker_service_socket();
 asocket* create_app_tracker_service_socket();
+asocket* create_app_delta_tracker_service_socket();
 
 // Create a socket pair. Send one end to the debuggable process `jdwp_pid` and
 // return the other one.
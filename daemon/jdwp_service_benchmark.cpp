@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG JDWP
+
+#include "sysdeps.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <adbconnection/client.h>
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include "adb.h"
+#include "adb_io.h"
+#include "adb_trace.h"
+#include "daemon/jdwp_service.h"
+#include "fdevent/fdevent.h"
+#include "socket.h"
+
+using namespace std::chrono_literals;
+
+// Measures how fast DDM data (think heap dumps) gets from ART to the transport: a fake ART,
+// registered through libadbconnection like the real one, writes chunks into the JDWP connection
+// adbd handed it; adbd's local socket reads them and passes them to a stand-in for the remote
+// socket, which acks them after a simulated round trip to the host.
+//
+// init_jdwp() listens on @jdwp-control, so stop adbd before running this on a device.
+
+// A heap dump's worth of data is sent per iteration, in DDM chunks of this size.
+static constexpr size_t kDumpSize = 32 * 1024 * 1024;
+static constexpr size_t kChunkSize = 64 * 1024;
+
+static void RunOnLooper(std::function<void()> fn) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    fdevent_run_on_looper([&]() {
+        fn();
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&done]() { return done; });
+}
+
+// Starts the fdevent loop and the JDWP control socket as adbd does, and registers this process
+// with it the way ART's adbconnection plugin does. Returns the client context.
+static AdbConnectionClientContext* StartAdbdAndArt() {
+    static AdbConnectionClientContext* ctx = []() {
+        std::thread([]() { fdevent_loop(); }).detach();
+        init_jdwp();
+
+        AdbConnectionClientInfo pid_info = {};
+        pid_info.type = AdbConnectionClientInfoType::pid;
+        pid_info.data.pid = getpid();
+        AdbConnectionClientInfo debuggable_info = {};
+        debuggable_info.type = AdbConnectionClientInfoType::debuggable;
+        debuggable_info.data.debuggable = true;
+        const AdbConnectionClientInfo* infos[] = {&pid_info, &debuggable_info};
+
+        // The control socket is set up asynchronously.
+        AdbConnectionClientContext* result = nullptr;
+        for (int attempt = 0; attempt < 100 && !result; ++attempt) {
+            result = adbconnection_client_new(infos, std::size(infos));
+            if (!result) std::this_thread::sleep_for(10ms);
+        }
+        if (!result) {
+            LOG(FATAL) << "failed to connect to the JDWP control socket";
+        }
+        return result;
+    }();
+    return ctx;
+}
+
+// Does what a debugger's jdwp:<pid> does, returning adbd's end of the connection and setting
+// |art_end| to the end ART receives.
+static unique_fd ConnectDebugger(AdbConnectionClientContext* ctx, unique_fd* art_end) {
+    // Retry until adbd has processed our registration.
+    unique_fd adbd_end;
+    for (int attempt = 0; attempt < 100 && adbd_end < 0; ++attempt) {
+        RunOnLooper([&adbd_end]() { adbd_end = create_jdwp_connection_fd(getpid()); });
+        if (adbd_end < 0) std::this_thread::sleep_for(10ms);
+    }
+    if (adbd_end < 0) {
+        LOG(FATAL) << "adbd doesn't know about the fake ART";
+    }
+
+    adb_pollfd pfd = {.fd = adbconnection_client_pollfd(ctx), .events = POLLIN};
+    if (adb_poll(&pfd, 1, 5000) != 1) {
+        LOG(FATAL) << "adbd didn't send a JDWP connection";
+    }
+    art_end->reset(adbconnection_client_receive_jdwp_fd(ctx));
+    if (*art_end < 0) {
+        LOG(FATAL) << "failed to receive JDWP connection";
+    }
+    return adbd_end;
+}
+
+// The remote socket's side of a jdwp: connection: counts the bytes the local socket sends to the
+// host, and acks them |rtt| later from a separate thread, standing in for the link and the host.
+struct FakeRemoteSocket : public asocket {
+    FakeRemoteSocket(bool delayed_ack, std::chrono::microseconds rtt)
+        : delayed_ack(delayed_ack), rtt(rtt) {
+        enqueue = [](asocket* s, apacket::payload_type data) {
+            return static_cast<FakeRemoteSocket*>(s)->Receive(data.size());
+        };
+        ready = [](asocket*) {};
+        close = [](asocket* s) { s->peer = nullptr; };
+        ack_thread = std::thread([this]() { AckLoop(); });
+    }
+
+    ~FakeRemoteSocket() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        cv.notify_all();
+        ack_thread.join();
+    }
+
+    // Called on the fdevent thread.
+    int Receive(size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received += size;
+        acks.emplace_back(std::chrono::steady_clock::now() + rtt, size);
+        cv.notify_all();
+        return 1;
+    }
+
+    void AckLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopped) {
+            if (acks.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+            auto [due, size] = acks.front();
+            if (std::chrono::steady_clock::now() < due) {
+                cv.wait_until(lock, due);
+                continue;
+            }
+            acks.pop_front();
+            fdevent_run_on_looper([this, size = size]() {
+                if (!peer) return;
+                local_socket_ack(peer, delayed_ack ? std::optional<int32_t>(size) : std::nullopt);
+            });
+        }
+    }
+
+    void WaitForBytes(size_t total) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this, total]() { return received >= total; });
+    }
+
+    const bool delayed_ack;
+    const std::chrono::microseconds rtt;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t received = 0;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, size_t>> acks;
+    bool stopped = false;
+    std::thread ack_thread;
+};
+
+// A DDMS packet carrying an HPDS (heap dump segment) chunk of |size| bytes.
+static std::vector<char> MakeDdmPacket(size_t size) {
+    static constexpr size_t kJdwpHeaderSize = 11;
+    static constexpr size_t kChunkHeaderSize = 8;
+    std::vector<char> packet(kJdwpHeaderSize + kChunkHeaderSize + size, 0x5a);
+    auto put32 = [&packet](size_t offset, uint32_t value) {
+        packet[offset] = value >> 24;
+        packet[offset + 1] = value >> 16;
+        packet[offset + 2] = value >> 8;
+        packet[offset + 3] = value;
+    };
+    put32(0, packet.size());
+    put32(4, 1);        // id
+    packet[8] = 0;      // flags: command
+    packet[9] = 0xc7;   // DDMS command set
+    packet[10] = 0x01;  // chunk
+    memcpy(&packet[11], "HPDS", 4);
+    put32(15, size);
+    return packet;
+}
+
+// Arguments: whether delayed acks are in use, the simulated round trip to the host in
+// microseconds, and whether to put the connection back to the system's default socket buffer size,
+// to compare against what adbd configures.
+static void BM_Jdwp_DdmThroughput(benchmark::State& state) {
+    AdbConnectionClientContext* ctx = StartAdbdAndArt();
+
+    bool delayed_ack = state.range(0);
+    std::chrono::microseconds rtt(state.range(1));
+    bool default_buffers = state.range(2);
+
+    unique_fd art_end;
+    unique_fd adbd_end = ConnectDebugger(ctx, &art_end);
+    if (default_buffers) {
+        unique_fd probe(socket(AF_UNIX, SOCK_STREAM, 0));
+        int size;
+        socklen_t len = sizeof(size);
+        getsockopt(probe.get(), SOL_SOCKET, SO_SNDBUF, &size, &len);
+        // The kernel doubles whatever is set.
+        size /= 2;
+        adb_setsockopt(art_end, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        adb_setsockopt(adbd_end, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+
+    auto remote = std::make_unique<FakeRemoteSocket>(delayed_ack, rtt);
+    RunOnLooper([&]() {
+        asocket* local = create_local_socket(std::move(adbd_end));
+        if (delayed_ack) {
+            local->available_send_bytes = INITIAL_DELAYED_ACK_BYTES;
+        }
+        local->peer = remote.get();
+        remote->peer = local;
+        local->ready(local);
+    });
+
+    std::vector<char> packet = MakeDdmPacket(kChunkSize);
+    size_t total = 0;
+    for (auto _ : state) {
+        for (size_t sent = 0; sent < kDumpSize; sent += packet.size()) {
+            if (!WriteFdExactly(art_end, packet.data(), packet.size())) {
+                LOG(FATAL) << "failed to write DDM chunk";
+            }
+            total += packet.size();
+        }
+        remote->WaitForBytes(total);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(total));
+
+    RunOnLooper([&]() {
+        if (asocket* local = remote->peer) {
+            local->peer = nullptr;
+            remote->peer = nullptr;
+            local->close(local);
+        }
+    });
+}
+
+BENCHMARK(BM_Jdwp_DdmThroughput)
+        ->ArgNames({"delayed_ack", "rtt_us", "default_buffers"})
+        ->ArgsProduct({{0, 1}, {0, 250, 1000}, {0, 1}})
+        ->UseRealTime();
+
+int main(int argc, char** argv) {
+    android::base::SetMinimumLogSeverity(android::base::WARNING);
+    adb_trace_init(argv);
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    ::benchmark::RunSpecifiedBenchmarks();
+}
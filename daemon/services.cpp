@@ -31,6 +31,7 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <thread>
 
 #include <android-base/file.h>
@@ -54,6 +55,7 @@
 #include "tradeinmode.h"
 #include "transport.h"
 
+#include "daemon/exec_batch_service.h"
 #include "daemon/file_sync_service.h"
 #include "daemon/framebuffer_service.h"
 #include "daemon/jdwp_service.h"
@@ -100,9 +102,11 @@ unique_fd ShellService(std::string_view args, const atransport* transport) {
     //   PTY for interactive, raw for non-interactive.
     //   No protocol.
     //   $TERM set to "dumb".
+    //   No compression.
     SubprocessType type(command.empty() ? SubprocessType::kPty : SubprocessType::kRaw);
     SubprocessProtocol protocol = SubprocessProtocol::kNone;
     std::string terminal_type = "dumb";
+    CompressionType compression = CompressionType::None;
 
     for (const std::string& arg : android::base::Split(service_args, ",")) {
         if (arg == kShellServiceArgRaw) {
@@ -111,6 +115,10 @@ unique_fd ShellService(std::string_view args, const atransport* transport) {
             type = SubprocessType::kPty;
         } else if (arg == kShellServiceArgShellProtocol) {
             protocol = SubprocessProtocol::kShell;
+        } else if (arg == kShellServiceArgLZ4) {
+            compression = CompressionType::LZ4;
+        } else if (arg == kShellServiceArgZstd) {
+            compression = CompressionType::Zstd;
         } else if (arg.starts_with("TERM=")) {
             terminal_type = arg.substr(strlen("TERM="));
         } else if (!arg.empty()) {
@@ -119,7 +127,12 @@ unique_fd ShellService(std::string_view args, const atransport* transport) {
         }
     }
 
-    return StartSubprocess(command, terminal_type.c_str(), type, protocol);
+    // Compressed output needs the shell protocol to carry it.
+    if (protocol == SubprocessProtocol::kNone) {
+        compression = CompressionType::None;
+    }
+
+    return StartSubprocess(command, terminal_type.c_str(), type, protocol, compression);
 }
 
 static void spin_service(unique_fd fd) {
@@ -256,6 +269,8 @@ asocket* daemon_service_to_socket(std::string_view name, atransport* transport)
         return create_jdwp_tracker_service_socket();
     } else if (name == "track-app") {
         return create_app_tracker_service_socket();
+    } else if (name == "track-app-delta") {
+        return create_app_delta_tracker_service_socket();
     } else if (android::base::ConsumePrefix(&name, "sink:")) {
         uint64_t byte_count = 0;
         if (!ParseUint(&byte_count, name)) {
@@ -289,6 +304,16 @@ unique_fd daemon_service_to_fd(std::string_view name, atransport* transport) {
 #if defined(__ANDROID__)
     if (name.starts_with("framebuffer:")) {
         return create_service_thread("fb", framebuffer_service);
+    } else if (android::base::ConsumePrefix(&name, "framebuffer-stream:")) {
+        FramebufferStreamOptions options;
+        std::string error;
+        if (!FramebufferStreamOptions::Parse(name, &options, &error)) {
+            LOG(ERROR) << error;
+            return unique_fd{};
+        }
+        return create_service_thread("fbstream", [options](unique_fd fd) {
+            framebuffer_stream_service(std::move(fd), options);
+        });
     } else if (android::base::ConsumePrefix(&name, "remount:")) {
         std::string cmd = "/system/bin/remount ";
         cmd += name;
@@ -356,6 +381,20 @@ unique_fd daemon_service_to_fd(std::string_view name, atransport* transport) {
     } else if (android::base::ConsumePrefix(&name, "exec:")) {
         return StartSubprocess(std::string(name), nullptr, SubprocessType::kRaw,
                                SubprocessProtocol::kNone);
+    } else if (android::base::ConsumePrefix(&name, "exec-batch:")) {
+        // The argument is the maximum number of commands to run at once.
+        static constexpr size_t kDefaultWorkers = 4;
+        static constexpr size_t kMaxWorkers = 32;
+        // Commands waiting for a worker; past that, the client is held back by the socket.
+        static constexpr size_t kMaxPendingCommands = 256;
+        size_t workers = kDefaultWorkers;
+        if (!name.empty() && (!ParseUint(&workers, name) || workers == 0)) {
+            return unique_fd{};
+        }
+        workers = std::min(workers, kMaxWorkers);
+        return create_service_thread("exec-batch", std::bind(exec_batch_service,
+                                                             std::placeholders::_1, workers,
+                                                             kMaxPendingCommands));
     } else if (name.starts_with("sync:")) {
         return create_service_thread("sync", file_sync_service);
     } else if (android::base::ConsumePrefix(&name, "reverse:")) {
@@ -82,6 +82,7 @@
 #include "shell_service.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <paths.h>
 #include <pty.h>
 #include <pwd.h>
@@ -110,6 +111,7 @@
 #include "adb_utils.h"
 #include "daemon/logging.h"
 #include "security_log_tags.h"
+#include "shell_compression.h"
 #include "shell_protocol.h"
 
 namespace {
@@ -172,7 +174,7 @@ struct SubprocessPollfds {
 class Subprocess {
   public:
     Subprocess(std::string command, const char* terminal_type, SubprocessType type,
-               SubprocessProtocol protocol, bool make_pty_raw);
+               SubprocessProtocol protocol, bool make_pty_raw, CompressionType compression);
     ~Subprocess();
 
     const std::string& command() const { return command_; }
@@ -211,11 +213,21 @@ class Subprocess {
     unique_fd* PassInput();
     unique_fd* PassOutput(unique_fd* sfd, ShellProtocol::Id id);
 
+    // Moves output from |sfd| to the protocol FD through a pipe with splice(), so that it never
+    // gets copied into our buffer. Returns false if splice() can't be used with these FDs, in
+    // which case nothing has been read; otherwise sets |dead_sfd| like PassOutput() does.
+    bool SpliceOutput(unique_fd* sfd, ShellProtocol::Id id, unique_fd** dead_sfd);
+
+    // Sends any compressed output that's being held back. Returns false on failure.
+    bool FlushOutput();
+    bool OutputPending() const;
+
     const std::string command_;
     const std::string terminal_type_;
     SubprocessType type_;
     SubprocessProtocol protocol_;
     bool make_pty_raw_;
+    CompressionType compression_;
     pid_t pid_ = -1;
     unique_fd local_socket_sfd_;
 
@@ -224,16 +236,26 @@ class Subprocess {
     std::unique_ptr<ShellProtocol> input_, output_;
     size_t input_bytes_left_ = 0;
 
+    // Only set if the client asked for compressed output.
+    std::unique_ptr<ShellOutputCompressor> stdout_compressor_, stderr_compressor_;
+
+    // Raw, uncompressed output is spliced to the protocol FD, see SpliceOutput().
+    bool splice_output_ = false;
+    unique_fd splice_read_, splice_write_;
+    size_t splice_size_ = 0;
+
     DISALLOW_COPY_AND_ASSIGN(Subprocess);
 };
 
 Subprocess::Subprocess(std::string command, const char* terminal_type, SubprocessType type,
-                       SubprocessProtocol protocol, bool make_pty_raw)
+                       SubprocessProtocol protocol, bool make_pty_raw,
+                       CompressionType compression)
     : command_(std::move(command)),
       terminal_type_(terminal_type ? terminal_type : ""),
       type_(type),
       protocol_(protocol),
-      make_pty_raw_(make_pty_raw) {}
+      make_pty_raw_(make_pty_raw),
+      compression_(compression) {}
 
 Subprocess::~Subprocess() {
     WaitForExit();
@@ -498,6 +520,16 @@ bool Subprocess::ConnectProtocolEndpoints(std::string* _Nonnull error) {
             return false;
         }
 
+        if (compression_ != CompressionType::None) {
+            stdout_compressor_ =
+                    std::make_unique<ShellOutputCompressor>(compression_, ShellProtocol::kIdStdout);
+            stderr_compressor_ =
+                    std::make_unique<ShellOutputCompressor>(compression_, ShellProtocol::kIdStderr);
+        } else if (type_ == SubprocessType::kRaw) {
+            // PTYs don't support splice(), and compressed output has to pass through us anyway.
+            splice_output_ = true;
+        }
+
         // Don't let reads/writes to the subprocess block our thread. This isn't
         // likely but could happen under unusual circumstances, such as if we
         // write a ton of data to stdin but the subprocess never reads it and
@@ -612,6 +644,12 @@ void Subprocess::PassDataStreams() {
             dead_sfd->reset();
         }
     }
+
+    // Whatever output is left has to go out before the exit code.
+    if (protocol_sfd_ != -1 && !FlushOutput()) {
+        PLOG(ERROR) << "error writing protocol FD " << protocol_sfd_.get();
+        protocol_sfd_.reset();
+    }
 }
 
 unique_fd* Subprocess::PollLoop(SubprocessPollfds* pfds) {
@@ -622,7 +660,10 @@ unique_fd* Subprocess::PollLoop(SubprocessPollfds* pfds) {
 
     // Keep calling poll() and passing data until an FD closes/errors.
     while (!dead_sfd) {
-        if (adb_poll(pfds->data(), pfds->size(), -1) < 0) {
+        // Compressed output is flushed as soon as the subprocess has nothing more ready, so
+        // that interactive output isn't held back waiting for a full block.
+        int rc = adb_poll(pfds->data(), pfds->size(), OutputPending() ? 0 : -1);
+        if (rc < 0) {
             if (errno == EINTR) {
                 continue;
             } else {
@@ -631,6 +672,11 @@ unique_fd* Subprocess::PollLoop(SubprocessPollfds* pfds) {
                 stderr_sfd_.reset(-1);
                 return nullptr;
             }
+        } else if (rc == 0) {
+            if (!FlushOutput()) {
+                return &protocol_sfd_;
+            }
+            continue;
         }
 
         // Read stdout, write to protocol FD.
@@ -755,7 +801,13 @@ unique_fd* Subprocess::PassInput() {
 }
 
 unique_fd* Subprocess::PassOutput(unique_fd* sfd, ShellProtocol::Id id) {
-    int bytes = adb_read(*sfd, output_->data(), output_->data_capacity());
+    unique_fd* dead_sfd = nullptr;
+    if (splice_output_ && SpliceOutput(sfd, id, &dead_sfd)) {
+        return dead_sfd;
+    }
+
+    size_t capacity = output_->data_capacity();
+    int bytes = adb_read(*sfd, output_->data(), capacity);
     if (bytes == 0 || (bytes < 0 && errno != EAGAIN)) {
         // read() returns EIO if a PTY closes; don't report this as an error,
         // it just means the subprocess completed.
@@ -765,16 +817,97 @@ unique_fd* Subprocess::PassOutput(unique_fd* sfd, ShellProtocol::Id id) {
         return sfd;
     }
 
-    if (bytes > 0 && !output_->Write(id, bytes)) {
-        if (errno != 0) {
-            PLOG(ERROR) << "error reading protocol FD " << protocol_sfd_.get();
+    if (bytes > 0) {
+        ShellOutputCompressor* compressor = id == ShellProtocol::kIdStdout
+                                                    ? stdout_compressor_.get()
+                                                    : stderr_compressor_.get();
+        bool written = compressor ? compressor->Write(output_.get(), output_->data(), bytes)
+                                  : output_->Write(id, bytes);
+        if (!written) {
+            if (errno != 0) {
+                PLOG(ERROR) << "error reading protocol FD " << protocol_sfd_.get();
+            }
+            return &protocol_sfd_;
+        }
+
+        // The buffer starts small; grow it while the subprocess keeps it full.
+        if (static_cast<size_t>(bytes) == capacity) {
+            output_->Reserve(capacity * 2);
         }
-        return &protocol_sfd_;
     }
 
     return nullptr;
 }
 
+bool Subprocess::SpliceOutput(unique_fd* sfd, ShellProtocol::Id id, unique_fd** dead_sfd) {
+    if (splice_read_.get() == -1) {
+        if (!Pipe(&splice_read_, &splice_write_)) {
+            PLOG(WARNING) << "failed to create splice pipe";
+            splice_output_ = false;
+            return false;
+        }
+        // A bigger pipe means fewer, larger packets. It's fine to be stuck with the default.
+        fcntl(splice_write_.get(), F_SETPIPE_SZ, MAX_PAYLOAD);
+        int size = fcntl(splice_write_.get(), F_GETPIPE_SZ);
+        splice_size_ = size > 0 ? size : 4096;
+    }
+
+    // The pipe is always drained before returning, so a whole pipe's worth fits.
+    ssize_t bytes = splice(sfd->get(), nullptr, splice_write_.get(), nullptr, splice_size_,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (bytes < 0) {
+        if (errno == EINVAL) {
+            D("splice not supported for fd %d, copying output instead", sfd->get());
+            splice_output_ = false;
+            splice_read_.reset();
+            splice_write_.reset();
+            return false;
+        }
+        if (errno != EAGAIN) {
+            PLOG(ERROR) << "error reading output FD " << sfd->get();
+            *dead_sfd = sfd;
+        }
+        return true;
+    } else if (bytes == 0) {
+        *dead_sfd = sfd;
+        return true;
+    }
+
+    if (!output_->WriteHeader(id, bytes)) {
+        PLOG(ERROR) << "error writing protocol FD " << protocol_sfd_.get();
+        *dead_sfd = &protocol_sfd_;
+        return true;
+    }
+    while (bytes > 0) {
+        ssize_t written = splice(splice_read_.get(), nullptr, protocol_sfd_.get(), nullptr, bytes,
+                                 SPLICE_F_MOVE);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            // Half a packet went out, so there's no way to recover the stream.
+            PLOG(ERROR) << "error writing protocol FD " << protocol_sfd_.get();
+            *dead_sfd = &protocol_sfd_;
+            return true;
+        }
+        bytes -= written;
+    }
+    return true;
+}
+
+bool Subprocess::FlushOutput() {
+    for (ShellOutputCompressor* compressor : {stdout_compressor_.get(), stderr_compressor_.get()}) {
+        if (compressor && !compressor->Flush(output_.get())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Subprocess::OutputPending() const {
+    return (stdout_compressor_ && stdout_compressor_->pending()) ||
+           (stderr_compressor_ && stderr_compressor_->pending());
+}
+
 void Subprocess::WaitForExit() {
     int exit_code = 1;
 
@@ -843,7 +976,7 @@ unique_fd ReportError(SubprocessProtocol protocol, const std::string& message) {
 }
 
 unique_fd StartSubprocess(std::string name, const char* terminal_type, SubprocessType type,
-                          SubprocessProtocol protocol) {
+                          SubprocessProtocol protocol, CompressionType compression) {
     // If we aren't using the shell protocol we must allocate a PTY to properly close the
     // subprocess. PTYs automatically send SIGHUP to the slave-side process when the master side
     // of the PTY closes, which we rely on. If we use a raw pipe, processes that don't read/write,
@@ -860,7 +993,7 @@ unique_fd StartSubprocess(std::string name, const char* terminal_type, Subproces
 
     unique_fd error_fd;
     unique_fd fd = StartSubprocess(std::move(name), terminal_type, type, protocol, make_pty_raw,
-                                   protocol, &error_fd);
+                                   protocol, &error_fd, compression);
     if (fd == -1) {
         return error_fd;
     }
@@ -869,13 +1002,14 @@ unique_fd StartSubprocess(std::string name, const char* terminal_type, Subproces
 
 unique_fd StartSubprocess(std::string name, const char* terminal_type, SubprocessType type,
                           SubprocessProtocol protocol, bool make_pty_raw,
-                          SubprocessProtocol error_protocol, unique_fd* error_fd) {
+                          SubprocessProtocol error_protocol, unique_fd* error_fd,
+                          CompressionType compression) {
     D("starting %s subprocess (protocol=%s, TERM=%s): '%s'",
       type == SubprocessType::kRaw ? "raw" : "PTY",
       protocol == SubprocessProtocol::kNone ? "none" : "shell", terminal_type, name.c_str());
 
     auto subprocess = std::make_unique<Subprocess>(std::move(name), terminal_type, type, protocol,
-                                                   make_pty_raw);
+                                                   make_pty_raw, compression);
     if (!subprocess) {
         LOG(ERROR) << "failed to allocate new subprocess";
         *error_fd = ReportError(error_protocol, "failed to allocate new subprocess");
@@ -910,7 +1044,7 @@ unique_fd StartCommandInProcess(std::string name, Command command, SubprocessPro
     constexpr auto make_pty_raw = false;
 
     auto subprocess = std::make_unique<Subprocess>(std::move(name), terminal_type, type, protocol,
-                                                   make_pty_raw);
+                                                   make_pty_raw, CompressionType::None);
     if (!subprocess) {
         LOG(ERROR) << "failed to allocate new subprocess";
         return ReportError(protocol, "failed to allocate new subprocess");
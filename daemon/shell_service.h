@@ -19,6 +19,7 @@
 #include <string>
 
 #include "adb_unique_fd.h"
+#include "file_sync_protocol.h"
 
 #include <string_view>
 
@@ -35,14 +36,19 @@ enum class SubprocessProtocol {
 // Forks and starts a new shell subprocess. If |name| is empty an interactive
 // shell is started, otherwise |name| is executed non-interactively.
 //
+// With the shell protocol, |compression| (LZ4 or Zstd) compresses the subprocess's output as
+// described in shell_compression.h.
+//
 // Returns an open FD connected to the subprocess or -1 on failure.
 unique_fd StartSubprocess(std::string name, const char* terminal_type, SubprocessType type,
-                          SubprocessProtocol protocol);
+                          SubprocessProtocol protocol,
+                          CompressionType compression = CompressionType::None);
 
 // The same as above but with more fined grained control and custom error handling.
 unique_fd StartSubprocess(std::string name, const char* terminal_type, SubprocessType type,
                           SubprocessProtocol protocol, bool make_pty_raw,
-                          SubprocessProtocol error_protocol, unique_fd* error_fd);
+                          SubprocessProtocol error_protocol, unique_fd* error_fd,
+                          CompressionType compression = CompressionType::None);
 
 // Executes |command| in a separate thread.
 // Sets up in/out and error streams to emulate shell-like behavior.
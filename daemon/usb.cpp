@@ -181,10 +181,45 @@ struct UsbFfsConnection : public Connection {
 
     virtual bool Write(std::unique_ptr<apacket> packet) override final {
         VLOG(USB) << "USB write: " << dump_header(&packet->msg);
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            scheduler_.Enqueue(std::move(packet));
+        }
+
+        // Wake up the worker thread to submit writes.
+        uint64_t notify = 1;
+        ssize_t rc = adb_write(worker_event_fd_.get(), &notify, sizeof(notify));
+        if (rc < 0) {
+            PLOG(FATAL) << "failed to notify worker eventfd to submit writes";
+        }
+
+        return true;
+    }
+
+    virtual void SetSocketPriority(uint32_t id, WritePriority priority) override final {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        scheduler_.SetPriority(id, priority);
+    }
+
+    virtual void ForgetSocketPriority(uint32_t id) override final {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        scheduler_.ForgetPriority(id);
+    }
+
+    // Turns scheduled packets into write requests. Only a couple of queue depths' worth of
+    // requests are built ahead of time, so that packets from interactive sockets don't end up
+    // stuck behind megabytes of requests for a bulk transfer.
+    void ScheduleWrites() REQUIRES(write_mutex_) {
+        while (write_requests_.size() - writes_submitted_ < kUsbWriteQueueDepth &&
+               !scheduler_.empty()) {
+            AppendWriteRequests(scheduler_.Dequeue());
+        }
+    }
+
+    void AppendWriteRequests(std::unique_ptr<apacket> packet) REQUIRES(write_mutex_) {
         auto header = std::make_shared<Block>(sizeof(packet->msg));
         memcpy(header->data(), &packet->msg, sizeof(packet->msg));
 
-        std::lock_guard<std::mutex> lock(write_mutex_);
         write_requests_.push_back(
                 CreateWriteBlock(std::move(header), 0, sizeof(packet->msg), next_write_id_++));
         if (!packet->payload.empty()) {
@@ -203,15 +238,6 @@ struct UsbFfsConnection : public Connection {
                 offset += write_size;
             }
         }
-
-        // Wake up the worker thread to submit writes.
-        uint64_t notify = 1;
-        ssize_t rc = adb_write(worker_event_fd_.get(), &notify, sizeof(notify));
-        if (rc < 0) {
-            PLOG(FATAL) << "failed to notify worker eventfd to submit writes";
-        }
-
-        return true;
     }
 
     virtual bool Start() override final {
@@ -224,6 +250,11 @@ struct UsbFfsConnection : public Connection {
             return;
         }
         stopped_ = true;
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            scheduler_.ForgetPriorities();
+        }
+
         uint64_t notify = 1;
         ssize_t rc = adb_write(worker_event_fd_.get(), &notify, sizeof(notify));
         if (rc < 0) {
@@ -427,6 +458,7 @@ struct UsbFfsConnection : public Connection {
                 HandleEvents();
 
                 std::lock_guard<std::mutex> lock(write_mutex_);
+                ScheduleWrites();
                 SubmitWrites();
             }
         });
@@ -715,6 +747,7 @@ struct UsbFfsConnection : public Connection {
     size_t needed_read_id_ = 0;
 
     std::mutex write_mutex_;
+    PacketScheduler scheduler_ GUARDED_BY(write_mutex_);
     std::deque<IoWriteBlock> write_requests_ GUARDED_BY(write_mutex_);
     size_t next_write_id_ GUARDED_BY(write_mutex_) = 0;
     size_t writes_submitted_ GUARDED_BY(write_mutex_) = 0;
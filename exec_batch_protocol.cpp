@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "exec_batch_protocol.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+bool ExecBatchWrite(ShellProtocol* protocol, ShellProtocol::Id id, uint32_t command_id,
+                    const char* data, size_t length) {
+    do {
+        size_t chunk = std::min(length, kExecBatchMaxData);
+        protocol->Reserve(sizeof(command_id) + chunk);
+        memcpy(protocol->data(), &command_id, sizeof(command_id));
+        if (chunk > 0) {
+            memcpy(protocol->data() + sizeof(command_id), data, chunk);
+        }
+        if (!protocol->Write(id, sizeof(command_id) + chunk)) {
+            return false;
+        }
+        data += chunk;
+        length -= chunk;
+    } while (length > 0);
+    return true;
+}
+
+bool ExecBatchParse(const ShellProtocol& protocol, uint32_t* command_id, std::string_view* data) {
+    if (protocol.data_length() < sizeof(*command_id)) {
+        return false;
+    }
+    memcpy(command_id, protocol.data(), sizeof(*command_id));
+    *data = std::string_view(protocol.data() + sizeof(*command_id),
+                             protocol.data_length() - sizeof(*command_id));
+    return true;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+#include "shell_protocol.h"
+
+// The exec-batch service runs many commands over a single ShellProtocol stream. The data of every
+// packet starts with the 4-byte id of the command it's about, which the client picks:
+//
+//   client -> device:
+//     kIdStdin       a command to run, as with "shell,v2,raw:"; its stdin is empty.
+//     kIdCloseStdin  no more commands will follow (this packet has no command id).
+//   device -> client:
+//     kIdStdout      output of a command.
+//     kIdStderr      error output of a command.
+//     kIdExit        a command finished; the single byte after the id is its exit code.
+//
+// Commands run concurrently, so the output of different commands can be interleaved. The service
+// closes the stream once every command has exited.
+//
+// Packets never carry more than kExecBatchMaxData bytes after the id, which is small enough for
+// a ShellProtocol to never split them.
+static constexpr size_t kExecBatchMaxData = 64 * 1024;
+
+// Sends |length| bytes of |data| about |command_id|, in as many packets as needed. A packet is
+// sent even if |length| is 0.
+//
+// Returns false if the FD closed or errored.
+bool ExecBatchWrite(ShellProtocol* protocol, ShellProtocol::Id id, uint32_t command_id,
+                    const char* data, size_t length);
+
+// Splits the packet last read by |protocol| into its command id and data.
+//
+// Returns false if the packet is too short to have a command id.
+bool ExecBatchParse(const ShellProtocol& protocol, uint32_t* command_id, std::string_view* data);
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "exec_batch_protocol.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "adb_unique_fd.h"
+#include "sysdeps.h"
+
+class ExecBatchProtocolTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        int fds[2];
+        ASSERT_EQ(0, adb_socketpair(fds));
+        read_fd_.reset(fds[0]);
+        write_fd_.reset(fds[1]);
+        read_protocol_ = std::make_unique<ShellProtocol>(read_fd_);
+        write_protocol_ = std::make_unique<ShellProtocol>(write_fd_);
+    }
+
+    unique_fd read_fd_;
+    unique_fd write_fd_;
+    std::unique_ptr<ShellProtocol> read_protocol_;
+    std::unique_ptr<ShellProtocol> write_protocol_;
+};
+
+TEST_F(ExecBatchProtocolTest, round_trip) {
+    std::string command = "getprop ro.build.id";
+    ASSERT_TRUE(ExecBatchWrite(write_protocol_.get(), ShellProtocol::kIdStdin, 42, command.data(),
+                               command.size()));
+    char exit_code = 3;
+    ASSERT_TRUE(ExecBatchWrite(write_protocol_.get(), ShellProtocol::kIdExit, 0xdeadbeef,
+                               &exit_code, 1));
+
+    uint32_t id;
+    std::string_view data;
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_EQ(ShellProtocol::kIdStdin, read_protocol_->id());
+    ASSERT_TRUE(ExecBatchParse(*read_protocol_, &id, &data));
+    ASSERT_EQ(42U, id);
+    ASSERT_EQ(command, data);
+
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_EQ(ShellProtocol::kIdExit, read_protocol_->id());
+    ASSERT_TRUE(ExecBatchParse(*read_protocol_, &id, &data));
+    ASSERT_EQ(0xdeadbeefU, id);
+    ASSERT_EQ(std::string_view("\3", 1), data);
+}
+
+TEST_F(ExecBatchProtocolTest, empty_data) {
+    ASSERT_TRUE(ExecBatchWrite(write_protocol_.get(), ShellProtocol::kIdStdout, 7, nullptr, 0));
+
+    uint32_t id;
+    std::string_view data;
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_TRUE(ExecBatchParse(*read_protocol_, &id, &data));
+    ASSERT_EQ(7U, id);
+    ASSERT_TRUE(data.empty());
+}
+
+TEST_F(ExecBatchProtocolTest, large_data_is_split) {
+    std::string output(kExecBatchMaxData * 2 + 10, 'x');
+    std::thread writer([this, &output]() {
+        ASSERT_TRUE(ExecBatchWrite(write_protocol_.get(), ShellProtocol::kIdStdout, 1,
+                                   output.data(), output.size()));
+    });
+
+    std::string received;
+    for (size_t expected : {kExecBatchMaxData, kExecBatchMaxData, size_t(10)}) {
+        uint32_t id;
+        std::string_view data;
+        ASSERT_TRUE(read_protocol_->Read());
+        ASSERT_TRUE(ExecBatchParse(*read_protocol_, &id, &data));
+        ASSERT_EQ(1U, id);
+        ASSERT_EQ(expected, data.size());
+        received.append(data);
+    }
+    writer.join();
+    ASSERT_EQ(output, received);
+}
+
+TEST_F(ExecBatchProtocolTest, missing_command_id) {
+    memcpy(write_protocol_->data(), "ab", 2);
+    ASSERT_TRUE(write_protocol_->Write(ShellProtocol::kIdStdin, 2));
+
+    uint32_t id;
+    std::string_view data;
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_FALSE(ExecBatchParse(*read_protocol_, &id, &data));
+}
@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define TRACE_TAG ADB
+
+#include "sysdeps.h"
+
+#include "framebuffer_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "adb_io.h"
+#include "adb_trace.h"
+
+// Sanity limit on what a frame can claim to be, so a corrupt stream can't make us allocate
+// arbitrary amounts of memory.
+static constexpr size_t kMaxFrameBytes = 256 * 1024 * 1024;
+
+// see hardware/hardware.h
+bool FillFbinfo(uint32_t format, uint32_t width, uint32_t height, uint32_t color_space,
+                fbinfo* info) {
+    *info = {};
+    info->version = DDMS_RAWIMAGE_VERSION;
+    info->colorSpace = color_space;
+    info->width = width;
+    info->height = height;
+    switch (format) {
+        case 1: /* RGBA_8888 */
+            info->bpp = 32;
+            info->red_offset = 0;
+            info->red_length = 8;
+            info->green_offset = 8;
+            info->green_length = 8;
+            info->blue_offset = 16;
+            info->blue_length = 8;
+            info->alpha_offset = 24;
+            info->alpha_length = 8;
+            break;
+        case 2: /* RGBX_8888 */
+            info->bpp = 32;
+            info->red_offset = 0;
+            info->red_length = 8;
+            info->green_offset = 8;
+            info->green_length = 8;
+            info->blue_offset = 16;
+            info->blue_length = 8;
+            info->alpha_offset = 24;
+            info->alpha_length = 0;
+            break;
+        case 3: /* RGB_888 */
+            info->bpp = 24;
+            info->red_offset = 0;
+            info->red_length = 8;
+            info->green_offset = 8;
+            info->green_length = 8;
+            info->blue_offset = 16;
+            info->blue_length = 8;
+            info->alpha_offset = 24;
+            info->alpha_length = 0;
+            break;
+        case 4: /* RGB_565 */
+            info->bpp = 16;
+            info->red_offset = 11;
+            info->red_length = 5;
+            info->green_offset = 5;
+            info->green_length = 6;
+            info->blue_offset = 0;
+            info->blue_length = 5;
+            info->alpha_offset = 0;
+            info->alpha_length = 0;
+            break;
+        case 5: /* BGRA_8888 */
+            info->bpp = 32;
+            info->red_offset = 16;
+            info->red_length = 8;
+            info->green_offset = 8;
+            info->green_length = 8;
+            info->blue_offset = 0;
+            info->blue_length = 8;
+            info->alpha_offset = 24;
+            info->alpha_length = 8;
+            break;
+        default:
+            return false;
+    }
+    info->size = width * height * (info->bpp / 8);
+    return true;
+}
+
+bool FramebufferStreamOptions::Parse(std::string_view arg, FramebufferStreamOptions* options,
+                                     std::string* error) {
+    *options = {};
+    for (const std::string& part : android::base::Split(std::string(arg), ",")) {
+        std::string_view value = part;
+        uint32_t number;
+        if (part.empty()) {
+            continue;
+        } else if (part == "none") {
+            options->compression = CompressionType::None;
+        } else if (part == "lz4") {
+            options->compression = CompressionType::LZ4;
+        } else if (part == "zstd") {
+            options->compression = CompressionType::Zstd;
+        } else if (android::base::ConsumePrefix(&value, "frames=") &&
+                   android::base::ParseUint(std::string(value), &number)) {
+            options->frames = number;
+        } else if (android::base::ConsumePrefix(&value, "interval=") &&
+                   android::base::ParseUint(std::string(value), &number)) {
+            options->interval = std::chrono::milliseconds(number);
+        } else {
+            *error = "invalid framebuffer-stream option: " + part;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string FramebufferStreamOptions::ToString() const {
+    const char* name = "none";
+    if (compression == CompressionType::LZ4) {
+        name = "lz4";
+    } else if (compression == CompressionType::Zstd) {
+        name = "zstd";
+    }
+    return android::base::StringPrintf("%s,frames=%u,interval=%lld", name, frames,
+                                       static_cast<long long>(interval.count()));
+}
+
+namespace {
+
+// The layout of a frame's tiles.
+struct TileGrid {
+    TileGrid(uint32_t width, uint32_t height, size_t bytes_per_pixel, uint32_t tile_size)
+        : width(width),
+          height(height),
+          bytes_per_pixel(bytes_per_pixel),
+          tile_size(tile_size),
+          columns((width + tile_size - 1) / tile_size),
+          rows((height + tile_size - 1) / tile_size) {}
+
+    size_t count() const { return static_cast<size_t>(columns) * rows; }
+
+    // The number of bytes in each row of |tile|, and the number of rows.
+    size_t row_bytes(size_t tile) const {
+        uint32_t x = (tile % columns) * tile_size;
+        return std::min(tile_size, width - x) * bytes_per_pixel;
+    }
+    size_t row_count(size_t tile) const {
+        uint32_t y = (tile / columns) * tile_size;
+        return std::min(tile_size, height - y);
+    }
+    size_t bytes(size_t tile) const { return row_bytes(tile) * row_count(tile); }
+
+    // The offset of row |row| of |tile| in the image.
+    size_t offset(size_t tile, size_t row) const {
+        size_t x = (tile % columns) * tile_size;
+        size_t y = (tile / columns) * tile_size + row;
+        return (y * width + x) * bytes_per_pixel;
+    }
+
+    uint32_t width;
+    uint32_t height;
+    size_t bytes_per_pixel;
+    uint32_t tile_size;
+    uint32_t columns;
+    uint32_t rows;
+};
+
+size_t BytesPerPixel(uint32_t format) {
+    fbinfo info;
+    return FillFbinfo(format, 0, 0, 0, &info) ? info.bpp / 8 : 0;
+}
+
+}  // namespace
+
+FramebufferEncoder::FramebufferEncoder(CompressionType compression) {
+    // Frames are flushed individually, so big blocks only waste memory.
+    static constexpr size_t kBlockSize = 256 * 1024;
+    switch (compression) {
+        case CompressionType::None:
+            encoder_ = &encoder_storage_.emplace<NullEncoder>(kBlockSize);
+            break;
+        case CompressionType::LZ4:
+            encoder_ = &encoder_storage_.emplace<LZ4Encoder>(kBlockSize);
+            break;
+        case CompressionType::Zstd:
+            encoder_ = &encoder_storage_.emplace<ZstdEncoder>(kBlockSize);
+            break;
+        default:
+            LOG(FATAL) << "unexpected framebuffer compression type "
+                       << static_cast<int>(compression);
+    }
+}
+
+bool FramebufferEncoder::Encode(FramebufferFrame* frame, std::vector<char>* output) {
+    size_t bytes_per_pixel = BytesPerPixel(frame->format);
+    if (bytes_per_pixel == 0 || frame->width == 0 || frame->height == 0 ||
+        frame->pixels.size() != size_t(frame->width) * frame->height * bytes_per_pixel) {
+        LOG(ERROR) << "bad frame: format " << frame->format << ", " << frame->width << "x"
+                   << frame->height << ", " << frame->pixels.size() << " bytes";
+        return false;
+    }
+
+    FramebufferFrameHeader header = {};
+    header.format = frame->format;
+    header.color_space = frame->color_space;
+    header.width = frame->width;
+    header.height = frame->height;
+    header.tile_size = kTileSize;
+
+    Block payload;
+    bool key_frame = previous_.format != frame->format || previous_.width != frame->width ||
+                     previous_.height != frame->height;
+    if (!key_frame) {
+        TileGrid grid(frame->width, frame->height, bytes_per_pixel, kTileSize);
+        std::vector<uint32_t> changed;
+        size_t changed_bytes = 0;
+        for (size_t tile = 0; tile < grid.count(); ++tile) {
+            for (size_t row = 0; row < grid.row_count(tile); ++row) {
+                size_t offset = grid.offset(tile, row);
+                if (memcmp(&frame->pixels[offset], &previous_.pixels[offset],
+                           grid.row_bytes(tile)) != 0) {
+                    changed.push_back(tile);
+                    changed_bytes += grid.bytes(tile);
+                    break;
+                }
+            }
+        }
+
+        // When most of the screen changed, the indices aren't worth it.
+        if (changed_bytes * 2 > frame->pixels.size()) {
+            key_frame = true;
+        } else {
+            payload.resize(changed.size() * sizeof(uint32_t) + changed_bytes);
+            char* p = payload.data();
+            memcpy(p, changed.data(), changed.size() * sizeof(uint32_t));
+            p += changed.size() * sizeof(uint32_t);
+            for (uint32_t tile : changed) {
+                for (size_t row = 0; row < grid.row_count(tile); ++row) {
+                    memcpy(p, &frame->pixels[grid.offset(tile, row)], grid.row_bytes(tile));
+                    p += grid.row_bytes(tile);
+                }
+            }
+            header.tile_count = changed.size();
+        }
+    }
+    if (key_frame) {
+        header.flags = FramebufferFrameHeader::kKeyFrame;
+        payload = Block(frame->pixels.begin(), frame->pixels.end());
+    }
+    header.raw_size = payload.size();
+
+    if (!payload.empty()) {
+        encoder_->Append(std::move(payload));
+    }
+    encoder_->Flush();
+    output->resize(sizeof(header));
+    while (true) {
+        Block block;
+        EncodeResult result = encoder_->Encode(&block);
+        if (result == EncodeResult::Error) {
+            LOG(ERROR) << "failed to compress frame";
+            return false;
+        }
+        output->insert(output->end(), block.begin(), block.end());
+        if (result != EncodeResult::MoreOutput) {
+            break;
+        }
+    }
+    header.payload_size = output->size() - sizeof(header);
+    memcpy(output->data(), &header, sizeof(header));
+
+    // Keep this frame to compare the next one against, and hand back the old buffer for reuse.
+    std::swap(previous_, *frame);
+    return true;
+}
+
+bool FramebufferDecoder::ReadHeader(borrowed_fd fd, std::string* error) {
+    FramebufferStreamHeader header;
+    if (!ReadFdExactly(fd, &header, sizeof(header))) {
+        *error = "failed to read framebuffer stream header";
+        return false;
+    }
+    if (header.magic != FramebufferStreamHeader::kMagic ||
+        header.version != FramebufferStreamHeader::kVersion) {
+        *error = android::base::StringPrintf("unsupported framebuffer stream %#x version %u",
+                                             header.magic, header.version);
+        return false;
+    }
+
+    output_.resize(256 * 1024);
+    std::span<char> output_buffer(output_.data(), output_.size());
+    switch (static_cast<CompressionType>(header.compression)) {
+        case CompressionType::None:
+            decoder_ = &decoder_storage_.emplace<NullDecoder>(output_buffer);
+            break;
+        case CompressionType::LZ4:
+            decoder_ = &decoder_storage_.emplace<LZ4Decoder>(output_buffer);
+            break;
+        case CompressionType::Zstd:
+            decoder_ = &decoder_storage_.emplace<ZstdDecoder>(output_buffer);
+            break;
+        default:
+            *error = android::base::StringPrintf("unsupported framebuffer stream compression %u",
+                                                 header.compression);
+            return false;
+    }
+    return true;
+}
+
+bool FramebufferDecoder::Decompress(Block payload, std::string* error) {
+    raw_.clear();
+    if (!payload.empty()) {
+        decoder_->Append(std::move(payload));
+    }
+    while (true) {
+        std::span<char> output;
+        DecodeResult result = decoder_->Decode(&output);
+        if (result == DecodeResult::Error || raw_.size() + output.size() > header_.raw_size) {
+            *error = "corrupt framebuffer stream";
+            return false;
+        }
+        raw_.insert(raw_.end(), output.begin(), output.end());
+        if (result != DecodeResult::MoreOutput) {
+            break;
+        }
+    }
+    if (raw_.size() != header_.raw_size) {
+        *error = "truncated framebuffer stream frame";
+        return false;
+    }
+    return true;
+}
+
+bool FramebufferDecoder::ReadFrame(borrowed_fd fd, std::string* error) {
+    error->clear();
+    if (!ReadFdExactly(fd, &header_, sizeof(header_))) {
+        return false;
+    }
+
+    size_t bytes_per_pixel = BytesPerPixel(header_.format);
+    size_t frame_bytes = size_t(header_.width) * header_.height * bytes_per_pixel;
+    if (bytes_per_pixel == 0 || frame_bytes == 0 || frame_bytes > kMaxFrameBytes ||
+        header_.tile_size == 0 || header_.raw_size > kMaxFrameBytes ||
+        header_.payload_size > kMaxFrameBytes) {
+        *error = "corrupt framebuffer stream frame header";
+        return false;
+    }
+
+    Block payload(header_.payload_size);
+    if (!ReadFdExactly(fd, payload.data(), payload.size())) {
+        *error = "truncated framebuffer stream frame";
+        return false;
+    }
+    if (!Decompress(std::move(payload), error)) {
+        return false;
+    }
+
+    if (header_.flags & FramebufferFrameHeader::kKeyFrame) {
+        if (raw_.size() != frame_bytes) {
+            *error = "framebuffer stream key frame has the wrong size";
+            return false;
+        }
+        frame_.format = header_.format;
+        frame_.color_space = header_.color_space;
+        frame_.width = header_.width;
+        frame_.height = header_.height;
+        std::swap(frame_.pixels, raw_);
+        return true;
+    }
+
+    if (frame_.format != header_.format || frame_.width != header_.width ||
+        frame_.height != header_.height) {
+        *error = "framebuffer stream delta frame doesn't match the previous frame";
+        return false;
+    }
+    frame_.color_space = header_.color_space;
+
+    TileGrid grid(header_.width, header_.height, bytes_per_pixel, header_.tile_size);
+    size_t index_bytes = size_t(header_.tile_count) * sizeof(uint32_t);
+    if (raw_.size() < index_bytes) {
+        *error = "framebuffer stream delta frame is truncated";
+        return false;
+    }
+    const char* tiles = raw_.data() + index_bytes;
+    const char* end = raw_.data() + raw_.size();
+    for (size_t i = 0; i < header_.tile_count; ++i) {
+        uint32_t tile;
+        memcpy(&tile, raw_.data() + i * sizeof(tile), sizeof(tile));
+        if (tile >= grid.count() || size_t(end - tiles) < grid.bytes(tile)) {
+            *error = "framebuffer stream delta frame is corrupt";
+            return false;
+        }
+        for (size_t row = 0; row < grid.row_count(tile); ++row) {
+            memcpy(&frame_.pixels[grid.offset(tile, row)], tiles, grid.row_bytes(tile));
+            tiles += grid.row_bytes(tile);
+        }
+    }
+    if (tiles != end) {
+        *error = "framebuffer stream delta frame has trailing data";
+        return false;
+    }
+    return true;
+}
+
+bool SendFramebufferStream(borrowed_fd fd, const FramebufferStreamOptions& options,
+                           const std::function<bool(FramebufferFrame*)>& capture) {
+    FramebufferStreamHeader header = {
+            .magic = FramebufferStreamHeader::kMagic,
+            .version = FramebufferStreamHeader::kVersion,
+            .compression = static_cast<uint32_t>(options.compression),
+    };
+    if (!WriteFdExactly(fd, &header, sizeof(header))) {
+        return false;
+    }
+
+    FramebufferEncoder encoder(options.compression);
+    FramebufferFrame frame;
+    std::vector<char> output;
+    for (uint32_t i = 0; options.frames == 0 || i < options.frames; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if (!capture(&frame) || !encoder.Encode(&frame, &output)) {
+            return false;
+        }
+        if (!WriteFdExactly(fd, output.data(), output.size())) {
+            return false;
+        }
+        std::this_thread::sleep_until(start + options.interval);
+    }
+    return true;
+}
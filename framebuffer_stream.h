@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <android-base/macros.h>
+
+#include "adb_unique_fd.h"
+#include "compression_utils.h"
+#include "file_sync_protocol.h"
+#include "types.h"
+
+// Streaming screen captures (the framebuffer-stream: service, see kFeatureFramebufferStream).
+//
+// Where framebuffer: sends a single uncompressed frame, framebuffer-stream: sends a series of them
+// over one connection. Frames are split into tiles, and after the first frame only the tiles that
+// changed since the previous one are sent. Everything after the stream header goes through a
+// single LZ4 or Zstd stream, flushed at the end of every frame.
+//
+// The device sends a FramebufferStreamHeader, then for each frame a FramebufferFrameHeader
+// followed by |payload_size| bytes of (compressed) payload. Once decompressed, the payload of a
+// key frame is the whole image. The payload of a delta frame is |tile_count| uint32_t tile indices
+// in increasing order, followed by the pixels of those tiles, one tile after the other, each tile
+// row by row. Tiles are numbered row by row, and the ones on the right and bottom edges may be
+// smaller than |tile_size|. All integers are little-endian.
+
+// The DDMS raw image header, as sent by the framebuffer: service.
+#define DDMS_RAWIMAGE_VERSION 2
+struct fbinfo {
+    unsigned int version;
+    unsigned int bpp;
+    unsigned int colorSpace;
+    unsigned int size;
+    unsigned int width;
+    unsigned int height;
+    unsigned int red_offset;
+    unsigned int red_length;
+    unsigned int blue_offset;
+    unsigned int blue_length;
+    unsigned int green_offset;
+    unsigned int green_length;
+    unsigned int alpha_offset;
+    unsigned int alpha_length;
+} __attribute__((packed));
+
+// Fills in |info| for an image in one of screencap's pixel formats (see hardware/hardware.h).
+// Returns false if the format isn't supported.
+bool FillFbinfo(uint32_t format, uint32_t width, uint32_t height, uint32_t color_space,
+                fbinfo* info);
+
+struct FramebufferStreamHeader {
+    static constexpr uint32_t kMagic = 0x53424641;  // "AFBS"
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t compression;  // CompressionType
+} __attribute__((packed));
+
+struct FramebufferFrameHeader {
+    static constexpr uint32_t kKeyFrame = 1;
+
+    uint32_t flags;
+    uint32_t format;
+    uint32_t color_space;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t tile_count;
+    uint32_t raw_size;      // Payload size after decompression.
+    uint32_t payload_size;  // Payload size on the wire.
+} __attribute__((packed));
+
+// A captured image, in screencap's format.
+struct FramebufferFrame {
+    uint32_t format = 0;
+    uint32_t color_space = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<char> pixels;
+
+    size_t bytes_per_pixel() const { return width && height ? pixels.size() / width / height : 0; }
+};
+
+struct FramebufferStreamOptions {
+    CompressionType compression = CompressionType::LZ4;
+
+    // The number of frames to send, or 0 to keep going until the client disconnects.
+    uint32_t frames = 0;
+
+    // The minimum time between the start of two captures.
+    std::chrono::milliseconds interval{0};
+
+    // Parses the argument of the framebuffer-stream: service: comma-separated "lz4", "zstd" or
+    // "none", "frames=N" and "interval=MS".
+    static bool Parse(std::string_view arg, FramebufferStreamOptions* options, std::string* error);
+    std::string ToString() const;
+};
+
+// Turns frames into what goes on the wire.
+class FramebufferEncoder {
+  public:
+    static constexpr uint32_t kTileSize = 32;
+
+    // |compression| must be None, LZ4 or Zstd.
+    explicit FramebufferEncoder(CompressionType compression);
+
+    // Encodes |frame| against the previous one, replacing |output|. Takes over |frame|'s pixels.
+    bool Encode(FramebufferFrame* frame, std::vector<char>* output);
+
+  private:
+    FramebufferFrame previous_;
+    std::variant<std::monostate, NullEncoder, LZ4Encoder, ZstdEncoder> encoder_storage_;
+    Encoder* encoder_ = nullptr;
+
+    DISALLOW_COPY_AND_ASSIGN(FramebufferEncoder);
+};
+
+// Reads a stream and rebuilds the frames.
+class FramebufferDecoder {
+  public:
+    FramebufferDecoder() = default;
+
+    // Reads and checks the stream header.
+    bool ReadHeader(borrowed_fd fd, std::string* error);
+
+    // Reads the next frame. Returns false at the end of the stream or on error, setting |error| in
+    // the latter case.
+    bool ReadFrame(borrowed_fd fd, std::string* error);
+
+    const FramebufferFrame& frame() const { return frame_; }
+    const FramebufferFrameHeader& last_header() const { return header_; }
+
+  private:
+    bool Decompress(Block payload, std::string* error);
+
+    FramebufferFrameHeader header_ = {};
+    FramebufferFrame frame_;
+    std::vector<char> raw_;
+    std::vector<char> output_;
+    std::variant<std::monostate, NullDecoder, LZ4Decoder, ZstdDecoder> decoder_storage_;
+    Decoder* decoder_ = nullptr;
+
+    DISALLOW_COPY_AND_ASSIGN(FramebufferDecoder);
+};
+
+// Captures frames with |capture| and sends them to |fd| as described by |options|, until the
+// frame count is reached, |capture| fails or the client goes away.
+bool SendFramebufferStream(borrowed_fd fd, const FramebufferStreamOptions& options,
+                           const std::function<bool(FramebufferFrame*)>& capture);
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "framebuffer_stream.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sysdeps.h"
+
+// Stands in for screencap: an RGBA_8888 gradient with a small square that moves one step per
+// frame, and a rotation to a different size halfway through.
+class SyntheticScreen {
+  public:
+    SyntheticScreen(uint32_t width, uint32_t height) : width_(width), height_(height) {}
+
+    bool Capture(FramebufferFrame* frame) {
+        ++count_;
+        uint32_t width = count_ > 4 ? height_ : width_;
+        uint32_t height = count_ > 4 ? width_ : height_;
+        frame->format = 1;
+        frame->color_space = 0;
+        frame->width = width;
+        frame->height = height;
+        frame->pixels.resize(width * height * 4);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                bool square = x >= count_ * 7 && x < count_ * 7 + 20 && y >= 10 && y < 30;
+                char* p = &frame->pixels[(y * width + x) * 4];
+                p[0] = square ? 0xff : x;
+                p[1] = square ? 0 : y;
+                p[2] = square ? 0 : x ^ y;
+                p[3] = 0xff;
+            }
+        }
+        frames_.push_back(frame->pixels);
+        return true;
+    }
+
+    const std::vector<std::vector<char>>& frames() const { return frames_; }
+
+  private:
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t count_ = 0;
+    std::vector<std::vector<char>> frames_;
+};
+
+class FramebufferStreamTest : public ::testing::TestWithParam<CompressionType> {};
+
+TEST_P(FramebufferStreamTest, round_trip) {
+    int fds[2];
+    ASSERT_EQ(0, adb_socketpair(fds));
+    unique_fd sender(fds[0]), receiver(fds[1]);
+
+    FramebufferStreamOptions options;
+    options.compression = GetParam();
+    options.frames = 8;
+
+    // Sizes that aren't a multiple of the tile size exercise the partial tiles at the edges.
+    SyntheticScreen screen(200, 100);
+    std::thread thread([&]() {
+        ASSERT_TRUE(SendFramebufferStream(sender, options, [&screen](FramebufferFrame* frame) {
+            return screen.Capture(frame);
+        }));
+        sender.reset();
+    });
+
+    FramebufferDecoder decoder;
+    std::string error;
+    ASSERT_TRUE(decoder.ReadHeader(receiver, &error)) << error;
+    std::vector<FramebufferFrameHeader> headers;
+    std::vector<std::vector<char>> frames;
+    while (decoder.ReadFrame(receiver, &error)) {
+        headers.push_back(decoder.last_header());
+        frames.push_back(decoder.frame().pixels);
+    }
+    ASSERT_EQ("", error);
+    thread.join();
+
+    ASSERT_EQ(screen.frames(), frames);
+    ASSERT_EQ(8U, headers.size());
+
+    // The first frame and the one after the rotation are sent whole; the others only carry the
+    // tiles the square moved through.
+    for (size_t i = 0; i < headers.size(); ++i) {
+        bool key_frame = i == 0 || i == 4;
+        ASSERT_EQ(key_frame, (headers[i].flags & FramebufferFrameHeader::kKeyFrame) != 0) << i;
+        if (!key_frame) {
+            ASSERT_GT(headers[i].tile_count, 0U);
+            ASSERT_LE(headers[i].tile_count, 4U);
+            ASSERT_LT(headers[i].raw_size, headers[0].raw_size / 4);
+        }
+        if (GetParam() != CompressionType::None) {
+            ASSERT_LT(headers[i].payload_size, headers[i].raw_size);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Algorithms, FramebufferStreamTest,
+                         ::testing::Values(CompressionType::None, CompressionType::LZ4,
+                                           CompressionType::Zstd));
+
+TEST(FramebufferStreamOptions, parse) {
+    FramebufferStreamOptions options;
+    std::string error;
+    ASSERT_TRUE(FramebufferStreamOptions::Parse("zstd,frames=3,interval=50", &options, &error));
+    ASSERT_EQ(CompressionType::Zstd, options.compression);
+    ASSERT_EQ(3U, options.frames);
+    ASSERT_EQ(50, options.interval.count());
+    ASSERT_EQ("zstd,frames=3,interval=50", options.ToString());
+
+    ASSERT_TRUE(FramebufferStreamOptions::Parse("", &options, &error));
+    ASSERT_EQ(CompressionType::LZ4, options.compression);
+    ASSERT_EQ(0U, options.frames);
+
+    ASSERT_FALSE(FramebufferStreamOptions::Parse("brotli", &options, &error));
+    ASSERT_FALSE(FramebufferStreamOptions::Parse("frames=x", &options, &error));
+}
+
+TEST(FramebufferStream, corrupt_stream) {
+    int fds[2];
+    ASSERT_EQ(0, adb_socketpair(fds));
+    unique_fd sender(fds[0]), receiver(fds[1]);
+
+    FramebufferStreamHeader header = {FramebufferStreamHeader::kMagic,
+                                      FramebufferStreamHeader::kVersion,
+                                      static_cast<uint32_t>(CompressionType::None)};
+    FramebufferFrameHeader frame = {};
+    frame.format = 1;
+    frame.width = 2;
+    frame.height = 2;
+    frame.tile_size = 32;
+    frame.tile_count = 1;
+    frame.raw_size = 4;
+    frame.payload_size = 4;
+    uint32_t bad_tile = 7;
+    ASSERT_EQ(static_cast<int>(sizeof(header)), adb_write(sender, &header, sizeof(header)));
+    ASSERT_EQ(static_cast<int>(sizeof(frame)), adb_write(sender, &frame, sizeof(frame)));
+    ASSERT_EQ(4, adb_write(sender, &bad_tile, 4));
+
+    // A delta frame without a key frame to apply it to.
+    FramebufferDecoder decoder;
+    std::string error;
+    ASSERT_TRUE(decoder.ReadHeader(receiver, &error));
+    ASSERT_FALSE(decoder.ReadFrame(receiver, &error));
+    ASSERT_NE("", error);
+}
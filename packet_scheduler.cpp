@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG TRANSPORT
+
+#include "sysdeps.h"
+
+#include "packet_scheduler.h"
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include "adb.h"
+#include "adb_trace.h"
+#include "buffer_budget.h"
+
+using android::base::StartsWith;
+
+WritePriority GetServiceWritePriority(std::string_view service) {
+    // shell:, shell,v2,pty:, etc.
+    if (StartsWith(service, "shell:") || StartsWith(service, "shell,") ||
+        StartsWith(service, "exec-batch:")) {
+        return WritePriority::Interactive;
+    }
+
+    if (StartsWith(service, "jdwp:") || service == "track-jdwp" || service == "track-app" ||
+        service == "track-app-delta") {
+        return WritePriority::Interactive;
+    }
+
+    if (StartsWith(service, "sync:") || StartsWith(service, "framebuffer:") ||
+        StartsWith(service, "framebuffer-stream:") || StartsWith(service, "sink:") ||
+        StartsWith(service, "source:") || StartsWith(service, "abb_exec:")) {
+        return WritePriority::Bulk;
+    }
+
+    return WritePriority::Normal;
+}
+
+size_t PacketScheduler::Quantum(WritePriority priority) {
+    switch (priority) {
+        case WritePriority::Bulk:
+            return 16 * 1024;
+        case WritePriority::Normal:
+            return 64 * 1024;
+        case WritePriority::Interactive:
+            return 256 * 1024;
+    }
+}
+
+static bool IsSocketPacket(const apacket& packet) {
+    switch (packet.msg.command) {
+        case A_OPEN:
+        case A_OKAY:
+        case A_WRTE:
+        case A_CLSE:
+            return packet.msg.arg0 != 0;
+        default:
+            return false;
+    }
+}
+
+void PacketScheduler::SetPriority(uint32_t id, WritePriority priority) {
+    std::lock_guard<std::mutex> lock(priority_mutex_);
+    priorities_[id] = priority;
+}
+
+WritePriority PacketScheduler::GetPriority(uint32_t id) {
+    std::lock_guard<std::mutex> lock(priority_mutex_);
+    auto it = priorities_.find(id);
+    return it == priorities_.end() ? WritePriority::Normal : it->second;
+}
+
+void PacketScheduler::ForgetPriority(uint32_t id) {
+    std::lock_guard<std::mutex> lock(priority_mutex_);
+    priorities_.erase(id);
+}
+
+void PacketScheduler::ForgetPriorities() {
+    std::lock_guard<std::mutex> lock(priority_mutex_);
+    priorities_.clear();
+}
+
+size_t PacketScheduler::priority_count() {
+    std::lock_guard<std::mutex> lock(priority_mutex_);
+    return priorities_.size();
+}
+
+PacketScheduler::~PacketScheduler() {
+    BufferBudget::Global().Release(queued_bytes_);
+}
+
+void PacketScheduler::Enqueue(std::unique_ptr<apacket> packet) {
+    ++queued_packets_;
+    queued_bytes_ += packet->payload.size();
+    BufferBudget::Global().Charge(packet->payload.size());
+    if (!IsSocketPacket(*packet)) {
+        control_.push_back(std::move(packet));
+        return;
+    }
+
+    uint32_t id = packet->msg.arg0;
+    auto [it, inserted] = flows_.try_emplace(id);
+    Flow& flow = it->second;
+    if (inserted) {
+        // The priority is only looked up when a flow becomes active, so that sockets with data
+        // continuously queued don't take the priority lock for every packet.
+        flow.quantum = Quantum(GetPriority(id));
+        active_flows_.push_back(id);
+    }
+    flow.packets.push_back(std::move(packet));
+}
+
+std::unique_ptr<apacket> PacketScheduler::Dequeue() {
+    std::unique_ptr<apacket> result;
+    if (!control_.empty()) {
+        result = std::move(control_.front());
+        control_.pop_front();
+        --queued_packets_;
+        queued_bytes_ -= result->payload.size();
+        BufferBudget::Global().Release(result->payload.size());
+        return result;
+    }
+
+    while (!active_flows_.empty()) {
+        uint32_t id = active_flows_.front();
+        auto it = flows_.find(id);
+        CHECK(it != flows_.end());
+        Flow& flow = it->second;
+
+        if (!flow.in_round) {
+            flow.deficit += flow.quantum;
+            flow.in_round = true;
+        }
+
+        size_t size = sizeof(amessage) + flow.packets.front()->payload.size();
+        if (flow.deficit < size) {
+            // Out of credit for this round, move on to the next flow.
+            flow.in_round = false;
+            active_flows_.pop_front();
+            active_flows_.push_back(id);
+            continue;
+        }
+
+        flow.deficit -= size;
+        result = std::move(flow.packets.front());
+        flow.packets.pop_front();
+        --queued_packets_;
+        queued_bytes_ -= result->payload.size();
+        BufferBudget::Global().Release(result->payload.size());
+
+        if (flow.packets.empty()) {
+            // Idle flows don't get to bank credit.
+            active_flows_.pop_front();
+            flows_.erase(it);
+        }
+
+        // A_CLSE is the last thing a socket sends.
+        if (result->msg.command == A_CLSE) {
+            ForgetPriority(id);
+        }
+        return result;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include <android-base/macros.h>
+#include <android-base/thread_annotations.h>
+
+#include "types.h"
+
+// How eagerly a socket's outgoing packets should be scheduled relative to the other sockets
+// sharing the same transport.
+enum class WritePriority {
+    Bulk,         // File transfers and other throughput-bound streams (sync, framebuffer, ...).
+    Normal,       // Everything we don't know anything about.
+    Interactive,  // Latency-sensitive streams (shell, jdwp, ...).
+};
+
+// Returns the priority class for sockets opened for |service|.
+WritePriority GetServiceWritePriority(std::string_view service);
+
+// Decides the order in which queued packets are handed to the underlying connection, so that
+// one bulk transfer can't starve every other socket on the transport.
+//
+// Packets that belong to a socket (A_OPEN, A_OKAY, A_WRTE and A_CLSE, keyed by the sender's local
+// id) are queued per socket and served with deficit round robin, with a larger quantum for higher
+// priority classes. Everything else (A_CNXN, A_AUTH, A_STLS, ...) jumps the queue. Packets from a
+// single socket are never reordered.
+//
+// SetPriority, ForgetPriority, ForgetPriorities and priority_count are thread-safe: they can be
+// called from any thread, e.g. when a socket is opened or closed. Everything else must be called
+// from the connection's writer context (or with its write lock held).
+class PacketScheduler {
+  public:
+    PacketScheduler() = default;
+    ~PacketScheduler();
+
+    // Sets the priority class for packets sent by the local socket |id|. The priority is
+    // forgotten once the socket's A_CLSE has been dequeued, or when ForgetPriority is called for
+    // sockets that go away without sending one through the scheduler.
+    void SetPriority(uint32_t id, WritePriority priority);
+    void ForgetPriority(uint32_t id);
+
+    // Forgets every socket's priority, e.g. when the connection is stopped or reset.
+    void ForgetPriorities();
+
+    // The number of sockets with a priority set. Only used for testing.
+    size_t priority_count();
+
+    void Enqueue(std::unique_ptr<apacket> packet);
+
+    // Returns the next packet to write, or nullptr if nothing is queued.
+    std::unique_ptr<apacket> Dequeue();
+
+    bool empty() const { return queued_packets_ == 0; }
+    size_t queued_packets() const { return queued_packets_; }
+    size_t queued_bytes() const { return queued_bytes_; }
+
+    // The number of bytes a socket of the given priority may send per round.
+    static size_t Quantum(WritePriority priority);
+
+  private:
+    struct Flow {
+        std::deque<std::unique_ptr<apacket>> packets;
+        size_t quantum = 0;
+        size_t deficit = 0;
+
+        // Whether the flow has already been credited its quantum for the current round.
+        bool in_round = false;
+    };
+
+    WritePriority GetPriority(uint32_t id);
+
+    std::deque<std::unique_ptr<apacket>> control_;
+    std::unordered_map<uint32_t, Flow> flows_;
+
+    // Ids of the flows with queued packets, in round robin order.
+    std::deque<uint32_t> active_flows_;
+
+    size_t queued_packets_ = 0;
+
+    // Payload bytes queued, which are charged to the global BufferBudget.
+    size_t queued_bytes_ = 0;
+
+    std::mutex priority_mutex_;
+    std::unordered_map<uint32_t, WritePriority> priorities_ GUARDED_BY(priority_mutex_);
+
+    DISALLOW_COPY_AND_ASSIGN(PacketScheduler);
+};
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "adb.h"
+
+static std::unique_ptr<apacket> MakePacket(uint32_t command, uint32_t local_id, uint32_t seq,
+                                           size_t payload_size = 0) {
+    auto packet = std::make_unique<apacket>();
+    packet->msg.command = command;
+    packet->msg.arg0 = local_id;
+    packet->msg.arg1 = seq;
+    packet->msg.data_length = payload_size;
+    packet->payload.resize(payload_size);
+    return packet;
+}
+
+TEST(PacketScheduler, empty) {
+    PacketScheduler scheduler;
+    ASSERT_TRUE(scheduler.empty());
+    ASSERT_EQ(nullptr, scheduler.Dequeue());
+}
+
+TEST(PacketScheduler, control_packets_first) {
+    PacketScheduler scheduler;
+    scheduler.Enqueue(MakePacket(A_WRTE, 1, 0, 16));
+    scheduler.Enqueue(MakePacket(A_CNXN, 0, 0));
+    scheduler.Enqueue(MakePacket(A_AUTH, 0, 1));
+    ASSERT_EQ(3U, scheduler.queued_packets());
+
+    ASSERT_EQ(static_cast<uint32_t>(A_CNXN), scheduler.Dequeue()->msg.command);
+    ASSERT_EQ(static_cast<uint32_t>(A_AUTH), scheduler.Dequeue()->msg.command);
+    ASSERT_EQ(static_cast<uint32_t>(A_WRTE), scheduler.Dequeue()->msg.command);
+    ASSERT_TRUE(scheduler.empty());
+}
+
+TEST(PacketScheduler, per_socket_order) {
+    PacketScheduler scheduler;
+    for (uint32_t i = 0; i < 100; ++i) {
+        scheduler.Enqueue(MakePacket(A_WRTE, 1 + i % 3, i, (i % 7) * 10000));
+    }
+    scheduler.Enqueue(MakePacket(A_CLSE, 1, 100));
+
+    std::vector<uint32_t> last(4, 0);
+    std::vector<bool> seen(4, false);
+    while (auto packet = scheduler.Dequeue()) {
+        uint32_t id = packet->msg.arg0;
+        if (seen[id]) {
+            ASSERT_GT(packet->msg.arg1, last[id]);
+        }
+        seen[id] = true;
+        last[id] = packet->msg.arg1;
+    }
+    ASSERT_EQ(100U, last[1]);
+    ASSERT_TRUE(scheduler.empty());
+}
+
+TEST(PacketScheduler, interactive_not_starved_by_bulk) {
+    PacketScheduler scheduler;
+    scheduler.SetPriority(1, WritePriority::Bulk);
+    scheduler.SetPriority(2, WritePriority::Interactive);
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        scheduler.Enqueue(MakePacket(A_WRTE, 1, i, 64 * 1024));
+    }
+    scheduler.Enqueue(MakePacket(A_WRTE, 2, 0, 1));
+
+    // The keystroke must not have to wait for the whole 4MiB backlog to drain.
+    size_t position = 0;
+    while (auto packet = scheduler.Dequeue()) {
+        if (packet->msg.arg0 == 2) {
+            break;
+        }
+        ++position;
+    }
+    ASSERT_LE(position, 1U);
+}
+
+TEST(PacketScheduler, equal_share) {
+    PacketScheduler scheduler;
+    for (uint32_t i = 0; i < 32; ++i) {
+        scheduler.Enqueue(MakePacket(A_WRTE, 1, i, 4096));
+        scheduler.Enqueue(MakePacket(A_WRTE, 2, i, 4096));
+    }
+
+    // Two flows of the same priority with the same packet sizes should stay within a quantum's
+    // worth of packets of each other.
+    const size_t max_skew = PacketScheduler::Quantum(WritePriority::Normal) / 4096 + 1;
+    size_t count[3] = {};
+    while (auto packet = scheduler.Dequeue()) {
+        ++count[packet->msg.arg0];
+        size_t skew = count[1] > count[2] ? count[1] - count[2] : count[2] - count[1];
+        ASSERT_LE(skew, max_skew);
+    }
+    ASSERT_EQ(32U, count[1]);
+    ASSERT_EQ(32U, count[2]);
+}
+
+TEST(PacketScheduler, service_priority) {
+    ASSERT_EQ(WritePriority::Interactive, GetServiceWritePriority("shell:ls"));
+    ASSERT_EQ(WritePriority::Interactive, GetServiceWritePriority("shell,v2,pty:"));
+    ASSERT_EQ(WritePriority::Interactive, GetServiceWritePriority("jdwp:1234"));
+    ASSERT_EQ(WritePriority::Interactive, GetServiceWritePriority("track-jdwp"));
+    ASSERT_EQ(WritePriority::Bulk, GetServiceWritePriority("sync:"));
+    ASSERT_EQ(WritePriority::Bulk, GetServiceWritePriority("framebuffer:"));
+    ASSERT_EQ(WritePriority::Normal, GetServiceWritePriority("tcp:5555"));
+    ASSERT_EQ(WritePriority::Normal, GetServiceWritePriority("shellfoo"));
+}
+
+TEST(PacketScheduler, forget_priority) {
+    PacketScheduler scheduler;
+    scheduler.SetPriority(1, WritePriority::Interactive);
+    scheduler.SetPriority(2, WritePriority::Bulk);
+    scheduler.SetPriority(3, WritePriority::Bulk);
+    ASSERT_EQ(3U, scheduler.priority_count());
+
+    // Socket 1 closes normally, with an A_CLSE that goes through the scheduler.
+    scheduler.Enqueue(MakePacket(A_CLSE, 1, 0));
+    ASSERT_EQ(static_cast<uint32_t>(A_CLSE), scheduler.Dequeue()->msg.command);
+    ASSERT_EQ(2U, scheduler.priority_count());
+
+    // Socket 2 is torn down without ever sending one.
+    scheduler.ForgetPriority(2);
+    ASSERT_EQ(1U, scheduler.priority_count());
+
+    // Socket 3 is forgotten along with everything else when the connection goes away.
+    scheduler.ForgetPriorities();
+    ASSERT_EQ(0U, scheduler.priority_count());
+}
@@ -33,6 +33,7 @@
 
 #include "adb.h"
 #include "adb_io.h"
+#include "adb_mdns.h"
 #include "adb_unique_fd.h"
 #include "adb_utils.h"
 #include "adb_wifi.h"
@@ -41,6 +42,10 @@
 #include "sysdeps.h"
 #include "transport.h"
 
+#if ADB_HOST
+#include "client/logcat_fanout.h"
+#endif
+
 namespace {
 
 void service_bootstrap_func(std::string service_name, std::function<void(unique_fd)> func,
@@ -156,6 +161,33 @@ static void pair_service(unique_fd fd, std::string host, std::string password) {
     }
 }
 
+// Reads the devices to pair with from |fd|, in the same format as host:pair, up to an empty string,
+// and sends back "<host> TAB <response>" for each as it finishes.
+static void pair_batch_service(unique_fd fd) {
+    std::vector<PairingTarget> targets;
+    while (true) {
+        std::string target;
+        std::string error;
+        if (!ReadProtocolString(fd, &target, &error)) {
+            D("pair-batch: %s", error.c_str());
+            return;
+        }
+        if (target.empty()) {
+            break;
+        }
+        size_t divider = target.find(':');
+        if (divider == std::string::npos || divider == 0) {
+            SendProtocolString(fd, target + "\tFailed: no pairing code");
+            continue;
+        }
+        targets.push_back({target.substr(divider + 1), target.substr(0, divider)});
+    }
+
+    adb_wifi_pair_devices(targets, [&fd, &targets](size_t i, const std::string& response) {
+        SendProtocolString(fd, targets[i].host + "\t" + response);
+    });
+}
+
 static void wait_service(unique_fd fd, std::string serial, TransportId transport_id,
                          std::string spec) {
     std::vector<std::string> components = android::base::Split(spec, "-");
@@ -247,8 +279,8 @@ static void wait_service(unique_fd fd, std::string serial, TransportId transport
 #endif
 
 #if ADB_HOST
-asocket* host_service_to_socket(std::string_view name, std::string_view serial,
-                                TransportId transport_id) {
+asocket* host_service_to_socket(std::string_view name, TransportType type,
+                                std::string_view serial, TransportId transport_id) {
     if (name == "track-devices") {
         return create_device_tracker(SHORT_TEXT);
     } else if (name == "track-devices-l") {
@@ -278,6 +310,13 @@ asocket* host_service_to_socket(std::string_view name, std::string_view serial,
         unique_fd fd = create_service_thread(
                 "pair", std::bind(pair_service, std::placeholders::_1, host, password));
         return create_local_socket(std::move(fd));
+    } else if (name == "pair-batch") {
+        unique_fd fd = create_service_thread("pair-batch", pair_batch_service);
+        return create_local_socket(std::move(fd));
+    } else if (android::base::ConsumePrefix(&name, "logcat-shared:")) {
+        return create_logcat_subscriber(name, type, serial, transport_id);
+    } else if (name == "mdns:track") {
+        return create_mdns_tracker();
     }
     return nullptr;
 }
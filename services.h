@@ -24,6 +24,9 @@
 constexpr char kShellServiceArgRaw[] = "raw";
 constexpr char kShellServiceArgPty[] = "pty";
 constexpr char kShellServiceArgShellProtocol[] = "v2";
+// Compress stdout/stderr (shell protocol only).
+constexpr char kShellServiceArgLZ4[] = "lz4";
+constexpr char kShellServiceArgZstd[] = "zstd";
 
 // Special flags sent by minadbd. They indicate the end of sideload transfer and the result of
 // installation or wipe.
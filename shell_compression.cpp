@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG SHELL
+
+#include "sysdeps.h"
+
+#include "shell_compression.h"
+
+#include <string.h>
+
+#include <android-base/logging.h>
+
+#include "adb_trace.h"
+
+ShellOutputCompressor::ShellOutputCompressor(CompressionType compression, ShellProtocol::Id id)
+    : id_(id == ShellProtocol::kIdStdout ? ShellProtocol::kIdStdoutCompressed
+                                         : ShellProtocol::kIdStderrCompressed) {
+    CHECK(id == ShellProtocol::kIdStdout || id == ShellProtocol::kIdStderr);
+    switch (compression) {
+        case CompressionType::LZ4:
+            encoder_ = &encoder_storage_.emplace<LZ4Encoder>(kBlockSize);
+            break;
+        case CompressionType::Zstd:
+            encoder_ = &encoder_storage_.emplace<ZstdEncoder>(kBlockSize);
+            break;
+        default:
+            LOG(FATAL) << "unexpected shell compression type " << static_cast<int>(compression);
+    }
+}
+
+bool ShellOutputCompressor::Write(ShellProtocol* protocol, const char* data, size_t length) {
+    // Copy the input out before anything is sent, since sending reuses |protocol|'s buffer.
+    Block block(length);
+    memcpy(block.data(), data, length);
+    encoder_->Append(std::move(block));
+    pending_ = true;
+    return Drain(protocol);
+}
+
+bool ShellOutputCompressor::Flush(ShellProtocol* protocol) {
+    if (!pending_) {
+        return true;
+    }
+    encoder_->Flush();
+    pending_ = false;
+    return Drain(protocol);
+}
+
+bool ShellOutputCompressor::Drain(ShellProtocol* protocol) {
+    while (true) {
+        Block output;
+        EncodeResult result = encoder_->Encode(&output);
+        if (result == EncodeResult::Error) {
+            LOG(ERROR) << "failed to compress shell output";
+            errno = EIO;
+            return false;
+        }
+
+        if (!output.empty()) {
+            protocol->Reserve(output.size());
+            CHECK_LE(output.size(), protocol->data_capacity());
+            memcpy(protocol->data(), output.data(), output.size());
+            if (!protocol->Write(id_, output.size())) {
+                return false;
+            }
+        }
+
+        if (result != EncodeResult::MoreOutput) {
+            return true;
+        }
+    }
+}
+
+bool ShellOutputDecompressor::Decode(const char* data, size_t length, const Callback& callback) {
+    if (!decoder_) {
+        header_.insert(header_.end(), data, data + length);
+
+        // Both LZ4 and Zstd frames start with a 4-byte little-endian magic number.
+        static constexpr uint32_t kLZ4Magic = 0x184D2204;
+        static constexpr uint32_t kZstdMagic = 0xFD2FB528;
+        uint32_t magic;
+        if (header_.size() < sizeof(magic)) {
+            return true;
+        }
+        memcpy(&magic, header_.data(), sizeof(magic));
+
+        output_.resize(ShellOutputCompressor::kBlockSize);
+        std::span<char> output_buffer(output_.data(), output_.size());
+        if (magic == kLZ4Magic) {
+            decoder_ = &decoder_storage_.emplace<LZ4Decoder>(output_buffer);
+        } else if (magic == kZstdMagic) {
+            decoder_ = &decoder_storage_.emplace<ZstdDecoder>(output_buffer);
+        } else {
+            LOG(ERROR) << "unknown compressed shell output format " << std::hex << magic;
+            return false;
+        }
+
+        std::vector<char> header = std::move(header_);
+        header_.clear();
+        return Decode(header.data(), header.size(), callback);
+    }
+
+    if (length == 0) {
+        return true;
+    }
+    Block block(length);
+    memcpy(block.data(), data, length);
+    decoder_->Append(std::move(block));
+    while (true) {
+        std::span<char> output;
+        DecodeResult result = decoder_->Decode(&output);
+        if (result == DecodeResult::Error) {
+            return false;
+        }
+        if (!output.empty() && !callback(output.data(), output.size())) {
+            return false;
+        }
+        if (result != DecodeResult::MoreOutput) {
+            return true;
+        }
+    }
+}
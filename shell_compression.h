@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <variant>
+#include <vector>
+
+#include "compression_utils.h"
+#include "file_sync_protocol.h"
+#include "shell_protocol.h"
+
+// Compressed shell protocol output.
+//
+// If the client asks for it (see kFeatureShell2LZ4 and kFeatureShell2Zstd), adbd sends the
+// subprocess's stdout and stderr as kIdStdoutCompressed and kIdStderrCompressed packets. Each of
+// the two is a single LZ4 or Zstd stream that spans all its packets. adbd flushes the streams
+// whenever the subprocess has no more output ready, so that interactive output isn't held back
+// waiting for a full block. Errors reported before the subprocess starts, and the exit code, are
+// never compressed.
+
+// Compresses one of a subprocess's output streams.
+class ShellOutputCompressor {
+  public:
+    // Compressed packets carry at most this many bytes.
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    // |compression| must be LZ4 or Zstd. |id| is kIdStdout or kIdStderr.
+    ShellOutputCompressor(CompressionType compression, ShellProtocol::Id id);
+
+    // Compresses |length| bytes of |data|, sending complete blocks through |protocol|. |data| may
+    // point into |protocol|'s buffer.
+    //
+    // Returns false if the FD closed or errored.
+    bool Write(ShellProtocol* protocol, const char* data, size_t length);
+
+    // Sends everything written so far.
+    //
+    // Returns false if the FD closed or errored.
+    bool Flush(ShellProtocol* protocol);
+
+    // Whether there's data that hasn't been flushed yet.
+    bool pending() const { return pending_; }
+
+  private:
+    bool Drain(ShellProtocol* protocol);
+
+    ShellProtocol::Id id_;
+    std::variant<std::monostate, LZ4Encoder, ZstdEncoder> encoder_storage_;
+    Encoder* encoder_ = nullptr;
+    bool pending_ = false;
+
+    DISALLOW_COPY_AND_ASSIGN(ShellOutputCompressor);
+};
+
+// Decompresses one of the compressed output streams. The algorithm is told apart by the magic
+// number at the start of the stream.
+class ShellOutputDecompressor {
+  public:
+    using Callback = std::function<bool(const char* data, size_t length)>;
+
+    ShellOutputDecompressor() = default;
+
+    // Decompresses a packet's worth of data, passing the output to |callback|.
+    //
+    // Returns false if the data is corrupt, or if |callback| returns false.
+    bool Decode(const char* data, size_t length, const Callback& callback);
+
+  private:
+    // Bytes seen before there were enough to pick the decoder.
+    std::vector<char> header_;
+    std::vector<char> output_;
+    std::variant<std::monostate, LZ4Decoder, ZstdDecoder> decoder_storage_;
+    Decoder* decoder_ = nullptr;
+
+    DISALLOW_COPY_AND_ASSIGN(ShellOutputDecompressor);
+};
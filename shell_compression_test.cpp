@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shell_compression.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "adb_unique_fd.h"
+#include "sysdeps.h"
+
+class ShellCompressionTest : public ::testing::TestWithParam<CompressionType> {
+  protected:
+    void SetUp() override {
+        int fds[2];
+        ASSERT_EQ(0, adb_socketpair(fds));
+        read_fd_.reset(fds[0]);
+        write_fd_.reset(fds[1]);
+        read_protocol_ = std::make_unique<ShellProtocol>(read_fd_);
+        write_protocol_ = std::make_unique<ShellProtocol>(write_fd_);
+    }
+
+    // Reads the packets that have been sent so far, decompressing them into |stdout_|.
+    void ReadAvailable() {
+        while (true) {
+            adb_pollfd pfd = {.fd = read_fd_.get(), .events = POLLIN};
+            ASSERT_GE(adb_poll(&pfd, 1, 0), 0);
+            if (!(pfd.revents & POLLIN)) {
+                return;
+            }
+            ASSERT_TRUE(read_protocol_->Read());
+            ASSERT_EQ(ShellProtocol::kIdStdoutCompressed, read_protocol_->id());
+            ASSERT_LE(read_protocol_->data_length(), ShellOutputCompressor::kBlockSize);
+            ASSERT_TRUE(decompressor_.Decode(read_protocol_->data(), read_protocol_->data_length(),
+                                             [this](const char* data, size_t length) {
+                                                 stdout_.append(data, length);
+                                                 return true;
+                                             }));
+        }
+    }
+
+    unique_fd read_fd_;
+    unique_fd write_fd_;
+    std::unique_ptr<ShellProtocol> read_protocol_;
+    std::unique_ptr<ShellProtocol> write_protocol_;
+    ShellOutputDecompressor decompressor_;
+    std::string stdout_;
+};
+
+TEST_P(ShellCompressionTest, flush) {
+    ShellOutputCompressor compressor(GetParam(), ShellProtocol::kIdStdout);
+    ASSERT_FALSE(compressor.pending());
+
+    std::string line = "I/ActivityManager: Start proc 1234:com.example/u0a100\n";
+    ASSERT_TRUE(compressor.Write(write_protocol_.get(), line.data(), line.size()));
+    ASSERT_TRUE(compressor.pending());
+    ASSERT_TRUE(compressor.Flush(write_protocol_.get()));
+    ASSERT_FALSE(compressor.pending());
+    ReadAvailable();
+    ASSERT_EQ(line, stdout_);
+
+    // The stream carries on after a flush.
+    ASSERT_TRUE(compressor.Write(write_protocol_.get(), line.data(), line.size()));
+    ASSERT_TRUE(compressor.Flush(write_protocol_.get()));
+    ReadAvailable();
+    ASSERT_EQ(line + line, stdout_);
+}
+
+TEST_P(ShellCompressionTest, large_output) {
+    ShellOutputCompressor compressor(GetParam(), ShellProtocol::kIdStdout);
+
+    // Enough repetitive text to fill several blocks even once compressed.
+    std::string expected;
+    for (int i = 0; expected.size() < 4 * 1024 * 1024; ++i) {
+        expected += "line " + std::to_string(i * 7919 % 100003) + " of some log output\n";
+    }
+
+    // The socket buffer won't hold all of it, so read while writing.
+    std::thread reader([this, &expected]() {
+        while (stdout_.size() < expected.size()) {
+            ASSERT_TRUE(read_protocol_->Read());
+            ASSERT_TRUE(decompressor_.Decode(read_protocol_->data(), read_protocol_->data_length(),
+                                             [this](const char* data, size_t length) {
+                                                 stdout_.append(data, length);
+                                                 return true;
+                                             }));
+        }
+    });
+
+    // Subprocess output is read in chunks up to the size of the protocol buffer.
+    size_t chunk_size = write_protocol_->data_capacity();
+    for (size_t offset = 0; offset < expected.size(); offset += chunk_size) {
+        size_t length = std::min(chunk_size, expected.size() - offset);
+        memcpy(write_protocol_->data(), expected.data() + offset, length);
+        ASSERT_TRUE(compressor.Write(write_protocol_.get(), write_protocol_->data(), length));
+    }
+    ASSERT_TRUE(compressor.Flush(write_protocol_.get()));
+    reader.join();
+    ASSERT_EQ(expected, stdout_);
+}
+
+TEST_P(ShellCompressionTest, stderr) {
+    ShellOutputCompressor compressor(GetParam(), ShellProtocol::kIdStderr);
+    ASSERT_TRUE(compressor.Write(write_protocol_.get(), "error\n", 6));
+    ASSERT_TRUE(compressor.Flush(write_protocol_.get()));
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_EQ(ShellProtocol::kIdStderrCompressed, read_protocol_->id());
+}
+
+INSTANTIATE_TEST_SUITE_P(Algorithms, ShellCompressionTest,
+                         ::testing::Values(CompressionType::LZ4, CompressionType::Zstd));
+
+TEST(ShellOutputDecompressor, unknown_format) {
+    ShellOutputDecompressor decompressor;
+    auto callback = [](const char*, size_t) { return true; };
+    // Not enough to tell yet.
+    ASSERT_TRUE(decompressor.Decode("ab", 2, callback));
+    ASSERT_FALSE(decompressor.Decode("cd", 2, callback));
+}
@@ -16,8 +16,11 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
+
 #include <android-base/macros.h>
 
 #include "adb.h"
@@ -28,6 +31,10 @@
 // To keep things simple and predictable, reads and writes block until an entire
 // packet is complete.
 //
+// The packet buffer is allocated on first use, starts small, and grows as
+// needed up to MAX_PAYLOAD bytes, so that idle protocol objects stay cheap.
+// Buffers are recycled through a process-wide pool when the object goes away.
+//
 // Example: read raw data from |fd| and send it in a packet.
 //   ShellProtocol* p = new ShellProtocol(protocol_fd);
 //   int len = adb_read(stdout_fd, p->data(), p->data_capacity());
@@ -53,35 +60,45 @@ class ShellProtocol {
         // Window size change (an ASCII version of struct winsize).
         kIdWindowSizeChange = 5,
 
+        // Compressed stdout/stderr, each a single LZ4 or Zstd stream (see shell_compression.h).
+        kIdStdoutCompressed = 6,
+        kIdStderrCompressed = 7,
+
         // Indicates an invalid or unknown packet.
         kIdInvalid = 255,
     };
 
-    // ShellPackets will probably be too large to allocate on the stack so they
-    // should be dynamically allocated on the heap instead.
-    //
     // |fd| is an open file descriptor to be used to send or receive packets.
     explicit ShellProtocol(borrowed_fd fd);
     virtual ~ShellProtocol();
 
-    // Returns a pointer to the data buffer.
-    const char* data() const { return buffer_ + kHeaderSize; }
-    char* data() { return buffer_ + kHeaderSize; }
+    // Returns a pointer to the data buffer, allocating it if necessary. The
+    // pointer is invalidated by Read() and Reserve(), which may reallocate.
+    const char* data() const;
+    char* data();
 
     // Returns the total capacity of the data buffer.
-    size_t data_capacity() const { return buffer_end_ - data(); }
+    size_t data_capacity() const;
+
+    // Grows the data buffer to at least |length| bytes, or the maximum packet
+    // size if that is smaller. The contents of the buffer are preserved.
+    //
+    // Write() never grows the buffer, so callers that copy more than a few
+    // bytes into data() should reserve space first.
+    void Reserve(size_t length);
 
     // Reads a packet from the FD.
     //
-    // If a packet is too big to fit in the buffer then Read() will split the
-    // packet across multiple calls. For example, reading a 50-byte packet into
-    // a 20-byte buffer would read 20 bytes, 20 bytes, then 10 bytes.
+    // The buffer is grown to fit the packet if possible. If a packet is still
+    // too big to fit in the buffer then Read() will split the packet across
+    // multiple calls. For example, reading a 50-byte packet into a 20-byte
+    // buffer would read 20 bytes, 20 bytes, then 10 bytes.
     //
     // Returns false if the FD closed or errored.
     bool Read();
 
     // Returns the ID of the packet in the buffer.
-    int id() const { return buffer_[0]; }
+    int id() const { return buffer_ ? buffer_[0] : static_cast<char>(kIdInvalid); }
 
     // Returns the number of bytes that have been read into the data buffer.
     size_t data_length() const { return data_length_; }
@@ -91,6 +108,12 @@ class ShellProtocol {
     // Returns false if the FD closed or errored.
     bool Write(Id id, size_t length);
 
+    // Writes only the header of a packet, for callers that send the |length|
+    // bytes of data to the FD themselves, e.g. with splice().
+    //
+    // Returns false if the FD closed or errored.
+    bool WriteHeader(Id id, size_t length);
+
   private:
     // Packets support 4-byte lengths.
     typedef uint32_t length_t;
@@ -98,19 +121,27 @@ class ShellProtocol {
     enum {
         // It's OK if MAX_PAYLOAD doesn't match on the sending and receiving
         // end, reading will split larger packets into multiple smaller ones.
-        kBufferSize = MAX_PAYLOAD,
+        kMinBufferSize = 4096,
+        kMaxBufferSize = MAX_PAYLOAD,
 
         // Header is 1 byte ID + 4 bytes length.
         kHeaderSize = sizeof(Id) + sizeof(length_t)
     };
 
+    // Makes sure the buffer (header included) holds at least |size| bytes.
+    void Allocate(size_t size) const;
+
     borrowed_fd fd_;
-    char buffer_[kBufferSize];
+
+    // Lazily allocated, so these are mutable to let const data() work.
+    mutable std::unique_ptr<char[]> buffer_;
+    mutable size_t buffer_size_ = 0;
+
     size_t data_length_ = 0, bytes_left_ = 0;
 
     // We need to be able to modify this value for testing purposes, but it
     // will stay constant during actual program use.
-    char* buffer_end_ = buffer_ + sizeof(buffer_);
+    size_t max_data_capacity_ = kMaxBufferSize - kHeaderSize;
 
     friend class ShellProtocolTest;
 
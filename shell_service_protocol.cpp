@@ -19,20 +19,126 @@
 #include <string.h>
 
 #include <algorithm>
+#include <bit>
+#include <mutex>
+#include <vector>
+
+#include <android-base/no_destructor.h>
+#include <android-base/thread_annotations.h>
 
 #include "adb_io.h"
 
-ShellProtocol::ShellProtocol(borrowed_fd fd) : fd_(fd) {
-    buffer_[0] = kIdInvalid;
-}
+namespace {
+
+// Packet buffers of destroyed ShellProtocol objects, kept for reuse by new ones. Every shell,
+// exec-batch command and interactive session has one or two, and most are short-lived.
+class BufferPool {
+  public:
+    // Buffer sizes are powers of two in [kMinSize, kMaxSize].
+    static constexpr size_t kMinSize = 4096;
+    static constexpr size_t kMaxSize = MAX_PAYLOAD;
+
+    // Upper bound on the memory held by idle buffers.
+    static constexpr size_t kMaxCachedBytes = 4 * 1024 * 1024;
+
+    static BufferPool& Instance() {
+        static android::base::NoDestructor<BufferPool> pool;
+        return *pool;
+    }
+
+    // Rounds |size| up to a buffer size.
+    static size_t SizeFor(size_t size) {
+        return std::bit_ceil(std::clamp(size, kMinSize, kMaxSize));
+    }
+
+    std::unique_ptr<char[]> Take(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<std::unique_ptr<char[]>>& free = free_[Index(size)];
+            if (!free.empty()) {
+                std::unique_ptr<char[]> buffer = std::move(free.back());
+                free.pop_back();
+                cached_bytes_ -= size;
+                return buffer;
+            }
+        }
+        return std::make_unique_for_overwrite<char[]>(size);
+    }
+
+    void Give(std::unique_ptr<char[]> buffer, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cached_bytes_ + size > kMaxCachedBytes) {
+            return;
+        }
+        free_[Index(size)].push_back(std::move(buffer));
+        cached_bytes_ += size;
+    }
+
+  private:
+    static constexpr size_t kClasses = std::countr_zero(kMaxSize) - std::countr_zero(kMinSize) + 1;
+
+    static size_t Index(size_t size) {
+        return std::countr_zero(size) - std::countr_zero(kMinSize);
+    }
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<char[]>> free_[kClasses] GUARDED_BY(mutex_);
+    size_t cached_bytes_ GUARDED_BY(mutex_) = 0;
+};
+
+static_assert(std::has_single_bit(BufferPool::kMaxSize));
+
+}  // namespace
+
+ShellProtocol::ShellProtocol(borrowed_fd fd) : fd_(fd) {}
 
 ShellProtocol::~ShellProtocol() {
+    if (buffer_) {
+        BufferPool::Instance().Give(std::move(buffer_), buffer_size_);
+    }
+}
+
+void ShellProtocol::Allocate(size_t size) const {
+    if (buffer_ && buffer_size_ >= size) {
+        return;
+    }
+
+    size_t new_size = BufferPool::SizeFor(size);
+    std::unique_ptr<char[]> new_buffer = BufferPool::Instance().Take(new_size);
+    if (buffer_) {
+        memcpy(new_buffer.get(), buffer_.get(), buffer_size_);
+        BufferPool::Instance().Give(std::move(buffer_), buffer_size_);
+    } else {
+        new_buffer[0] = kIdInvalid;
+    }
+    buffer_ = std::move(new_buffer);
+    buffer_size_ = new_size;
+}
+
+const char* ShellProtocol::data() const {
+    Allocate(kMinBufferSize);
+    return buffer_.get() + kHeaderSize;
+}
+
+char* ShellProtocol::data() {
+    Allocate(kMinBufferSize);
+    return buffer_.get() + kHeaderSize;
+}
+
+size_t ShellProtocol::data_capacity() const {
+    Allocate(kMinBufferSize);
+    return std::min(buffer_size_ - kHeaderSize, max_data_capacity_);
+}
+
+void ShellProtocol::Reserve(size_t length) {
+    Allocate(kHeaderSize + std::min(length, max_data_capacity_));
 }
 
 bool ShellProtocol::Read() {
     // Only read a new header if we've finished the last packet.
     if (!bytes_left_) {
-        if (!ReadFdExactly(fd_, buffer_, kHeaderSize)) {
+        Allocate(kMinBufferSize);
+        if (!ReadFdExactly(fd_, buffer_.get(), kHeaderSize)) {
             return false;
         }
 
@@ -40,6 +146,7 @@ bool ShellProtocol::Read() {
         memcpy(&packet_length, &buffer_[1], sizeof(packet_length));
         bytes_left_ = packet_length;
         data_length_ = 0;
+        Reserve(bytes_left_);
     }
 
     size_t read_length = std::min(bytes_left_, data_capacity());
@@ -54,9 +161,19 @@ bool ShellProtocol::Read() {
 }
 
 bool ShellProtocol::Write(Id id, size_t length) {
+    Allocate(kMinBufferSize);
     buffer_[0] = id;
     length_t typed_length = length;
     memcpy(&buffer_[1], &typed_length, sizeof(typed_length));
 
-    return WriteFdExactly(fd_, buffer_, kHeaderSize + length);
+    return WriteFdExactly(fd_, buffer_.get(), kHeaderSize + length);
+}
+
+bool ShellProtocol::WriteHeader(Id id, size_t length) {
+    char header[kHeaderSize];
+    header[0] = id;
+    length_t typed_length = length;
+    memcpy(&header[1], &typed_length, sizeof(typed_length));
+
+    return WriteFdExactly(fd_, header, sizeof(header));
 }
@@ -19,8 +19,12 @@
 #include <gtest/gtest.h>
 
 #include <signal.h>
+#include <stdint.h>
 #include <string.h>
 
+#include <string>
+#include <thread>
+
 #include "sysdeps.h"
 
 class ShellProtocolTest : public ::testing::Test {
@@ -69,7 +73,7 @@ class ShellProtocolTest : public ::testing::Test {
 
     // Fakes the buffer size so we can test filling buffers.
     void SetReadDataCapacity(size_t size) {
-        read_protocol_->buffer_end_ = read_protocol_->data() + size;
+        read_protocol_->max_data_capacity_ = size;
     }
 
 #if !defined(_WIN32)
@@ -196,3 +200,47 @@ TEST_F(ShellProtocolTest, ReadPacketFromClosedPipe) {
     // Second read should fail.
     ASSERT_FALSE(read_protocol_->Read());
 }
+
+// Tests that the buffer starts small and grows to fit large packets.
+TEST_F(ShellProtocolTest, LargePacketGrowsBuffer) {
+    ShellProtocol::Id id = ShellProtocol::kIdStdout;
+    std::string data(100000, 'x');
+    data[0] = 'a';
+    data.back() = 'z';
+
+    ASSERT_LT(write_protocol_->data_capacity(), data.size());
+    write_protocol_->Reserve(data.size());
+    ASSERT_GE(write_protocol_->data_capacity(), data.size());
+    memcpy(write_protocol_->data(), data.data(), data.size());
+
+    // The packet may not fit in the socket buffer, so write it from another thread.
+    std::thread writer([&]() { ASSERT_TRUE(write_protocol_->Write(id, data.size())); });
+    ASSERT_TRUE(read_protocol_->Read());
+    writer.join();
+
+    ASSERT_GE(read_protocol_->data_capacity(), data.size());
+    ASSERT_TRUE(PacketEquals(read_protocol_, id, data.data(), data.size()));
+}
+
+// Tests that growing the buffer keeps its contents.
+TEST_F(ShellProtocolTest, ReservePreservesData) {
+    memcpy(write_protocol_->data(), "hello", 5);
+    write_protocol_->Reserve(64 * 1024);
+    ASSERT_EQ(0, memcmp(write_protocol_->data(), "hello", 5));
+
+    // Asking for more than a packet can hold is capped.
+    write_protocol_->Reserve(SIZE_MAX);
+    ASSERT_LE(write_protocol_->data_capacity(), static_cast<size_t>(MAX_PAYLOAD));
+    ASSERT_EQ(0, memcmp(write_protocol_->data(), "hello", 5));
+}
+
+// Tests a packet whose data is written separately from its header.
+TEST_F(ShellProtocolTest, WriteHeader) {
+    ShellProtocol::Id id = ShellProtocol::kIdStderr;
+
+    ASSERT_TRUE(write_protocol_->WriteHeader(id, 3));
+    ASSERT_EQ(3, adb_write(write_fd_, "abc", 3));
+
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_TRUE(PacketEquals(read_protocol_, id, "abc", 3));
+}
@@ -24,6 +24,7 @@
 #include <optional>
 #include <string>
 
+#include "ack_window.h"
 #include "adb_unique_fd.h"
 #include "fdevent/fdevent.h"
 #include "types.h"
@@ -128,6 +129,16 @@ struct asocket {
     // we'll send out a full packet.
     std::optional<int64_t> available_send_bytes;
 
+    // The window we grant the other end if delayed_ack is available. Only used by local sockets.
+    std::optional<AckWindow> ack_window;
+
+    // Backpressure from the global BufferBudget. Only used by local sockets.
+    // Whether we stopped reading from fd because the budget was exhausted.
+    bool read_throttled = false;
+    // Acks we owe the other end, but are holding back until our queue drains.
+    bool ack_withheld = false;
+    uint32_t withheld_ack_bytes = 0;
+
     // Start Smart socket fields
     // A temporary buffer used to hold a partially-read service string for smartsockets.
     std::string smart_socket_data;
@@ -42,6 +42,7 @@
 #include "adb.h"
 #include "adb_io.h"
 #include "adb_utils.h"
+#include "buffer_budget.h"
 #include "transport.h"
 #include "types.h"
 
@@ -128,6 +129,7 @@ static SocketFlushResult local_socket_flush_incoming(asocket* s) {
         D("LS(%u) %s: rc = %zd", s->id, __func__, rc);
         if (rc > 0) {
             bytes_flushed = rc;
+            BufferBudget::Global().Release(rc);
             if (static_cast<size_t>(rc) == s->packet_queue.size()) {
                 s->packet_queue.clear();
             } else {
@@ -145,14 +147,44 @@ static SocketFlushResult local_socket_flush_incoming(asocket* s) {
 
     bool fd_full = !s->packet_queue.empty() && !s->has_write_error;
     if (s->transport && s->peer) {
+        // If there's too much data buffered in the process, don't let the other side send any more
+        // to a socket that can't keep up. The acks are sent once the queue has been drained, or
+        // the budget has freed up.
+        bool withhold_ack = fd_full && BufferBudget::Global().Exhausted();
         if (s->available_send_bytes.has_value()) {
             // Deferred acks are available.
-            send_ready(s->id, s->peer->id, s->transport, bytes_flushed);
+            uint32_t ack_bytes = bytes_flushed;
+            if (s->ack_window) {
+                size_t old_window = s->ack_window->window();
+                ack_bytes = s->ack_window->OnFlushed(bytes_flushed, s->packet_queue.size(),
+                                                     AckWindow::Clock::now());
+                if (s->ack_window->window() != old_window) {
+                    VLOG(PACKETS) << "LS(" << s->id << "): delayed ack window " << old_window
+                                  << " -> " << s->ack_window->window() << " (min rtt "
+                                  << (s->ack_window->min_rtt() ? s->ack_window->min_rtt()->count()
+                                                               : -1)
+                                  << "us, drain rate " << s->ack_window->drain_rate()
+                                  << "B/s, total " << AckWindow::TotalWindowBytes() << ")";
+                }
+            }
+            if (withhold_ack) {
+                D("LS(%u): socket buffer budget exhausted, withholding ack", s->id);
+                s->withheld_ack_bytes += ack_bytes;
+            } else {
+                send_ready(s->id, s->peer->id, s->transport, ack_bytes + s->withheld_ack_bytes);
+                s->withheld_ack_bytes = 0;
+            }
         } else {
             // Deferred acks aren't available, we should ask for more data as long as we have less
             // than a full packet left in our queue.
-            if (bytes_flushed != 0 && s->packet_queue.size() < MAX_PAYLOAD) {
-                send_ready(s->id, s->peer->id, s->transport, 0);
+            if ((bytes_flushed != 0 || s->ack_withheld) && s->packet_queue.size() < MAX_PAYLOAD) {
+                if (withhold_ack) {
+                    D("LS(%u): socket buffer budget exhausted, withholding ack", s->id);
+                    s->ack_withheld = true;
+                } else {
+                    send_ready(s->id, s->peer->id, s->transport, 0);
+                    s->ack_withheld = false;
+                }
             }
         }
     }
@@ -227,17 +259,28 @@ static bool local_socket_flush_outgoing(asocket* s) {
             return false;
         }
 
+        bool blocked = false;
         if (r > 0) {
             if (s->available_send_bytes) {
                 if (*s->available_send_bytes <= 0) {
                     D("LS(%u): send buffer full (%" PRId64 ")", saved_id, *s->available_send_bytes);
                     fdevent_del(s->fde, FDE_READ);
+                    blocked = true;
                 }
             } else {
                 D("LS(%u): acks not deferred, blocking", saved_id);
                 fdevent_del(s->fde, FDE_READ);
+                blocked = true;
             }
         }
+
+        // If there's too much data buffered in the process already, stop reading until some of
+        // it has been written out.
+        if (!blocked && BufferBudget::Global().Exhausted()) {
+            D("LS(%u): socket buffer budget exhausted, blocking", saved_id);
+            s->read_throttled = true;
+            fdevent_del(s->fde, FDE_READ);
+        }
     }
 
     if (is_eof) {
@@ -252,6 +295,11 @@ static bool local_socket_flush_outgoing(asocket* s) {
 static int local_socket_enqueue(asocket* s, apacket::payload_type data) {
     D("LS(%d): enqueue %zu", s->id, data.size());
 
+    if (s->ack_window) {
+        s->ack_window->OnReceived(data.size(), AckWindow::Clock::now());
+    }
+
+    BufferBudget::Global().Charge(data.size());
     s->packet_queue.append(std::move(data));
     switch (local_socket_flush_incoming(s)) {
         case SocketFlushResult::Destroyed:
@@ -268,11 +316,31 @@ static int local_socket_enqueue(asocket* s, apacket::payload_type data) {
 }
 
 static void local_socket_ready(asocket* s) {
+    if (BufferBudget::Global().Exhausted()) {
+        // Don't pick up any more data until the budget frees up: local_sockets_resume will
+        // call us again then.
+        D("LS(%d): ready, but socket buffer budget exhausted", s->id);
+        s->read_throttled = true;
+        fdevent_del(s->fde, FDE_READ);
+        return;
+    }
+
     /* far side is ready for data, pay attention to
        readable events */
+    s->read_throttled = false;
     fdevent_add(s->fde, FDE_READ);
 }
 
+// Called on the fdevent thread when the socket buffer budget frees up after being exhausted.
+static void local_sockets_resume() {
+    std::lock_guard<std::recursive_mutex> lock(local_socket_list_lock);
+    for (asocket* s : local_socket_list) {
+        if (s->read_throttled) {
+            local_socket_ready(s);
+        }
+    }
+}
+
 struct ClosingSocket {
     std::chrono::steady_clock::time_point begin;
 };
@@ -332,6 +400,7 @@ static void local_socket_destroy(asocket* s) {
 
     deferred_close(fdevent_release(s->fde));
 
+    BufferBudget::Global().Release(s->packet_queue.size());
     remove_socket(s);
     delete s;
 
@@ -344,6 +413,13 @@ static void local_socket_destroy(asocket* s) {
 static void local_socket_close(asocket* s) {
     D("entered local_socket_close. LS(%d) fd=%d", s->id, s->fd);
     std::lock_guard<std::recursive_mutex> lock(local_socket_list_lock);
+
+    // The scheduler forgets a socket's write priority when it dequeues the socket's A_CLSE, but
+    // a socket doesn't always get to send one (e.g. when its transport is being kicked).
+    atransport* t = s->transport ? s->transport : (s->peer ? s->peer->transport : nullptr);
+    if (t) {
+        t->ForgetSocketPriority(s->id);
+    }
     if (s->peer) {
         D("LS(%d): closing peer. peer->id=%d peer->fd=%d", s->id, s->peer->id, s->peer->fd);
         /* Note: it's important to call shutdown before disconnecting from
@@ -451,6 +527,11 @@ asocket* create_local_socket(unique_fd ufd) {
     s->close = local_socket_close;
     install_local_socket(s);
 
+    static std::once_flag resume_callback_once;
+    std::call_once(resume_callback_once, []() {
+        BufferBudget::Global().SetResumeCallback(local_sockets_resume);
+    });
+
     s->fde = fdevent_create(fd, local_socket_event_func, s);
     D("LS(%d): created (fd=%d)", s->id, s->fd);
     return s;
@@ -572,10 +653,13 @@ void connect_to_remote(asocket* s, std::string_view destination) {
     p->msg.arg0 = s->id;
 
     if (s->transport->SupportsDelayedAck()) {
-        p->msg.arg1 = INITIAL_DELAYED_ACK_BYTES;
+        s->ack_window.emplace();
+        p->msg.arg1 = s->ack_window->window();
         s->available_send_bytes = 0;
     }
 
+    s->transport->SetSocketPriority(s->id, GetServiceWritePriority(destination));
+
     // adbd used to expect a null-terminated string.
     // Keep doing so to maintain backward compatibility.
     p->payload.resize(destination.size() + 1);
@@ -782,6 +866,7 @@ bool parse_host_service(std::string_view* out_serial, std::string_view* out_comm
 }  // namespace internal
 
 static int smart_socket_enqueue(asocket* s, apacket::payload_type data) {
+    std::string request;
     std::string_view service;
     std::string_view serial;
     TransportId transport_id = 0;
@@ -814,11 +899,13 @@ static int smart_socket_enqueue(asocket* s, apacket::payload_type data) {
         return 0;
     }
 
-    s->smart_socket_data[len + 4] = 0;
+    // Clients may pipeline requests (see host:pipeline), so only consume this one.
+    request = s->smart_socket_data.substr(4, len);
+    s->smart_socket_data.erase(0, len + 4);
 
-    D("SS(%d): '%s'", s->id, (char*)(s->smart_socket_data.data() + 4));
+    D("SS(%d): '%s'", s->id, request.c_str());
 
-    service = std::string_view(s->smart_socket_data).substr(4);
+    service = request;
 
     VLOG(SERVICES) << "service request: '" << service << "'";
 
@@ -863,8 +950,12 @@ static int smart_socket_enqueue(asocket* s, apacket::payload_type data) {
                 goto fail;
 
             case HostRequestResult::SwitchedTransport:
+            case HostRequestResult::Pipelined:
                 D("SS(%d): okay transport", s->id);
-                s->smart_socket_data.clear();
+                if (!s->smart_socket_data.empty()) {
+                    // The next request is already here.
+                    return smart_socket_enqueue(s, apacket::payload_type());
+                }
                 return 0;
 
             case HostRequestResult::Unhandled:
@@ -876,7 +967,7 @@ static int smart_socket_enqueue(asocket* s, apacket::payload_type data) {
         ** and tear down here.
         */
         // TODO: Convert to string_view.
-        s2 = host_service_to_socket(service, serial, transport_id);
+        s2 = host_service_to_socket(service, type, serial, transport_id);
         if (s2 == nullptr) {
             LOG(VERBOSE) << "SS(" << s->id << "): couldn't create host service '" << service << "'";
             std::string msg = std::string("unknown host service '") + std::string(service) + "'";
@@ -930,7 +1021,7 @@ static int smart_socket_enqueue(asocket* s, apacket::payload_type data) {
     /* give them our transport and upref it */
     s->peer->transport = s->transport;
 
-    connect_to_remote(s->peer, std::string_view(s->smart_socket_data).substr(4));
+    connect_to_remote(s->peer, request);
     s->peer = nullptr;
     s->close(s);
     return 1;
@@ -20,3 +20,10 @@
 
 int network_loopback_client(int port, int type, std::string* error);
 int network_loopback_server(int port, int type, std::string* error, bool prefer_ipv4);
+
+#if !defined(_WIN32)
+// Starts connecting a nonblocking, close-on-exec TCP socket to |port| on the IPv4 (or IPv6)
+// loopback address. Returns the socket, which becomes writable once the connection is established
+// or failed (see SO_ERROR), or -1 if connecting failed right away.
+int network_loopback_client_nonblocking(bool ipv6, int port, std::string* error);
+#endif
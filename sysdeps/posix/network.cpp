@@ -17,6 +17,7 @@
 #include "sysdeps/network.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -90,6 +91,32 @@ int network_loopback_client(int port, int type, std::string* error) {
     return rc;
 }
 
+int network_loopback_client_nonblocking(bool ipv6, int port, std::string* error) {
+    unique_fd s(socket(ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0));
+    if (s == -1) {
+        set_error(error);
+        return -1;
+    }
+
+    int flags = fcntl(s.get(), F_GETFL);
+    if (flags == -1 || fcntl(s.get(), F_SETFL, flags | O_NONBLOCK) != 0 ||
+        fcntl(s.get(), F_SETFD, FD_CLOEXEC) != 0) {
+        set_error(error);
+        return -1;
+    }
+
+    struct sockaddr_storage addr_storage = {};
+    socklen_t addrlen = sizeof(addr_storage);
+    sockaddr* addr = (ipv6 ? loopback_addr6 : loopback_addr4)(&addr_storage, &addrlen, port);
+
+    if (connect(s.get(), addr, addrlen) != 0 && errno != EINPROGRESS) {
+        set_error(error);
+        return -1;
+    }
+
+    return s.release();
+}
+
 static int _network_loopback_server(bool ipv6, int port, int type, std::string* error) {
     unique_fd s(socket(ipv6 ? AF_INET6 : AF_INET, type, 0));
     if (s == -1) {
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+#include <android-base/thread_annotations.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+namespace adb {
+namespace tls {
+
+// The keys a TLS server encrypts its session tickets with, so that clients can resume their
+// session when they reconnect instead of going through the certificate exchange again. Share one
+// instance between all the connections of a server (see TlsConnection::SetSessionTicketKeys).
+//
+// New tickets are encrypted with a fresh key every |rotation_interval|, and tickets encrypted
+// with any of the |max_keys| most recent keys are accepted, so a ticket is good for at most
+// |rotation_interval| * |max_keys|. The keys are only ever kept in memory.
+class SessionTicketKeys {
+  public:
+    SessionTicketKeys(std::chrono::seconds rotation_interval, size_t max_keys);
+
+    // How long a ticket can be used for.
+    std::chrono::seconds lifetime() const { return rotation_interval_ * max_keys_; }
+
+    // Starts encrypting new tickets with a new key, and drops the oldest key if there are more
+    // than |max_keys|.
+    void Rotate();
+
+    // Implements SSL_CTX_set_tlsext_ticket_key_cb.
+    int Callback(uint8_t* key_name, uint8_t* iv, EVP_CIPHER_CTX* cipher_ctx, HMAC_CTX* hmac_ctx,
+                 int encrypt);
+
+  private:
+    static constexpr size_t kKeyNameSize = 16;
+    static constexpr size_t kKeySize = 16;
+
+    struct Key {
+        uint8_t name[kKeyNameSize];
+        uint8_t aes_key[kKeySize];
+        uint8_t hmac_key[kKeySize];
+        std::chrono::steady_clock::time_point created;
+    };
+
+    void RotateLocked(std::chrono::steady_clock::time_point now) REQUIRES(mutex_);
+
+    const std::chrono::seconds rotation_interval_;
+    const size_t max_keys_;
+
+    std::mutex mutex_;
+    // Newest first.
+    std::deque<Key> keys_ GUARDED_BY(mutex_);
+};
+
+}  // namespace tls
+}  // namespace adb
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 #include <string_view>
 #include <vector>
 
@@ -27,6 +28,8 @@
 #include <openssl/ssl.h>
 #include <openssl/x509.h>
 
+#include "adb/tls/session_ticket_keys.h"
+
 namespace adb {
 namespace tls {
 
@@ -51,6 +54,7 @@ class TlsConnection {
 
     using CertVerifyCb = std::function<int(X509_STORE_CTX*)>;
     using SetCertCb = std::function<int(SSL*)>;
+    using NewSessionCb = std::function<void(bssl::UniquePtr<SSL_SESSION>)>;
 
     virtual ~TlsConnection() = default;
 
@@ -92,6 +96,29 @@ class TlsConnection {
     // default.
     virtual void EnableClientPostHandshakeCheck(bool enable) = 0;
 
+    // Client only. Offers to resume |session|, from an earlier connection to the
+    // same server, in the next handshake. If the server doesn't accept it, the
+    // handshake falls back to the full certificate exchange.
+    virtual void SetSession(SSL_SESSION* session) = 0;
+
+    // Client only. |cb| is called with every session that the server issues a
+    // ticket for, which can be passed to SetSession() on a later connection.
+    // TLS 1.3 tickets arrive after the handshake, so this is usually called
+    // from ReadFully().
+    virtual void SetNewSessionCallback(NewSessionCb cb) = 0;
+
+    // Server only. Issues session tickets encrypted with |keys|, and accepts
+    // tickets from earlier connections that used the same keys. Without keys,
+    // no tickets are issued.
+    //
+    // A resumed session skips the certificate exchange, so the certificate the
+    // client presented when the session was established is checked again, with
+    // the certificate verify callback if there is one.
+    virtual void SetSessionTicketKeys(std::shared_ptr<SessionTicketKeys> keys) = 0;
+
+    // Returns true if the handshake resumed an earlier session.
+    virtual bool SessionReused() = 0;
+
     // Starts the handshake process. Returns TlsError::Success if handshake
     // succeeded.
     virtual TlsError DoHandshake() = 0;
@@ -109,6 +136,31 @@ class TlsConnection {
     // Returns false otherwise.
     virtual bool WriteFully(std::string_view data) = 0;
 
+    // Writes the concatenation of |data|. Every WriteFully() call produces at
+    // least one TLS record, with its own header and authentication tag, so
+    // this gathers small pieces into full records before encrypting them.
+    // Returns false if not everything could be written.
+    virtual bool WritevFully(const std::vector<std::string_view>& data) = 0;
+
+    // Hands the traffic keys to the kernel (Linux kTLS), so that the socket
+    // encrypts what is written to it and decrypts what is read from it, and
+    // can be used with plain reads and writes. Must be called after a
+    // successful handshake, before anything is read or written. Returns
+    // false, leaving the connection as it was, if the kernel or the
+    // negotiated cipher suite doesn't support it.
+    //
+    // Reads are only offloaded if nothing but application data is expected
+    // from the peer: a client that waits for session tickets, or that peeked
+    // after the handshake, keeps reading through BoringSSL. Reading anything
+    // else from an offloaded socket fails with EIO.
+    //
+    // ReadFully(), WriteFully() and WritevFully() keep working either way.
+    virtual bool EnableKernelOffload() = 0;
+
+    // Whether writes and reads can bypass this object and go to the socket.
+    virtual bool IsWriteOffloaded() = 0;
+    virtual bool IsReadOffloaded() = 0;
+
     // Create a new TlsConnection instance. |cert| and |priv_key| cannot be
     // empty.
     static std::unique_ptr<TlsConnection> Create(Role role, std::string_view cert,
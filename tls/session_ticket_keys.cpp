@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "adb/tls/session_ticket_keys.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+#include <openssl/rand.h>
+
+namespace adb {
+namespace tls {
+
+SessionTicketKeys::SessionTicketKeys(std::chrono::seconds rotation_interval, size_t max_keys)
+    : rotation_interval_(rotation_interval), max_keys_(max_keys) {
+    CHECK_GT(max_keys_, 0U);
+}
+
+void SessionTicketKeys::Rotate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    RotateLocked(std::chrono::steady_clock::now());
+}
+
+void SessionTicketKeys::RotateLocked(std::chrono::steady_clock::time_point now) {
+    Key key;
+    CHECK(RAND_bytes(key.name, sizeof(key.name)));
+    CHECK(RAND_bytes(key.aes_key, sizeof(key.aes_key)));
+    CHECK(RAND_bytes(key.hmac_key, sizeof(key.hmac_key)));
+    key.created = now;
+    keys_.push_front(key);
+    while (keys_.size() > max_keys_) {
+        keys_.pop_back();
+    }
+}
+
+int SessionTicketKeys::Callback(uint8_t* key_name, uint8_t* iv, EVP_CIPHER_CTX* cipher_ctx,
+                                HMAC_CTX* hmac_ctx, int encrypt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+
+    // Rotate lazily, and forget keys that are too old even if we didn't rotate for a while.
+    while (!keys_.empty() && now - keys_.back().created >= lifetime()) {
+        keys_.pop_back();
+    }
+    if (keys_.empty() || now - keys_.front().created >= rotation_interval_) {
+        RotateLocked(now);
+    }
+
+    if (encrypt) {
+        const Key& key = keys_.front();
+        memcpy(key_name, key.name, sizeof(key.name));
+        if (!RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) ||
+            !EVP_EncryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), nullptr, key.aes_key, iv) ||
+            !HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), nullptr)) {
+            return -1;
+        }
+        return 1;
+    }
+
+    auto it = std::find_if(keys_.begin(), keys_.end(), [key_name](const Key& key) {
+        return memcmp(key.name, key_name, sizeof(key.name)) == 0;
+    });
+    if (it == keys_.end()) {
+        // Unknown or expired key: fall back to a full handshake.
+        return 0;
+    }
+    if (!EVP_DecryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), nullptr, it->aes_key, iv) ||
+        !HMAC_Init_ex(hmac_ctx, it->hmac_key, sizeof(it->hmac_key), EVP_sha256(), nullptr)) {
+        return -1;
+    }
+    // Ask for the ticket to be renewed if it was encrypted with an older key.
+    return it == keys_.begin() ? 1 : 2;
+}
+
+}  // namespace tls
+}  // namespace adb
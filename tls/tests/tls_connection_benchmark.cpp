@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AdbWifiTlsConnectionBenchmark"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <adb/crypto/key.h>
+#include <adb/crypto/rsa_2048_key.h>
+#include <adb/crypto/x509_generator.h>
+#include <adb/tls/session_ticket_keys.h>
+#include <adb/tls/tls_connection.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <openssl/ssl.h>
+
+using android::base::unique_fd;
+using namespace adb::crypto;
+using namespace adb::tls;
+
+struct Identity {
+    std::string cert;
+    std::string priv_key;
+};
+
+static Identity CreateIdentity() {
+    auto key = CreateRSA2048Key();
+    CHECK(key);
+    auto x509 = GenerateX509Certificate(key->GetEvpPkey());
+    CHECK(x509);
+    return {X509ToPEMString(x509.get()), Key::ToPEMString(key->GetEvpPkey())};
+}
+
+struct Connection {
+    unique_fd server_fd;
+    unique_fd client_fd;
+    std::unique_ptr<TlsConnection> server;
+    std::unique_ptr<TlsConnection> client;
+    bssl::UniquePtr<SSL_SESSION> new_session;
+};
+
+// A TCP connection over loopback, for what only works with TCP.
+static void TcpSocketpair(unique_fd* server, unique_fd* client) {
+    unique_fd listener(socket(AF_INET, SOCK_STREAM, 0));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    CHECK_EQ(0, bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    CHECK_EQ(0, listen(listener.get(), 1));
+    CHECK_EQ(0, getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len));
+    client->reset(socket(AF_INET, SOCK_STREAM, 0));
+    CHECK_EQ(0, connect(client->get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    server->reset(accept(listener.get(), nullptr, nullptr));
+    CHECK_GE(server->get(), 0);
+}
+
+// Connects a client to a server, offering |session| if it's set. Session tickets arrive after
+// the handshake, so the server sends a byte for the client to pick them up with.
+static std::unique_ptr<Connection> Connect(const Identity& server_id, const Identity& client_id,
+                                           std::shared_ptr<SessionTicketKeys> keys,
+                                           SSL_SESSION* session, bool tcp) {
+    auto c = std::make_unique<Connection>();
+    if (tcp) {
+        TcpSocketpair(&c->server_fd, &c->client_fd);
+    } else {
+        CHECK(android::base::Socketpair(SOCK_STREAM, &c->server_fd, &c->client_fd));
+    }
+    c->server = TlsConnection::Create(TlsConnection::Role::Server, server_id.cert,
+                                      server_id.priv_key, c->server_fd);
+    c->client = TlsConnection::Create(TlsConnection::Role::Client, client_id.cert,
+                                      client_id.priv_key, c->client_fd);
+    c->server->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    c->client->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    if (keys) {
+        c->server->SetSessionTicketKeys(std::move(keys));
+        c->client->SetSession(session);
+        c->client->SetNewSessionCallback([c = c.get()](bssl::UniquePtr<SSL_SESSION> s) {
+            c->new_session = std::move(s);
+        });
+    }
+
+    std::thread client_thread([&]() {
+        CHECK_EQ(c->client->DoHandshake(), TlsConnection::TlsError::Success);
+        uint8_t byte;
+        CHECK(c->client->ReadFully(&byte, 1));
+    });
+    CHECK_EQ(c->server->DoHandshake(), TlsConnection::TlsError::Success);
+    CHECK(c->server->WriteFully("x"));
+    client_thread.join();
+    CHECK_EQ(session != nullptr, c->server->SessionReused());
+    return c;
+}
+
+// A reconnection with the full certificate exchange, which is what adb did before it kept
+// sessions around.
+static void BM_TlsHandshake_Full(benchmark::State& state) {
+    Identity server_id = CreateIdentity();
+    Identity client_id = CreateIdentity();
+    auto keys = std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 8);
+    for (auto _ : state) {
+        Connect(server_id, client_id, keys, nullptr, false);
+    }
+}
+
+static void BM_TlsHandshake_Resumed(benchmark::State& state) {
+    Identity server_id = CreateIdentity();
+    Identity client_id = CreateIdentity();
+    auto keys = std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 8);
+    bssl::UniquePtr<SSL_SESSION> session =
+            std::move(Connect(server_id, client_id, keys, nullptr, false)->new_session);
+    for (auto _ : state) {
+        session = std::move(Connect(server_id, client_id, keys, session.get(), false)->new_session);
+    }
+}
+
+enum class Crypto {
+    BoringSSL,
+    Kernel,
+};
+
+// Sends state.range(0) bytes at a time from the server to the client, the way adbd sends
+// payloads, with the encryption in userspace or in the kernel.
+template <Crypto crypto>
+static void BM_TlsThroughput(benchmark::State& state) {
+    Identity server_id = CreateIdentity();
+    Identity client_id = CreateIdentity();
+    auto c = Connect(server_id, client_id, nullptr, nullptr, true);
+    if (crypto == Crypto::Kernel &&
+        (!c->server->EnableKernelOffload() || !c->client->EnableKernelOffload())) {
+        state.SkipWithError("kTLS unavailable");
+        return;
+    }
+
+    const size_t size = state.range(0);
+    std::string buf(size, 'a');
+    std::thread reader([&]() {
+        std::vector<uint8_t> in(size);
+        for (size_t i = 0; i < state.max_iterations; ++i) {
+            CHECK(c->client->ReadFully(in.data(), in.size()));
+        }
+    });
+    for (auto _ : state) {
+        CHECK(c->server->WriteFully(buf));
+    }
+    reader.join();
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+enum class Records {
+    // A record for every header and payload, which is what FdConnection used to do.
+    PerWrite,
+    Coalesced,
+};
+
+// Sends bursts of 32 packets of a 24 byte header and a state.range(0) byte payload. CPU time only
+// counts the sending thread, so bytes_per_second is the inverse of the encryption CPU per byte.
+template <Records records>
+static void BM_TlsPackets(benchmark::State& state) {
+    static constexpr size_t kBurstSize = 32;
+    Identity server_id = CreateIdentity();
+    Identity client_id = CreateIdentity();
+    auto c = Connect(server_id, client_id, nullptr, nullptr, false);
+
+    std::string header(24, 'h');
+    std::string payload(state.range(0), 'p');
+    std::vector<std::string_view> pieces;
+    for (size_t i = 0; i < kBurstSize; ++i) {
+        pieces.push_back(header);
+        pieces.push_back(payload);
+    }
+    const size_t burst_bytes = kBurstSize * (header.size() + payload.size());
+
+    std::thread reader([&]() {
+        std::vector<uint8_t> in(burst_bytes);
+        for (size_t i = 0; i < state.max_iterations; ++i) {
+            CHECK(c->client->ReadFully(in.data(), in.size()));
+        }
+    });
+    for (auto _ : state) {
+        if (records == Records::Coalesced) {
+            CHECK(c->server->WritevFully(pieces));
+        } else {
+            for (std::string_view piece : pieces) {
+                CHECK(c->server->WriteFully(piece));
+            }
+        }
+    }
+    reader.join();
+    state.SetItemsProcessed(state.iterations() * kBurstSize);
+    state.SetBytesProcessed(state.iterations() * burst_bytes);
+}
+
+BENCHMARK(BM_TlsHandshake_Full)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TlsHandshake_Resumed)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_TlsPackets, Records::PerWrite)->Arg(1)->Arg(4096)->Arg(64 * 1024);
+BENCHMARK_TEMPLATE(BM_TlsPackets, Records::Coalesced)->Arg(1)->Arg(4096)->Arg(64 * 1024);
+BENCHMARK_TEMPLATE(BM_TlsThroughput, Crypto::BoringSSL)->Range(4096, 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_TlsThroughput, Crypto::Kernel)->Range(4096, 1024 * 1024);
+
+int main(int argc, char** argv) {
+    android::base::SetMinimumLogSeverity(android::base::WARNING);
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    ::benchmark::RunSpecifiedBenchmarks();
+}
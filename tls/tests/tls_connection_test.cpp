@@ -16,6 +16,11 @@
 
 #define LOG_TAG "AdbWifiTlsConnectionTest"
 
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <memory>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -23,7 +28,9 @@
 #include <adb/crypto/rsa_2048_key.h>
 #include <adb/crypto/x509_generator.h>
 #include <adb/tls/adb_ca_list.h>
+#include <adb/tls/session_ticket_keys.h>
 #include <adb/tls/tls_connection.h>
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
@@ -251,12 +258,86 @@ class AdbWifiTlsConnectionTest : public testing::Test {
         }
     }
 
+    // Replaces the connections with new ones over a new socket pair, as if the
+    // client reconnected.
+    void Reconnect() {
+        WaitForClientConnection();
+        server_.reset();
+        client_.reset();
+        SetUp();
+    }
+
+    // Replaces the socket pair with a TCP connection over loopback, which kTLS
+    // needs.
+    void UseTcp() {
+        unique_fd listener(socket(AF_INET, SOCK_STREAM, 0));
+        ASSERT_GE(listener.get(), 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        ASSERT_EQ(0, bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+        ASSERT_EQ(0, listen(listener.get(), 1));
+        ASSERT_EQ(0, getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len));
+
+        client_fd_.reset(socket(AF_INET, SOCK_STREAM, 0));
+        ASSERT_EQ(0, connect(client_fd_.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+        server_fd_.reset(accept(listener.get(), nullptr, nullptr));
+        ASSERT_GE(server_fd_.get(), 0);
+
+        server_ = TlsConnection::Create(TlsConnection::Role::Server, kTestRsa2048ServerCert,
+                                        kTestRsa2048ServerPrivKey, server_fd_);
+        client_ = TlsConnection::Create(TlsConnection::Role::Client, kTestRsa2048ClientCert,
+                                        kTestRsa2048ClientPrivKey, client_fd_);
+        ASSERT_NE(nullptr, server_);
+        ASSERT_NE(nullptr, client_);
+    }
+
+    // Sends a message each way.
+    void Exchange() {
+        client_thread_ = std::thread([&]() {
+            EXPECT_TRUE(client_->WriteFully(
+                    std::string_view(reinterpret_cast<const char*>(msg_.data()), msg_.size())));
+            auto data = client_->ReadFully(msg_.size());
+            EXPECT_EQ(data, msg_);
+        });
+        auto data = server_->ReadFully(msg_.size());
+        EXPECT_EQ(data, msg_);
+        EXPECT_TRUE(server_->WriteFully(
+                std::string_view(reinterpret_cast<const char*>(msg_.data()), msg_.size())));
+        WaitForClientConnection();
+    }
+
+    // Sets up the client to offer |session| and to save the sessions it is
+    // issued in |last_session_|, and the server to issue tickets with |keys|.
+    void EnableResumption(SSL_SESSION* session, std::shared_ptr<SessionTicketKeys> keys) {
+        client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+        client_->SetSession(session);
+        client_->SetNewSessionCallback([this](bssl::UniquePtr<SSL_SESSION> session) {
+            last_session_ = std::move(session);
+        });
+        server_->SetSessionTicketKeys(std::move(keys));
+    }
+
+    // Sends a message from the server to the client. TLS 1.3 session tickets
+    // are sent after the handshake, so the client only gets them once it reads.
+    void ServerToClient() {
+        client_thread_ = std::thread([&]() {
+            auto data = client_->ReadFully(msg_.size());
+            EXPECT_EQ(data, msg_);
+        });
+        EXPECT_TRUE(server_->WriteFully(
+                std::string_view(reinterpret_cast<const char*>(msg_.data()), msg_.size())));
+        WaitForClientConnection();
+    }
+
     unique_fd server_fd_;
     unique_fd client_fd_;
     const std::vector<uint8_t> msg_{0xff, 0xab, 0x32, 0xf6, 0x12, 0x56};
     std::unique_ptr<TlsConnection> server_;
     std::unique_ptr<TlsConnection> client_;
     std::thread client_thread_;
+    bssl::UniquePtr<SSL_SESSION> last_session_;
 };
 
 TEST_F(AdbWifiTlsConnectionTest, InvalidCreationParams) {
@@ -604,5 +685,281 @@ TEST_F(AdbWifiTlsConnectionTest, SetClientCAList_AdbCAList) {
     ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
     client_thread_.join();
 }
+TEST_F(AdbWifiTlsConnectionTest, SessionResumption) {
+    auto keys = std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2);
+    int verify_count = 0;
+
+    EnableResumption(nullptr, keys);
+    server_->SetCertVerifyCallback([&](X509_STORE_CTX*) {
+        ++verify_count;
+        return 1;
+    });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    EXPECT_FALSE(server_->SessionReused());
+    EXPECT_FALSE(client_->SessionReused());
+    EXPECT_EQ(verify_count, 1);
+    ServerToClient();
+    ASSERT_NE(nullptr, last_session_);
+
+    Reconnect();
+    bssl::UniquePtr<SSL_SESSION> session = std::move(last_session_);
+    EnableResumption(session.get(), keys);
+    server_->SetCertVerifyCallback([&](X509_STORE_CTX*) {
+        ++verify_count;
+        return 1;
+    });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    EXPECT_TRUE(server_->SessionReused());
+    EXPECT_TRUE(client_->SessionReused());
+    // The client's certificate is checked again, even though it wasn't sent.
+    EXPECT_EQ(verify_count, 2);
+    // The resumed connection works, and issues a new session.
+    ServerToClient();
+    ASSERT_NE(nullptr, last_session_);
+}
+
+TEST_F(AdbWifiTlsConnectionTest, SessionResumption_CertificateRevoked) {
+    auto keys = std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2);
+    EnableResumption(nullptr, keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    ServerToClient();
+    ASSERT_NE(nullptr, last_session_);
+
+    // The server no longer accepts the client's certificate, e.g. because the
+    // user revoked the key.
+    Reconnect();
+    bssl::UniquePtr<SSL_SESSION> session = std::move(last_session_);
+    EnableResumption(session.get(), keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 0; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::CertificateRejected);
+    WaitForClientConnection();
+}
+
+TEST_F(AdbWifiTlsConnectionTest, SessionResumption_UnknownKeys) {
+    EnableResumption(nullptr, std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2));
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    ServerToClient();
+    ASSERT_NE(nullptr, last_session_);
+
+    // A server with different keys, e.g. after adbd restarted, can't decrypt
+    // the ticket and falls back to a full handshake.
+    Reconnect();
+    bssl::UniquePtr<SSL_SESSION> session = std::move(last_session_);
+    EnableResumption(session.get(),
+                     std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2));
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    EXPECT_FALSE(server_->SessionReused());
+    EXPECT_FALSE(client_->SessionReused());
+}
+
+TEST_F(AdbWifiTlsConnectionTest, SessionResumption_KeyRotation) {
+    auto keys = std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2);
+    EnableResumption(nullptr, keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    ServerToClient();
+    ASSERT_NE(nullptr, last_session_);
+    bssl::UniquePtr<SSL_SESSION> old_session = std::move(last_session_);
+
+    // Tickets encrypted with the previous key are still accepted.
+    keys->Rotate();
+    Reconnect();
+    EnableResumption(old_session.get(), keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    EXPECT_TRUE(server_->SessionReused());
+
+    // But not once the key was rotated out.
+    keys->Rotate();
+    Reconnect();
+    EnableResumption(old_session.get(), keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    EXPECT_FALSE(server_->SessionReused());
+}
+
+TEST_F(AdbWifiTlsConnectionTest, KernelOffload_Unsupported) {
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+
+    // kTLS only works on TCP sockets, so this falls back to BoringSSL.
+    EXPECT_FALSE(server_->EnableKernelOffload());
+    EXPECT_FALSE(server_->IsWriteOffloaded());
+    EXPECT_FALSE(server_->IsReadOffloaded());
+    Exchange();
+}
+
+TEST_F(AdbWifiTlsConnectionTest, KernelOffload) {
+    ASSERT_NO_FATAL_FAILURE(UseTcp());
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+
+    if (!server_->EnableKernelOffload()) {
+        GTEST_SKIP() << "kTLS unavailable";
+    }
+    EXPECT_TRUE(server_->IsWriteOffloaded());
+    EXPECT_TRUE(server_->IsReadOffloaded());
+    // Both ends don't have to agree.
+    Exchange();
+
+    ASSERT_TRUE(client_->EnableKernelOffload());
+    EXPECT_TRUE(client_->IsWriteOffloaded());
+    EXPECT_TRUE(client_->IsReadOffloaded());
+    Exchange();
+
+    // The socket can be used directly.
+    client_thread_ = std::thread([&]() {
+        ASSERT_EQ(static_cast<ssize_t>(msg_.size()),
+                  write(client_fd_.get(), msg_.data(), msg_.size()));
+    });
+    auto data = server_->ReadFully(msg_.size());
+    EXPECT_EQ(data, msg_);
+    WaitForClientConnection();
+}
+
+TEST_F(AdbWifiTlsConnectionTest, KernelOffload_ClientExpectingTickets) {
+    ASSERT_NO_FATAL_FAILURE(UseTcp());
+    EnableResumption(nullptr, std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2));
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+
+    if (!client_->EnableKernelOffload()) {
+        GTEST_SKIP() << "kTLS unavailable";
+    }
+    // Session tickets can only be read through BoringSSL.
+    EXPECT_TRUE(client_->IsWriteOffloaded());
+    EXPECT_FALSE(client_->IsReadOffloaded());
+    Exchange();
+    EXPECT_NE(nullptr, last_session_);
+}
+
+TEST_F(AdbWifiTlsConnectionTest, KernelOffload_SessionTickets) {
+    auto keys = std::make_shared<SessionTicketKeys>(std::chrono::hours(1), 2);
+    ASSERT_NO_FATAL_FAILURE(UseTcp());
+    EnableResumption(nullptr, keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+
+    // The server issues its tickets through BoringSSL before the kernel takes
+    // over, so they have to be on the wire, and counted in the record sequence
+    // the kernel continues from, or the client can't decrypt what follows.
+    if (!server_->EnableKernelOffload()) {
+        GTEST_SKIP() << "kTLS unavailable";
+    }
+    EXPECT_TRUE(server_->IsWriteOffloaded());
+    Exchange();
+    Exchange();
+    ASSERT_NE(nullptr, last_session_);
+
+    // The ticket can be used to resume, and the resumed connection can be
+    // offloaded as well.
+    Reconnect();
+    ASSERT_NO_FATAL_FAILURE(UseTcp());
+    bssl::UniquePtr<SSL_SESSION> session = std::move(last_session_);
+    EnableResumption(session.get(), keys);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+    EXPECT_TRUE(server_->SessionReused());
+    EXPECT_TRUE(client_->SessionReused());
+
+    ASSERT_TRUE(server_->EnableKernelOffload());
+    Exchange();
+    EXPECT_NE(nullptr, last_session_);
+}
+
+TEST_F(AdbWifiTlsConnectionTest, WritevFully) {
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+
+    // Small pieces, empty pieces, and pieces spanning several records.
+    std::vector<std::string> pieces;
+    for (size_t size : {24, 0, 1, 24, 100000, 24, 16384, 16383, 24, 0}) {
+        pieces.emplace_back(size, static_cast<char>('a' + pieces.size()));
+    }
+    std::string expected = android::base::Join(pieces, "");
+
+    client_thread_ = std::thread([&]() {
+        auto data = client_->ReadFully(expected.size());
+        EXPECT_EQ(std::string(data.begin(), data.end()), expected);
+    });
+    EXPECT_TRUE(server_->WritevFully(std::vector<std::string_view>(pieces.begin(), pieces.end())));
+    WaitForClientConnection();
+}
+
+TEST_F(AdbWifiTlsConnectionTest, WritevFully_FullRecords) {
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    StartClientHandshakeAsync(TlsError::Success);
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    WaitForClientConnection();
+
+    // A header and a 1 byte payload for 1000 packets, and a large payload.
+    std::string header(24, 'h');
+    std::string small_payload(1, 'p');
+    std::string large_payload(64 * 1024 + 10, 'l');
+    std::vector<std::string_view> pieces;
+    size_t total = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        pieces.push_back(header);
+        pieces.push_back(small_payload);
+        total += header.size() + small_payload.size();
+    }
+    pieces.push_back(header);
+    pieces.push_back(large_payload);
+    total += header.size() + large_payload.size();
+    ASSERT_TRUE(server_->WritevFully(pieces));
+
+    // Count the records on the wire. Every TLS 1.3 record has a 5 byte header,
+    // and adds the 1 byte content type and a 16 byte tag to its plaintext.
+    size_t plaintext = 0;
+    size_t records = 0;
+    while (plaintext < total) {
+        uint8_t record_header[5];
+        ASSERT_TRUE(android::base::ReadFully(client_fd_, record_header, sizeof(record_header)));
+        size_t length = (record_header[3] << 8) | record_header[4];
+        std::vector<uint8_t> body(length);
+        ASSERT_TRUE(android::base::ReadFully(client_fd_, body.data(), body.size()));
+        plaintext += length - 17;
+        ++records;
+    }
+    EXPECT_EQ(total, plaintext);
+    EXPECT_EQ((total + SSL3_RT_MAX_PLAIN_LENGTH - 1) / SSL3_RT_MAX_PLAIN_LENGTH, records);
+}
+
 }  // namespace tls
 }  // namespace adb
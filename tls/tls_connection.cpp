@@ -17,13 +17,26 @@
 #include "adb/tls/tls_connection.h"
 
 #include <limits.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #include <algorithm>
+#include <string>
 #include <vector>
 
 #include <android-base/logging.h>
+#include <android-base/macros.h>
 #include <android-base/strings.h>
 #include <openssl/err.h>
+#include <openssl/hkdf.h>
+#include <openssl/mem.h>
 #include <openssl/ssl.h>
 
 using android::base::borrowed_fd;
@@ -34,6 +47,84 @@ namespace tls {
 namespace {
 
 static constexpr char kExportedKeyLabel[] = "adb-label";
+static constexpr char kSessionIdContext[] = "adb";
+
+#if defined(__linux__)
+// Missing from older UAPI headers.
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+// The key and IV for one direction of a connection, as setsockopt(SOL_TLS) takes them.
+union KernelCryptoInfo {
+    tls_crypto_info info;
+    tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+    tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+    tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+#endif
+};
+
+// HKDF-Expand-Label from RFC 8446, section 7.1, with an empty context.
+static bool ExpandLabel(uint8_t* out, size_t out_len, const EVP_MD* digest,
+                        bssl::Span<const uint8_t> secret, std::string_view label) {
+    std::string tls_label = "tls13 " + std::string(label);
+    std::vector<uint8_t> info = {static_cast<uint8_t>(out_len >> 8),
+                                 static_cast<uint8_t>(out_len),
+                                 static_cast<uint8_t>(tls_label.size())};
+    info.insert(info.end(), tls_label.begin(), tls_label.end());
+    info.push_back(0);
+    return HKDF_expand(out, out_len, digest, secret.data(), secret.size(), info.data(),
+                       info.size());
+}
+
+// Derives the traffic key and IV from |secret|, the traffic secret for one direction, and
+// fills in |info| with them and the sequence number of the next record.
+template <typename T>
+static socklen_t FillCryptoInfo(T* info, uint16_t cipher_type, const EVP_MD* digest,
+                                bssl::Span<const uint8_t> secret, uint64_t seq) {
+    uint8_t iv[sizeof(info->salt) + sizeof(info->iv)];
+    if (!ExpandLabel(info->key, sizeof(info->key), digest, secret, "key") ||
+        !ExpandLabel(iv, sizeof(iv), digest, secret, "iv")) {
+        return 0;
+    }
+    info->info.version = TLS_1_3_VERSION;
+    info->info.cipher_type = cipher_type;
+    // The kernel takes the IV split into the salt and the rest.
+    memcpy(info->salt, iv, sizeof(info->salt));
+    memcpy(info->iv, iv + sizeof(info->salt), sizeof(info->iv));
+    for (size_t i = 0; i < sizeof(info->rec_seq); ++i) {
+        info->rec_seq[i] = seq >> (8 * (sizeof(info->rec_seq) - 1 - i));
+    }
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return sizeof(*info);
+}
+
+// Returns the size of the filled in |info|, or 0 if the kernel doesn't support the negotiated
+// cipher suite.
+static socklen_t GetKernelCryptoInfo(const SSL* ssl, bssl::Span<const uint8_t> secret,
+                                     uint64_t seq, KernelCryptoInfo* info) {
+    memset(info, 0, sizeof(*info));
+    switch (SSL_CIPHER_get_protocol_id(SSL_get_current_cipher(ssl))) {
+        case 0x1301:  // TLS_AES_128_GCM_SHA256
+            return FillCryptoInfo(&info->aes_gcm_128, TLS_CIPHER_AES_GCM_128, EVP_sha256(), secret,
+                                  seq);
+        case 0x1302:  // TLS_AES_256_GCM_SHA384
+            return FillCryptoInfo(&info->aes_gcm_256, TLS_CIPHER_AES_GCM_256, EVP_sha384(), secret,
+                                  seq);
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        case 0x1303:  // TLS_CHACHA20_POLY1305_SHA256
+            return FillCryptoInfo(&info->chacha20_poly1305, TLS_CIPHER_CHACHA20_POLY1305,
+                                  EVP_sha256(), secret, seq);
+#endif
+        default:
+            return 0;
+    }
+}
+#endif  // defined(__linux__)
 
 class TlsConnectionImpl : public TlsConnection {
   public:
@@ -47,10 +138,18 @@ class TlsConnectionImpl : public TlsConnection {
     void SetClientCAList(STACK_OF(X509_NAME) * ca_list) override;
     std::vector<uint8_t> ExportKeyingMaterial(size_t length) override;
     void EnableClientPostHandshakeCheck(bool enable) override;
+    void SetSession(SSL_SESSION* session) override;
+    void SetNewSessionCallback(NewSessionCb cb) override;
+    void SetSessionTicketKeys(std::shared_ptr<SessionTicketKeys> keys) override;
+    bool SessionReused() override;
     TlsError DoHandshake() override;
     std::vector<uint8_t> ReadFully(size_t size) override;
     bool ReadFully(void* buf, size_t size) override;
     bool WriteFully(std::string_view data) override;
+    bool WritevFully(const std::vector<std::string_view>& data) override;
+    bool EnableKernelOffload() override;
+    bool IsWriteOffloaded() override { return write_offloaded_; }
+    bool IsReadOffloaded() override { return read_offloaded_; }
 
     static bssl::UniquePtr<EVP_PKEY> EvpPkeyFromPEM(std::string_view pem);
     static bssl::UniquePtr<CRYPTO_BUFFER> BufferFromPEM(std::string_view pem);
@@ -58,10 +157,18 @@ class TlsConnectionImpl : public TlsConnection {
   private:
     static int SSLSetCertVerifyCb(X509_STORE_CTX* ctx, void* opaque);
     static int SSLSetCertCb(SSL* ssl, void* opaque);
+    static int SSLNewSessionCb(SSL* ssl, SSL_SESSION* session);
+    static int SSLTicketKeyCb(SSL* ssl, uint8_t* key_name, uint8_t* iv, EVP_CIPHER_CTX* cipher_ctx,
+                              HMAC_CTX* hmac_ctx, int encrypt);
+    static TlsConnectionImpl* FromSSL(SSL* ssl);
 
     static bssl::UniquePtr<X509> X509FromBuffer(bssl::UniquePtr<CRYPTO_BUFFER> buffer);
     static const char* SSLErrorString();
     void Invalidate();
+    bool VerifyResumedPeer();
+    bool KernelReadFully(void* buf, size_t size);
+    bool KernelWriteFully(std::string_view data);
+    bool KernelWritevFully(const std::vector<std::string_view>& data);
     TlsError GetFailureReason(int err);
     const char* RoleToString() { return role_ == Role::Server ? kServerRoleStr : kClientRoleStr; }
 
@@ -74,9 +181,16 @@ class TlsConnectionImpl : public TlsConnection {
     bssl::UniquePtr<SSL> ssl_;
     std::vector<bssl::UniquePtr<X509>> known_certificates_;
     bool client_verify_post_handshake_ = false;
+    bool write_offloaded_ = false;
+    bool read_offloaded_ = false;
+    // Where WritevFully() gathers records.
+    std::string write_buffer_;
+    bssl::UniquePtr<SSL_SESSION> session_;
+    std::shared_ptr<SessionTicketKeys> ticket_keys_;
 
     CertVerifyCb cert_verify_cb_;
     SetCertCb set_cert_cb_;
+    NewSessionCb new_session_cb_;
     borrowed_fd fd_;
     static constexpr char kClientRoleStr[] = "[client]: ";
     static constexpr char kServerRoleStr[] = "[server]: ";
@@ -94,8 +208,9 @@ TlsConnectionImpl::TlsConnectionImpl(Role role, std::string_view cert, std::stri
 }
 
 TlsConnectionImpl::~TlsConnectionImpl() {
-    // shutdown the SSL connection
-    if (ssl_ != nullptr) {
+    // shutdown the SSL connection. Once writes are offloaded, BoringSSL can't
+    // write the close_notify anymore, and the peer just sees the socket close.
+    if (ssl_ != nullptr && !write_offloaded_) {
         SSL_shutdown(ssl_.get());
     }
 }
@@ -152,6 +267,25 @@ int TlsConnectionImpl::SSLSetCertCb(SSL* ssl, void* opaque) {
     return p->set_cert_cb_(ssl);
 }
 
+// static
+TlsConnectionImpl* TlsConnectionImpl::FromSSL(SSL* ssl) {
+    return reinterpret_cast<TlsConnectionImpl*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+}
+
+// static
+int TlsConnectionImpl::SSLNewSessionCb(SSL* ssl, SSL_SESSION* session) {
+    // Returning 1 takes ownership of the session.
+    FromSSL(ssl)->new_session_cb_(bssl::UniquePtr<SSL_SESSION>(session));
+    return 1;
+}
+
+// static
+int TlsConnectionImpl::SSLTicketKeyCb(SSL* ssl, uint8_t* key_name, uint8_t* iv,
+                                      EVP_CIPHER_CTX* cipher_ctx, HMAC_CTX* hmac_ctx,
+                                      int encrypt) {
+    return FromSSL(ssl)->ticket_keys_->Callback(key_name, iv, cipher_ctx, hmac_ctx, encrypt);
+}
+
 bool TlsConnectionImpl::AddTrustedCertificate(std::string_view cert) {
     // Create X509 buffer from the certificate string
     auto buf = X509FromBuffer(BufferFromPEM(cert));
@@ -193,6 +327,49 @@ void TlsConnectionImpl::EnableClientPostHandshakeCheck(bool enable) {
     client_verify_post_handshake_ = enable;
 }
 
+void TlsConnectionImpl::SetSession(SSL_SESSION* session) {
+    CHECK(role_ == Role::Client);
+    if (session != nullptr) {
+        SSL_SESSION_up_ref(session);
+    }
+    session_.reset(session);
+}
+
+void TlsConnectionImpl::SetNewSessionCallback(NewSessionCb cb) {
+    CHECK(role_ == Role::Client);
+    new_session_cb_ = cb;
+}
+
+void TlsConnectionImpl::SetSessionTicketKeys(std::shared_ptr<SessionTicketKeys> keys) {
+    CHECK(role_ == Role::Server);
+    ticket_keys_ = std::move(keys);
+}
+
+bool TlsConnectionImpl::SessionReused() {
+    return ssl_ != nullptr && SSL_session_reused(ssl_.get());
+}
+
+bool TlsConnectionImpl::VerifyResumedPeer() {
+    bssl::UniquePtr<X509> cert(SSL_get_peer_certificate(ssl_.get()));
+    if (cert == nullptr) {
+        LOG(ERROR) << RoleToString() << "Resumed session has no peer certificate";
+        return false;
+    }
+
+    bssl::UniquePtr<X509_STORE_CTX> store_ctx(X509_STORE_CTX_new());
+    if (store_ctx == nullptr ||
+        !X509_STORE_CTX_init(store_ctx.get(), SSL_CTX_get_cert_store(ssl_ctx_.get()), cert.get(),
+                             nullptr)) {
+        LOG(ERROR) << RoleToString() << "Unable to create X509_STORE_CTX";
+        return false;
+    }
+
+    if (cert_verify_cb_) {
+        return cert_verify_cb_(store_ctx.get()) == 1;
+    }
+    return X509_verify_cert(store_ctx.get()) == 1;
+}
+
 TlsConnection::TlsError TlsConnectionImpl::GetFailureReason(int err) {
     switch (ERR_GET_REASON(err)) {
         case SSL_R_SSLV3_ALERT_BAD_CERTIFICATE:
@@ -263,12 +440,38 @@ TlsConnection::TlsError TlsConnectionImpl::DoHandshake() {
 
     SSL_CTX_set_verify(ssl_ctx_.get(), SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, nullptr);
 
+    // Session resumption.
+    SSL_CTX_set_app_data(ssl_ctx_.get(), this);
+    if (role_ == Role::Server) {
+        SSL_CTX_set_session_id_context(ssl_ctx_.get(),
+                                       reinterpret_cast<const uint8_t*>(kSessionIdContext),
+                                       sizeof(kSessionIdContext) - 1);
+        if (ticket_keys_) {
+            uint32_t lifetime = ticket_keys_->lifetime().count();
+            SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx_.get(), SSLTicketKeyCb);
+            SSL_CTX_set_timeout(ssl_ctx_.get(), lifetime);
+            SSL_CTX_set_session_psk_dhe_timeout(ssl_ctx_.get(), lifetime);
+        } else {
+            // The SSL_CTX would encrypt tickets with a key of its own, which no
+            // later connection could decrypt.
+            SSL_CTX_set_options(ssl_ctx_.get(), SSL_OP_NO_TICKET);
+        }
+    } else if (new_session_cb_) {
+        SSL_CTX_set_session_cache_mode(ssl_ctx_.get(),
+                                       SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ssl_ctx_.get(), SSLNewSessionCb);
+    }
+
     // Okay! Let's try to do the handshake!
     ssl_.reset(SSL_new(ssl_ctx_.get()));
     if (!SSL_set_fd(ssl_.get(), fd_.get())) {
         LOG(ERROR) << RoleToString() << "SSL_set_fd failed. [" << SSLErrorString() << "]";
         return TlsError::UnknownFailure;
     }
+    if (role_ == Role::Client && session_ && !SSL_set_session(ssl_.get(), session_.get())) {
+        LOG(WARNING) << RoleToString() << "Unable to offer session for resumption ["
+                     << SSLErrorString() << "]";
+    }
 
     switch (role_) {
         case Role::Server:
@@ -286,6 +489,12 @@ TlsConnection::TlsError TlsConnectionImpl::DoHandshake() {
         return GetFailureReason(sslerr);
     }
 
+    if (role_ == Role::Server && SSL_session_reused(ssl_.get()) && !VerifyResumedPeer()) {
+        LOG(ERROR) << RoleToString() << "Rejected the certificate of a resumed session";
+        Invalidate();
+        return TlsError::CertificateRejected;
+    }
+
     if (client_verify_post_handshake_ && role_ == Role::Client) {
         uint8_t check;
         // Try to peek one byte for any failures. This assumes on success that
@@ -299,7 +508,8 @@ TlsConnection::TlsError TlsConnectionImpl::DoHandshake() {
         }
     }
 
-    LOG(INFO) << RoleToString() << "Handshake succeeded.";
+    LOG(INFO) << RoleToString() << "Handshake succeeded"
+              << (SSL_session_reused(ssl_.get()) ? " (resumed)." : ".");
     return TlsError::Success;
 }
 
@@ -319,6 +529,9 @@ std::vector<uint8_t> TlsConnectionImpl::ReadFully(size_t size) {
 
 bool TlsConnectionImpl::ReadFully(void* buf, size_t size) {
     CHECK_GT(size, 0U);
+    if (read_offloaded_) {
+        return KernelReadFully(buf, size);
+    }
     if (!ssl_) {
         LOG(ERROR) << RoleToString() << "Tried to read on a null SSL connection";
         return false;
@@ -345,6 +558,9 @@ bool TlsConnectionImpl::WriteFully(std::string_view data) {
         LOG(ERROR) << RoleToString() << "Tried to read on a null SSL connection";
         return false;
     }
+    if (write_offloaded_) {
+        return KernelWriteFully(data);
+    }
 
     while (!data.empty()) {
         int bytes_out = SSL_write(ssl_.get(), data.data(),
@@ -357,6 +573,167 @@ bool TlsConnectionImpl::WriteFully(std::string_view data) {
     }
     return true;
 }
+
+bool TlsConnectionImpl::WritevFully(const std::vector<std::string_view>& data) {
+    if (!ssl_) {
+        LOG(ERROR) << RoleToString() << "Tried to write on a null SSL connection";
+        return false;
+    }
+    if (write_offloaded_) {
+        return KernelWritevFully(data);
+    }
+
+    // SSL_write() makes records of up to SSL3_RT_MAX_PLAIN_LENGTH bytes. Copy
+    // pieces together until they fill a record, but pass as many full records'
+    // worth of a large piece as there are straight to SSL_write().
+    write_buffer_.clear();
+    for (std::string_view piece : data) {
+        if (!write_buffer_.empty()) {
+            size_t size = std::min(piece.size(), SSL3_RT_MAX_PLAIN_LENGTH - write_buffer_.size());
+            write_buffer_.append(piece.substr(0, size));
+            piece.remove_prefix(size);
+            if (write_buffer_.size() < SSL3_RT_MAX_PLAIN_LENGTH) {
+                continue;
+            }
+            if (!WriteFully(write_buffer_)) {
+                return false;
+            }
+            write_buffer_.clear();
+        }
+
+        size_t direct = piece.size() - piece.size() % SSL3_RT_MAX_PLAIN_LENGTH;
+        if (direct > 0 && !WriteFully(piece.substr(0, direct))) {
+            return false;
+        }
+        write_buffer_.append(piece.substr(direct));
+    }
+    return write_buffer_.empty() || WriteFully(write_buffer_);
+}
+
+bool TlsConnectionImpl::EnableKernelOffload() {
+#if defined(__linux__)
+    if (!ssl_ || SSL_version(ssl_.get()) != TLS1_3_VERSION) {
+        return false;
+    }
+
+    bssl::Span<const uint8_t> read_secret;
+    bssl::Span<const uint8_t> write_secret;
+    if (!bssl::SSL_get_traffic_secrets(ssl_.get(), &read_secret, &write_secret)) {
+        return false;
+    }
+    KernelCryptoInfo tx;
+    KernelCryptoInfo rx;
+    socklen_t tx_size =
+            GetKernelCryptoInfo(ssl_.get(), write_secret, SSL_get_write_sequence(ssl_.get()), &tx);
+    socklen_t rx_size =
+            GetKernelCryptoInfo(ssl_.get(), read_secret, SSL_get_read_sequence(ssl_.get()), &rx);
+    bool offloaded = false;
+    if (tx_size == 0 || rx_size == 0) {
+        LOG(INFO) << RoleToString() << "kTLS doesn't support the cipher suite";
+    } else if (setsockopt(fd_.get(), SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+        PLOG(INFO) << RoleToString() << "kTLS unavailable";
+    } else if (setsockopt(fd_.get(), SOL_TLS, TLS_TX, &tx, tx_size) != 0) {
+        PLOG(INFO) << RoleToString() << "Unable to offload writes to kTLS";
+    } else {
+        offloaded = write_offloaded_ = true;
+
+        // The kernel only hands out application data through read(), so keep reading through
+        // BoringSSL if anything else is expected, or if BoringSSL already buffered records.
+        bool expect_tickets = role_ == Role::Client && new_session_cb_;
+        if (!expect_tickets && !SSL_has_pending(ssl_.get())) {
+            if (setsockopt(fd_.get(), SOL_TLS, TLS_RX, &rx, rx_size) == 0) {
+                read_offloaded_ = true;
+            } else {
+                PLOG(INFO) << RoleToString() << "Unable to offload reads to kTLS";
+            }
+        }
+        LOG(INFO) << RoleToString() << "Offloaded "
+                  << (read_offloaded_ ? "reads and writes" : "writes") << " to kTLS";
+    }
+    OPENSSL_cleanse(&tx, sizeof(tx));
+    OPENSSL_cleanse(&rx, sizeof(rx));
+    return offloaded;
+#else
+    return false;
+#endif
+}
+
+bool TlsConnectionImpl::KernelReadFully(void* buf, size_t size) {
+#if defined(__linux__)
+    uint8_t* p8 = reinterpret_cast<uint8_t*>(buf);
+    while (size > 0) {
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd_.get(), p8, size));
+        if (bytes_read <= 0) {
+            // EIO means the peer sent something other than application data, e.g. an alert.
+            PLOG(ERROR) << RoleToString() << "kTLS read failed";
+            return false;
+        }
+        size -= bytes_read;
+        p8 += bytes_read;
+    }
+    return true;
+#else
+    UNUSED(buf, size);
+    return false;
+#endif
+}
+
+bool TlsConnectionImpl::KernelWritevFully(const std::vector<std::string_view>& data) {
+#if defined(__linux__)
+    // The kernel fills records across iovecs by itself.
+    std::vector<iovec> iovs;
+    iovs.reserve(data.size());
+    for (std::string_view piece : data) {
+        if (!piece.empty()) {
+            iovs.push_back({const_cast<char*>(piece.data()), piece.size()});
+        }
+    }
+
+    size_t i = 0;
+    while (i < iovs.size()) {
+        msghdr msg = {};
+        msg.msg_iov = &iovs[i];
+        msg.msg_iovlen = std::min(iovs.size() - i, static_cast<size_t>(IOV_MAX));
+        ssize_t bytes_out = TEMP_FAILURE_RETRY(sendmsg(fd_.get(), &msg, MSG_NOSIGNAL));
+        if (bytes_out <= 0) {
+            PLOG(ERROR) << RoleToString() << "kTLS write failed";
+            return false;
+        }
+
+        size_t written = bytes_out;
+        while (i < iovs.size() && written >= iovs[i].iov_len) {
+            written -= iovs[i].iov_len;
+            ++i;
+        }
+        if (written > 0) {
+            iovs[i].iov_base = static_cast<char*>(iovs[i].iov_base) + written;
+            iovs[i].iov_len -= written;
+        }
+    }
+    return true;
+#else
+    UNUSED(data);
+    return false;
+#endif
+}
+
+bool TlsConnectionImpl::KernelWriteFully(std::string_view data) {
+#if defined(__linux__)
+    while (!data.empty()) {
+        ssize_t bytes_out =
+                TEMP_FAILURE_RETRY(send(fd_.get(), data.data(), data.size(), MSG_NOSIGNAL));
+        if (bytes_out <= 0) {
+            PLOG(ERROR) << RoleToString() << "kTLS write failed";
+            return false;
+        }
+        data = data.substr(bytes_out);
+    }
+    return true;
+#else
+    UNUSED(data);
+    return false;
+#endif
+}
 }  // namespace
 
 // static
@@ -32,9 +32,11 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <set>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <adb/crypto/rsa_2048_key.h>
 #include <adb/crypto/x509_generator.h>
@@ -42,6 +44,7 @@
 #include <android-base/logging.h>
 #include <android-base/no_destructor.h>
 #include <android-base/parsenetaddress.h>
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/thread_annotations.h>
@@ -59,6 +62,7 @@
 #include <google/protobuf/text_format.h>
 #include "adb_host.pb.h"
 #include "client/detach.h"
+#include "client/transport_client.h"
 #include "client/usb.h"
 #endif
 
@@ -91,6 +95,11 @@ const char* const kFeatureFixedPushSymlinkTimestamp = "fixed_push_symlink_timest
 const char* const kFeatureAbbExec = "abb_exec";
 const char* const kFeatureRemountShell = "remount_shell";
 const char* const kFeatureTrackApp = "track_app";
+const char* const kFeatureTrackAppDelta = "track_app_delta";
+const char* const kFeatureExecBatch = "exec_batch";
+const char* const kFeatureShell2LZ4 = "shell_v2_lz4";
+const char* const kFeatureShell2Zstd = "shell_v2_zstd";
+const char* const kFeatureFramebufferStream = "framebuffer_stream";
 const char* const kFeatureSendRecv2 = "sendrecv_v2";
 const char* const kFeatureSendRecv2Brotli = "sendrecv_v2_brotli";
 const char* const kFeatureSendRecv2LZ4 = "sendrecv_v2_lz4";
@@ -104,64 +113,195 @@ const char* const kFeatureDevRaw = "devraw";
 const char* const kFeatureAppInfo = "app_info";  // Add information to track-app (package name, ...)
 const char* const kFeatureServerStatus = "server_status";  // Ability to output server status
 
+#if ADB_HOST
+
+ReconnectQueue::ReconnectQueue(Random random) : random_(std::move(random)) {}
+
+// static
+std::chrono::milliseconds ReconnectQueue::Backoff(size_t failed_attempts, const Random& random) {
+    // Double from kInitialDelay, then wait somewhere between half of that and all of it.
+    auto backoff = kInitialDelay * (1 << std::min<size_t>(failed_attempts, 16));
+    backoff = std::min<std::chrono::milliseconds>(backoff, kMaxBackoff);
+    return std::chrono::milliseconds(random(backoff.count() / 2, backoff.count()));
+}
+
+void ReconnectQueue::Add(atransport* transport, Clock::time_point now) {
+    queue_.insert(Attempt{transport, now + kInitialDelay, now, 0});
+}
+
+std::optional<ReconnectQueue::Clock::time_point> ReconnectQueue::NextAttemptTime() const {
+    if (queue_.empty()) {
+        return std::nullopt;
+    }
+    return queue_.begin()->reconnect_time;
+}
+
+std::vector<atransport*> ReconnectQueue::TakeKicked() {
+    std::vector<atransport*> kicked;
+    for (auto it = queue_.begin(); it != queue_.end();) {
+        if (it->transport->kicked()) {
+            kicked.push_back(it->transport);
+            it = queue_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return kicked;
+}
+
+atransport* ReconnectQueue::TakeDue(Clock::time_point now) {
+    if (queue_.empty() || queue_.begin()->reconnect_time > now) {
+        return nullptr;
+    }
+    in_flight_.push_back(*queue_.begin());
+    queue_.erase(queue_.begin());
+    return in_flight_.back().transport;
+}
+
+bool ReconnectQueue::RetryNow(std::string_view serial, Clock::time_point now) {
+    auto it = std::find_if(queue_.begin(), queue_.end(), [serial](const Attempt& attempt) {
+        return attempt.transport->serial == serial;
+    });
+    if (it == queue_.end()) {
+        for (const Attempt& attempt : in_flight_) {
+            if (attempt.transport->serial == serial) {
+                retry_now_.insert(attempt.transport);
+            }
+        }
+        return false;
+    }
+
+    D("retrying reconnection to %s now", it->transport->serial.c_str());
+    Attempt attempt = *it;
+    queue_.erase(it);
+    attempt.reconnect_time = now;
+    queue_.insert(attempt);
+    return true;
+}
+
+ReconnectQueue::Attempt ReconnectQueue::TakeInFlight(atransport* transport) {
+    auto it = std::find_if(in_flight_.begin(), in_flight_.end(),
+                           [transport](const Attempt& attempt) {
+                               return attempt.transport == transport;
+                           });
+    CHECK(it != in_flight_.end());
+    Attempt attempt = *it;
+    in_flight_.erase(it);
+    return attempt;
+}
+
+bool ReconnectQueue::Failed(atransport* transport, Clock::time_point now) {
+    Attempt attempt = TakeInFlight(transport);
+    bool retry_now = retry_now_.erase(transport) != 0;
+    if (now - attempt.disconnect_time >= kRetryDuration) {
+        LOG(INFO) << "giving up on reconnecting to " << transport->serial << " after "
+                  << attempt.failed_attempts + 1 << " attempts";
+        ++abandoned_;
+        return false;
+    }
+
+    ++attempt.failed_attempts;
+    attempt.reconnect_time = retry_now ? now : now + Backoff(attempt.failed_attempts, random_);
+    queue_.insert(attempt);
+    return true;
+}
+
+void ReconnectQueue::Succeeded(atransport* transport, Clock::time_point now) {
+    Attempt attempt = TakeInFlight(transport);
+    retry_now_.erase(transport);
+    auto recovery_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - attempt.disconnect_time);
+    LOG(INFO) << "reconnected to " << transport->serial << " after " << recovery_time.count()
+              << "ms (" << attempt.failed_attempts + 1 << " attempts)";
+    ++succeeded_;
+    total_recovery_time_ += recovery_time;
+    max_recovery_time_ = std::max(max_recovery_time_, recovery_time);
+}
+
+void ReconnectQueue::Aborted(atransport* transport) {
+    TakeInFlight(transport);
+    retry_now_.erase(transport);
+}
+
+std::vector<atransport*> ReconnectQueue::TakeAll() {
+    std::vector<atransport*> transports;
+    for (const Attempt& attempt : queue_) {
+        transports.push_back(attempt.transport);
+    }
+    queue_.clear();
+    return transports;
+}
+
+ReconnectStats ReconnectQueue::Stats() const {
+    ReconnectStats stats;
+    stats.pending = queue_.size() + in_flight_.size();
+    stats.succeeded = succeeded_;
+    stats.abandoned = abandoned_;
+    if (succeeded_ != 0) {
+        stats.mean_recovery_time = total_recovery_time_ / succeeded_;
+    }
+    stats.max_recovery_time = max_recovery_time_;
+    return stats;
+}
+
+#endif
+
 namespace {
 
 #if ADB_HOST
 
 // Tracks and handles atransport*s that are attempting reconnection.
+//
+// Reconnect() blocks on a TCP connect and, for wireless devices, a TLS handshake, so attempts are
+// made from a small pool of threads: when many devices drop at once (e.g. the network they share
+// went down), they don't have to wait for each other to come back.
 class ReconnectHandler {
   public:
     ReconnectHandler() = default;
     ~ReconnectHandler() = default;
 
-    // Starts the ReconnectHandler thread.
+    // Starts the ReconnectHandler threads.
     void Start();
 
-    // Requests the ReconnectHandler thread to stop.
+    // Requests the ReconnectHandler threads to stop.
     void Stop();
 
     // Adds the atransport* to the queue of reconnect attempts.
     void TrackTransport(atransport* transport);
 
-    // Wake up the ReconnectHandler thread to have it check for kicked transports.
+    // Wake up the ReconnectHandler threads to have them check for kicked transports.
     void CheckForKicked();
 
-  private:
-    // The main thread loop.
-    void Run();
+    // Makes the next reconnect attempt to the transport with |serial|, if there is one, right
+    // away instead of waiting for its backoff to expire.
+    void RetryNow(std::string_view serial);
 
-    // Tracks a reconnection attempt.
-    struct ReconnectAttempt {
-        atransport* transport;
-        std::chrono::steady_clock::time_point reconnect_time;
-        size_t attempts_left;
+    ReconnectStats Stats();
 
-        bool operator<(const ReconnectAttempt& rhs) const {
-            if (reconnect_time == rhs.reconnect_time) {
-                return reinterpret_cast<uintptr_t>(transport) <
-                       reinterpret_cast<uintptr_t>(rhs.transport);
-            }
-            return reconnect_time < rhs.reconnect_time;
-        }
-    };
+  private:
+    // The loop run by each thread.
+    void Run();
 
-    // Only retry for up to one minute.
-    static constexpr const std::chrono::seconds kDefaultTimeout = 3s;
-    static constexpr const size_t kMaxAttempts = 20;
+    static constexpr const size_t kMaxConcurrentAttempts = 8;
 
     // Protects all members.
     std::mutex reconnect_mutex_;
     bool running_ GUARDED_BY(reconnect_mutex_) = true;
-    std::thread handler_thread_;
+    std::vector<std::thread> handler_threads_;
     std::condition_variable reconnect_cv_;
-    std::set<ReconnectAttempt> reconnect_queue_ GUARDED_BY(reconnect_mutex_);
+    ReconnectQueue queue_ GUARDED_BY(reconnect_mutex_){
+            [jitter = std::mt19937(std::random_device()())](int64_t min, int64_t max) mutable {
+                return std::uniform_int_distribution<int64_t>(min, max)(jitter);
+            }};
 
     DISALLOW_COPY_AND_ASSIGN(ReconnectHandler);
 };
 
 void ReconnectHandler::Start() {
     fdevent_check_looper();
-    handler_thread_ = std::thread(&ReconnectHandler::Run, this);
+    for (size_t i = 0; i < kMaxConcurrentAttempts; ++i) {
+        handler_threads_.emplace_back(&ReconnectHandler::Run, this);
+    }
 }
 
 void ReconnectHandler::Stop() {
@@ -170,15 +310,16 @@ void ReconnectHandler::Stop() {
         std::lock_guard<std::mutex> lock(reconnect_mutex_);
         running_ = false;
     }
-    reconnect_cv_.notify_one();
-    handler_thread_.join();
+    reconnect_cv_.notify_all();
+    for (auto& thread : handler_threads_) {
+        thread.join();
+    }
+    handler_threads_.clear();
 
     // Drain the queue to free all resources.
     std::lock_guard<std::mutex> lock(reconnect_mutex_);
-    while (!reconnect_queue_.empty()) {
-        ReconnectAttempt attempt = *reconnect_queue_.begin();
-        reconnect_queue_.erase(reconnect_queue_.begin());
-        remove_transport(attempt.transport);
+    for (atransport* transport : queue_.TakeAll()) {
+        remove_transport(transport);
     }
 }
 
@@ -187,31 +328,43 @@ void ReconnectHandler::TrackTransport(atransport* transport) {
     {
         std::lock_guard<std::mutex> lock(reconnect_mutex_);
         if (!running_) return;
-        // Arbitrary sleep to give adbd time to get ready, if we disconnected because it exited.
-        auto reconnect_time = std::chrono::steady_clock::now() + 250ms;
-        reconnect_queue_.emplace(
-                ReconnectAttempt{transport, reconnect_time, ReconnectHandler::kMaxAttempts});
+        queue_.Add(transport, std::chrono::steady_clock::now());
     }
     reconnect_cv_.notify_one();
 }
 
 void ReconnectHandler::CheckForKicked() {
+    reconnect_cv_.notify_all();
+}
+
+void ReconnectHandler::RetryNow(std::string_view serial) {
+    {
+        std::lock_guard<std::mutex> lock(reconnect_mutex_);
+        if (!queue_.RetryNow(serial, std::chrono::steady_clock::now())) {
+            return;
+        }
+    }
     reconnect_cv_.notify_one();
 }
 
+ReconnectStats ReconnectHandler::Stats() {
+    std::lock_guard<std::mutex> lock(reconnect_mutex_);
+    return queue_.Stats();
+}
+
 void ReconnectHandler::Run() {
     while (true) {
-        ReconnectAttempt attempt;
+        atransport* transport;
         {
             std::unique_lock<std::mutex> lock(reconnect_mutex_);
             ScopedLockAssertion assume_lock(reconnect_mutex_);
 
-            if (!reconnect_queue_.empty()) {
+            if (auto next = queue_.NextAttemptTime(); next) {
                 // FIXME: libstdc++ (used on Windows) implements condition_variable with
                 //        system_clock as its clock, so we're probably hosed if the clock changes,
                 //        even if we use steady_clock throughout. This problem goes away once we
                 //        switch to libc++.
-                reconnect_cv_.wait_until(lock, reconnect_queue_.begin()->reconnect_time);
+                reconnect_cv_.wait_until(lock, *next);
             } else {
                 reconnect_cv_.wait(lock);
             }
@@ -220,56 +373,46 @@ void ReconnectHandler::Run() {
 
             // Scan the whole list for kicked transports, so that we immediately handle an explicit
             // disconnect request.
-            for (auto it = reconnect_queue_.begin(); it != reconnect_queue_.end();) {
-                if (it->transport->kicked()) {
-                    D("transport %s was kicked. giving up on it.", it->transport->serial.c_str());
-                    remove_transport(it->transport);
-                    it = reconnect_queue_.erase(it);
-                } else {
-                    ++it;
-                }
+            for (atransport* kicked : queue_.TakeKicked()) {
+                D("transport %s was kicked. giving up on it.", kicked->serial.c_str());
+                remove_transport(kicked);
             }
 
-            if (reconnect_queue_.empty()) continue;
-
             // Go back to sleep if we either woke up spuriously, or we were woken up to remove
             // a kicked transport, and the first transport isn't ready for reconnection yet.
             auto now = std::chrono::steady_clock::now();
-            if (reconnect_queue_.begin()->reconnect_time > now) {
-                continue;
-            }
+            transport = queue_.TakeDue(now);
+            if (!transport) continue;
 
-            attempt = *reconnect_queue_.begin();
-            reconnect_queue_.erase(reconnect_queue_.begin());
+            // Other threads sleep until the attempt that was first when they went to sleep is
+            // due, so hand over the next one if it's due as well.
+            if (auto next = queue_.NextAttemptTime(); next && *next <= now) {
+                reconnect_cv_.notify_one();
+            }
         }
-        D("attempting to reconnect %s", attempt.transport->serial.c_str());
-
-        switch (attempt.transport->Reconnect()) {
-            case ReconnectResult::Retry: {
-                D("attempting to reconnect %s failed.", attempt.transport->serial.c_str());
-                if (attempt.attempts_left == 0) {
-                    D("transport %s exceeded the number of retry attempts. giving up on it.",
-                      attempt.transport->serial.c_str());
-                    remove_transport(attempt.transport);
-                    continue;
-                }
+        D("attempting to reconnect %s", transport->serial.c_str());
 
-                std::lock_guard<std::mutex> lock(reconnect_mutex_);
-                reconnect_queue_.emplace(ReconnectAttempt{
-                        attempt.transport,
-                        std::chrono::steady_clock::now() + ReconnectHandler::kDefaultTimeout,
-                        attempt.attempts_left - 1});
+        ReconnectResult result = transport->Reconnect();
+
+        std::lock_guard<std::mutex> lock(reconnect_mutex_);
+        auto now = std::chrono::steady_clock::now();
+        switch (result) {
+            case ReconnectResult::Retry:
+                D("attempting to reconnect %s failed.", transport->serial.c_str());
+                if (!queue_.Failed(transport, now)) {
+                    remove_transport(transport);
+                }
                 continue;
-            }
 
             case ReconnectResult::Success:
-                D("reconnection to %s succeeded.", attempt.transport->serial.c_str());
-                register_transport(attempt.transport);
+                queue_.Succeeded(transport, now);
+                register_transport(transport);
                 continue;
 
             case ReconnectResult::Abort:
-                D("cancelling reconnection attempt to %s.", attempt.transport->serial.c_str());
-                remove_transport(attempt.transport);
+                D("cancelling reconnection attempt to %s.", transport->serial.c_str());
+                queue_.Aborted(transport);
+                remove_transport(transport);
                 continue;
         }
     }
@@ -295,6 +438,15 @@ std::string Connection::Serial() const {
     return transport_ ? transport_->serial_name() : "<unknown>";
 }
 
+bool BlockingConnection::WriteMultiple(const std::vector<std::unique_ptr<apacket>>& packets) {
+    for (const auto& packet : packets) {
+        if (!Write(packet.get())) {
+            return false;
+        }
+    }
+    return true;
+}
+
 BlockingConnectionAdapter::BlockingConnectionAdapter(std::unique_ptr<BlockingConnection> connection)
     : underlying_(std::move(connection)) {}
 
@@ -313,22 +465,38 @@ bool BlockingConnectionAdapter::Start() {
 
     write_thread_ = std::thread([this]() {
         LOG(INFO) << Serial() << ": write thread spawning";
+        std::vector<std::unique_ptr<apacket>> batch;
         while (true) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            ScopedLockAssertion assume_locked(mutex_);
-            cv_.wait(lock, [this]() REQUIRES(mutex_) {
-                return this->stopped_ || !this->write_queue_.empty();
-            });
-
-            if (this->stopped_) {
+            if (this->scheduler_.empty()) {
+                // Returns nullptr once Stop() has closed the queue.
+                std::unique_ptr<apacket> packet = this->write_queue_.Pop();
+                if (!packet) {
+                    return;
+                }
+                this->scheduler_.Enqueue(std::move(packet));
+            } else if (this->write_queue_.closed()) {
                 return;
             }
 
-            std::unique_ptr<apacket> packet = std::move(this->write_queue_.front());
-            this->write_queue_.pop_front();
-            lock.unlock();
+            // Hand everything that has been queued up in the meantime to the scheduler, and let
+            // it pick the next batch, so that a burst of small packets (acks, keystrokes, ...)
+            // goes out in as few writes as possible without waiting behind a bulk transfer.
+            while (std::unique_ptr<apacket> packet = this->write_queue_.TryPop()) {
+                this->scheduler_.Enqueue(std::move(packet));
+            }
+
+            size_t batch_bytes = 0;
+            batch.clear();
+            while (batch.size() < kMaxWriteBatchPackets && batch_bytes < kMaxWriteBatchBytes) {
+                std::unique_ptr<apacket> packet = this->scheduler_.Dequeue();
+                if (!packet) {
+                    break;
+                }
+                batch_bytes += sizeof(amessage) + packet->payload.size();
+                batch.push_back(std::move(packet));
+            }
 
-            if (!this->underlying_->Write(packet.get())) {
+            if (!this->underlying_->WriteMultiple(batch)) {
                 break;
             }
         }
@@ -416,7 +584,8 @@ void BlockingConnectionAdapter::Stop() {
     LOG(INFO) << "BlockingConnectionAdapter(" << Serial() << "): stopping";
 
     this->underlying_->Close();
-    this->cv_.notify_one();
+    this->write_queue_.Close();
+    this->scheduler_.ForgetPriorities();
 
     // Move the threads out into locals with the lock taken, and then unlock to let them exit.
     std::thread read_thread;
@@ -436,21 +605,25 @@ void BlockingConnectionAdapter::Stop() {
 }
 
 bool BlockingConnectionAdapter::Write(std::unique_ptr<apacket> packet) {
-    {
-        std::lock_guard<std::mutex> lock(this->mutex_);
-        write_queue_.emplace_back(std::move(packet));
-    }
-
-    cv_.notify_one();
+    // Packets written after Stop() are silently dropped, as they always have been.
+    write_queue_.Push(std::move(packet));
     return true;
 }
 
+void BlockingConnectionAdapter::SetSocketPriority(uint32_t id, WritePriority priority) {
+    scheduler_.SetPriority(id, priority);
+}
+
+void BlockingConnectionAdapter::ForgetSocketPriority(uint32_t id) {
+    scheduler_.ForgetPriority(id);
+}
+
 FdConnection::FdConnection(unique_fd fd) : fd_(std::move(fd)) {}
 
 FdConnection::~FdConnection() {}
 
 bool FdConnection::DispatchRead(void* buf, size_t len) {
-    if (tls_ != nullptr) {
+    if (tls_ != nullptr && !tls_->IsReadOffloaded()) {
         // The TlsConnection doesn't allow 0 byte reads
         if (len == 0) {
             return true;
@@ -461,18 +634,6 @@ bool FdConnection::DispatchRead(void* buf, size_t len) {
     return ReadFdExactly(fd_.get(), buf, len);
 }
 
-bool FdConnection::DispatchWrite(void* buf, size_t len) {
-    if (tls_ != nullptr) {
-        // The TlsConnection doesn't allow 0 byte writes
-        if (len == 0) {
-            return true;
-        }
-        return tls_->WriteFully(std::string_view(reinterpret_cast<const char*>(buf), len));
-    }
-
-    return WriteFdExactly(fd_.get(), buf, len);
-}
-
 bool FdConnection::Read(apacket* packet) {
     if (!DispatchRead(&packet->msg, sizeof(amessage))) {
         D("remote local: read terminated (message)");
@@ -494,14 +655,32 @@ bool FdConnection::Read(apacket* packet) {
     return true;
 }
 
+static void AppendTlsPieces(const apacket& packet, std::vector<std::string_view>* pieces) {
+    pieces->emplace_back(reinterpret_cast<const char*>(&packet.msg), sizeof(packet.msg));
+    if (packet.msg.data_length) {
+        pieces->emplace_back(&packet.payload[0], packet.msg.data_length);
+    }
+}
+
 bool FdConnection::Write(apacket* packet) {
-    if (!DispatchWrite(&packet->msg, sizeof(packet->msg))) {
+    if (tls_ != nullptr && !tls_->IsWriteOffloaded()) {
+        // Send the header and the payload in the same TLS record.
+        std::vector<std::string_view> pieces;
+        AppendTlsPieces(*packet, &pieces);
+        if (!tls_->WritevFully(pieces)) {
+            D("remote local: write terminated");
+            return false;
+        }
+        return true;
+    }
+
+    if (!WriteFdExactly(fd_.get(), &packet->msg, sizeof(packet->msg))) {
         D("remote local: write terminated");
         return false;
     }
 
     if (packet->msg.data_length) {
-        if (!DispatchWrite(&packet->payload[0], packet->msg.data_length)) {
+        if (!WriteFdExactly(fd_.get(), &packet->payload[0], packet->msg.data_length)) {
             D("remote local: write terminated");
             return false;
         }
@@ -510,6 +689,57 @@ bool FdConnection::Write(apacket* packet) {
     return true;
 }
 
+bool FdConnection::WriteMultiple(const std::vector<std::unique_ptr<apacket>>& packets) {
+    if (tls_ != nullptr && !tls_->IsWriteOffloaded()) {
+        // Pack the whole batch into as few TLS records as possible.
+        std::vector<std::string_view> pieces;
+        pieces.reserve(packets.size() * 2);
+        for (const auto& packet : packets) {
+            AppendTlsPieces(*packet, &pieces);
+        }
+        if (!tls_->WritevFully(pieces)) {
+            D("remote local: write terminated");
+            return false;
+        }
+        return true;
+    }
+
+    // Send every header and payload in the batch with a single writev where possible.
+    std::vector<adb_iovec> iovs;
+    iovs.reserve(packets.size() * 2);
+    for (const auto& packet : packets) {
+        adb_iovec header;
+        header.iov_base = &packet->msg;
+        header.iov_len = sizeof(packet->msg);
+        iovs.push_back(header);
+
+        if (packet->msg.data_length) {
+            adb_iovec payload;
+            payload.iov_base = &packet->payload[0];
+            payload.iov_len = packet->msg.data_length;
+            iovs.push_back(payload);
+        }
+    }
+
+    if (!WritevFdExactly(fd_.get(), iovs.data(), iovs.size())) {
+        D("remote local: write terminated");
+        return false;
+    }
+    return true;
+}
+
+// Whether to hand the keys of TLS connections to the kernel after the handshake, so that their
+// traffic can take the same paths as plain TCP connections.
+static bool tls_offload_enabled() {
+#if ADB_HOST
+    static const char* env = getenv("ADB_TLS_OFFLOAD");
+    static bool result = env && strcmp(env, "1") == 0;
+#else
+    static bool result = android::base::GetBoolProperty("persist.adb.tls_offload", false);
+#endif
+    return result;
+}
+
 bool FdConnection::DoTlsHandshake(RSA* key, std::string* auth_key) {
     bssl::UniquePtr<EVP_PKEY> evp_pkey(EVP_PKEY_new());
     if (!EVP_PKEY_set1_RSA(evp_pkey.get(), key)) {
@@ -538,6 +768,15 @@ bool FdConnection::DoTlsHandshake(RSA* key, std::string* auth_key) {
     tls_->SetCertificateCallback(adb_tls_set_certificate);
     // Allow any server certificate
     tls_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    // Offer the session from the last connection to the device, and keep the
+    // ones the device issues on this connection for the next time.
+    if (!tls_peer_.empty()) {
+        bssl::UniquePtr<SSL_SESSION> session = adb_tls_take_session(tls_peer_);
+        tls_->SetSession(session.get());
+        tls_->SetNewSessionCallback([peer = tls_peer_](bssl::UniquePtr<SSL_SESSION> session) {
+            adb_tls_save_session(peer, std::move(session));
+        });
+    }
 #else
     // Add callback to check certificate against a list of known public keys
     tls_->SetCertVerifyCallback(
@@ -545,10 +784,14 @@ bool FdConnection::DoTlsHandshake(RSA* key, std::string* auth_key) {
     // Add the list of allowed client CA issuers
     auto ca_list = adbd_tls_client_ca_list();
     tls_->SetClientCAList(ca_list.get());
+    tls_->SetSessionTicketKeys(adbd_tls_session_ticket_keys());
 #endif
 
     auto err = tls_->DoHandshake();
     if (err == TlsError::Success) {
+        if (tls_offload_enabled()) {
+            tls_->EnableKernelOffload();
+        }
         return true;
     }
 
@@ -712,6 +955,7 @@ bool iterate_transports(std::function<bool(const atransport*)> fn) {
 // Call this function each time the transport list has changed.
 void update_transports() {
     update_transport_status();
+    save_tcp_connections();
 
     // Notify `adb track-devices` clients.
     device_tracker* tracker = device_tracker_list;
@@ -793,6 +1037,14 @@ static void fdevent_register_transport(atransport* t) {
 void init_reconnect_handler() {
     reconnect_handler.Start();
 }
+
+void reconnect_transport_now(std::string_view serial) {
+    reconnect_handler.RetryNow(serial);
+}
+
+ReconnectStats reconnect_stats() {
+    return reconnect_handler.Stats();
+}
 #endif
 
 void kick_all_transports() {
@@ -1054,6 +1306,18 @@ int atransport::Write(apacket* p) {
     return this->connection()->Write(std::unique_ptr<apacket>(p)) ? 0 : -1;
 }
 
+void atransport::SetSocketPriority(uint32_t id, WritePriority priority) {
+    if (auto connection = this->connection(); connection) {
+        connection->SetSocketPriority(id, priority);
+    }
+}
+
+void atransport::ForgetSocketPriority(uint32_t id) {
+    if (auto connection = this->connection(); connection) {
+        connection->ForgetSocketPriority(id);
+    }
+}
+
 void atransport::Reset() {
     if (!kicked_.exchange(true)) {
         LOG(INFO) << "resetting transport " << this << " " << this->serial;
@@ -1224,6 +1488,11 @@ const FeatureSet& supported_features() {
             kFeatureDevRaw,
             kFeatureAppInfo,
             kFeatureServerStatus,
+            kFeatureTrackAppDelta,
+            kFeatureExecBatch,
+            kFeatureShell2LZ4,
+            kFeatureShell2Zstd,
+            kFeatureFramebufferStream,
         };
         // clang-format on
 
@@ -1266,6 +1535,8 @@ bool atransport::has_feature(const std::string& feature) const {
 }
 
 void atransport::SetFeatures(const std::string& features_string) {
+    static std::atomic<uint64_t> next_generation(1);
+    features_generation_ = next_generation++;
     features_ = StringToFeatureSet(features_string);
     delayed_ack_ = CanUseFeature(features_, kFeatureDelayedAck);
 }
@@ -1718,7 +1989,7 @@ std::shared_ptr<RSA> atransport::Key() {
 std::shared_ptr<RSA> atransport::NextKey() {
     if (keys_.empty()) {
         LOG(INFO) << "fetching keys for transport " << this->serial_name();
-        keys_ = adb_auth_get_private_keys();
+        keys_ = adb_auth_get_private_keys(serial);
 
         // We should have gotten at least one key: the one that's automatically generated.
         CHECK(!keys_.empty());
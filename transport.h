@@ -17,6 +17,7 @@
 #ifndef __TRANSPORT_H
 #define __TRANSPORT_H
 
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <atomic>
@@ -28,6 +29,7 @@
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -40,7 +42,9 @@
 
 #include "adb.h"
 #include "adb_unique_fd.h"
+#include "packet_scheduler.h"
 #include "types.h"
+#include "write_queue.h"
 
 // Even though the feature set is used as a set, we only have a dozen or two
 // of available features at any moment. Vector works much better in terms of
@@ -89,6 +93,8 @@ extern const char* const kFeatureFixedPushSymlinkTimestamp;
 extern const char* const kFeatureRemountShell;
 // adbd supports `track-app` service reporting debuggable/profileable apps.
 extern const char* const kFeatureTrackApp;
+// adbd supports `track-app-delta` service reporting incremental updates to the track-app list.
+extern const char* const kFeatureTrackAppDelta;
 // adbd supports version 2 of send/recv.
 extern const char* const kFeatureSendRecv2;
 // adbd supports brotli for send/recv v2.
@@ -103,6 +109,14 @@ extern const char* const kFeatureSendRecv2DryRunSend;
 extern const char* const kFeatureDelayedAck;
 // adbd supports `dev-raw` service
 extern const char* const kFeatureDevRaw;
+// adbd supports the `exec-batch` service.
+extern const char* const kFeatureExecBatch;
+// adbd supports LZ4 compressed output for shell,v2.
+extern const char* const kFeatureShell2LZ4;
+// adbd supports Zstd compressed output for shell,v2.
+extern const char* const kFeatureShell2Zstd;
+// adbd supports the `framebuffer-stream` service.
+extern const char* const kFeatureFramebufferStream;
 
 TransportId NextTransportId();
 
@@ -115,6 +129,11 @@ struct Connection {
 
     virtual bool Write(std::unique_ptr<apacket> packet) = 0;
 
+    // Set the scheduling priority of the packets sent by local socket |id|, for connections that
+    // schedule their writes with a PacketScheduler.
+    virtual void SetSocketPriority(uint32_t id, WritePriority priority) {}
+    virtual void ForgetSocketPriority(uint32_t id) {}
+
     // Return true if the transport successfully started.
     virtual bool Start() = 0;
     virtual void Stop() = 0;
@@ -160,6 +179,11 @@ struct BlockingConnection {
     virtual bool Read(apacket* packet) = 0;
     virtual bool Write(apacket* packet) = 0;
 
+    // Write a batch of packets, in order. Called from the writer thread with everything that was
+    // queued up when it woke up, so that implementations can coalesce small packets into fewer
+    // syscalls. The default implementation just writes them one at a time.
+    virtual bool WriteMultiple(const std::vector<std::unique_ptr<apacket>>& packets);
+
     virtual bool DoTlsHandshake(RSA* key, std::string* auth_key = nullptr) = 0;
 
     // Terminate a connection.
@@ -177,6 +201,8 @@ struct BlockingConnectionAdapter : public Connection {
     virtual ~BlockingConnectionAdapter();
 
     virtual bool Write(std::unique_ptr<apacket> packet) override final;
+    virtual void SetSocketPriority(uint32_t id, WritePriority priority) override final;
+    virtual void ForgetSocketPriority(uint32_t id) override final;
 
     virtual bool Start() override final;
     virtual void Stop() override final;
@@ -185,6 +211,10 @@ struct BlockingConnectionAdapter : public Connection {
     virtual void Reset() override final;
 
   private:
+    // Upper bounds on how much the writer thread hands to the underlying connection at once.
+    static constexpr size_t kMaxWriteBatchPackets = 64;
+    static constexpr size_t kMaxWriteBatchBytes = 256 * 1024;
+
     void StartReadThread() REQUIRES(mutex_);
     bool started_ GUARDED_BY(mutex_) = false;
     bool stopped_ GUARDED_BY(mutex_) = false;
@@ -193,9 +223,12 @@ struct BlockingConnectionAdapter : public Connection {
     std::thread read_thread_ GUARDED_BY(mutex_);
     std::thread write_thread_ GUARDED_BY(mutex_);
 
-    std::deque<std::unique_ptr<apacket>> write_queue_ GUARDED_BY(mutex_);
+    PacketWriteQueue write_queue_;
+
+    // Only accessed by the writer thread (apart from SetPriority).
+    PacketScheduler scheduler_;
+
     std::mutex mutex_;
-    std::condition_variable cv_;
 
     std::once_flag error_flag_;
 };
@@ -206,17 +239,21 @@ struct FdConnection : public BlockingConnection {
 
     bool Read(apacket* packet) override final;
     bool Write(apacket* packet) override final;
+    bool WriteMultiple(const std::vector<std::unique_ptr<apacket>>& packets) override final;
     bool DoTlsHandshake(RSA* key, std::string* auth_key) override final;
 
     void Close() override;
     virtual void Reset() override final { Close(); }
 
+    // The device's serial, for resuming TLS sessions from earlier connections to it.
+    void SetTlsPeer(std::string serial) { tls_peer_ = std::move(serial); }
+
   private:
     bool DispatchRead(void* buf, size_t len);
-    bool DispatchWrite(void* buf, size_t len);
 
     unique_fd fd_;
     std::unique_ptr<adb::tls::TlsConnection> tls_;
+    std::string tls_peer_;
 };
 
 // Waits for a transport's connection to be not pending. This is a separate
@@ -288,6 +325,8 @@ class atransport : public enable_weak_from_this<atransport> {
     ~atransport();
 
     int Write(apacket* p);
+    void SetSocketPriority(uint32_t id, WritePriority priority);
+    void ForgetSocketPriority(uint32_t id);
     void Reset();
     void Kick();
     bool kicked() const { return kicked_; }
@@ -345,6 +384,9 @@ class atransport : public enable_weak_from_this<atransport> {
     std::shared_ptr<RSA> Key();
     std::shared_ptr<RSA> NextKey();
     void ResetKeys();
+
+    // Whether the device asked us to authenticate since the keys were last reset.
+    bool KeysFetched() const { return !keys_.empty(); }
 #endif
 
     char token[TOKEN_SIZE] = {};
@@ -358,6 +400,11 @@ class atransport : public enable_weak_from_this<atransport> {
 
     const FeatureSet& features() const { return features_; }
 
+    // Changes whenever the feature set is loaded, i.e. every time the device (re)connects, so that
+    // features cached by clients can be told apart from those of a later connection that reuses
+    // the same transport (and id). Generations are unique across transports.
+    uint64_t features_generation() const { return features_generation_; }
+
     bool has_feature(const std::string& feature) const;
 
     bool SupportsDelayedAck() const {
@@ -409,6 +456,7 @@ class atransport : public enable_weak_from_this<atransport> {
     // A set of features transmitted in the banner with the initial connection.
     // This is stored in the banner as 'features=feature0,feature1,etc'.
     FeatureSet features_;
+    uint64_t features_generation_ = 0;
     int protocol_version;
     size_t max_payload;
 
@@ -485,6 +533,110 @@ void init_reconnect_handler();
 void init_mdns_transport_discovery();
 
 #if ADB_HOST
+// Retries reconnecting to the TCP device with |serial| right away, if it is waiting to be
+// reconnected. Called when mDNS sees the device again.
+void reconnect_transport_now(std::string_view serial);
+
+struct ReconnectStats {
+    // Devices waiting to be reconnected.
+    size_t pending = 0;
+    // Devices that came back, and those that were given up on.
+    size_t succeeded = 0;
+    size_t abandoned = 0;
+    // How long the devices that came back were gone for.
+    std::chrono::milliseconds mean_recovery_time{0};
+    std::chrono::milliseconds max_recovery_time{0};
+};
+ReconnectStats reconnect_stats();
+
+// The bookkeeping behind reconnecting to TCP devices that went away: which transports are waiting
+// to be reconnected, when each of them is due, and how that went. The threads that make the
+// attempts (see ReconnectHandler in transport.cpp) pass in the time and serialize access.
+class ReconnectQueue {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Returns a random number between |min| and |max|, inclusive.
+    using Random = std::function<int64_t(int64_t min, int64_t max)>;
+
+    // Arbitrary delay to give adbd time to get ready, if we disconnected because it exited.
+    static constexpr std::chrono::milliseconds kInitialDelay{250};
+    static constexpr std::chrono::milliseconds kMaxBackoff{8000};
+    // Only retry for up to one minute.
+    static constexpr std::chrono::seconds kRetryDuration{60};
+
+    explicit ReconnectQueue(Random random);
+
+    // Returns how long to wait after |failed_attempts| failed attempts. The delay doubles with
+    // every attempt, up to kMaxBackoff, and is randomized so that devices which went away
+    // together don't all retry in lockstep.
+    static std::chrono::milliseconds Backoff(size_t failed_attempts, const Random& random);
+
+    // Queues the first attempt to reconnect |transport|, which just went away.
+    void Add(atransport* transport, Clock::time_point now);
+
+    // When the next queued attempt is due, if there is one.
+    std::optional<Clock::time_point> NextAttemptTime() const;
+
+    // Takes the transports that were kicked while waiting out of the queue, to be given up on.
+    std::vector<atransport*> TakeKicked();
+
+    // Takes the next attempt out of the queue, if it is due, and marks it as in flight.
+    atransport* TakeDue(Clock::time_point now);
+
+    // Makes the next attempt to reconnect the transport with |serial| due right away, or if an
+    // attempt is in flight and fails, retries right away. Returns true if a queued attempt became
+    // due.
+    bool RetryNow(std::string_view serial, Clock::time_point now);
+
+    // Records the outcome of the in-flight attempt for |transport|. Failed() queues the next
+    // attempt, and returns false if the transport should be given up on instead.
+    bool Failed(atransport* transport, Clock::time_point now);
+    void Succeeded(atransport* transport, Clock::time_point now);
+    void Aborted(atransport* transport);
+
+    // Takes every queued transport out of the queue.
+    std::vector<atransport*> TakeAll();
+
+    ReconnectStats Stats() const;
+
+  private:
+    // Tracks a reconnection attempt.
+    struct Attempt {
+        atransport* transport;
+        Clock::time_point reconnect_time;
+        // When the transport went away, to give up on it eventually and to measure how long it
+        // took to come back.
+        Clock::time_point disconnect_time;
+        size_t failed_attempts;
+
+        bool operator<(const Attempt& rhs) const {
+            if (reconnect_time == rhs.reconnect_time) {
+                return reinterpret_cast<uintptr_t>(transport) <
+                       reinterpret_cast<uintptr_t>(rhs.transport);
+            }
+            return reconnect_time < rhs.reconnect_time;
+        }
+    };
+
+    // Removes the in-flight attempt for |transport|, and returns it.
+    Attempt TakeInFlight(atransport* transport);
+
+    Random random_;
+    std::set<Attempt> queue_;
+    // Attempts that are being made, and the transports that should be retried right away if
+    // their attempt fails.
+    std::vector<Attempt> in_flight_;
+    std::set<atransport*> retry_now_;
+
+    size_t succeeded_ = 0;
+    size_t abandoned_ = 0;
+    std::chrono::milliseconds total_recovery_time_{0};
+    std::chrono::milliseconds max_recovery_time_{0};
+
+    DISALLOW_COPY_AND_ASSIGN(ReconnectQueue);
+};
+
 atransport* find_transport(const char* serial);
 
 void kick_all_tcp_devices();
@@ -17,12 +17,18 @@
 #include <malloc.h>
 #include <stdio.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include <android-base/logging.h>
 #include <benchmark/benchmark.h>
 
 #include "adb_trace.h"
 #include "sysdeps.h"
 #include "transport.h"
+#include "write_queue.h"
 
 #define ADB_CONNECTION_BENCHMARK(benchmark_name, ...)                          \
     BENCHMARK_TEMPLATE(benchmark_name, FdConnection, ##__VA_ARGS__)            \
@@ -182,6 +188,140 @@ void BM_Connection_Echo(benchmark::State& state) {
 ADB_CONNECTION_BENCHMARK(BM_Connection_Echo, ThreadPolicy::SameThread);
 ADB_CONNECTION_BENCHMARK(BM_Connection_Echo, ThreadPolicy::MainThread);
 
+// The write queue that connections used before PacketWriteQueue: a mutex-protected deque, with a
+// condition variable that gets signalled for every packet.
+struct MutexWriteQueue {
+    bool Push(std::unique_ptr<apacket> packet) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.emplace_back(std::move(packet));
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    std::unique_ptr<apacket> Pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return closed_ || !queue_.empty(); });
+        if (closed_) {
+            return nullptr;
+        }
+        std::unique_ptr<apacket> packet = std::move(queue_.front());
+        queue_.pop_front();
+        return packet;
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::unique_ptr<apacket>> queue_;
+    bool closed_ = false;
+};
+
+// Measures packets/sec through a connection write queue for 1-byte payloads, which is what
+// interactive shell traffic and delayed-ack A_OKAYs look like. The benchmark thread is the
+// producer (as the fdevent thread would be), and a separate thread drains the queue (as a
+// connection's writer thread would).
+template <typename QueueType>
+void BM_WriteQueue_SmallPackets(benchmark::State& state) {
+    QueueType queue;
+    std::atomic<size_t> received_packets = 0;
+    std::thread consumer([&queue, &received_packets]() {
+        while (queue.Pop()) {
+            ++received_packets;
+        }
+    });
+
+    for (auto _ : state) {
+        std::unique_ptr<apacket> packet = std::make_unique<apacket>();
+        memset(&packet->msg, 0, sizeof(packet->msg));
+        packet->msg.command = A_WRTE;
+        packet->msg.data_length = 1;
+        packet->payload.resize(1);
+        packet->payload[0] = 0xff;
+        queue.Push(std::move(packet));
+    }
+
+    while (received_packets < state.iterations()) {
+        continue;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+
+    queue.Close();
+    consumer.join();
+}
+
+BENCHMARK_TEMPLATE(BM_WriteQueue_SmallPackets, MutexWriteQueue)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteQueue_SmallPackets, PacketWriteQueue)->UseRealTime();
+
+static std::vector<std::unique_ptr<apacket>> MakeMixedPackets(size_t count, size_t large_every) {
+    std::vector<std::unique_ptr<apacket>> packets;
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = (large_every != 0 && i % large_every == 0) ? 64 * 1024 : 1;
+        auto packet = std::make_unique<apacket>();
+        memset(&packet->msg, 0, sizeof(packet->msg));
+        packet->msg.command = A_WRTE;
+        packet->msg.data_length = length;
+        packet->payload.resize(length);
+        memset(&packet->payload[0], 0xff, length);
+        packets.push_back(std::move(packet));
+    }
+    return packets;
+}
+
+// Writes bursts of 32 packets through an FdConnection over a socketpair, either one packet at a
+// time or coalesced with WriteMultiple. The argument controls the mix: 0 means every payload is a
+// single byte, N means every Nth payload is 64KiB.
+template <bool kCoalesce>
+void BM_FdConnection_MixedPackets(benchmark::State& state) {
+    static constexpr size_t kBurstSize = 32;
+
+    int fds[2];
+    if (adb_socketpair(fds) != 0) {
+        LOG(FATAL) << "failed to create socketpair";
+    }
+    FdConnection connection{unique_fd(fds[0])};
+    unique_fd reader(fds[1]);
+
+    std::thread drain([&reader]() {
+        std::vector<char> buf(256 * 1024);
+        while (adb_read(reader.get(), buf.data(), buf.size()) > 0) {
+            continue;
+        }
+    });
+
+    auto packets = MakeMixedPackets(kBurstSize, state.range(0));
+    size_t burst_bytes = 0;
+    for (const auto& packet : packets) {
+        burst_bytes += sizeof(packet->msg) + packet->payload.size();
+    }
+
+    for (auto _ : state) {
+        if (kCoalesce) {
+            connection.WriteMultiple(packets);
+        } else {
+            for (const auto& packet : packets) {
+                connection.Write(packet.get());
+            }
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kBurstSize));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * burst_bytes));
+
+    connection.Close();
+    drain.join();
+}
+
+BENCHMARK_TEMPLATE(BM_FdConnection_MixedPackets, false)->Arg(0)->Arg(8)->Arg(1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_FdConnection_MixedPackets, true)->Arg(0)->Arg(8)->Arg(1)->UseRealTime();
+
 int main(int argc, char** argv) {
     // Set M_DECAY_TIME so that our allocations aren't immediately purged on free.
     mallopt(M_DECAY_TIME, 1);
@@ -28,25 +28,15 @@
 
 #include "adb_unique_fd.h"
 #include "adb_utils.h"
+#include "packet_scheduler.h"
 #include "sysdeps.h"
 #include "transport.h"
 #include "types.h"
-
-static void CreateWakeFds(unique_fd* read, unique_fd* write) {
-    // TODO: eventfd on linux?
-    int wake_fds[2];
-    int rc = adb_socketpair(wake_fds);
-    set_file_block_mode(wake_fds[0], false);
-    set_file_block_mode(wake_fds[1], false);
-    CHECK_EQ(0, rc);
-    *read = unique_fd(wake_fds[0]);
-    *write = unique_fd(wake_fds[1]);
-}
+#include "write_queue.h"
 
 struct NonblockingFdConnection : public Connection {
     NonblockingFdConnection(unique_fd fd) : started_(false), fd_(std::move(fd)) {
         set_file_block_mode(fd_.get(), false);
-        CreateWakeFds(&wake_fd_read_, &wake_fd_write_);
     }
 
     void SetRunning(bool value) {
@@ -62,29 +52,56 @@ struct NonblockingFdConnection : public Connection {
     void Run(std::string* error) {
         SetRunning(true);
         while (IsRunning()) {
+            // Pick up everything that was queued since the last iteration, let the scheduler
+            // decide what goes out next, and try to write it out in one go. Only a bounded amount
+            // is moved into the write buffer, so that a packet from an interactive socket never
+            // has to wait behind more than that.
+            while (std::unique_ptr<apacket> packet = write_queue_.TryPop()) {
+                scheduler_.Enqueue(std::move(packet));
+            }
+            while (write_buffer_.size() < kMaxWriteBufferBytes && !scheduler_.empty()) {
+                AppendPacket(scheduler_.Dequeue());
+            }
+
+            if (writable_ && !write_buffer_.empty()) {
+                if (DispatchWrites() == WriteResult::Error) {
+                    *error = "write failed";
+                    return;
+                }
+            }
+
+            // Only sleep if nothing was queued while we were busy, and there's nothing left in
+            // the scheduler that we could write right away. Otherwise, just check the socket and
+            // go back around the loop.
+            bool sleeping = false;
+            if (!writable_ || scheduler_.empty()) {
+                sleeping = write_queue_.PrepareToWait();
+            }
+
             adb_pollfd pfds[2] = {
                 {.fd = fd_.get(), .events = POLLIN},
-                {.fd = wake_fd_read_.get(), .events = POLLIN},
+                {.fd = write_queue_.wake_fd(), .events = POLLIN},
             };
 
-            {
-                std::lock_guard<std::mutex> lock(this->write_mutex_);
-                if (!writable_) {
-                    pfds[0].events |= POLLOUT;
-                }
+            if (!writable_) {
+                pfds[0].events |= POLLOUT;
             }
 
-            int rc = adb_poll(pfds, 2, -1);
+            int rc = adb_poll(pfds, 2, sleeping ? -1 : 0);
             if (rc == -1) {
                 *error = android::base::StringPrintf("poll failed: %s", strerror(errno));
                 return;
-            } else if (rc == 0) {
+            } else if (rc == 0 && sleeping) {
                 LOG(FATAL) << "poll timed out with an infinite timeout?";
             }
 
+            if (sleeping) {
+                // We were woken up either to pick up new packets, or to exit.
+                write_queue_.FinishWait();
+            }
+
             if (pfds[0].revents) {
                 if ((pfds[0].revents & POLLOUT)) {
-                    std::lock_guard<std::mutex> lock(this->write_mutex_);
                     if (DispatchWrites() == WriteResult::Error) {
                         *error = "write failed";
                         return;
@@ -125,15 +142,6 @@ struct NonblockingFdConnection : public Connection {
                     }
                 }
             }
-
-            if (pfds[1].revents) {
-                uint64_t buf;
-                rc = adb_read(wake_fd_read_.get(), &buf, sizeof(buf));
-                CHECK_EQ(static_cast<int>(sizeof(buf)), rc);
-
-                // We were woken up either to add POLLOUT to our events, or to exit.
-                // Do nothing.
-            }
         }
     }
 
@@ -152,8 +160,9 @@ struct NonblockingFdConnection : public Connection {
 
     void Stop() override final {
         SetRunning(false);
-        WakeThread();
+        write_queue_.Close();
         thread_.join();
+        scheduler_.ForgetPriorities();
     }
 
     bool DoTlsHandshake(RSA* key, std::string* auth_key) override final {
@@ -161,20 +170,13 @@ struct NonblockingFdConnection : public Connection {
         return false;
     }
 
-    void WakeThread() {
-        uint64_t buf = 0;
-        if (TEMP_FAILURE_RETRY(adb_write(wake_fd_write_.get(), &buf, sizeof(buf))) != sizeof(buf)) {
-            LOG(FATAL) << "failed to wake up thread";
-        }
-    }
-
     enum class WriteResult {
         Error,
         Completed,
         TryAgain,
     };
 
-    WriteResult DispatchWrites() REQUIRES(write_mutex_) {
+    WriteResult DispatchWrites() {
         CHECK(!write_buffer_.empty());
         auto iovs = write_buffer_.iovecs();
         ssize_t rc = adb_writev(fd_.get(), iovs.data(), iovs.size());
@@ -200,8 +202,7 @@ struct NonblockingFdConnection : public Connection {
         return WriteResult::TryAgain;
     }
 
-    bool Write(std::unique_ptr<apacket> packet) final {
-        std::lock_guard<std::mutex> lock(write_mutex_);
+    void AppendPacket(std::unique_ptr<apacket> packet) {
         const char* header_begin = reinterpret_cast<const char*>(&packet->msg);
         const char* header_end = header_begin + sizeof(packet->msg);
         auto header_block = IOVector::block_type(header_begin, header_end);
@@ -209,14 +210,20 @@ struct NonblockingFdConnection : public Connection {
         if (!packet->payload.empty()) {
             write_buffer_.append(std::move(packet->payload));
         }
+    }
 
-        WriteResult result = DispatchWrites();
-        if (result == WriteResult::TryAgain) {
-            WakeThread();
-        }
-        return result != WriteResult::Error;
+    bool Write(std::unique_ptr<apacket> packet) final {
+        return write_queue_.Push(std::move(packet));
+    }
+
+    void SetSocketPriority(uint32_t id, WritePriority priority) final {
+        scheduler_.SetPriority(id, priority);
     }
 
+    void ForgetSocketPriority(uint32_t id) final { scheduler_.ForgetPriority(id); }
+
+    static constexpr size_t kMaxWriteBufferBytes = 256 * 1024;
+
     std::thread thread_;
 
     std::atomic<bool> started_;
@@ -227,12 +234,14 @@ struct NonblockingFdConnection : public Connection {
     IOVector read_buffer_;
 
     unique_fd fd_;
-    unique_fd wake_fd_read_;
-    unique_fd wake_fd_write_;
 
-    std::mutex write_mutex_;
-    bool writable_ GUARDED_BY(write_mutex_) = true;
-    IOVector write_buffer_ GUARDED_BY(write_mutex_);
+    // Written to from any thread, drained by the connection thread into write_buffer_.
+    PacketWriteQueue write_queue_;
+
+    // Only accessed from the connection thread (apart from PacketScheduler::SetPriority).
+    PacketScheduler scheduler_;
+    bool writable_ = true;
+    IOVector write_buffer_;
 
     IOVector incoming_queue_;
 };
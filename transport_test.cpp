@@ -18,6 +18,10 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <random>
+#include <vector>
+
 #include "adb.h"
 #include "fdevent/fdevent_test.h"
 
@@ -197,4 +201,124 @@ TEST_F(TransportTest, test_matches_target_local) {
         EXPECT_FALSE(t.MatchesTarget("abc:100.100.100.100"));
     }
 }
+
+static int64_t LowestRandom(int64_t min, int64_t) {
+    return min;
+}
+
+static int64_t HighestRandom(int64_t, int64_t max) {
+    return max;
+}
+
+TEST(ReconnectQueue, backoff_bounds) {
+    using namespace std::chrono_literals;
+    // The delay doubles with every failed attempt, and is somewhere between half of it and all
+    // of it.
+    EXPECT_EQ(125ms, ReconnectQueue::Backoff(0, LowestRandom));
+    EXPECT_EQ(250ms, ReconnectQueue::Backoff(0, HighestRandom));
+    EXPECT_EQ(250ms, ReconnectQueue::Backoff(1, LowestRandom));
+    EXPECT_EQ(500ms, ReconnectQueue::Backoff(1, HighestRandom));
+    EXPECT_EQ(500ms, ReconnectQueue::Backoff(2, LowestRandom));
+    EXPECT_EQ(2000ms, ReconnectQueue::Backoff(3, HighestRandom));
+
+    std::mt19937 rng(1234);
+    ReconnectQueue::Random random = [&rng](int64_t min, int64_t max) {
+        return std::uniform_int_distribution<int64_t>(min, max)(rng);
+    };
+    for (size_t i = 0; i < 1000; ++i) {
+        auto backoff = ReconnectQueue::Backoff(2, random);
+        EXPECT_GE(backoff, 500ms);
+        EXPECT_LE(backoff, 1000ms);
+    }
+}
+
+TEST(ReconnectQueue, backoff_cap) {
+    for (size_t failed_attempts : {5, 6, 16, 17, 1000}) {
+        EXPECT_EQ(ReconnectQueue::kMaxBackoff / 2,
+                  ReconnectQueue::Backoff(failed_attempts, LowestRandom));
+        EXPECT_EQ(ReconnectQueue::kMaxBackoff,
+                  ReconnectQueue::Backoff(failed_attempts, HighestRandom));
+    }
+}
+
+TEST_F(TransportTest, reconnect_queue_retry_now) {
+    using namespace std::chrono_literals;
+    ReconnectQueue queue(HighestRandom);
+    atransport t{kTransportLocal};
+    t.serial = "192.168.1.2:5555";
+    auto now = ReconnectQueue::Clock::now();
+
+    queue.Add(&t, now);
+    ASSERT_EQ(now + ReconnectQueue::kInitialDelay, queue.NextAttemptTime());
+    ASSERT_EQ(nullptr, queue.TakeDue(now));
+
+    // Only the transport with the serial is made due.
+    ASSERT_FALSE(queue.RetryNow("192.168.1.3:5555", now));
+    ASSERT_TRUE(queue.RetryNow(t.serial, now));
+    ASSERT_EQ(&t, queue.TakeDue(now));
+    ASSERT_FALSE(queue.NextAttemptTime().has_value());
+
+    // Without a request, a failed attempt is retried after the backoff.
+    now += 1s;
+    ASSERT_TRUE(queue.Failed(&t, now));
+    ASSERT_EQ(now + 500ms, queue.NextAttemptTime());
+    ASSERT_EQ(nullptr, queue.TakeDue(now));
+
+    // A request that arrives while an attempt is in flight makes its retry due right away.
+    ASSERT_EQ(&t, queue.TakeDue(now + 500ms));
+    ASSERT_FALSE(queue.RetryNow(t.serial, now + 600ms));
+    now += 1s;
+    ASSERT_TRUE(queue.Failed(&t, now));
+    ASSERT_EQ(now, queue.NextAttemptTime());
+
+    // The request only applies to one attempt.
+    ASSERT_EQ(&t, queue.TakeDue(now));
+    ASSERT_TRUE(queue.Failed(&t, now));
+    ASSERT_EQ(now + 2000ms, queue.NextAttemptTime());
+    ASSERT_EQ(std::vector<atransport*>{&t}, queue.TakeAll());
+}
+
+TEST_F(TransportTest, reconnect_queue_stats) {
+    using namespace std::chrono_literals;
+    ReconnectQueue queue(LowestRandom);
+    atransport back{kTransportLocal};
+    back.serial = "192.168.1.2:5555";
+    atransport gone{kTransportLocal};
+    gone.serial = "192.168.1.3:5555";
+    atransport aborted{kTransportLocal};
+    aborted.serial = "192.168.1.4:5555";
+    auto start = ReconnectQueue::Clock::now();
+
+    queue.Add(&back, start);
+    queue.Add(&gone, start);
+    queue.Add(&aborted, start);
+    ASSERT_EQ(3U, queue.Stats().pending);
+
+    // In-flight attempts are still pending.
+    auto now = start + ReconnectQueue::kInitialDelay;
+    ASSERT_NE(nullptr, queue.TakeDue(now));
+    ASSERT_NE(nullptr, queue.TakeDue(now));
+    ASSERT_NE(nullptr, queue.TakeDue(now));
+    ASSERT_EQ(3U, queue.Stats().pending);
+
+    queue.Aborted(&aborted);
+    queue.Succeeded(&back, start + 3s);
+    ASSERT_FALSE(queue.Failed(&gone, start + ReconnectQueue::kRetryDuration));
+
+    ReconnectStats stats = queue.Stats();
+    EXPECT_EQ(0U, stats.pending);
+    EXPECT_EQ(1U, stats.succeeded);
+    EXPECT_EQ(1U, stats.abandoned);
+    EXPECT_EQ(3000ms, stats.mean_recovery_time);
+    EXPECT_EQ(3000ms, stats.max_recovery_time);
+
+    // Recovery times are averaged over the transports that came back.
+    queue.Add(&back, start + 10s);
+    ASSERT_EQ(&back, queue.TakeDue(start + 11s));
+    queue.Succeeded(&back, start + 11s);
+    stats = queue.Stats();
+    EXPECT_EQ(2U, stats.succeeded);
+    EXPECT_EQ(2000ms, stats.mean_recovery_time);
+    EXPECT_EQ(3000ms, stats.max_recovery_time);
+}
 #endif
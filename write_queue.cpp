@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG TRANSPORT
+
+#include "sysdeps.h"
+
+#include "write_queue.h"
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include <android-base/logging.h>
+
+#include "adb_trace.h"
+#include "adb_utils.h"
+#include "buffer_budget.h"
+
+PacketWriteQueue::PacketWriteQueue(size_t capacity) : ring_(capacity) {
+#if defined(__linux__)
+    wake_fd_read_.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (wake_fd_read_ == -1) {
+        PLOG(FATAL) << "failed to create eventfd";
+    }
+    wake_fd_write_.reset(dup(wake_fd_read_.get()));
+    if (wake_fd_write_ == -1) {
+        PLOG(FATAL) << "failed to dup eventfd";
+    }
+#else
+    int wake_fds[2];
+    if (adb_socketpair(wake_fds) != 0) {
+        PLOG(FATAL) << "failed to create wake socketpair";
+    }
+    set_file_block_mode(wake_fds[0], false);
+    set_file_block_mode(wake_fds[1], false);
+    wake_fd_read_.reset(wake_fds[0]);
+    wake_fd_write_.reset(wake_fds[1]);
+#endif
+}
+
+PacketWriteQueue::~PacketWriteQueue() {
+    // Return whatever is still queued to the budget.
+    while (TryPop()) {
+        continue;
+    }
+}
+
+bool PacketWriteQueue::Push(std::unique_ptr<apacket> packet) {
+    if (closed()) {
+        return false;
+    }
+
+    BufferBudget::Global().Charge(packet->payload.size());
+
+    // Once anything has spilled into the overflow list, keep appending to it until the consumer
+    // has taken it, so that a thread's packets can't overtake its own earlier ones.
+    if (overflowed_.load(std::memory_order_acquire) || !ring_.TryPush(&packet)) {
+        std::lock_guard<std::mutex> lock(overflow_mutex_);
+        if (overflow_.empty()) {
+            VLOG(TRANSPORT) << "write queue full (" << ring_.capacity()
+                            << " packets), spilling into overflow";
+        }
+        overflow_.push_back(std::move(packet));
+        overflowed_.store(true, std::memory_order_release);
+    }
+
+    // Pairs with the fence in PrepareToWait: either we see that the consumer is about to sleep,
+    // or the consumer sees our packet.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.exchange(false)) {
+        Signal();
+    }
+    return true;
+}
+
+std::unique_ptr<apacket> PacketWriteQueue::TryPop() {
+    std::unique_ptr<apacket> result = TryPopUnaccounted();
+    if (result) {
+        BufferBudget::Global().Release(result->payload.size());
+    }
+    return result;
+}
+
+std::unique_ptr<apacket> PacketWriteQueue::TryPopUnaccounted() {
+    std::unique_ptr<apacket> result;
+    if (!pending_.empty()) {
+        result = std::move(pending_.front());
+        pending_.pop_front();
+        return result;
+    }
+
+    if (ring_.TryPop(&result)) {
+        return result;
+    }
+
+    if (overflowed_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(overflow_mutex_);
+
+        // A producer may have claimed a ring cell before spilling its next packet and not have
+        // published it yet. Hand out the overflow list only once that cell has been popped, or
+        // the spilled packet would overtake it. Checking under the lock means every cell claimed
+        // before a packet in |overflow_| was pushed is accounted for.
+        if (!ring_.Drained()) {
+            return nullptr;
+        }
+        pending_.swap(overflow_);
+        overflowed_.store(false, std::memory_order_release);
+    }
+
+    if (!pending_.empty()) {
+        result = std::move(pending_.front());
+        pending_.pop_front();
+    }
+    return result;
+}
+
+std::unique_ptr<apacket> PacketWriteQueue::Pop() {
+    while (true) {
+        if (closed()) {
+            return nullptr;
+        }
+
+        if (auto packet = TryPop(); packet) {
+            return packet;
+        }
+
+        if (!PrepareToWait()) {
+            continue;
+        }
+
+        adb_pollfd pfd = {.fd = wake_fd(), .events = POLLIN};
+        int rc = adb_poll(&pfd, 1, -1);
+        if (rc == -1) {
+            PLOG(FATAL) << "failed to poll write queue wake fd";
+        }
+        FinishWait();
+    }
+}
+
+bool PacketWriteQueue::HasPending() {
+    if (!pending_.empty() || !ring_.Empty()) {
+        return true;
+    }
+
+    // The overflow list can only be taken once the ring is drained (see TryPopUnaccounted). If it
+    // isn't, a producer is still writing the next cell, and it checks |waiting_| once it has
+    // published it, so sleep on the wake fd instead of spinning until it does.
+    return overflowed_.load(std::memory_order_acquire) && ring_.Drained();
+}
+
+bool PacketWriteQueue::PrepareToWait() {
+    waiting_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (HasPending() || closed()) {
+        waiting_.store(false);
+        return false;
+    }
+    return true;
+}
+
+void PacketWriteQueue::FinishWait() {
+    waiting_.store(false);
+
+    // Drain the wake fd. A stale wakeup left over from a producer that raced with PrepareToWait
+    // returning false is harmless: it just costs one spurious trip around the loop.
+    char buf[64];
+    while (adb_read(wake_fd_read_.get(), buf, sizeof(buf)) > 0) {
+        continue;
+    }
+}
+
+void PacketWriteQueue::Signal() {
+    uint64_t value = 1;
+    ssize_t rc = adb_write(wake_fd_write_.get(), &value, sizeof(value));
+    if (rc == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        PLOG(FATAL) << "failed to signal write queue wake fd";
+    }
+}
+
+void PacketWriteQueue::Close() {
+    closed_.store(true, std::memory_order_release);
+    Signal();
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <android-base/logging.h>
+#include <android-base/macros.h>
+#include <android-base/thread_annotations.h>
+
+#include "adb_unique_fd.h"
+#include "types.h"
+
+// A bounded, lock-free, multiple-producer single-consumer ring buffer.
+//
+// This is the classic sequence-numbered ring: each cell carries a sequence number that tells
+// producers whether the cell is free for the current lap, and tells the consumer whether the
+// value in it has been published. Producers only contend on a single CAS of the enqueue position;
+// the consumer never writes to anything shared with producers other than the cell it just emptied.
+template <typename T>
+class MpscQueue {
+  public:
+    // |capacity| is rounded up to the next power of two.
+    explicit MpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Attempts to move |*value| into the queue. Returns false without touching |*value| if the
+    // queue is full. Can be called from any thread.
+    bool TryPush(T* value) {
+        Cell* cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(*value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Attempts to remove the oldest published value. Must only be called from the consumer thread.
+    bool TryPop(T* value) {
+        Cell* cell = &cells_[dequeue_pos_ & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeue_pos_ + 1) < 0) {
+            return false;
+        }
+
+        *value = std::move(cell->value);
+        cell->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+    // Returns true if every value a producer has claimed a cell for has been popped, including
+    // values that are still being written. Consumer thread only.
+    bool Drained() const { return enqueue_pos_.load(std::memory_order_acquire) == dequeue_pos_; }
+
+    // Returns true if the next value hasn't been published yet. Consumer thread only.
+    bool Empty() const {
+        const Cell* cell = &cells_[dequeue_pos_ & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        return static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeue_pos_ + 1) < 0;
+    }
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+
+    // Keep the producer and consumer positions on separate cache lines.
+    alignas(64) std::atomic<size_t> enqueue_pos_ = 0;
+    alignas(64) size_t dequeue_pos_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(MpscQueue);
+};
+
+// The outgoing packet queue of a Connection.
+//
+// Any thread may Push, a single writer thread drains the queue. The fast path is the lock-free
+// ring above; if it fills up (e.g. a stalled device with lots of sockets open), packets spill
+// into a mutex-protected overflow list so that Push never blocks the fdevent thread and never
+// fails. Packets pushed by a given thread are always popped in the order they were pushed: once
+// anything has spilled, every push goes to the overflow list, and the consumer only takes the
+// list once the ring has been drained of every cell a producer claimed before it spilled.
+//
+// Wakeups are batched: the writer thread announces that it's about to sleep, and only the first
+// producer to observe that signals the wake fd, so a burst of packets costs one wakeup instead of
+// one per packet. On Linux the wake fd is an eventfd, elsewhere it's one end of a socketpair.
+//
+// Queued payloads are charged to the global BufferBudget until they're popped.
+class PacketWriteQueue {
+  public:
+    static constexpr size_t kDefaultCapacity = 1024;
+
+    explicit PacketWriteQueue(size_t capacity = kDefaultCapacity);
+    ~PacketWriteQueue();
+
+    // Enqueues a packet. Returns false (and drops the packet) if the queue has been closed.
+    bool Push(std::unique_ptr<apacket> packet);
+
+    // Dequeues the next packet, or returns nullptr if none is available. Consumer thread only.
+    std::unique_ptr<apacket> TryPop();
+
+    // Blocks until a packet is available, or the queue is closed, in which case it returns
+    // nullptr. Consumer thread only.
+    std::unique_ptr<apacket> Pop();
+
+    // For consumers with their own poll loop: call PrepareToWait before sleeping on wake_fd().
+    // If it returns false, there is work to do (or the queue was closed) and the consumer must
+    // not sleep. After waking up, the consumer must call FinishWait.
+    bool PrepareToWait();
+    void FinishWait();
+    int wake_fd() const { return wake_fd_read_.get(); }
+
+    // Closes the queue and wakes up the consumer. Packets that are still queued are discarded
+    // when the queue is destroyed.
+    void Close();
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  private:
+    std::unique_ptr<apacket> TryPopUnaccounted();
+    // Whether TryPop would return something.
+    bool HasPending();
+    void Signal();
+
+    MpscQueue<std::unique_ptr<apacket>> ring_;
+
+    std::mutex overflow_mutex_;
+    std::deque<std::unique_ptr<apacket>> overflow_ GUARDED_BY(overflow_mutex_);
+    std::atomic<bool> overflowed_ = false;
+
+    // Packets taken from the overflow list, owned by the consumer.
+    std::deque<std::unique_ptr<apacket>> pending_;
+
+    std::atomic<bool> waiting_ = false;
+    std::atomic<bool> closed_ = false;
+
+    unique_fd wake_fd_read_;
+    unique_fd wake_fd_write_;
+
+    DISALLOW_COPY_AND_ASSIGN(PacketWriteQueue);
+};
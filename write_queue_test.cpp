@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "write_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "adb.h"
+
+static std::unique_ptr<apacket> MakePacket(uint32_t arg0, uint32_t arg1) {
+    auto packet = std::make_unique<apacket>();
+    packet->msg.command = A_WRTE;
+    packet->msg.arg0 = arg0;
+    packet->msg.arg1 = arg1;
+    return packet;
+}
+
+TEST(MpscQueue, fifo) {
+    MpscQueue<int> queue(4);
+    ASSERT_EQ(4U, queue.capacity());
+    ASSERT_TRUE(queue.Empty());
+
+    for (int i = 0; i < 4; ++i) {
+        int value = i;
+        ASSERT_TRUE(queue.TryPush(&value));
+    }
+
+    int overflow = 4;
+    ASSERT_FALSE(queue.TryPush(&overflow));
+
+    for (int i = 0; i < 4; ++i) {
+        int value;
+        ASSERT_TRUE(queue.TryPop(&value));
+        ASSERT_EQ(i, value);
+    }
+
+    int value;
+    ASSERT_FALSE(queue.TryPop(&value));
+    ASSERT_TRUE(queue.Empty());
+}
+
+TEST(MpscQueue, capacity_rounding) {
+    MpscQueue<int> queue(5);
+    ASSERT_EQ(8U, queue.capacity());
+}
+
+TEST(MpscQueue, full_push_leaves_value) {
+    MpscQueue<std::unique_ptr<int>> queue(2);
+    auto a = std::make_unique<int>(1);
+    auto b = std::make_unique<int>(2);
+    auto c = std::make_unique<int>(3);
+    ASSERT_TRUE(queue.TryPush(&a));
+    ASSERT_TRUE(queue.TryPush(&b));
+    ASSERT_FALSE(queue.TryPush(&c));
+    ASSERT_NE(nullptr, c);
+    ASSERT_EQ(3, *c);
+}
+
+TEST(PacketWriteQueue, overflow_preserves_order) {
+    PacketWriteQueue queue(4);
+    for (uint32_t i = 0; i < 64; ++i) {
+        ASSERT_TRUE(queue.Push(MakePacket(0, i)));
+    }
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        auto packet = queue.TryPop();
+        ASSERT_NE(nullptr, packet);
+        ASSERT_EQ(i, packet->msg.arg1);
+
+        // Interleave more pushes while the overflow list is being drained.
+        if (i == 10) {
+            ASSERT_TRUE(queue.Push(MakePacket(0, 64)));
+        }
+    }
+
+    auto packet = queue.TryPop();
+    ASSERT_NE(nullptr, packet);
+    ASSERT_EQ(64U, packet->msg.arg1);
+    ASSERT_EQ(nullptr, queue.TryPop());
+}
+
+TEST(PacketWriteQueue, close) {
+    PacketWriteQueue queue;
+    ASSERT_TRUE(queue.Push(MakePacket(0, 0)));
+    queue.Close();
+    ASSERT_TRUE(queue.closed());
+    ASSERT_FALSE(queue.Push(MakePacket(0, 1)));
+    ASSERT_EQ(nullptr, queue.Pop());
+    ASSERT_FALSE(queue.PrepareToWait());
+}
+
+TEST(PacketWriteQueue, close_wakes_consumer) {
+    PacketWriteQueue queue;
+    std::thread consumer([&queue]() { ASSERT_EQ(nullptr, queue.Pop()); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.Close();
+    consumer.join();
+}
+
+TEST(PacketWriteQueue, multiple_producers) {
+    static constexpr uint32_t kProducers = 4;
+    static constexpr uint32_t kPacketsPerProducer = 10000;
+
+    // Use a small ring so that the overflow path gets exercised as well.
+    PacketWriteQueue queue(16);
+
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < kProducers; ++producer) {
+        producers.emplace_back([&queue, producer]() {
+            for (uint32_t i = 0; i < kPacketsPerProducer; ++i) {
+                queue.Push(MakePacket(producer, i));
+            }
+        });
+    }
+
+    // Every producer's packets must come out in the order they were pushed.
+    std::vector<uint32_t> next(kProducers, 0);
+    for (uint32_t i = 0; i < kProducers * kPacketsPerProducer; ++i) {
+        auto packet = queue.Pop();
+        ASSERT_NE(nullptr, packet);
+        uint32_t producer = packet->msg.arg0;
+        ASSERT_LT(producer, kProducers);
+        ASSERT_EQ(next[producer], packet->msg.arg1);
+        ++next[producer];
+    }
+
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    ASSERT_EQ(nullptr, queue.TryPop());
+}
+
+TEST(PacketWriteQueue, multiple_producers_tiny_ring) {
+    static constexpr uint32_t kProducers = 8;
+    static constexpr uint32_t kPacketsPerProducer = 20000;
+
+    // With a two-cell ring nearly every push races with another producer's half-written cell
+    // while the overflow list is being filled and drained.
+    PacketWriteQueue queue(2);
+
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < kProducers; ++producer) {
+        producers.emplace_back([&queue, producer]() {
+            for (uint32_t i = 0; i < kPacketsPerProducer; ++i) {
+                queue.Push(MakePacket(producer, i));
+            }
+        });
+    }
+
+    // Poll with TryPop so that the consumer keeps racing the producers instead of sleeping.
+    std::vector<uint32_t> next(kProducers, 0);
+    uint32_t received = 0;
+    while (received < kProducers * kPacketsPerProducer) {
+        auto packet = queue.TryPop();
+        if (!packet) {
+            continue;
+        }
+        ++received;
+        uint32_t producer = packet->msg.arg0;
+        ASSERT_LT(producer, kProducers);
+        ASSERT_EQ(next[producer], packet->msg.arg1) << "producer " << producer;
+        ++next[producer];
+    }
+
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    ASSERT_EQ(nullptr, queue.TryPop());
+}
+
+TEST(PacketWriteQueue, multiple_producers_tiny_ring_blocking) {
+    static constexpr uint32_t kProducers = 8;
+    static constexpr uint32_t kPacketsPerProducer = 20000;
+
+    // Like multiple_producers_tiny_ring, but the consumer sleeps on the wake fd whenever nothing
+    // can be popped, including while the overflow list waits for a half-written ring cell. A
+    // lost wakeup hangs the test.
+    PacketWriteQueue queue(2);
+
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < kProducers; ++producer) {
+        producers.emplace_back([&queue, producer]() {
+            for (uint32_t i = 0; i < kPacketsPerProducer; ++i) {
+                queue.Push(MakePacket(producer, i));
+            }
+        });
+    }
+
+    std::vector<uint32_t> next(kProducers, 0);
+    for (uint32_t i = 0; i < kProducers * kPacketsPerProducer; ++i) {
+        auto packet = queue.Pop();
+        ASSERT_NE(nullptr, packet);
+        uint32_t producer = packet->msg.arg0;
+        ASSERT_LT(producer, kProducers);
+        ASSERT_EQ(next[producer], packet->msg.arg1) << "producer " << producer;
+        ++next[producer];
+    }
+
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    ASSERT_EQ(nullptr, queue.TryPop());
+}